@@ -0,0 +1,69 @@
+// example lcrest endpoint plugin
+//
+// GET /hal/summary/<root> returns the number of values and of set bits
+// of one root together with its generation.
+//
+// build:
+//   gcc -shared -fPIC -DULAPI -I<linuxcnc>/include -o summary.so summary.c
+//
+// config:
+//   <plugin file="/path/to/summary.so" arg="GuiOutMain"/>
+
+#include <stdio.h>
+#include <string.h>
+
+#include "lcrest_plugin_api.h"
+
+static const LCREST_PLUGIN_API_T *api;
+
+static void count_values(CONF_JSON_ITEM_T *json, int *values, int *bits) {
+  for (; json != NULL; json = json->next) {
+    count_values(json->childs, values, bits);
+    if (!CONF_TYPE_IS_LEAF(json->type)) {
+      continue;
+    }
+
+    (*values)++;
+    if (json->hal.type == HAL_BIT && api->get_double(json) != 0.0) {
+      (*bits)++;
+    }
+  }
+}
+
+static int callback_summary(const struct _u_request * request, struct _u_response * response, void * user_data) {
+  CONF_JSON_ITEM_T *root = (CONF_JSON_ITEM_T *) user_data;
+  char body[128];
+  int values = 0;
+  int bits = 0;
+
+  if (api->admit_enter(request, response, admitGet)) {
+    return U_CALLBACK_CONTINUE;
+  }
+
+  count_values(root->childs, &values, &bits);
+  snprintf(body, sizeof(body), "{\"generation\":\"%016llx\",\"values\":%d,\"bitsSet\":%d}",
+    (unsigned long long) api->get_generation(root), values, bits);
+  ulfius_set_string_body_response(response, 200, body);
+  u_map_put(response->map_header, "Content-Type", "application/json");
+
+  api->admit_leave();
+  return U_CALLBACK_CONTINUE;
+}
+
+int lcrest_plugin_init(const LCREST_PLUGIN_API_T *lcrest_api, const char *arg, void **priv) {
+  CONF_JSON_ITEM_T *root;
+
+  if (lcrest_api->version != LCREST_PLUGIN_API_VERSION) {
+    return -1;
+  }
+  api = lcrest_api;
+
+  // register all roots, or only the one given as arg
+  for (root = api->conf->json; root != NULL; root = root->next) {
+    if (arg == NULL || strcmp(arg, root->name) == 0) {
+      ulfius_add_endpoint_by_val(api->instance, "GET", "/hal/summary", root->name, 0, &callback_summary, root);
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,213 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <netinet/in.h>
+#include <ulfius.h>
+
+#include "lcrest.h"
+#include "lcrest_conf.h"
+#include "lcrest_admit.h"
+
+#define ADMIT_CLIENTS     1024
+#define ADMIT_MAX_PROBE   32
+
+// a client idle for this long has a full bucket and gives up its slot
+#define ADMIT_IDLE_SEC    60
+
+#define NSEC_PER_SEC 1000000000ULL
+
+typedef struct {
+  uint64_t interval;
+  uint64_t tolerance;
+} ADMIT_RATE_T;
+
+typedef struct {
+  uint64_t key;
+  uint64_t tat[admitClassCount];
+} ADMIT_CLIENT_T;
+
+static uint64_t get_time(void);
+static uint64_t mix_key(uint64_t x);
+static uint64_t get_client_key(const struct sockaddr *addr);
+static bool is_idle(const ADMIT_CLIENT_T *client, uint64_t now);
+static ADMIT_CLIENT_T *get_client(uint64_t key, uint64_t now);
+static int take_token(uint64_t *tat_ptr, const ADMIT_RATE_T *rate, uint64_t now, uint64_t *wait);
+static void set_reject_response(struct _u_response *response, uint64_t wait);
+
+static unsigned int max_requests;
+static ADMIT_RATE_T rates[admitClassCount];
+
+static unsigned int inflight;
+static ADMIT_CLIENT_T clients[ADMIT_CLIENTS];
+static ADMIT_CLIENT_T overflow_client;
+
+static uint64_t get_time(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static uint64_t mix_key(uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return x;
+}
+
+static uint64_t get_client_key(const struct sockaddr *addr) {
+  const struct sockaddr_in *in4;
+  const struct sockaddr_in6 *in6;
+  uint64_t hi, lo, key;
+
+  if (addr == NULL) {
+    return 0;
+  }
+
+  switch (addr->sa_family) {
+    case AF_INET:
+      in4 = (const struct sockaddr_in *) addr;
+      key = mix_key(((uint64_t) AF_INET << 32) | in4->sin_addr.s_addr);
+      break;
+    case AF_INET6:
+      in6 = (const struct sockaddr_in6 *) addr;
+      memcpy(&hi, &in6->sin6_addr.s6_addr[0], sizeof(hi));
+      memcpy(&lo, &in6->sin6_addr.s6_addr[8], sizeof(lo));
+      key = mix_key(hi ^ mix_key(lo));
+      break;
+    default:
+      return 0;
+  }
+
+  // zero marks a free slot
+  return key != 0 ? key : 1;
+}
+
+static bool is_idle(const ADMIT_CLIENT_T *client, uint64_t now) {
+  int i;
+
+  if (now < ADMIT_IDLE_SEC * NSEC_PER_SEC) {
+    return false;
+  }
+
+  for (i = 0; i < admitClassCount; i++) {
+    if (__atomic_load_n(&client->tat[i], __ATOMIC_RELAXED) > now - ADMIT_IDLE_SEC * NSEC_PER_SEC) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static ADMIT_CLIENT_T *get_client(uint64_t key, uint64_t now) {
+  ADMIT_CLIENT_T *client, *idle = NULL;
+  uint64_t cur, idle_key = 0;
+  int i;
+
+  if (key == 0) {
+    return &overflow_client;
+  }
+
+  // open addressing, a slot is claimed while free or idle
+  for (i = 0; i < ADMIT_MAX_PROBE; i++) {
+    client = &clients[(key + i) % ADMIT_CLIENTS];
+    cur = __atomic_load_n(&client->key, __ATOMIC_ACQUIRE);
+    if (cur == key) {
+      return client;
+    }
+    if (cur == 0) {
+      if (__atomic_compare_exchange_n(&client->key, &cur, key, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) || cur == key) {
+        return client;
+      }
+    }
+    if (idle == NULL && is_idle(client, now)) {
+      idle = client;
+      idle_key = cur;
+    }
+  }
+
+  // the old times of an idle slot equal a full bucket, so the new client
+  // takes it over as is. a concurrent request of the old client may still
+  // charge it once, which only costs the new client a token.
+  if (idle != NULL && __atomic_compare_exchange_n(&idle->key, &idle_key, key, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+    return idle;
+  }
+
+  // table is crowded, unknown clients share a single bucket
+  return &overflow_client;
+}
+
+static int take_token(uint64_t *tat_ptr, const ADMIT_RATE_T *rate, uint64_t now, uint64_t *wait) {
+  uint64_t tat, start, next;
+
+  // generic cell rate algorithm: a token bucket kept as one timestamp
+  tat = __atomic_load_n(tat_ptr, __ATOMIC_RELAXED);
+  do {
+    start = (tat > now) ? tat : now;
+    if (start - now > rate->tolerance) {
+      *wait = start - now - rate->tolerance;
+      return -1;
+    }
+    next = start + rate->interval;
+  } while (!__atomic_compare_exchange_n(tat_ptr, &tat, next, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+  return 0;
+}
+
+static void set_reject_response(struct _u_response *response, uint64_t wait) {
+  char retry[24];
+
+  snprintf(retry, sizeof(retry), "%llu", (unsigned long long) ((wait + NSEC_PER_SEC - 1) / NSEC_PER_SEC));
+  ulfius_set_string_body_response(response, 429, "Too many requests.");
+  u_map_put(response->map_header, "Retry-After", retry);
+}
+
+void admit_init(const CONF_SERVER_T *server) {
+  const CONF_RATE_T *conf_rates[admitClassCount] = { &server->get_rate, &server->post_rate };
+  unsigned int burst;
+  int i;
+
+  max_requests = server->max_requests;
+
+  for (i = 0; i < admitClassCount; i++) {
+    rates[i].interval = 0;
+    rates[i].tolerance = 0;
+    if (conf_rates[i]->rate > 0) {
+      burst = conf_rates[i]->burst > 0 ? conf_rates[i]->burst : conf_rates[i]->rate;
+      rates[i].interval = NSEC_PER_SEC / conf_rates[i]->rate;
+      rates[i].tolerance = rates[i].interval * (burst - 1);
+    }
+  }
+}
+
+int admit_enter(const struct _u_request *request, struct _u_response *response, ADMIT_CLASS_T cls) {
+  ADMIT_CLIENT_T *client;
+  uint64_t now, wait;
+
+  // per client rate limit
+  if (rates[cls].interval > 0) {
+    now = get_time();
+    client = get_client(get_client_key(request->client_address), now);
+    if (take_token(&client->tat[cls], &rates[cls], now, &wait)) {
+      set_reject_response(response, wait);
+      return -1;
+    }
+  }
+
+  // global in-flight limit
+  if (__atomic_add_fetch(&inflight, 1, __ATOMIC_ACQUIRE) > max_requests && max_requests > 0) {
+    __atomic_sub_fetch(&inflight, 1, __ATOMIC_RELEASE);
+    set_reject_response(response, NSEC_PER_SEC);
+    return -1;
+  }
+
+  return 0;
+}
+
+void admit_leave(void) {
+  __atomic_sub_fetch(&inflight, 1, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,19 @@
+#ifndef LCREST_ADMIT_H
+#define LCREST_ADMIT_H
+
+#include <ulfius.h>
+
+#include "lcrest.h"
+#include "lcrest_conf.h"
+
+typedef enum {
+  admitGet = 0,
+  admitPost,
+  admitClassCount
+} ADMIT_CLASS_T;
+
+void admit_init(const CONF_SERVER_T *server);
+int admit_enter(const struct _u_request *request, struct _u_response *response, ADMIT_CLASS_T cls);
+void admit_leave(void);
+
+#endif
@@ -0,0 +1,441 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+
+#include "lcrest.h"
+#include "lcrest_conf.h"
+#include "lcrest_hal.h"
+#include "lcrest_buf.h"
+#include "lcrest_sys.h"
+#include "lcrest_audit.h"
+#include "lcrest_audit_file.h"
+
+#define AUDIT_DRAIN_INTERVAL_NS 50000000L
+#define AUDIT_PATH_MAX          1024
+
+typedef struct {
+  uint64_t time;
+  CONF_JSON_ITEM_T *json;
+  bool ok;
+  uint8_t family;
+  uint8_t addr[16];
+  double old_value;
+  double new_value;
+} AUDIT_ENTRY_T;
+
+typedef struct {
+  size_t seq;
+  AUDIT_ENTRY_T entry;
+} AUDIT_CELL_T;
+
+static uint64_t get_time(void);
+static double get_value(const HAL_VALUE_T *val);
+static uint8_t get_type(hal_type_t type);
+static int enqueue(const AUDIT_ENTRY_T *entry);
+static int dequeue(AUDIT_ENTRY_T *entry);
+static int open_file(void);
+static int rotate_file(void);
+static void flush_out(void);
+static void put_mark(uint8_t type, uint32_t count);
+static void put_entry(const AUDIT_ENTRY_T *entry);
+static void *drain_thread(void *arg);
+
+static const CONF_AUDIT_T *audit_conf;
+static bool enabled;
+
+// bounded multi-producer ring (sequence per cell), drained by one thread
+static AUDIT_CELL_T *cells;
+static size_t cell_mask;
+static size_t enqueue_pos;
+static size_t dequeue_pos;
+static unsigned int dropped;
+
+// leaf ids are item indexes offset by a per root base
+static uint32_t *root_base;
+static uint8_t *named;
+static uint32_t named_count;
+
+static int fd = -1;
+static uint64_t file_size;
+static BUF_T out;
+static bool write_failed;
+
+static pthread_t thread;
+static bool stop;
+
+static uint64_t get_time(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static double get_value(const HAL_VALUE_T *val) {
+  switch (val->type) {
+    case halValueBool:
+      return val->b;
+    case halValueInt:
+      return val->i;
+    case halValueReal:
+      return val->d;
+    default:
+      return 0.0;
+  }
+}
+
+static uint8_t get_type(hal_type_t type) {
+  switch (type) {
+    case HAL_BIT:
+      return AUDIT_TYPE_BIT;
+    case HAL_FLOAT:
+      return AUDIT_TYPE_FLOAT;
+    case HAL_S32:
+      return AUDIT_TYPE_S32;
+    case HAL_U32:
+      return AUDIT_TYPE_U32;
+    default:
+      return 0;
+  }
+}
+
+static int enqueue(const AUDIT_ENTRY_T *entry) {
+  AUDIT_CELL_T *cell;
+  size_t pos, seq;
+  intptr_t diff;
+
+  pos = __atomic_load_n(&enqueue_pos, __ATOMIC_RELAXED);
+  while (1) {
+    cell = &cells[pos & cell_mask];
+    seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+    diff = (intptr_t) seq - (intptr_t) pos;
+    if (diff == 0) {
+      if (__atomic_compare_exchange_n(&enqueue_pos, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        break;
+      }
+    } else if (diff < 0) {
+      // ring is full
+      return -1;
+    } else {
+      pos = __atomic_load_n(&enqueue_pos, __ATOMIC_RELAXED);
+    }
+  }
+
+  cell->entry = *entry;
+  __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+  return 0;
+}
+
+static int dequeue(AUDIT_ENTRY_T *entry) {
+  AUDIT_CELL_T *cell = &cells[dequeue_pos & cell_mask];
+
+  if (__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) != dequeue_pos + 1) {
+    return -1;
+  }
+
+  *entry = cell->entry;
+  __atomic_store_n(&cell->seq, dequeue_pos + cell_mask + 1, __ATOMIC_RELEASE);
+  dequeue_pos++;
+  return 0;
+}
+
+static int open_file(void) {
+  struct stat st;
+  AUDIT_FILE_HEADER_T hdr;
+
+  fd = open(audit_conf->file, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    fprintf(stderr, "%s: ERROR: unable to open audit log %s: %s\n", modname, audit_conf->file, strerror(errno));
+    return -1;
+  }
+
+  if (fstat(fd, &st) < 0) {
+    fprintf(stderr, "%s: ERROR: unable to stat audit log %s: %s\n", modname, audit_conf->file, strerror(errno));
+    close(fd);
+    fd = -1;
+    return -1;
+  }
+  file_size = st.st_size;
+
+  // new file needs a header
+  if (file_size == 0) {
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, AUDIT_FILE_MAGIC, sizeof(hdr.magic));
+    hdr.version = AUDIT_FILE_VERSION;
+    buf_put(&out, (const char *) &hdr, sizeof(hdr));
+  }
+
+  // names have to be repeated in every session
+  memset(named, 0, named_count);
+  put_mark(AUDIT_REC_START, 0);
+
+  return 0;
+}
+
+static int rotate_file(void) {
+  char from[AUDIT_PATH_MAX];
+  char to[AUDIT_PATH_MAX];
+  int i;
+
+  close(fd);
+  fd = -1;
+
+  // shift old files, the oldest one gets overwritten
+  for (i = audit_conf->rotate - 1; i > 0; i--) {
+    snprintf(from, sizeof(from), "%s.%d", audit_conf->file, i);
+    snprintf(to, sizeof(to), "%s.%d", audit_conf->file, i + 1);
+    rename(from, to);
+  }
+
+  if (audit_conf->rotate > 0) {
+    snprintf(to, sizeof(to), "%s.1", audit_conf->file);
+    rename(audit_conf->file, to);
+  } else {
+    unlink(audit_conf->file);
+  }
+
+  return open_file();
+}
+
+static void flush_out(void) {
+  size_t pos = 0;
+  ssize_t len;
+
+  if (fd < 0) {
+    out.len = 0;
+    return;
+  }
+
+  while (pos < out.len) {
+    len = write(fd, out.data + pos, out.len - pos);
+    if (len < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (!write_failed) {
+        fprintf(stderr, "%s: ERROR: unable to write audit log: %s\n", modname, strerror(errno));
+        write_failed = true;
+      }
+      break;
+    }
+    pos += len;
+  }
+
+  file_size += pos;
+  out.len = 0;
+  out.error = false;
+}
+
+static void put_mark(uint8_t type, uint32_t count) {
+  AUDIT_REC_MARK_T rec;
+
+  memset(&rec, 0, sizeof(rec));
+  rec.type = type;
+  rec.count = count;
+  rec.time = get_time();
+  buf_put(&out, (const char *) &rec, sizeof(rec));
+}
+
+static void put_entry(const AUDIT_ENTRY_T *entry) {
+  CONF_JSON_ITEM_T *root;
+  AUDIT_REC_NAME_T name_rec;
+  AUDIT_REC_WRITE_T rec;
+  char path[AUDIT_PATH_MAX];
+  uint32_t id;
+  int len;
+
+  // rotate before anything of this entry is written (worst case size)
+  if (audit_conf->max_size > 0 && file_size + out.len + sizeof(name_rec) + sizeof(path) + sizeof(rec) > audit_conf->max_size &&
+      file_size + out.len > sizeof(AUDIT_FILE_HEADER_T) + sizeof(AUDIT_REC_MARK_T)) {
+    flush_out();
+    if (rotate_file()) {
+      return;
+    }
+  }
+
+  for (root = entry->json; root->parent != NULL; root = root->parent);
+  id = root_base[root->root_index] + entry->json->item_index;
+
+  // first use of a leaf in this session
+  if (!named[id]) {
+    len = conf_get_item_path(entry->json, path, sizeof(path));
+    if (len < 0) {
+      len = 0;
+    }
+    name_rec.type = AUDIT_REC_NAME;
+    name_rec.hal_type = get_type(entry->json->hal.type);
+    name_rec.len = len;
+    name_rec.id = id;
+    buf_put(&out, (const char *) &name_rec, sizeof(name_rec));
+    buf_put(&out, path, len);
+    named[id] = 1;
+  }
+
+  memset(&rec, 0, sizeof(rec));
+  rec.type = AUDIT_REC_WRITE;
+  rec.hal_type = get_type(entry->json->hal.type);
+  rec.status = entry->ok ? AUDIT_STATUS_OK : AUDIT_STATUS_REJECTED;
+  rec.family = entry->family;
+  rec.id = id;
+  rec.time = entry->time;
+  memcpy(rec.addr, entry->addr, sizeof(rec.addr));
+  rec.old_value = entry->old_value;
+  rec.new_value = entry->new_value;
+  buf_put(&out, (const char *) &rec, sizeof(rec));
+}
+
+static void *drain_thread(void *arg) {
+  struct timespec ts = { 0, AUDIT_DRAIN_INTERVAL_NS };
+  AUDIT_ENTRY_T entry;
+  unsigned int lost;
+  bool done;
+  int count;
+
+  do {
+    done = __atomic_load_n(&stop, __ATOMIC_ACQUIRE);
+
+    for (count = 0; dequeue(&entry) == 0; count++) {
+      put_entry(&entry);
+    }
+
+    lost = __atomic_exchange_n(&dropped, 0, __ATOMIC_RELAXED);
+    if (lost > 0) {
+      put_mark(AUDIT_REC_DROP, lost);
+    }
+
+    if (out.len > 0) {
+      flush_out();
+    }
+
+    if (count == 0 && !done) {
+      nanosleep(&ts, NULL);
+    }
+  } while (!done);
+
+  return NULL;
+}
+
+void audit_record(CONF_JSON_ITEM_T *json, const struct sockaddr *client, bool ok, const HAL_VALUE_T *old_val, const HAL_VALUE_T *new_val) {
+  AUDIT_ENTRY_T entry;
+
+  if (!__atomic_load_n(&enabled, __ATOMIC_ACQUIRE)) {
+    return;
+  }
+
+  entry.time = get_time();
+  entry.json = json;
+  entry.ok = ok;
+  entry.old_value = get_value(old_val);
+  entry.new_value = get_value(new_val);
+
+  memset(entry.addr, 0, sizeof(entry.addr));
+  entry.family = AUDIT_FAMILY_NONE;
+  if (client != NULL && client->sa_family == AF_INET) {
+    entry.family = AUDIT_FAMILY_INET;
+    memcpy(entry.addr, &((const struct sockaddr_in *) client)->sin_addr, 4);
+  } else if (client != NULL && client->sa_family == AF_INET6) {
+    entry.family = AUDIT_FAMILY_INET6;
+    memcpy(entry.addr, &((const struct sockaddr_in6 *) client)->sin6_addr, 16);
+  }
+
+  // never block the request path
+  if (enqueue(&entry)) {
+    __atomic_add_fetch(&dropped, 1, __ATOMIC_RELAXED);
+  }
+}
+
+int audit_start(CONF_ROOT_T *conf) {
+  CONF_JSON_ITEM_T *root;
+  size_t i;
+  int count;
+
+  audit_conf = &conf->audit;
+  if (audit_conf->file == NULL) {
+    return 0;
+  }
+
+  // alloc ring
+  cells = calloc(audit_conf->ring_size, sizeof(AUDIT_CELL_T));
+  if (cells == NULL) {
+    fprintf(stderr, "%s: ERROR: unable to alloc memory for audit ring\n", modname);
+    goto fail0;
+  }
+  cell_mask = audit_conf->ring_size - 1;
+  for (i = 0; i < audit_conf->ring_size; i++) {
+    cells[i].seq = i;
+  }
+  enqueue_pos = 0;
+  dequeue_pos = 0;
+
+  // assign leaf id ranges
+  for (count = 0, root = conf->json; root != NULL; root = root->next, count++);
+  root_base = calloc(count + 1, sizeof(uint32_t));
+  if (root_base == NULL) {
+    fprintf(stderr, "%s: ERROR: unable to alloc memory for audit ids\n", modname);
+    goto fail1;
+  }
+  named_count = 0;
+  for (root = conf->json; root != NULL; root = root->next) {
+    root_base[root->root_index] = named_count;
+    named_count += root->item_count;
+  }
+  named = calloc(named_count + 1, 1);
+  if (named == NULL) {
+    fprintf(stderr, "%s: ERROR: unable to alloc memory for audit ids\n", modname);
+    goto fail2;
+  }
+
+  buf_init(&out);
+  write_failed = false;
+  if (open_file()) {
+    goto fail3;
+  }
+
+  stop = false;
+  if (sys_thread_create(&thread, drain_thread, NULL)) {
+    fprintf(stderr, "%s: ERROR: unable to start audit thread\n", modname);
+    goto fail4;
+  }
+
+  __atomic_store_n(&enabled, true, __ATOMIC_RELEASE);
+  return 0;
+
+fail4:
+  close(fd);
+  fd = -1;
+fail3:
+  buf_free(&out);
+  free(named);
+fail2:
+  free(root_base);
+fail1:
+  free(cells);
+fail0:
+  return -1;
+}
+
+void audit_stop(void) {
+  if (!__atomic_load_n(&enabled, __ATOMIC_ACQUIRE)) {
+    return;
+  }
+  __atomic_store_n(&enabled, false, __ATOMIC_RELEASE);
+
+  // drain thread empties the ring before it exits
+  __atomic_store_n(&stop, true, __ATOMIC_RELEASE);
+  pthread_join(thread, NULL);
+
+  if (fd >= 0) {
+    close(fd);
+    fd = -1;
+  }
+  buf_free(&out);
+  free(named);
+  free(root_base);
+  free(cells);
+}
@@ -0,0 +1,16 @@
+#ifndef LCREST_AUDIT_H
+#define LCREST_AUDIT_H
+
+#include <stdbool.h>
+#include <sys/socket.h>
+
+#include "lcrest.h"
+#include "lcrest_conf.h"
+#include "lcrest_hal.h"
+
+int audit_start(CONF_ROOT_T *conf);
+void audit_stop(void);
+
+void audit_record(CONF_JSON_ITEM_T *json, const struct sockaddr *client, bool ok, const HAL_VALUE_T *old_val, const HAL_VALUE_T *new_val);
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef LCREST_AUDIT_FILE_H
+#define LCREST_AUDIT_FILE_H
+
+#include <stdint.h>
+
+// audit log file layout, shared by lcrest and lcrest-auditdump
+// all values are stored in host byte order
+
+#define AUDIT_FILE_MAGIC    "LCRAUDIT"
+#define AUDIT_FILE_VERSION  1
+
+#define AUDIT_REC_START 1
+#define AUDIT_REC_NAME  2
+#define AUDIT_REC_WRITE 3
+#define AUDIT_REC_DROP  4
+
+#define AUDIT_TYPE_BIT   1
+#define AUDIT_TYPE_FLOAT 2
+#define AUDIT_TYPE_S32   3
+#define AUDIT_TYPE_U32   4
+
+#define AUDIT_STATUS_OK       0
+#define AUDIT_STATUS_REJECTED 1
+
+#define AUDIT_FAMILY_NONE  0
+#define AUDIT_FAMILY_INET  1
+#define AUDIT_FAMILY_INET6 2
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+} AUDIT_FILE_HEADER_T;
+
+// start of a session, invalidates all names seen before (also used for drops)
+typedef struct {
+  uint8_t type;
+  uint8_t reserved[3];
+  uint32_t count;
+  uint64_t time;
+} AUDIT_REC_MARK_T;
+
+// maps a leaf id to its path, followed by len bytes of name
+typedef struct {
+  uint8_t type;
+  uint8_t hal_type;
+  uint16_t len;
+  uint32_t id;
+} AUDIT_REC_NAME_T;
+
+typedef struct {
+  uint8_t type;
+  uint8_t hal_type;
+  uint8_t status;
+  uint8_t family;
+  uint32_t id;
+  uint64_t time;
+  uint8_t addr[16];
+  double old_value;
+  double new_value;
+} AUDIT_REC_WRITE_T;
+
+#endif
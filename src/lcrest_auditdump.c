@@ -0,0 +1,210 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include "lcrest_audit_file.h"
+
+static const char *progname = "lcrest-auditdump";
+
+typedef struct {
+  char **names;
+  uint32_t count;
+} DUMP_NAMES_T;
+
+static const char *get_type_name(uint8_t type);
+static void format_time(uint64_t time, char *buf, size_t size);
+static void format_value(uint8_t type, double val, char *buf, size_t size);
+static void clear_names(DUMP_NAMES_T *names);
+static int set_name(DUMP_NAMES_T *names, uint32_t id, char *name);
+static int dump_file(const char *filename);
+
+static const char *get_type_name(uint8_t type) {
+  switch (type) {
+    case AUDIT_TYPE_BIT:
+      return "bit";
+    case AUDIT_TYPE_FLOAT:
+      return "float";
+    case AUDIT_TYPE_S32:
+      return "s32";
+    case AUDIT_TYPE_U32:
+      return "u32";
+    default:
+      return "unknown";
+  }
+}
+
+static void format_time(uint64_t time, char *buf, size_t size) {
+  time_t sec = time / 1000000000ULL;
+  struct tm tm;
+  size_t len;
+
+  gmtime_r(&sec, &tm);
+  len = strftime(buf, size, "%Y-%m-%dT%H:%M:%S", &tm);
+  snprintf(buf + len, size - len, ".%09uZ", (unsigned int) (time % 1000000000ULL));
+}
+
+static void format_value(uint8_t type, double val, char *buf, size_t size) {
+  if (type == AUDIT_TYPE_FLOAT) {
+    snprintf(buf, size, "%.15g", val);
+  } else {
+    snprintf(buf, size, "%.0f", val);
+  }
+}
+
+static void clear_names(DUMP_NAMES_T *names) {
+  uint32_t i;
+
+  for (i = 0; i < names->count; i++) {
+    free(names->names[i]);
+  }
+  free(names->names);
+  names->names = NULL;
+  names->count = 0;
+}
+
+static int set_name(DUMP_NAMES_T *names, uint32_t id, char *name) {
+  char **p;
+
+  if (id >= names->count) {
+    p = realloc(names->names, (id + 1) * sizeof(char *));
+    if (p == NULL) {
+      return -1;
+    }
+    memset(p + names->count, 0, (id + 1 - names->count) * sizeof(char *));
+    names->names = p;
+    names->count = id + 1;
+  }
+
+  free(names->names[id]);
+  names->names[id] = name;
+  return 0;
+}
+
+static int dump_file(const char *filename) {
+  int ret = -1;
+  FILE *file;
+  AUDIT_FILE_HEADER_T hdr;
+  union {
+    uint8_t type;
+    AUDIT_REC_MARK_T mark;
+    AUDIT_REC_NAME_T name;
+    AUDIT_REC_WRITE_T write;
+  } rec;
+  DUMP_NAMES_T names = { NULL, 0 };
+  char time_str[64], addr_str[INET6_ADDRSTRLEN], old_str[32], new_str[32];
+  const char *name;
+  char *str;
+
+  file = fopen(filename, "rb");
+  if (file == NULL) {
+    fprintf(stderr, "%s: ERROR: unable to open %s\n", progname, filename);
+    goto fail0;
+  }
+
+  if (fread(&hdr, sizeof(hdr), 1, file) != 1 || memcmp(hdr.magic, AUDIT_FILE_MAGIC, sizeof(hdr.magic)) != 0) {
+    fprintf(stderr, "%s: ERROR: %s is not an audit log\n", progname, filename);
+    goto fail1;
+  }
+  if (hdr.version != AUDIT_FILE_VERSION) {
+    fprintf(stderr, "%s: ERROR: %s has unsupported version %u\n", progname, filename, hdr.version);
+    goto fail1;
+  }
+
+  // all records start with the same 8 byte prefix
+  while (fread(&rec, 8, 1, file) == 1) {
+    switch (rec.type) {
+      case AUDIT_REC_START:
+      case AUDIT_REC_DROP:
+        if (fread((char *) &rec + 8, sizeof(AUDIT_REC_MARK_T) - 8, 1, file) != 1) {
+          goto truncated;
+        }
+        format_time(rec.mark.time, time_str, sizeof(time_str));
+        if (rec.type == AUDIT_REC_START) {
+          clear_names(&names);
+          printf("%s start\n", time_str);
+        } else {
+          printf("%s dropped %u\n", time_str, rec.mark.count);
+        }
+        break;
+
+      case AUDIT_REC_NAME:
+        str = malloc(rec.name.len + 1);
+        if (str == NULL) {
+          fprintf(stderr, "%s: ERROR: unable to alloc memory\n", progname);
+          goto fail2;
+        }
+        if (rec.name.len > 0 && fread(str, rec.name.len, 1, file) != 1) {
+          free(str);
+          goto truncated;
+        }
+        str[rec.name.len] = 0;
+        if (set_name(&names, rec.name.id, str)) {
+          free(str);
+          fprintf(stderr, "%s: ERROR: unable to alloc memory\n", progname);
+          goto fail2;
+        }
+        break;
+
+      case AUDIT_REC_WRITE:
+        if (fread((char *) &rec + 8, sizeof(AUDIT_REC_WRITE_T) - 8, 1, file) != 1) {
+          goto truncated;
+        }
+        format_time(rec.write.time, time_str, sizeof(time_str));
+        switch (rec.write.family) {
+          case AUDIT_FAMILY_INET:
+            inet_ntop(AF_INET, rec.write.addr, addr_str, sizeof(addr_str));
+            break;
+          case AUDIT_FAMILY_INET6:
+            inet_ntop(AF_INET6, rec.write.addr, addr_str, sizeof(addr_str));
+            break;
+          default:
+            strcpy(addr_str, "-");
+            break;
+        }
+        name = (rec.write.id < names.count && names.names[rec.write.id] != NULL) ? names.names[rec.write.id] : "?";
+        format_value(rec.write.hal_type, rec.write.old_value, old_str, sizeof(old_str));
+        format_value(rec.write.hal_type, rec.write.new_value, new_str, sizeof(new_str));
+        printf("%s %s %s %s %s -> %s%s\n", time_str, addr_str, name, get_type_name(rec.write.hal_type),
+          old_str, new_str, (rec.write.status == AUDIT_STATUS_OK) ? "" : " rejected");
+        break;
+
+      default:
+        fprintf(stderr, "%s: ERROR: %s has unknown record type %u\n", progname, filename, rec.type);
+        goto fail2;
+    }
+  }
+
+  ret = 0;
+  goto fail2;
+
+truncated:
+  // the last record may be incomplete if the server was killed
+  fprintf(stderr, "%s: WARNING: %s is truncated\n", progname, filename);
+  ret = 0;
+
+fail2:
+  clear_names(&names);
+fail1:
+  fclose(file);
+fail0:
+  return ret;
+}
+
+int main(int argc, char **argv) {
+  int i;
+
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <audit log> ...\n", progname);
+    return 1;
+  }
+
+  for (i = 1; i < argc; i++) {
+    if (dump_file(argv[i])) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,56 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lcrest.h"
+#include "lcrest_buf.h"
+
+#define BUF_MIN_SIZE 4096
+
+void buf_init(BUF_T *buf) {
+  memset(buf, 0, sizeof(BUF_T));
+}
+
+void buf_free(BUF_T *buf) {
+  free(buf->data);
+  buf_init(buf);
+}
+
+int buf_grow(BUF_T *buf, size_t len) {
+  size_t size;
+  char *data;
+
+  // keep failing after the first error, so callers only check at the end
+  if (buf->error) {
+    return -1;
+  }
+
+  size = (buf->size < BUF_MIN_SIZE) ? BUF_MIN_SIZE : buf->size;
+  while (size - buf->len < len) {
+    size <<= 1;
+  }
+
+  data = realloc(buf->data, size);
+  if (data == NULL) {
+    fprintf(stderr, "%s: ERROR: unable to alloc memory for buffer\n", modname);
+    buf->error = true;
+    return -1;
+  }
+
+  buf->data = data;
+  buf->size = size;
+  return 0;
+}
+
+void buf_put(BUF_T *buf, const char *data, size_t len) {
+  char *p = buf_reserve(buf, len);
+
+  if (p != NULL) {
+    memcpy(p, data, len);
+    buf->len += len;
+  }
+}
+
+void buf_puts(BUF_T *buf, const char *str) {
+  buf_put(buf, str, strlen(str));
+}
@@ -0,0 +1,36 @@
+#ifndef LCREST_BUF_H
+#define LCREST_BUF_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct {
+  char *data;
+  size_t len;
+  size_t size;
+  bool error;
+} BUF_T;
+
+void buf_init(BUF_T *buf);
+void buf_free(BUF_T *buf);
+int buf_grow(BUF_T *buf, size_t len);
+void buf_put(BUF_T *buf, const char *data, size_t len);
+void buf_puts(BUF_T *buf, const char *str);
+
+// returns space for at least len bytes, to be committed by increasing buf->len
+static inline char *buf_reserve(BUF_T *buf, size_t len) {
+  if (buf->size - buf->len < len && buf_grow(buf, len)) {
+    return NULL;
+  }
+  return buf->data + buf->len;
+}
+
+static inline void buf_putc(BUF_T *buf, char c) {
+  if (buf->len >= buf->size && buf_grow(buf, 1)) {
+    return;
+  }
+  buf->data[buf->len++] = c;
+}
+
+#endif
@@ -0,0 +1,563 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "lcrest.h"
+#include "lcrest_conf.h"
+#include "lcrest_hal.h"
+#include "lcrest_json.h"
+#include "lcrest_path.h"
+#include "lcrest_expr.h"
+#include "lcrest_loop.h"
+#include "lcrest_capture.h"
+#include "lcrest_capture_file.h"
+
+#define CAPTURE_PATH_MAX 1024
+
+typedef enum {
+  captureIdle = 0,
+  captureArmed,
+  captureTriggered,
+  captureDone
+} CAPTURE_STATE_T;
+
+typedef enum {
+  captureRising = 0,
+  captureFalling,
+  captureChange,
+  captureAbove,
+  captureBelow
+} CAPTURE_MODE_T;
+
+typedef struct {
+  CONF_JSON_ITEM_T **items;
+  int count;
+  int max;
+  CONF_JSON_ITEM_T *bad;
+} CAPTURE_MATCH_CTX_T;
+
+static const char *state_names[] = { "idle", "armed", "triggered", "done" };
+static const char *mode_names[] = { "rising", "falling", "change", "above", "below", NULL };
+
+static uint64_t get_time(void);
+static double read_value(CONF_JSON_ITEM_T *json);
+static bool check_trigger(double val);
+static void capture_tick(void *data);
+static void match_leaf(CONF_JSON_ITEM_T *json, void *data);
+static int resolve_paths(CONF_JSON_ITEM_T *root, const char *spec, CAPTURE_MATCH_CTX_T *ctx);
+static int parse_ms(const char *str, int def, int *samples);
+static void put_item_path(BUF_T *buf, CONF_JSON_ITEM_T *json);
+static void put_typed_value(BUF_T *buf, CONF_JSON_ITEM_T *json, double val);
+
+static CONF_ROOT_T *capture_root_conf;
+static const CONF_CAPTURE_T *capture_conf;
+static pthread_mutex_t capture_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// everything below is protected by capture_lock, state is also read atomically by the sampler
+static CAPTURE_STATE_T state;
+static double *ring;
+static CONF_JSON_ITEM_T **chans;
+static CONF_JSON_ITEM_T **arm_chans;
+static int chan_count;
+static CONF_JSON_ITEM_T *trig;
+static CAPTURE_MODE_T trig_mode;
+static double trig_level;
+static double trig_last;
+static bool trig_last_valid;
+static int pre_samples;
+static int post_samples;
+static int ring_size;
+static int head;
+static int filled;
+static int remaining;
+static int trig_slot;
+static int pre_taken;
+static uint64_t trig_time;
+
+static uint64_t get_time(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static double read_value(CONF_JSON_ITEM_T *json) {
+  if (json->type == confTypeJsonComputed) {
+    return expr_eval(json->hal.computed.code);
+  }
+
+  return hal_get_json_double(json);
+}
+
+static bool check_trigger(double val) {
+  bool fire;
+
+  switch (trig_mode) {
+    case captureRising:
+      fire = trig_last_valid && trig_last < trig_level && val >= trig_level;
+      break;
+    case captureFalling:
+      fire = trig_last_valid && trig_last >= trig_level && val < trig_level;
+      break;
+    case captureChange:
+      fire = trig_last_valid && val != trig_last;
+      break;
+    case captureAbove:
+      fire = val >= trig_level;
+      break;
+    case captureBelow:
+      fire = val <= trig_level;
+      break;
+    default:
+      fire = false;
+      break;
+  }
+
+  trig_last = val;
+  trig_last_valid = true;
+  return fire;
+}
+
+static void capture_tick(void *data) {
+  CAPTURE_STATE_T cur;
+  double *row;
+  int i;
+
+  // nothing to do while idle or done, don't touch the lock then
+  cur = __atomic_load_n(&state, __ATOMIC_ACQUIRE);
+  if (cur != captureArmed && cur != captureTriggered) {
+    return;
+  }
+
+  pthread_mutex_lock(&capture_lock);
+
+  // trigger sample is the first post trigger sample
+  if (state == captureArmed && check_trigger(read_value(trig))) {
+    pre_taken = (filled < pre_samples) ? filled : pre_samples;
+    trig_slot = head;
+    trig_time = get_time();
+    remaining = post_samples;
+    state = captureTriggered;
+  }
+
+  if (state == captureArmed || state == captureTriggered) {
+    row = ring + (size_t) head * capture_conf->channels;
+    for (i = 0; i < chan_count; i++) {
+      row[i] = read_value(chans[i]);
+    }
+    head = (head + 1) % ring_size;
+
+    if (state == captureArmed) {
+      if (filled < ring_size) {
+        filled++;
+      }
+    } else if (--remaining == 0) {
+      __atomic_store_n(&state, captureDone, __ATOMIC_RELEASE);
+    }
+  }
+
+  pthread_mutex_unlock(&capture_lock);
+}
+
+static void match_leaf(CONF_JSON_ITEM_T *json, void *data) {
+  CAPTURE_MATCH_CTX_T *ctx = (CAPTURE_MATCH_CTX_T *) data;
+
+  if (!CONF_TYPE_IS_LEAF(json->type)) {
+    if (ctx->bad == NULL) {
+      ctx->bad = json;
+    }
+    return;
+  }
+
+  if (ctx->count < ctx->max) {
+    ctx->items[ctx->count] = json;
+  }
+  ctx->count++;
+}
+
+static int resolve_paths(CONF_JSON_ITEM_T *root, const char *spec, CAPTURE_MATCH_CTX_T *ctx) {
+  const char *start;
+  const char *end;
+  PATH_T *path;
+
+  // comma separated list of paths
+  for (start = spec; *start != 0; start = (*end != 0) ? end + 1 : end) {
+    end = strchr(start, ',');
+    if (end == NULL) {
+      end = start + strlen(start);
+    }
+    if (end == start) {
+      continue;
+    }
+
+    path = path_parse(start, end - start);
+    if (path == NULL) {
+      return -1;
+    }
+    if (path_resolve(path, root->childs, match_leaf, ctx) == 0) {
+      path_free(path);
+      return -1;
+    }
+    path_free(path);
+  }
+
+  return (ctx->bad != NULL) ? -1 : 0;
+}
+
+static int parse_ms(const char *str, int def, int *samples) {
+  char *end;
+  long ms;
+
+  if (str == NULL || str[0] == 0) {
+    ms = def;
+  } else {
+    ms = strtol(str, &end, 10);
+    if (*end != 0 || ms < 0 || ms > 3600000) {
+      return -1;
+    }
+  }
+
+  *samples = (int) (((int64_t) ms * capture_conf->rate + 999) / 1000);
+  return 0;
+}
+
+int capture_start(CONF_ROOT_T *conf) {
+  capture_root_conf = conf;
+  capture_conf = &conf->capture;
+  if (capture_conf->rate <= 0) {
+    return 0;
+  }
+
+  // preallocate and prefault everything the sampler touches
+  ring = malloc((size_t) capture_conf->samples * capture_conf->channels * sizeof(double));
+  if (ring == NULL) {
+    fprintf(stderr, "%s: ERROR: unable to alloc memory for capture ring\n", modname);
+    goto fail0;
+  }
+  memset(ring, 0, (size_t) capture_conf->samples * capture_conf->channels * sizeof(double));
+
+  chans = calloc(2 * capture_conf->channels, sizeof(CONF_JSON_ITEM_T *));
+  if (chans == NULL) {
+    fprintf(stderr, "%s: ERROR: unable to alloc memory for capture channels\n", modname);
+    goto fail1;
+  }
+  arm_chans = chans + capture_conf->channels;
+
+  state = captureIdle;
+  if (loop_add_timer(1000000000ULL / capture_conf->rate, capture_tick, NULL)) {
+    goto fail2;
+  }
+
+  return 0;
+
+fail2:
+  free(chans);
+  chans = NULL;
+fail1:
+  free(ring);
+  ring = NULL;
+fail0:
+  return -1;
+}
+
+void capture_stop(void) {
+  if (ring == NULL) {
+    return;
+  }
+
+  // both channel tables share one allocation
+  free(chans < arm_chans ? chans : arm_chans);
+  free(ring);
+  chans = NULL;
+  arm_chans = NULL;
+  ring = NULL;
+}
+
+bool capture_is_enabled(void) {
+  return ring != NULL;
+}
+
+int capture_arm(const CAPTURE_REQUEST_T *req, const char **error) {
+  CONF_JSON_ITEM_T *root;
+  CONF_JSON_ITEM_T *trig_item;
+  CONF_JSON_ITEM_T **tmp;
+  CAPTURE_MATCH_CTX_T ctx;
+  const char **name;
+  CAPTURE_MODE_T mode = captureRising;
+  double level = 0.5;
+  char *end;
+  int pre, post;
+
+  // select root
+  if (req->root == NULL) {
+    *error = "root is required";
+    return -1;
+  }
+  for (root = capture_root_conf->json; root != NULL && strcmp(root->name, req->root) != 0; root = root->next);
+  if (root == NULL) {
+    *error = "unknown root";
+    return -1;
+  }
+
+  // trigger mode and level
+  if (req->mode != NULL && req->mode[0] != 0) {
+    for (name = mode_names; *name != NULL && strcmp(*name, req->mode) != 0; name++);
+    if (*name == NULL) {
+      *error = "invalid mode";
+      return -1;
+    }
+    mode = name - mode_names;
+  }
+  if (req->level != NULL && req->level[0] != 0) {
+    level = strtod(req->level, &end);
+    if (*end != 0) {
+      *error = "invalid level";
+      return -1;
+    }
+  }
+
+  // pre and post trigger time
+  if (parse_ms(req->pre, 0, &pre) || parse_ms(req->post, 1000, &post)) {
+    *error = "invalid pre/post time";
+    return -1;
+  }
+  if (post < 1) {
+    post = 1;
+  }
+  if (pre + post > capture_conf->samples) {
+    *error = "pre + post exceeds capture buffer";
+    return -1;
+  }
+
+  if (req->trigger == NULL || req->channels == NULL) {
+    *error = "trigger and channels are required";
+    return -1;
+  }
+
+  pthread_mutex_lock(&capture_lock);
+
+  // trigger must be a single value
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.items = &trig_item;
+  ctx.max = 1;
+  if (resolve_paths(root, req->trigger, &ctx) || ctx.count != 1) {
+    pthread_mutex_unlock(&capture_lock);
+    *error = "trigger must match a single value";
+    return -1;
+  }
+
+  // channels are resolved into the spare table
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.items = arm_chans;
+  ctx.max = capture_conf->channels;
+  if (resolve_paths(root, req->channels, &ctx) || ctx.count == 0) {
+    pthread_mutex_unlock(&capture_lock);
+    *error = "invalid channels";
+    return -1;
+  }
+  if (ctx.count > ctx.max) {
+    pthread_mutex_unlock(&capture_lock);
+    *error = "too many channels";
+    return -1;
+  }
+
+  // commit, this drops any previous capture
+  tmp = chans;
+  chans = arm_chans;
+  arm_chans = tmp;
+  chan_count = ctx.count;
+  trig = trig_item;
+  trig_mode = mode;
+  trig_level = level;
+  trig_last_valid = false;
+  pre_samples = pre;
+  post_samples = post;
+  ring_size = pre + post;
+  head = 0;
+  filled = 0;
+  __atomic_store_n(&state, captureArmed, __ATOMIC_RELEASE);
+
+  pthread_mutex_unlock(&capture_lock);
+  return 0;
+}
+
+void capture_disarm(void) {
+  pthread_mutex_lock(&capture_lock);
+  __atomic_store_n(&state, captureIdle, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&capture_lock);
+}
+
+static void put_item_path(BUF_T *buf, CONF_JSON_ITEM_T *json) {
+  char path[CAPTURE_PATH_MAX];
+
+  if (conf_get_item_path(json, path, sizeof(path)) < 0) {
+    json_put_string(buf, json->name);
+    return;
+  }
+
+  json_put_string(buf, path);
+}
+
+static void put_typed_value(BUF_T *buf, CONF_JSON_ITEM_T *json, double val) {
+  EXPR_VALUE_T typed;
+
+  // values were exact when sampled, the conversion back is lossless
+  switch (json->hal.type) {
+    case HAL_BIT:
+      typed.bit = (val != 0.0);
+      break;
+    case HAL_U32:
+      typed.u32 = val;
+      break;
+    case HAL_S32:
+      typed.s32 = val;
+      break;
+    default:
+      typed.flt = val;
+      break;
+  }
+
+  json_put_value(buf, json->hal.type, &typed, json->precision);
+}
+
+int capture_put_status(BUF_T *buf) {
+  char num[32];
+  int i;
+
+  pthread_mutex_lock(&capture_lock);
+
+  buf_puts(buf, "{\"state\":");
+  json_put_string(buf, state_names[state]);
+  snprintf(num, sizeof(num), "%d", capture_conf->rate);
+  buf_puts(buf, ",\"rate\":");
+  buf_puts(buf, num);
+
+  if (state != captureIdle) {
+    buf_puts(buf, ",\"trigger\":");
+    put_item_path(buf, trig);
+    buf_puts(buf, ",\"mode\":");
+    json_put_string(buf, mode_names[trig_mode]);
+    buf_puts(buf, ",\"level\":");
+    json_put_value(buf, HAL_FLOAT, &trig_level, -1);
+    snprintf(num, sizeof(num), "%d", pre_samples);
+    buf_puts(buf, ",\"pre\":");
+    buf_puts(buf, num);
+    snprintf(num, sizeof(num), "%d", post_samples);
+    buf_puts(buf, ",\"post\":");
+    buf_puts(buf, num);
+    buf_puts(buf, ",\"channels\":[");
+    for (i = 0; i < chan_count; i++) {
+      if (i > 0) {
+        buf_putc(buf, ',');
+      }
+      put_item_path(buf, chans[i]);
+    }
+    buf_putc(buf, ']');
+  }
+
+  pthread_mutex_unlock(&capture_lock);
+
+  buf_putc(buf, '}');
+  return buf->error ? -1 : 0;
+}
+
+int capture_put_data(BUF_T *buf, bool binary) {
+  CONF_JSON_ITEM_T **items;
+  CAPTURE_FILE_HEADER_T hdr;
+  BUF_T names;
+  double *data;
+  char num[32];
+  int count, start, slot, i, j;
+  int channels;
+  int pre;
+  uint64_t time;
+
+  // copy out the finished capture, so the lock is held only briefly
+  pthread_mutex_lock(&capture_lock);
+  if (state != captureDone) {
+    pthread_mutex_unlock(&capture_lock);
+    return -1;
+  }
+  channels = chan_count;
+  pre = pre_taken;
+  time = trig_time;
+  count = pre_taken + post_samples;
+  start = (trig_slot - pre_taken + ring_size) % ring_size;
+  items = malloc(channels * sizeof(CONF_JSON_ITEM_T *) + (size_t) count * channels * sizeof(double));
+  if (items == NULL) {
+    pthread_mutex_unlock(&capture_lock);
+    buf->error = true;
+    return 0;
+  }
+  data = (double *) (items + channels);
+  memcpy(items, chans, channels * sizeof(CONF_JSON_ITEM_T *));
+  for (i = 0, slot = start; i < count; i++, slot = (slot + 1) % ring_size) {
+    memcpy(data + (size_t) i * channels, ring + (size_t) slot * capture_conf->channels, channels * sizeof(double));
+  }
+  pthread_mutex_unlock(&capture_lock);
+
+  if (binary) {
+    buf_init(&names);
+    for (j = 0; j < channels; j++) {
+      char path[CAPTURE_PATH_MAX];
+      if (conf_get_item_path(items[j], path, sizeof(path)) < 0) {
+        snprintf(path, sizeof(path), "%s", items[j]->name);
+      }
+      buf_puts(&names, path);
+      buf_putc(&names, '\t');
+      buf_puts(&names, hal_get_type_name(items[j]->hal.type));
+      buf_putc(&names, '\n');
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, CAPTURE_FILE_MAGIC, sizeof(hdr.magic));
+    hdr.version = CAPTURE_FILE_VERSION;
+    hdr.header_size = sizeof(hdr) + names.len;
+    hdr.period_ns = 1000000000ULL / capture_conf->rate;
+    hdr.trigger_time = time;
+    hdr.channel_count = channels;
+    hdr.sample_count = count;
+    hdr.pre_samples = pre;
+    hdr.names_size = names.len;
+
+    buf_put(buf, (const char *) &hdr, sizeof(hdr));
+    buf_put(buf, names.data, names.len);
+    buf_put(buf, (const char *) data, (size_t) count * channels * sizeof(double));
+    if (names.error) {
+      buf->error = true;
+    }
+    buf_free(&names);
+  } else {
+    // columnar: one array per channel
+    snprintf(num, sizeof(num), "%d", capture_conf->rate);
+    buf_puts(buf, "{\"rate\":");
+    buf_puts(buf, num);
+    snprintf(num, sizeof(num), "%d", pre);
+    buf_puts(buf, ",\"pre\":");
+    buf_puts(buf, num);
+    snprintf(num, sizeof(num), "%llu", (unsigned long long) time);
+    buf_puts(buf, ",\"triggerTime\":");
+    buf_puts(buf, num);
+    buf_puts(buf, ",\"channels\":{");
+    for (j = 0; j < channels; j++) {
+      if (j > 0) {
+        buf_putc(buf, ',');
+      }
+      put_item_path(buf, items[j]);
+      buf_puts(buf, ":[");
+      for (i = 0; i < count; i++) {
+        if (i > 0) {
+          buf_putc(buf, ',');
+        }
+        put_typed_value(buf, items[j], data[(size_t) i * channels + j]);
+      }
+      buf_putc(buf, ']');
+    }
+    buf_puts(buf, "}}");
+  }
+
+  free(items);
+  return 0;
+}
@@ -0,0 +1,28 @@
+#ifndef LCREST_CAPTURE_H
+#define LCREST_CAPTURE_H
+
+#include "lcrest.h"
+#include "lcrest_conf.h"
+#include "lcrest_buf.h"
+
+typedef struct {
+  const char *root;
+  const char *trigger;
+  const char *mode;
+  const char *level;
+  const char *channels;
+  const char *pre;
+  const char *post;
+} CAPTURE_REQUEST_T;
+
+int capture_start(CONF_ROOT_T *conf);
+void capture_stop(void);
+bool capture_is_enabled(void);
+
+int capture_arm(const CAPTURE_REQUEST_T *req, const char **error);
+void capture_disarm(void);
+
+int capture_put_status(BUF_T *buf);
+int capture_put_data(BUF_T *buf, bool binary);
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef LCREST_CAPTURE_FILE_H
+#define LCREST_CAPTURE_FILE_H
+
+#include <stdint.h>
+
+// binary capture download layout, all values in host byte order
+//
+// the header is followed by names_size bytes of channel descriptions,
+// samples start at header_size. each sample is a row of channel_count
+// doubles, rows are in time order. sample pre_samples is the trigger
+// sample, taken at trigger_time (CLOCK_REALTIME, ns).
+//
+// channel description lines are tab separated:
+//   <path> <type>
+
+#define CAPTURE_FILE_MAGIC    "LCRCAPTR"
+#define CAPTURE_FILE_VERSION  1
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t header_size;
+  uint64_t period_ns;
+  uint64_t trigger_time;
+  uint32_t channel_count;
+  uint32_t sample_count;
+  uint32_t pre_samples;
+  uint32_t names_size;
+} CAPTURE_FILE_HEADER_T;
+
+#endif
@@ -1,12 +1,16 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <ctype.h>
 #include <expat.h>
+#include <arpa/inet.h>
 
 #include "lcrest.h"
 #include "lcrest_conf.h"
 #include "lcrest_hal.h"
+#include "lcrest_dtoa.h"
+#include "lcrest_expr.h"
 
 #define BUFFSIZE 8192
 #define XML_MAX_LEVELS 32
@@ -25,6 +29,19 @@ typedef struct CONF_XML_INST {
   CONF_JSON_ITEM_T *json_last;
   long json_array_factor;
 
+  bool server_found;
+  bool audit_found;
+  bool recorder_found;
+  bool replay_found;
+  bool shmpub_found;
+  bool udppub_found;
+  bool capture_found;
+  bool seq_found;
+  bool events_found;
+  bool static_found;
+  bool metrics_found;
+  bool rt_found;
+
 } CONF_XML_INST_T;
 
 typedef struct CONF_XML_HANLDER {
@@ -51,24 +68,66 @@ static void closeJsonArrayContainer(struct CONF_XML_INST *inst, int next);
 static void parseHalJsonRoot(struct CONF_XML_INST *inst, int next, const char **attr);
 static void parseHalJsonPin(struct CONF_XML_INST *inst, int next, const char **attr);
 static void parseHalJsonParam(struct CONF_XML_INST *inst, int next, const char **attr);
+static void parseHalJsonRef(struct CONF_XML_INST *inst, int next, const char **attr);
+static void parseHalJsonComputed(struct CONF_XML_INST *inst, int next, const char **attr);
 static void parseHalJsonObject(struct CONF_XML_INST *inst, int next, const char **attr);
 static void parseHalJsonArray(struct CONF_XML_INST *inst, int next, const char **attr);
+static void parseRestServer(struct CONF_XML_INST *inst, int next, const char **attr);
+static void parseAuditLog(struct CONF_XML_INST *inst, int next, const char **attr);
+static void parseRecorder(struct CONF_XML_INST *inst, int next, const char **attr);
+static void parseReplay(struct CONF_XML_INST *inst, int next, const char **attr);
+static void parseShmPublisher(struct CONF_XML_INST *inst, int next, const char **attr);
+static void parseUdpPublisher(struct CONF_XML_INST *inst, int next, const char **attr);
+static void parseCapture(struct CONF_XML_INST *inst, int next, const char **attr);
+static void parsePlugin(struct CONF_XML_INST *inst, int next, const char **attr);
+static void parseSequencer(struct CONF_XML_INST *inst, int next, const char **attr);
+static void parseEvents(struct CONF_XML_INST *inst, int next, const char **attr);
+static void parseStatic(struct CONF_XML_INST *inst, int next, const char **attr);
+static void parseMetrics(struct CONF_XML_INST *inst, int next, const char **attr);
+static void parseRtSampler(struct CONF_XML_INST *inst, int next, const char **attr);
+
+static int parsePrecision(struct CONF_XML_INST *inst, const char *el, const char *val);
+static int parseCpuList(struct CONF_XML_INST *inst, uint64_t *cpus, const char *val);
+static int parseInt(struct CONF_XML_INST *inst, const char *el, const char *attr, const char *val, long min, long max, long *ret);
+static int parseBool(struct CONF_XML_INST *inst, const char *el, const char *attr, const char *val, bool *ret);
+static int parseString(struct CONF_XML_INST *inst, const char *el, const char *attr, const char *val, char **ret);
+static int numberJsonItems(CONF_JSON_ITEM_T *json, int index);
+static int compileJsonComputed(CONF_JSON_ITEM_T *json);
 
 static void conf_free_json(CONF_JSON_ITEM_T *json, bool parent_cloned);
 
 static const CONF_XML_HANLDER_T xml_states[] = {
   { "halJson", confTypeNone, confTypeJson, NULL, NULL },
+  { "restServer", confTypeJson, confTypeRestServer, parseRestServer, NULL },
+  { "auditLog", confTypeJson, confTypeAuditLog, parseAuditLog, NULL },
+  { "recorder", confTypeJson, confTypeRecorder, parseRecorder, NULL },
+  { "replay", confTypeJson, confTypeReplay, parseReplay, NULL },
+  { "shmPublisher", confTypeJson, confTypeShmPublisher, parseShmPublisher, NULL },
+  { "udpPublisher", confTypeJson, confTypeUdpPublisher, parseUdpPublisher, NULL },
+  { "capture", confTypeJson, confTypeCapture, parseCapture, NULL },
+  { "plugin", confTypeJson, confTypePlugin, parsePlugin, NULL },
+  { "sequencer", confTypeJson, confTypeSequencer, parseSequencer, NULL },
+  { "events", confTypeJson, confTypeEvents, parseEvents, NULL },
+  { "static", confTypeJson, confTypeStatic, parseStatic, NULL },
+  { "metrics", confTypeJson, confTypeMetrics, parseMetrics, NULL },
+  { "rtSampler", confTypeJson, confTypeRtSampler, parseRtSampler, NULL },
   { "halJsonRoot", confTypeJson, confTypeJsonRoot, parseHalJsonRoot, closeJsonContainer },
   { "halJsonPin", confTypeJsonRoot, confTypeJsonPin, parseHalJsonPin, NULL },
   { "halJsonRaram", confTypeJsonRoot, confTypeJsonParam, parseHalJsonParam, NULL },
+  { "halJsonRef", confTypeJsonRoot, confTypeJsonRef, parseHalJsonRef, NULL },
+  { "halJsonComputed", confTypeJsonRoot, confTypeJsonComputed, parseHalJsonComputed, NULL },
   { "halJsonObject", confTypeJsonRoot, confTypeJsonObject, parseHalJsonObject, closeJsonContainer },
   { "halJsonArray", confTypeJsonRoot, confTypeJsonArray, parseHalJsonArray, closeJsonArrayContainer },
   { "halJsonPin", confTypeJsonObject, confTypeJsonPin, parseHalJsonPin, NULL },
   { "halJsonRaram", confTypeJsonObject, confTypeJsonParam, parseHalJsonParam, NULL },
+  { "halJsonRef", confTypeJsonObject, confTypeJsonRef, parseHalJsonRef, NULL },
+  { "halJsonComputed", confTypeJsonObject, confTypeJsonComputed, parseHalJsonComputed, NULL },
   { "halJsonObject", confTypeJsonObject, confTypeJsonObject, parseHalJsonObject, closeJsonContainer },
   { "halJsonArray", confTypeJsonObject, confTypeJsonArray, parseHalJsonArray, closeJsonArrayContainer },
   { "halJsonPin", confTypeJsonArray, confTypeJsonPin, parseHalJsonPin, NULL },
   { "halJsonRaram", confTypeJsonArray, confTypeJsonParam, parseHalJsonParam, NULL },
+  { "halJsonRef", confTypeJsonArray, confTypeJsonRef, parseHalJsonRef, NULL },
+  { "halJsonComputed", confTypeJsonArray, confTypeJsonComputed, parseHalJsonComputed, NULL },
   { "halJsonObject", confTypeJsonArray, confTypeJsonObject, parseHalJsonObject, closeJsonContainer },
   { "halJsonArray", confTypeJsonArray, confTypeJsonArray, parseHalJsonArray, closeJsonArrayContainer },
   { "NULL", -1, -1, NULL, NULL }
@@ -153,6 +212,9 @@ static CONF_JSON_ITEM_T *createJsonItem(struct CONF_XML_INST *inst, CONF_TYPE_T
   // set type
   json->type = type;
 
+  // floats are formatted shortest round-trip unless a precision is inherited
+  json->precision = (inst->json_parent != NULL) ? inst->json_parent->precision : -1;
+
   // set name
   json->name = strdup(name);
   if (json->name == NULL) {
@@ -281,6 +343,7 @@ static void closeJsonArrayContainer(struct CONF_XML_INST *inst, int next) {
 static void parseHalJsonRoot(struct CONF_XML_INST *inst, int next, const char **attr) {
   CONF_ROOT_T *conf = inst->conf;
   const char *iname = NULL;
+  int precision = -1;
   CONF_JSON_ITEM_T *json;
 
   while (*attr) {
@@ -293,6 +356,15 @@ static void parseHalJsonRoot(struct CONF_XML_INST *inst, int next, const char **
       continue;
     }
 
+    // parse precision
+    if (strcmp(name, "precision") == 0) {
+      precision = parsePrecision(inst, "halJsonRoot", val);
+      if (precision < 0) {
+        return;
+      }
+      continue;
+    }
+
     // handle error
     fprintf(stderr, "%s: ERROR: Invalid halJsonRoot attribute %s\n", modname, name);
     XML_StopParser(inst->parser, 0);
@@ -313,6 +385,11 @@ static void parseHalJsonRoot(struct CONF_XML_INST *inst, int next, const char **
     return;
   }
 
+  // override inherited precision
+  if (precision >= 0) {
+    json->precision = precision;
+  }
+
   // first root is head of list
   if (conf->json == NULL) {
     conf->json = json;
@@ -322,8 +399,10 @@ static void parseHalJsonRoot(struct CONF_XML_INST *inst, int next, const char **
 static void parseHalJsonPin(struct CONF_XML_INST *inst, int next, const char **attr) {
   CONF_ROOT_T *conf = inst->conf;
   const char *iname = NULL;
+  int precision = -1;
   hal_type_t type = -1;
   hal_pin_dir_t dir = -1;
+  bool event = false;
   CONF_JSON_ITEM_T *json;
 
   while (*attr) {
@@ -378,6 +457,23 @@ static void parseHalJsonPin(struct CONF_XML_INST *inst, int next, const char **a
       return;
     }
 
+    // parse precision
+    if (strcmp(name, "precision") == 0) {
+      precision = parsePrecision(inst, "halJsonPin", val);
+      if (precision < 0) {
+        return;
+      }
+      continue;
+    }
+
+    // parse event (journal value changes)
+    if (strcmp(name, "event") == 0) {
+      if (parseBool(inst, "halJsonPin", name, val, &event)) {
+        return;
+      }
+      continue;
+    }
+
     // handle error
     fprintf(stderr, "%s: ERROR: Invalid halJsonPin attribute %s\n", modname, name);
     XML_StopParser(inst->parser, 0);
@@ -412,9 +508,15 @@ static void parseHalJsonPin(struct CONF_XML_INST *inst, int next, const char **a
     return;
   }
 
+  // override inherited precision
+  if (precision >= 0) {
+    json->precision = precision;
+  }
+
   // set pin attributes
   json->hal.type = type;
   json->hal.pin.dir = dir;
+  json->event = event;
 
   // increase hal data size
   conf->json_hal_size += hal_get_pin_size(type) * inst->json_array_factor;
@@ -423,8 +525,10 @@ static void parseHalJsonPin(struct CONF_XML_INST *inst, int next, const char **a
 static void parseHalJsonParam(struct CONF_XML_INST *inst, int next, const char **attr) {
   CONF_ROOT_T *conf = inst->conf;
   const char *iname = NULL;
+  int precision = -1;
   hal_type_t type = -1;
   hal_param_dir_t dir = -1;
+  bool event = false;
   CONF_JSON_ITEM_T *json;
 
   while (*attr) {
@@ -475,6 +579,23 @@ static void parseHalJsonParam(struct CONF_XML_INST *inst, int next, const char *
       return;
     }
 
+    // parse precision
+    if (strcmp(name, "precision") == 0) {
+      precision = parsePrecision(inst, "halJsonParam", val);
+      if (precision < 0) {
+        return;
+      }
+      continue;
+    }
+
+    // parse event (journal value changes)
+    if (strcmp(name, "event") == 0) {
+      if (parseBool(inst, "halJsonParam", name, val, &event)) {
+        return;
+      }
+      continue;
+    }
+
     // handle error
     fprintf(stderr, "%s: ERROR: Invalid halJsonParam attribute %s\n", modname, name);
     XML_StopParser(inst->parser, 0);
@@ -509,16 +630,216 @@ static void parseHalJsonParam(struct CONF_XML_INST *inst, int next, const char *
     return;
   }
 
+  // override inherited precision
+  if (precision >= 0) {
+    json->precision = precision;
+  }
+
   // set pin attributes
   json->hal.type = type;
   json->hal.param.dir = dir;
+  json->event = event;
 
   // increase hal data size
   conf->json_hal_size += hal_get_param_size(type) * inst->json_array_factor;
 }
 
+static void parseHalJsonRef(struct CONF_XML_INST *inst, int next, const char **attr) {
+  const char *iname = NULL;
+  int precision = -1;
+  const char *target = NULL;
+  bool writable = false;
+  CONF_JSON_ITEM_T *json;
+
+  while (*attr) {
+    const char *name = *(attr++);
+    const char *val = *(attr++);
+
+    // parse name
+    if (strcmp(name, "name") == 0) {
+      iname = val;
+      continue;
+    }
+
+    // parse target
+    if (strcmp(name, "target") == 0) {
+      target = val;
+      continue;
+    }
+
+    // parse write
+    if (strcmp(name, "write") == 0) {
+      if (strcmp(val, "true") == 0) {
+        writable = true;
+        continue;
+      }
+      if (strcmp(val, "false") == 0) {
+        writable = false;
+        continue;
+      }
+      fprintf(stderr, "%s: ERROR: Invalid halJsonRef write %s\n", modname, val);
+      XML_StopParser(inst->parser, 0);
+      return;
+    }
+
+    // parse precision
+    if (strcmp(name, "precision") == 0) {
+      precision = parsePrecision(inst, "halJsonRef", val);
+      if (precision < 0) {
+        return;
+      }
+      continue;
+    }
+
+    // handle error
+    fprintf(stderr, "%s: ERROR: Invalid halJsonRef attribute %s\n", modname, name);
+    XML_StopParser(inst->parser, 0);
+    return;
+  }
+
+  // name is required
+  if (iname == NULL || iname[0] == 0) {
+    fprintf(stderr, "%s: ERROR: halJsonRef has no/empty name attribute\n", modname);
+    XML_StopParser(inst->parser, 0);
+    return;
+  }
+
+  // target is required
+  if (target == NULL || target[0] == 0) {
+    fprintf(stderr, "%s: ERROR: halJsonRef has no/empty target attribute\n", modname);
+    XML_StopParser(inst->parser, 0);
+    return;
+  }
+
+  // all array instances would reference the same target
+  if (inst->json_array_factor > 1) {
+    fprintf(stderr, "%s: ERROR: halJsonRef %s is not allowed inside halJsonArray\n", modname, iname);
+    XML_StopParser(inst->parser, 0);
+    return;
+  }
+
+  // add item
+  json = createJsonItem(inst, confTypeJsonRef, iname);
+  if (json == NULL) {
+    XML_StopParser(inst->parser, 0);
+    return;
+  }
+
+  // override inherited precision
+  if (precision >= 0) {
+    json->precision = precision;
+  }
+
+  // set ref attributes (type is taken from target on resolve)
+  json->hal.ref.writable = writable;
+  json->hal.ref.target = strdup(target);
+  if (json->hal.ref.target == NULL) {
+    fprintf(stderr, "%s: ERROR: unable to alloc memory for halJsonRef target\n", modname);
+    XML_StopParser(inst->parser, 0);
+    return;
+  }
+}
+
+static void parseHalJsonComputed(struct CONF_XML_INST *inst, int next, const char **attr) {
+  const char *iname = NULL;
+  int precision = -1;
+  hal_type_t type = HAL_FLOAT;
+  const char *expr = NULL;
+  CONF_JSON_ITEM_T *json;
+
+  while (*attr) {
+    const char *name = *(attr++);
+    const char *val = *(attr++);
+
+    // parse name
+    if (strcmp(name, "name") == 0) {
+      iname = val;
+      continue;
+    }
+
+    // parse type
+    if (strcmp(name, "type") == 0) {
+      if (strcmp(val, "bit") == 0) {
+        type = HAL_BIT;
+        continue;
+      }
+      if (strcmp(val, "float") == 0) {
+        type = HAL_FLOAT;
+        continue;
+      }
+      if (strcmp(val, "s32") == 0) {
+        type = HAL_S32;
+        continue;
+      }
+      if (strcmp(val, "u32") == 0) {
+        type = HAL_U32;
+        continue;
+      }
+      fprintf(stderr, "%s: ERROR: Invalid halJsonComputed type %s\n", modname, val);
+      XML_StopParser(inst->parser, 0);
+      return;
+    }
+
+    // parse expr
+    if (strcmp(name, "expr") == 0) {
+      expr = val;
+      continue;
+    }
+
+    // parse precision
+    if (strcmp(name, "precision") == 0) {
+      precision = parsePrecision(inst, "halJsonComputed", val);
+      if (precision < 0) {
+        return;
+      }
+      continue;
+    }
+
+    // handle error
+    fprintf(stderr, "%s: ERROR: Invalid halJsonComputed attribute %s\n", modname, name);
+    XML_StopParser(inst->parser, 0);
+    return;
+  }
+
+  // name is required
+  if (iname == NULL || iname[0] == 0) {
+    fprintf(stderr, "%s: ERROR: halJsonComputed has no/empty name attribute\n", modname);
+    XML_StopParser(inst->parser, 0);
+    return;
+  }
+
+  // expr is required
+  if (expr == NULL || expr[0] == 0) {
+    fprintf(stderr, "%s: ERROR: halJsonComputed has no/empty expr attribute\n", modname);
+    XML_StopParser(inst->parser, 0);
+    return;
+  }
+
+  // add item
+  json = createJsonItem(inst, confTypeJsonComputed, iname);
+  if (json == NULL) {
+    XML_StopParser(inst->parser, 0);
+    return;
+  }
+
+  // override inherited precision
+  if (precision >= 0) {
+    json->precision = precision;
+  }
+
+  // set computed attributes (expression is compiled after parsing, so forward references work)
+  json->hal.type = type;
+  json->hal.computed.expr = strdup(expr);
+  if (json->hal.computed.expr == NULL) {
+    fprintf(stderr, "%s: ERROR: unable to alloc memory for halJsonComputed expr\n", modname);
+    XML_StopParser(inst->parser, 0);
+    return;
+  }
+}
+
 static void parseHalJsonObject(struct CONF_XML_INST *inst, int next, const char **attr) {
   const char *iname = NULL;
+  int precision = -1;
   CONF_JSON_ITEM_T *json;
 
   while (*attr) {
@@ -531,6 +852,15 @@ static void parseHalJsonObject(struct CONF_XML_INST *inst, int next, const char
       continue;
     }
 
+    // parse precision
+    if (strcmp(name, "precision") == 0) {
+      precision = parsePrecision(inst, "halJsonObject", val);
+      if (precision < 0) {
+        return;
+      }
+      continue;
+    }
+
     // handle error
     fprintf(stderr, "%s: ERROR: Invalid halJsonObject attribute %s\n", modname, name);
     XML_StopParser(inst->parser, 0);
@@ -550,10 +880,16 @@ static void parseHalJsonObject(struct CONF_XML_INST *inst, int next, const char
     XML_StopParser(inst->parser, 0);
     return;
   }
+
+  // override inherited precision
+  if (precision >= 0) {
+    json->precision = precision;
+  }
 }
 
 static void parseHalJsonArray(struct CONF_XML_INST *inst, int next, const char **attr) {
   const char *iname = NULL;
+  int precision = -1;
   int size = 0;
   CONF_JSON_ITEM_T *json;
 
@@ -573,6 +909,15 @@ static void parseHalJsonArray(struct CONF_XML_INST *inst, int next, const char *
       continue;
     }
 
+    // parse precision
+    if (strcmp(name, "precision") == 0) {
+      precision = parsePrecision(inst, "halJsonArray", val);
+      if (precision < 0) {
+        return;
+      }
+      continue;
+    }
+
     // handle error
     fprintf(stderr, "%s: ERROR: Invalid halJsonArray attribute %s\n", modname, name);
     XML_StopParser(inst->parser, 0);
@@ -600,6 +945,11 @@ static void parseHalJsonArray(struct CONF_XML_INST *inst, int next, const char *
     return;
   }
 
+  // override inherited precision
+  if (precision >= 0) {
+    json->precision = precision;
+  }
+
   // set array attributes
   json->array_size = size;
 
@@ -607,70 +957,1211 @@ static void parseHalJsonArray(struct CONF_XML_INST *inst, int next, const char *
   inst->json_array_factor *= size;
 }
 
-static void conf_free_json(CONF_JSON_ITEM_T *json, bool parent_cloned) {
-  CONF_JSON_ITEM_T *json_next;
-  bool cloned;
+static int parsePrecision(struct CONF_XML_INST *inst, const char *el, const char *val) {
+  char *end;
+  long precision;
 
-  while (json != NULL) {
-    // get next
-    json_next = json->next;
-    cloned = parent_cloned || (json->array_index > 0);
+  precision = strtol(val, &end, 10);
+  if (val[0] == 0 || *end != 0 || precision < 0 || precision > DTOA_MAX_PRECISION) {
+    fprintf(stderr, "%s: ERROR: Invalid %s precision %s\n", modname, el, val);
+    XML_StopParser(inst->parser, 0);
+    return -1;
+  }
 
-    // free childs
-    conf_free_json(json->childs, cloned);
+  return precision;
+}
 
-    // free name only on first instance, since they are reused
-    if (!cloned) {
-      free(json->name);
+static int parseCpuList(struct CONF_XML_INST *inst, uint64_t *cpus, const char *val) {
+  const char *pos = val;
+  char *end;
+  long first, last, cpu;
+
+  while (1) {
+    // single cpu or range
+    first = strtol(pos, &end, 10);
+    if (end == pos || first < 0 || first >= CONF_SERVER_MAX_CPUS) {
+      goto fail;
+    }
+    last = first;
+    if (*end == '-') {
+      pos = end + 1;
+      last = strtol(pos, &end, 10);
+      if (end == pos || last < first || last >= CONF_SERVER_MAX_CPUS) {
+        goto fail;
+      }
     }
 
-    // free object
-    free(json);
+    for (cpu = first; cpu <= last; cpu++) {
+      cpus[cpu / 64] |= 1ULL << (cpu % 64);
+    }
 
-    // process next
-    json = json_next;
+    if (*end == 0) {
+      return 0;
+    }
+    if (*end != ',') {
+      goto fail;
+    }
+    pos = end + 1;
   }
+
+fail:
+  fprintf(stderr, "%s: ERROR: Invalid restServer cpus %s\n", modname, val);
+  XML_StopParser(inst->parser, 0);
+  return -1;
 }
 
-CONF_ROOT_T *conf_parse(const char *filename) {
-  CONF_ROOT_T *ret = NULL;
-  int done;
-  char buffer[BUFFSIZE];
-  FILE *file;
-  CONF_XML_INST_T inst;
+static int parseInt(struct CONF_XML_INST *inst, const char *el, const char *attr, const char *val, long min, long max, long *ret) {
+  char *end;
+  long v;
 
-  // open file
-  file = fopen(filename, "r");
-  if (file == NULL) {
-    fprintf(stderr, "%s: ERROR: unable to open config file %s\n", modname, filename);
-    goto fail0;
+  v = strtol(val, &end, 10);
+  if (val[0] == 0 || *end != 0 || v < min || v > max) {
+    fprintf(stderr, "%s: ERROR: Invalid %s %s %s\n", modname, el, attr, val);
+    XML_StopParser(inst->parser, 0);
+    return -1;
   }
 
-  // create xml parser
-  memset(&inst, 0, sizeof(inst));
-  if (initXmlInst((CONF_XML_INST_T *) &inst, xml_states)) {
-    fprintf(stderr, "%s: ERROR: Couldn't allocate memory for parser\n", modname);
-    goto fail1;
+  *ret = v;
+  return 0;
+}
+
+static int parseBool(struct CONF_XML_INST *inst, const char *el, const char *attr, const char *val, bool *ret) {
+  if (strcmp(val, "true") == 0) {
+    *ret = true;
+    return 0;
+  }
+  if (strcmp(val, "false") == 0) {
+    *ret = false;
+    return 0;
   }
 
-  // allocate conf header
-  inst.conf = calloc(1, sizeof(CONF_ROOT_T));
-  if (inst.conf == NULL) {
-    fprintf(stderr, "%s: ERROR: Couldn't allocate memory for conf header\n", modname);
-    goto fail2;
+  fprintf(stderr, "%s: ERROR: Invalid %s %s %s\n", modname, el, attr, val);
+  XML_StopParser(inst->parser, 0);
+  return -1;
+}
+
+static int parseString(struct CONF_XML_INST *inst, const char *el, const char *attr, const char *val, char **ret) {
+  free(*ret);
+  *ret = strdup(val);
+  if (*ret == NULL) {
+    fprintf(stderr, "%s: ERROR: unable to alloc memory for %s %s\n", modname, el, attr);
+    XML_StopParser(inst->parser, 0);
+    return -1;
   }
 
-  inst.json_array_factor = 1;
-  for (done=0; !done;) {
-    // read block
-    int len = fread(buffer, 1, BUFFSIZE, file);
-    if (ferror(file)) {
-      fprintf(stderr, "%s: ERROR: Couldn't read from file %s\n", modname, filename);
-      goto fail3;
+  return 0;
+}
+
+static int numberJsonItems(CONF_JSON_ITEM_T *json, int index) {
+  for (; json != NULL; json = json->next) {
+    json->item_index = index++;
+    index = numberJsonItems(json->childs, index);
+  }
+
+  return index;
+}
+
+static int compileJsonComputed(CONF_JSON_ITEM_T *json) {
+  char path[1024];
+  char err[256];
+
+  for (; json != NULL; json = json->next) {
+    if (compileJsonComputed(json->childs)) {
+      return -1;
     }
 
-    // check for EOF
-    done = feof(file);
+    if (json->type != confTypeJsonComputed) {
+      continue;
+    }
+
+    // paths are relative to the containing object, each array copy gets its own code
+    json->hal.computed.code = expr_compile(json->hal.computed.expr, json->parent->childs, err, sizeof(err));
+    if (json->hal.computed.code == NULL) {
+      if (conf_get_item_path(json, path, sizeof(path)) < 0) {
+        snprintf(path, sizeof(path), "%s", json->name);
+      }
+      fprintf(stderr, "%s: ERROR: halJsonComputed %s: %s in expr '%s'\n", modname, path, err, json->hal.computed.expr);
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+static void parseRestServer(struct CONF_XML_INST *inst, int next, const char **attr) {
+  CONF_SERVER_T *server = &inst->conf->server;
+  long val_long;
+
+  // only one server section is allowed
+  if (inst->server_found) {
+    fprintf(stderr, "%s: ERROR: Only one restServer is allowed\n", modname);
+    XML_StopParser(inst->parser, 0);
+    return;
+  }
+  inst->server_found = true;
+
+  while (*attr) {
+    const char *name = *(attr++);
+    const char *val = *(attr++);
+
+    // parse cpus
+    if (strcmp(name, "cpus") == 0) {
+      if (parseCpuList(inst, server->cpus, val)) {
+        return;
+      }
+      server->cpus_set = true;
+      continue;
+    }
+
+    // parse sched
+    if (strcmp(name, "sched") == 0) {
+      if (strcmp(val, "other") == 0) {
+        server->sched = confSchedOther;
+        continue;
+      }
+      if (strcmp(val, "batch") == 0) {
+        server->sched = confSchedBatch;
+        continue;
+      }
+      if (strcmp(val, "idle") == 0) {
+        server->sched = confSchedIdle;
+        continue;
+      }
+      fprintf(stderr, "%s: ERROR: Invalid restServer sched %s\n", modname, val);
+      XML_StopParser(inst->parser, 0);
+      return;
+    }
+
+    // parse nice
+    if (strcmp(name, "nice") == 0) {
+      if (parseInt(inst, "restServer", name, val, -20, 19, &val_long)) {
+        return;
+      }
+      server->nice = val_long;
+      continue;
+    }
+
+    // parse mlock
+    if (strcmp(name, "mlock") == 0) {
+      if (parseBool(inst, "restServer", name, val, &server->mlock)) {
+        return;
+      }
+      continue;
+    }
+
+    // parse prefault (kB)
+    if (strcmp(name, "prefault") == 0) {
+      if (parseInt(inst, "restServer", name, val, 0, 1024 * 1024, &val_long)) {
+        return;
+      }
+      server->prefault = val_long * 1024;
+      continue;
+    }
+
+    // parse maxConnections
+    if (strcmp(name, "maxConnections") == 0) {
+      if (parseInt(inst, "restServer", name, val, 0, 65536, &val_long)) {
+        return;
+      }
+      server->max_connections = val_long;
+      continue;
+    }
+
+    // parse maxRequests
+    if (strcmp(name, "maxRequests") == 0) {
+      if (parseInt(inst, "restServer", name, val, 0, 65536, &val_long)) {
+        return;
+      }
+      server->max_requests = val_long;
+      continue;
+    }
+
+    // parse getRate
+    if (strcmp(name, "getRate") == 0) {
+      if (parseInt(inst, "restServer", name, val, 0, 1000000, &val_long)) {
+        return;
+      }
+      server->get_rate.rate = val_long;
+      continue;
+    }
+
+    // parse getBurst
+    if (strcmp(name, "getBurst") == 0) {
+      if (parseInt(inst, "restServer", name, val, 0, 1000000, &val_long)) {
+        return;
+      }
+      server->get_rate.burst = val_long;
+      continue;
+    }
+
+    // parse postRate
+    if (strcmp(name, "postRate") == 0) {
+      if (parseInt(inst, "restServer", name, val, 0, 1000000, &val_long)) {
+        return;
+      }
+      server->post_rate.rate = val_long;
+      continue;
+    }
+
+    // parse postBurst
+    if (strcmp(name, "postBurst") == 0) {
+      if (parseInt(inst, "restServer", name, val, 0, 1000000, &val_long)) {
+        return;
+      }
+      server->post_rate.burst = val_long;
+      continue;
+    }
+
+    // parse mode
+    if (strcmp(name, "mode") == 0) {
+      if (strcmp(val, "thread") == 0) {
+        server->mode = confHttpThread;
+        continue;
+      }
+      if (strcmp(val, "epoll") == 0) {
+        server->mode = confHttpEpoll;
+        continue;
+      }
+      fprintf(stderr, "%s: ERROR: Invalid restServer mode %s\n", modname, val);
+      XML_StopParser(inst->parser, 0);
+      return;
+    }
+
+    // parse threads
+    if (strcmp(name, "threads") == 0) {
+      if (parseInt(inst, "restServer", name, val, 0, 1024, &val_long)) {
+        return;
+      }
+      server->threads = val_long;
+      continue;
+    }
+
+    // parse timeout (s)
+    if (strcmp(name, "timeout") == 0) {
+      if (parseInt(inst, "restServer", name, val, 0, 86400, &val_long)) {
+        return;
+      }
+      server->timeout = val_long;
+      continue;
+    }
+
+    // parse connMemory (kB)
+    if (strcmp(name, "connMemory") == 0) {
+      if (parseInt(inst, "restServer", name, val, 0, 64 * 1024, &val_long)) {
+        return;
+      }
+      server->conn_memory = val_long * 1024;
+      continue;
+    }
+
+    // parse backlog
+    if (strcmp(name, "backlog") == 0) {
+      if (parseInt(inst, "restServer", name, val, 0, 65535, &val_long)) {
+        return;
+      }
+      server->backlog = val_long;
+      continue;
+    }
+
+    // parse noDelay
+    if (strcmp(name, "noDelay") == 0) {
+      if (parseBool(inst, "restServer", name, val, &server->nodelay)) {
+        return;
+      }
+      continue;
+    }
+
+    // parse keepAlive (idle time in s)
+    if (strcmp(name, "keepAlive") == 0) {
+      if (parseInt(inst, "restServer", name, val, 0, 32767, &val_long)) {
+        return;
+      }
+      server->keepalive = val_long;
+      continue;
+    }
+
+    // parse renderThreads (parallel rendering of large roots, 0 = off)
+    if (strcmp(name, "renderThreads") == 0) {
+      if (parseInt(inst, "restServer", name, val, 0, 64, &val_long)) {
+        return;
+      }
+      server->render_threads = val_long;
+      continue;
+    }
+
+    // parse renderThreshold (minimum items of a root to render in parallel)
+    if (strcmp(name, "renderThreshold") == 0) {
+      if (parseInt(inst, "restServer", name, val, 1, 10000000, &val_long)) {
+        return;
+      }
+      server->render_threshold = val_long;
+      continue;
+    }
+
+    // handle error
+    fprintf(stderr, "%s: ERROR: Invalid restServer attribute %s\n", modname, name);
+    XML_StopParser(inst->parser, 0);
+    return;
+  }
+
+  // worker pool only exists in epoll mode
+  if (server->threads > 0 && server->mode != confHttpEpoll) {
+    fprintf(stderr, "%s: ERROR: restServer threads requires mode epoll\n", modname);
+    XML_StopParser(inst->parser, 0);
+    return;
+  }
+}
+
+static void parseAuditLog(struct CONF_XML_INST *inst, int next, const char **attr) {
+  CONF_AUDIT_T *audit = &inst->conf->audit;
+  long val_long;
+
+  // only one audit log is allowed
+  if (inst->audit_found) {
+    fprintf(stderr, "%s: ERROR: Only one auditLog is allowed\n", modname);
+    XML_StopParser(inst->parser, 0);
+    return;
+  }
+  inst->audit_found = true;
+
+  // defaults
+  audit->max_size = 1024 * 1024;
+  audit->rotate = 4;
+  audit->ring_size = 1024;
+
+  while (*attr) {
+    const char *name = *(attr++);
+    const char *val = *(attr++);
+
+    // parse file
+    if (strcmp(name, "file") == 0) {
+      if (parseString(inst, "auditLog", name, val, &audit->file)) {
+        return;
+      }
+      continue;
+    }
+
+    // parse maxSize (kB, 0 disables rotation)
+    if (strcmp(name, "maxSize") == 0) {
+      if (parseInt(inst, "auditLog", name, val, 0, 1024 * 1024, &val_long)) {
+        return;
+      }
+      audit->max_size = val_long * 1024;
+      continue;
+    }
+
+    // parse rotate
+    if (strcmp(name, "rotate") == 0) {
+      if (parseInt(inst, "auditLog", name, val, 0, 99, &val_long)) {
+        return;
+      }
+      audit->rotate = val_long;
+      continue;
+    }
+
+    // parse ringSize
+    if (strcmp(name, "ringSize") == 0) {
+      if (parseInt(inst, "auditLog", name, val, 2, 1024 * 1024, &val_long)) {
+        return;
+      }
+      if ((val_long & (val_long - 1)) != 0) {
+        fprintf(stderr, "%s: ERROR: auditLog ringSize must be a power of two\n", modname);
+        XML_StopParser(inst->parser, 0);
+        return;
+      }
+      audit->ring_size = val_long;
+      continue;
+    }
+
+    // handle error
+    fprintf(stderr, "%s: ERROR: Invalid auditLog attribute %s\n", modname, name);
+    XML_StopParser(inst->parser, 0);
+    return;
+  }
+
+  // file is required
+  if (audit->file == NULL) {
+    fprintf(stderr, "%s: ERROR: auditLog has no file attribute\n", modname);
+    XML_StopParser(inst->parser, 0);
+    return;
+  }
+}
+
+static void parseRecorder(struct CONF_XML_INST *inst, int next, const char **attr) {
+  CONF_RECORDER_T *recorder = &inst->conf->recorder;
+  long val_long;
+
+  // only one recorder is allowed
+  if (inst->recorder_found) {
+    fprintf(stderr, "%s: ERROR: Only one recorder is allowed\n", modname);
+    XML_StopParser(inst->parser, 0);
+    return;
+  }
+  inst->recorder_found = true;
+
+  // defaults
+  recorder->rate = 100;
+  recorder->duration = 300;
+
+  while (*attr) {
+    const char *name = *(attr++);
+    const char *val = *(attr++);
+
+    // parse file
+    if (strcmp(name, "file") == 0) {
+      if (parseString(inst, "recorder", name, val, &recorder->file)) {
+        return;
+      }
+      continue;
+    }
+
+    // parse rate (Hz)
+    if (strcmp(name, "rate") == 0) {
+      if (parseInt(inst, "recorder", name, val, 1, 10000, &val_long)) {
+        return;
+      }
+      recorder->rate = val_long;
+      continue;
+    }
+
+    // parse duration (s)
+    if (strcmp(name, "duration") == 0) {
+      if (parseInt(inst, "recorder", name, val, 1, 86400, &val_long)) {
+        return;
+      }
+      recorder->duration = val_long;
+      continue;
+    }
+
+    // parse roots (comma separated, default all)
+    if (strcmp(name, "roots") == 0) {
+      if (parseString(inst, "recorder", name, val, &recorder->roots)) {
+        return;
+      }
+      continue;
+    }
+
+    // handle error
+    fprintf(stderr, "%s: ERROR: Invalid recorder attribute %s\n", modname, name);
+    XML_StopParser(inst->parser, 0);
+    return;
+  }
+
+  // file is required
+  if (recorder->file == NULL) {
+    fprintf(stderr, "%s: ERROR: recorder has no file attribute\n", modname);
+    XML_StopParser(inst->parser, 0);
+    return;
+  }
+  // recording and replaying at once makes no sense
+  if (inst->replay_found) {
+    fprintf(stderr, "%s: ERROR: recorder and replay can not be used together\n", modname);
+    XML_StopParser(inst->parser, 0);
+    return;
+  }
+}
+
+static void parseReplay(struct CONF_XML_INST *inst, int next, const char **attr) {
+  CONF_REPLAY_T *replay = &inst->conf->replay;
+
+  // only one replay is allowed
+  if (inst->replay_found) {
+    fprintf(stderr, "%s: ERROR: Only one replay is allowed\n", modname);
+    XML_StopParser(inst->parser, 0);
+    return;
+  }
+  inst->replay_found = true;
+
+  while (*attr) {
+    const char *name = *(attr++);
+    const char *val = *(attr++);
+
+    // parse file
+    if (strcmp(name, "file") == 0) {
+      if (parseString(inst, "replay", name, val, &replay->file)) {
+        return;
+      }
+      continue;
+    }
+
+    // parse loop
+    if (strcmp(name, "loop") == 0) {
+      if (parseBool(inst, "replay", name, val, &replay->loop)) {
+        return;
+      }
+      continue;
+    }
+
+    // handle error
+    fprintf(stderr, "%s: ERROR: Invalid replay attribute %s\n", modname, name);
+    XML_StopParser(inst->parser, 0);
+    return;
+  }
+
+  // file is required
+  if (replay->file == NULL) {
+    fprintf(stderr, "%s: ERROR: replay has no file attribute\n", modname);
+    XML_StopParser(inst->parser, 0);
+    return;
+  }
+
+  // recording and replaying at once makes no sense
+  if (inst->recorder_found) {
+    fprintf(stderr, "%s: ERROR: recorder and replay can not be used together\n", modname);
+    XML_StopParser(inst->parser, 0);
+    return;
+  }
+}
+
+static void parseShmPublisher(struct CONF_XML_INST *inst, int next, const char **attr) {
+  CONF_SHMPUB_T *shmpub = &inst->conf->shmpub;
+  long val_long;
+
+  // only one publisher is allowed
+  if (inst->shmpub_found) {
+    fprintf(stderr, "%s: ERROR: Only one shmPublisher is allowed\n", modname);
+    XML_StopParser(inst->parser, 0);
+    return;
+  }
+  inst->shmpub_found = true;
+
+  // defaults
+  shmpub->rate = 100;
+
+  while (*attr) {
+    const char *name = *(attr++);
+    const char *val = *(attr++);
+
+    // parse name
+    if (strcmp(name, "name") == 0) {
+      if (val[0] != '/' || strchr(val + 1, '/') != NULL) {
+        fprintf(stderr, "%s: ERROR: Invalid shmPublisher name %s\n", modname, val);
+        XML_StopParser(inst->parser, 0);
+        return;
+      }
+      if (parseString(inst, "shmPublisher", name, val, &shmpub->name)) {
+        return;
+      }
+      continue;
+    }
+
+    // parse rate (Hz)
+    if (strcmp(name, "rate") == 0) {
+      if (parseInt(inst, "shmPublisher", name, val, 1, 10000, &val_long)) {
+        return;
+      }
+      shmpub->rate = val_long;
+      continue;
+    }
+
+    // parse roots (comma separated, default all)
+    if (strcmp(name, "roots") == 0) {
+      if (parseString(inst, "shmPublisher", name, val, &shmpub->roots)) {
+        return;
+      }
+      continue;
+    }
+
+    // handle error
+    fprintf(stderr, "%s: ERROR: Invalid shmPublisher attribute %s\n", modname, name);
+    XML_StopParser(inst->parser, 0);
+    return;
+  }
+
+  // default segment name
+  if (shmpub->name == NULL && parseString(inst, "shmPublisher", "name", "/lcrest", &shmpub->name)) {
+    return;
+  }
+}
+
+static void parseUdpPublisher(struct CONF_XML_INST *inst, int next, const char **attr) {
+  CONF_UDPPUB_T *udppub = &inst->conf->udppub;
+  struct in_addr addr;
+  long val_long;
+
+  // only one publisher is allowed
+  if (inst->udppub_found) {
+    fprintf(stderr, "%s: ERROR: Only one udpPublisher is allowed\n", modname);
+    XML_StopParser(inst->parser, 0);
+    return;
+  }
+  inst->udppub_found = true;
+
+  // defaults
+  udppub->port = 5555;
+  udppub->rate = 50;
+  udppub->ttl = 1;
+
+  while (*attr) {
+    const char *name = *(attr++);
+    const char *val = *(attr++);
+
+    // parse group
+    if (strcmp(name, "group") == 0) {
+      if (inet_pton(AF_INET, val, &addr) != 1 || !IN_MULTICAST(ntohl(addr.s_addr))) {
+        fprintf(stderr, "%s: ERROR: Invalid udpPublisher group %s\n", modname, val);
+        XML_StopParser(inst->parser, 0);
+        return;
+      }
+      if (parseString(inst, "udpPublisher", name, val, &udppub->group)) {
+        return;
+      }
+      continue;
+    }
+
+    // parse port
+    if (strcmp(name, "port") == 0) {
+      if (parseInt(inst, "udpPublisher", name, val, 1, 65535, &val_long)) {
+        return;
+      }
+      udppub->port = val_long;
+      continue;
+    }
+
+    // parse rate (Hz)
+    if (strcmp(name, "rate") == 0) {
+      if (parseInt(inst, "udpPublisher", name, val, 1, 1000, &val_long)) {
+        return;
+      }
+      udppub->rate = val_long;
+      continue;
+    }
+
+    // parse ttl
+    if (strcmp(name, "ttl") == 0) {
+      if (parseInt(inst, "udpPublisher", name, val, 0, 255, &val_long)) {
+        return;
+      }
+      udppub->ttl = val_long;
+      continue;
+    }
+
+    // parse interface
+    if (strcmp(name, "interface") == 0) {
+      if (inet_pton(AF_INET, val, &addr) != 1) {
+        fprintf(stderr, "%s: ERROR: Invalid udpPublisher interface %s\n", modname, val);
+        XML_StopParser(inst->parser, 0);
+        return;
+      }
+      if (parseString(inst, "udpPublisher", name, val, &udppub->interface)) {
+        return;
+      }
+      continue;
+    }
+
+    // parse roots (comma separated, default all)
+    if (strcmp(name, "roots") == 0) {
+      if (parseString(inst, "udpPublisher", name, val, &udppub->roots)) {
+        return;
+      }
+      continue;
+    }
+
+    // parse format
+    if (strcmp(name, "format") == 0) {
+      if (strcmp(val, "binary") == 0) {
+        udppub->json = false;
+        continue;
+      }
+      if (strcmp(val, "json") == 0) {
+        udppub->json = true;
+        continue;
+      }
+      fprintf(stderr, "%s: ERROR: Invalid udpPublisher format %s\n", modname, val);
+      XML_StopParser(inst->parser, 0);
+      return;
+    }
+
+    // handle error
+    fprintf(stderr, "%s: ERROR: Invalid udpPublisher attribute %s\n", modname, name);
+    XML_StopParser(inst->parser, 0);
+    return;
+  }
+
+  // group is required
+  if (udppub->group == NULL) {
+    fprintf(stderr, "%s: ERROR: udpPublisher has no group attribute\n", modname);
+    XML_StopParser(inst->parser, 0);
+    return;
+  }
+}
+
+static void parseCapture(struct CONF_XML_INST *inst, int next, const char **attr) {
+  CONF_CAPTURE_T *capture = &inst->conf->capture;
+  long val_long;
+
+  // only one capture section is allowed
+  if (inst->capture_found) {
+    fprintf(stderr, "%s: ERROR: Only one capture is allowed\n", modname);
+    XML_StopParser(inst->parser, 0);
+    return;
+  }
+  inst->capture_found = true;
+
+  // defaults
+  capture->rate = 1000;
+  capture->samples = 8192;
+  capture->channels = 16;
+
+  while (*attr) {
+    const char *name = *(attr++);
+    const char *val = *(attr++);
+
+    // parse rate (Hz)
+    if (strcmp(name, "rate") == 0) {
+      if (parseInt(inst, "capture", name, val, 1, 10000, &val_long)) {
+        return;
+      }
+      capture->rate = val_long;
+      continue;
+    }
+
+    // parse samples (ring size)
+    if (strcmp(name, "samples") == 0) {
+      if (parseInt(inst, "capture", name, val, 2, 1000000, &val_long)) {
+        return;
+      }
+      capture->samples = val_long;
+      continue;
+    }
+
+    // parse channels (max per capture)
+    if (strcmp(name, "channels") == 0) {
+      if (parseInt(inst, "capture", name, val, 1, 256, &val_long)) {
+        return;
+      }
+      capture->channels = val_long;
+      continue;
+    }
+
+    // handle error
+    fprintf(stderr, "%s: ERROR: Invalid capture attribute %s\n", modname, name);
+    XML_StopParser(inst->parser, 0);
+    return;
+  }
+}
+
+static void parsePlugin(struct CONF_XML_INST *inst, int next, const char **attr) {
+  CONF_PLUGIN_T *plugin;
+  CONF_PLUGIN_T **tail;
+
+  // plugins are loaded in config order
+  for (tail = &inst->conf->plugins; *tail != NULL; tail = &(*tail)->next);
+
+  plugin = calloc(1, sizeof(CONF_PLUGIN_T));
+  if (plugin == NULL) {
+    fprintf(stderr, "%s: ERROR: unable to alloc memory for plugin\n", modname);
+    XML_StopParser(inst->parser, 0);
+    return;
+  }
+  *tail = plugin;
+
+  while (*attr) {
+    const char *name = *(attr++);
+    const char *val = *(attr++);
+
+    // parse file
+    if (strcmp(name, "file") == 0) {
+      if (parseString(inst, "plugin", name, val, &plugin->file)) {
+        return;
+      }
+      continue;
+    }
+
+    // parse arg (passed to the plugin as is)
+    if (strcmp(name, "arg") == 0) {
+      if (parseString(inst, "plugin", name, val, &plugin->arg)) {
+        return;
+      }
+      continue;
+    }
+
+    // handle error
+    fprintf(stderr, "%s: ERROR: Invalid plugin attribute %s\n", modname, name);
+    XML_StopParser(inst->parser, 0);
+    return;
+  }
+
+  // file is required
+  if (plugin->file == NULL || plugin->file[0] == 0) {
+    fprintf(stderr, "%s: ERROR: plugin has no/empty file attribute\n", modname);
+    XML_StopParser(inst->parser, 0);
+    return;
+  }
+}
+
+static void parseSequencer(struct CONF_XML_INST *inst, int next, const char **attr) {
+  CONF_SEQ_T *seq = &inst->conf->seq;
+  long val_long;
+
+  // only one sequencer section is allowed
+  if (inst->seq_found) {
+    fprintf(stderr, "%s: ERROR: Only one sequencer is allowed\n", modname);
+    XML_StopParser(inst->parser, 0);
+    return;
+  }
+  inst->seq_found = true;
+
+  // defaults
+  seq->rate = 100;
+  seq->jobs = 16;
+  seq->steps = 64;
+
+  while (*attr) {
+    const char *name = *(attr++);
+    const char *val = *(attr++);
+
+    // parse rate (Hz)
+    if (strcmp(name, "rate") == 0) {
+      if (parseInt(inst, "sequencer", name, val, 1, 10000, &val_long)) {
+        return;
+      }
+      seq->rate = val_long;
+      continue;
+    }
+
+    // parse jobs (max concurrent)
+    if (strcmp(name, "jobs") == 0) {
+      if (parseInt(inst, "sequencer", name, val, 1, 1024, &val_long)) {
+        return;
+      }
+      seq->jobs = val_long;
+      continue;
+    }
+
+    // parse steps (max per job)
+    if (strcmp(name, "steps") == 0) {
+      if (parseInt(inst, "sequencer", name, val, 1, 10000, &val_long)) {
+        return;
+      }
+      seq->steps = val_long;
+      continue;
+    }
+
+    // handle error
+    fprintf(stderr, "%s: ERROR: Invalid sequencer attribute %s\n", modname, name);
+    XML_StopParser(inst->parser, 0);
+    return;
+  }
+}
+
+static void parseEvents(struct CONF_XML_INST *inst, int next, const char **attr) {
+  CONF_EVENTS_T *events = &inst->conf->events;
+  long val_long;
+
+  // only one events section is allowed
+  if (inst->events_found) {
+    fprintf(stderr, "%s: ERROR: Only one events is allowed\n", modname);
+    XML_StopParser(inst->parser, 0);
+    return;
+  }
+  inst->events_found = true;
+
+  // defaults
+  events->rate = 1000;
+  events->size = 4096;
+
+  while (*attr) {
+    const char *name = *(attr++);
+    const char *val = *(attr++);
+
+    // parse rate (Hz)
+    if (strcmp(name, "rate") == 0) {
+      if (parseInt(inst, "events", name, val, 1, 10000, &val_long)) {
+        return;
+      }
+      events->rate = val_long;
+      continue;
+    }
+
+    // parse size (journal entries)
+    if (strcmp(name, "size") == 0) {
+      if (parseInt(inst, "events", name, val, 16, 1000000, &val_long)) {
+        return;
+      }
+      events->size = val_long;
+      continue;
+    }
+
+    // handle error
+    fprintf(stderr, "%s: ERROR: Invalid events attribute %s\n", modname, name);
+    XML_StopParser(inst->parser, 0);
+    return;
+  }
+}
+
+static void parseStatic(struct CONF_XML_INST *inst, int next, const char **attr) {
+  CONF_STATIC_T *stat = &inst->conf->stat;
+  long val_long;
+
+  // only one static section is allowed
+  if (inst->static_found) {
+    fprintf(stderr, "%s: ERROR: Only one static is allowed\n", modname);
+    XML_StopParser(inst->parser, 0);
+    return;
+  }
+  inst->static_found = true;
+
+  // defaults
+  stat->max_age = 86400;
+
+  while (*attr) {
+    const char *name = *(attr++);
+    const char *val = *(attr++);
+
+    // parse dir
+    if (strcmp(name, "dir") == 0) {
+      if (parseString(inst, "static", name, val, &stat->dir)) {
+        return;
+      }
+      continue;
+    }
+
+    // parse url (prefix without trailing slash, must not be the server root)
+    if (strcmp(name, "url") == 0) {
+      if (val[0] != '/' || val[strlen(val) - 1] == '/' || strcmp(val, "/hal") == 0) {
+        fprintf(stderr, "%s: ERROR: Invalid static url %s\n", modname, val);
+        XML_StopParser(inst->parser, 0);
+        return;
+      }
+      if (parseString(inst, "static", name, val, &stat->url)) {
+        return;
+      }
+      continue;
+    }
+
+    // parse index (served for the prefix itself)
+    if (strcmp(name, "index") == 0) {
+      if (parseString(inst, "static", name, val, &stat->index)) {
+        return;
+      }
+      continue;
+    }
+
+    // parse maxAge (s)
+    if (strcmp(name, "maxAge") == 0) {
+      if (parseInt(inst, "static", name, val, 0, 31536000, &val_long)) {
+        return;
+      }
+      stat->max_age = val_long;
+      continue;
+    }
+
+    // handle error
+    fprintf(stderr, "%s: ERROR: Invalid static attribute %s\n", modname, name);
+    XML_StopParser(inst->parser, 0);
+    return;
+  }
+
+  // dir is required
+  if (stat->dir == NULL || stat->dir[0] == 0) {
+    fprintf(stderr, "%s: ERROR: static has no/empty dir attribute\n", modname);
+    XML_StopParser(inst->parser, 0);
+    return;
+  }
+
+  // defaults for strings
+  if ((stat->url == NULL && parseString(inst, "static", "url", "/hmi", &stat->url)) ||
+      (stat->index == NULL && parseString(inst, "static", "index", "index.html", &stat->index))) {
+    return;
+  }
+}
+
+static void parseMetrics(struct CONF_XML_INST *inst, int next, const char **attr) {
+  CONF_METRICS_T *metrics = &inst->conf->metrics;
+
+  // only one metrics section is allowed
+  if (inst->metrics_found) {
+    fprintf(stderr, "%s: ERROR: Only one metrics is allowed\n", modname);
+    XML_StopParser(inst->parser, 0);
+    return;
+  }
+  inst->metrics_found = true;
+
+  while (*attr) {
+    const char *name = *(attr++);
+    const char *val = *(attr++);
+
+    // parse prefix (metric name prefix)
+    if (strcmp(name, "prefix") == 0) {
+      if (val[0] == 0 || isdigit((unsigned char) val[0]) || val[strspn(val, "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_:")] != 0) {
+        fprintf(stderr, "%s: ERROR: Invalid metrics prefix %s\n", modname, val);
+        XML_StopParser(inst->parser, 0);
+        return;
+      }
+      if (parseString(inst, "metrics", name, val, &metrics->prefix)) {
+        return;
+      }
+      continue;
+    }
+
+    // parse roots (comma separated, default all)
+    if (strcmp(name, "roots") == 0) {
+      if (parseString(inst, "metrics", name, val, &metrics->roots)) {
+        return;
+      }
+      continue;
+    }
+
+    // handle error
+    fprintf(stderr, "%s: ERROR: Invalid metrics attribute %s\n", modname, name);
+    XML_StopParser(inst->parser, 0);
+    return;
+  }
+
+  // defaults for strings
+  if (metrics->prefix == NULL && parseString(inst, "metrics", "prefix", "lcrest", &metrics->prefix)) {
+    return;
+  }
+}
+
+static void parseRtSampler(struct CONF_XML_INST *inst, int next, const char **attr) {
+  CONF_RT_T *rt = &inst->conf->rt;
+  long val_long;
+
+  // only one rtSampler section is allowed
+  if (inst->rt_found) {
+    fprintf(stderr, "%s: ERROR: Only one rtSampler is allowed\n", modname);
+    XML_StopParser(inst->parser, 0);
+    return;
+  }
+  inst->rt_found = true;
+
+  // defaults
+  rt->slots = 64;
+  rt->writes = true;
+
+  while (*attr) {
+    const char *name = *(attr++);
+    const char *val = *(attr++);
+
+    // parse comp (HAL name of the lcrest_rt component)
+    if (strcmp(name, "comp") == 0) {
+      if (parseString(inst, "rtSampler", name, val, &rt->comp)) {
+        return;
+      }
+      continue;
+    }
+
+    // parse slots (ring size, power of two)
+    if (strcmp(name, "slots") == 0) {
+      if (parseInt(inst, "rtSampler", name, val, 2, 65536, &val_long)) {
+        return;
+      }
+      if ((val_long & (val_long - 1)) != 0) {
+        fprintf(stderr, "%s: ERROR: rtSampler slots %ld is not a power of two\n", modname, val_long);
+        XML_StopParser(inst->parser, 0);
+        return;
+      }
+      rt->slots = val_long;
+      continue;
+    }
+
+    // parse roots (comma separated, default all)
+    if (strcmp(name, "roots") == 0) {
+      if (parseString(inst, "rtSampler", name, val, &rt->roots)) {
+        return;
+      }
+      continue;
+    }
+
+    // parse writes (apply POST requests through the RT command ring)
+    if (strcmp(name, "writes") == 0) {
+      if (parseBool(inst, "rtSampler", name, val, &rt->writes)) {
+        return;
+      }
+      continue;
+    }
+
+    // handle error
+    fprintf(stderr, "%s: ERROR: Invalid rtSampler attribute %s\n", modname, name);
+    XML_StopParser(inst->parser, 0);
+    return;
+  }
+
+  // defaults for strings
+  if (rt->comp == NULL && parseString(inst, "rtSampler", "comp", "lcrest-rt", &rt->comp)) {
+    return;
+  }
+}
+
+static void conf_free_json(CONF_JSON_ITEM_T *json, bool parent_cloned) {
+  CONF_JSON_ITEM_T *json_next;
+  bool cloned;
+
+  while (json != NULL) {
+    // get next
+    json_next = json->next;
+    cloned = parent_cloned || (json->array_index > 0);
+
+    // free childs
+    conf_free_json(json->childs, cloned);
+
+    // free name only on first instance, since they are reused
+    if (!cloned) {
+      free(json->name);
+      if (json->type == confTypeJsonRef) {
+        free(json->hal.ref.target);
+      }
+      if (json->type == confTypeJsonComputed) {
+        free(json->hal.computed.expr);
+      }
+    }
+
+    // compiled code is per instance
+    if (json->type == confTypeJsonComputed) {
+      expr_free(json->hal.computed.code);
+    }
+
+    // free object
+    free(json);
+
+    // process next
+    json = json_next;
+  }
+}
+
+CONF_ROOT_T *conf_parse(const char *filename) {
+  CONF_ROOT_T *ret = NULL;
+  int done;
+  char buffer[BUFFSIZE];
+  FILE *file;
+  CONF_XML_INST_T inst;
+  CONF_JSON_ITEM_T *json;
+  int root_index;
+
+  // open file
+  file = fopen(filename, "r");
+  if (file == NULL) {
+    fprintf(stderr, "%s: ERROR: unable to open config file %s\n", modname, filename);
+    goto fail0;
+  }
+
+  // create xml parser
+  memset(&inst, 0, sizeof(inst));
+  if (initXmlInst((CONF_XML_INST_T *) &inst, xml_states)) {
+    fprintf(stderr, "%s: ERROR: Couldn't allocate memory for parser\n", modname);
+    goto fail1;
+  }
+
+  // allocate conf header
+  inst.conf = calloc(1, sizeof(CONF_ROOT_T));
+  if (inst.conf == NULL) {
+    fprintf(stderr, "%s: ERROR: Couldn't allocate memory for conf header\n", modname);
+    goto fail2;
+  }
+
+  inst.json_array_factor = 1;
+  for (done=0; !done;) {
+    // read block
+    int len = fread(buffer, 1, BUFFSIZE, file);
+    if (ferror(file)) {
+      fprintf(stderr, "%s: ERROR: Couldn't read from file %s\n", modname, filename);
+      goto fail3;
+    }
+
+    // check for EOF
+    done = feof(file);
 
     // parse current block
     if (!XML_Parse(inst.parser, buffer, len, done)) {
@@ -681,6 +2172,17 @@ CONF_ROOT_T *conf_parse(const char *filename) {
     }
   }
 
+  // number items per root in tree order (including array copies)
+  for (json = inst.conf->json, root_index = 0; json != NULL; json = json->next, root_index++) {
+    json->root_index = root_index;
+    json->item_count = numberJsonItems(json->childs, 0);
+  }
+
+  // compile computed fields
+  if (compileJsonComputed(inst.conf->json)) {
+    goto fail3;
+  }
+
   // everything is fine
   ret = inst.conf;
   inst.conf = NULL;
@@ -696,11 +2198,79 @@ fail0:
 }
 
 void conf_free(CONF_ROOT_T *conf) {
+  CONF_PLUGIN_T *plugin;
+
   if (conf == NULL) {
     return;
   }
 
   conf_free_json(conf->json, false);
+  free(conf->audit.file);
+  free(conf->recorder.file);
+  free(conf->recorder.roots);
+  free(conf->replay.file);
+  free(conf->shmpub.name);
+  free(conf->shmpub.roots);
+  free(conf->udppub.group);
+  free(conf->udppub.interface);
+  free(conf->udppub.roots);
+  free(conf->stat.dir);
+  free(conf->stat.url);
+  free(conf->stat.index);
+  free(conf->metrics.prefix);
+  free(conf->metrics.roots);
+  free(conf->rt.comp);
+  free(conf->rt.roots);
+  while (conf->plugins != NULL) {
+    plugin = conf->plugins;
+    conf->plugins = plugin->next;
+    free(plugin->file);
+    free(plugin->arg);
+    free(plugin);
+  }
   free(conf);
 }
 
+int conf_get_item_path(CONF_JSON_ITEM_T *json, char *buf, size_t size) {
+  int len = 0;
+  int n;
+
+  // path of parent first, root has no prefix
+  if (json->parent != NULL) {
+    len = conf_get_item_path(json->parent, buf, size);
+    if (len < 0) {
+      return -1;
+    }
+  }
+
+  if (json->type == confTypeJsonArray) {
+    n = snprintf(buf + len, size - len, "%s%s[%d]", (len > 0) ? "." : "", json->name, json->array_index);
+  } else {
+    n = snprintf(buf + len, size - len, "%s%s", (len > 0) ? "." : "", json->name);
+  }
+  if (n < 0 || (size_t) n >= size - len) {
+    return -1;
+  }
+
+  return len + n;
+}
+
+
+bool conf_is_root_selected(const char *roots, const char *name) {
+  size_t len = strlen(name);
+  const char *pos, *end;
+
+  // no list selects all roots
+  if (roots == NULL) {
+    return true;
+  }
+
+  for (pos = roots; *pos != 0; pos = (*end != 0) ? end + 1 : end) {
+    end = pos + strcspn(pos, ",");
+    if ((size_t) (end - pos) == len && strncmp(pos, name, len) == 0) {
+      return true;
+    }
+  }
+
+  return false;
+}
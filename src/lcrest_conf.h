@@ -12,11 +12,28 @@ typedef enum {
   confTypeJsonRoot,
   confTypeJsonPin,
   confTypeJsonParam,
+  confTypeJsonRef,
+  confTypeJsonComputed,
   confTypeJsonObject,
-  confTypeJsonArray
+  confTypeJsonArray,
+  confTypeRestServer,
+  confTypeAuditLog,
+  confTypeRecorder,
+  confTypeReplay,
+  confTypeShmPublisher,
+  confTypeUdpPublisher,
+  confTypeCapture,
+  confTypePlugin,
+  confTypeSequencer,
+  confTypeEvents,
+  confTypeStatic,
+  confTypeMetrics,
+  confTypeRtSampler
 } CONF_TYPE_T;
 
 #define CONF_TYPE_IS_CONTAINER(t) (t == confTypeJsonRoot || t == confTypeJsonObject || t == confTypeJsonArray)
+#define CONF_TYPE_IS_HAL(t) (t == confTypeJsonPin || t == confTypeJsonParam || t == confTypeJsonRef)
+#define CONF_TYPE_IS_LEAF(t) (CONF_TYPE_IS_HAL(t) || t == confTypeJsonComputed)
 
 typedef union {
   void *ptr;
@@ -42,13 +59,37 @@ typedef union {
 typedef struct {
   hal_pin_dir_t dir;
   CONF_JSON_HAL_PIN_PTR_T ptr;
+  void *obj;
 } CONF_JSON_HAL_PIN_T;
 
+typedef enum {
+  confRefPin = 0,
+  confRefSignal,
+  confRefParam
+} CONF_JSON_HAL_REF_TYPE_T;
+
+typedef struct {
+  char *target;
+  bool writable;
+  CONF_JSON_HAL_REF_TYPE_T type;
+  void *obj;
+  CONF_JSON_HAL_PARAM_PTR_T ptr;
+} CONF_JSON_HAL_REF_T;
+
+struct EXPR;
+
+typedef struct {
+  char *expr;
+  struct EXPR *code;
+} CONF_JSON_HAL_COMPUTED_T;
+
 typedef struct {
   hal_type_t type;
   union {
     CONF_JSON_HAL_PARAM_T param;
     CONF_JSON_HAL_PIN_T pin;
+    CONF_JSON_HAL_REF_T ref;
+    CONF_JSON_HAL_COMPUTED_T computed;
   };
 } CONF_JSON_HAL_T;
 
@@ -61,15 +102,157 @@ typedef struct CONF_JSON_ITEM {
   CONF_JSON_HAL_T hal;
   int array_size;
   int array_index;
+  int item_index;
+  int item_count;
+  int root_index;
+  int precision;
+  bool event;
+  size_t snap_offset;
+  size_t snap_size;
+  volatile void *local_ptr;
 } CONF_JSON_ITEM_T;
 
+#define CONF_SERVER_MAX_CPUS 1024
+
+typedef enum {
+  confSchedOther = 0,
+  confSchedBatch,
+  confSchedIdle
+} CONF_SCHED_T;
+
+typedef struct {
+  unsigned int rate;
+  unsigned int burst;
+} CONF_RATE_T;
+
+typedef enum {
+  confHttpThread = 0,
+  confHttpEpoll
+} CONF_HTTP_MODE_T;
+
+typedef struct {
+  bool cpus_set;
+  uint64_t cpus[CONF_SERVER_MAX_CPUS / 64];
+  CONF_SCHED_T sched;
+  int nice;
+  bool mlock;
+  size_t prefault;
+  unsigned int max_connections;
+  unsigned int max_requests;
+  CONF_RATE_T get_rate;
+  CONF_RATE_T post_rate;
+  CONF_HTTP_MODE_T mode;
+  unsigned int threads;
+  unsigned int timeout;
+  size_t conn_memory;
+  unsigned int backlog;
+  bool nodelay;
+  unsigned int keepalive;
+  unsigned int render_threads;
+  unsigned int render_threshold;
+} CONF_SERVER_T;
+
+typedef struct {
+  char *file;
+  size_t max_size;
+  int rotate;
+  size_t ring_size;
+} CONF_AUDIT_T;
+
+typedef struct {
+  char *file;
+  int rate;
+  int duration;
+  char *roots;
+} CONF_RECORDER_T;
+
+typedef struct {
+  char *file;
+  bool loop;
+} CONF_REPLAY_T;
+
+typedef struct {
+  char *name;
+  int rate;
+  char *roots;
+} CONF_SHMPUB_T;
+
+typedef struct {
+  char *group;
+  int port;
+  int rate;
+  int ttl;
+  char *interface;
+  char *roots;
+  bool json;
+} CONF_UDPPUB_T;
+
+typedef struct {
+  int rate;
+  int samples;
+  int channels;
+} CONF_CAPTURE_T;
+
+typedef struct {
+  int rate;
+  int jobs;
+  int steps;
+} CONF_SEQ_T;
+
+typedef struct {
+  int rate;
+  int size;
+} CONF_EVENTS_T;
+
+typedef struct {
+  char *dir;
+  char *url;
+  char *index;
+  int max_age;
+} CONF_STATIC_T;
+
+typedef struct {
+  char *prefix;
+  char *roots;
+} CONF_METRICS_T;
+
+typedef struct {
+  char *comp;
+  int slots;
+  char *roots;
+  bool writes;
+} CONF_RT_T;
+
+typedef struct CONF_PLUGIN {
+  struct CONF_PLUGIN *next;
+  char *file;
+  char *arg;
+} CONF_PLUGIN_T;
+
 typedef struct CONF_ROOT {
   CONF_JSON_ITEM_T *json;
   size_t json_hal_size;
+  void *json_hal_data;
+  CONF_SERVER_T server;
+  CONF_AUDIT_T audit;
+  CONF_RECORDER_T recorder;
+  CONF_REPLAY_T replay;
+  CONF_SHMPUB_T shmpub;
+  CONF_UDPPUB_T udppub;
+  CONF_CAPTURE_T capture;
+  CONF_SEQ_T seq;
+  CONF_EVENTS_T events;
+  CONF_STATIC_T stat;
+  CONF_METRICS_T metrics;
+  CONF_RT_T rt;
+  CONF_PLUGIN_T *plugins;
 } CONF_ROOT_T;
 
 CONF_ROOT_T *conf_parse(const char *filename);
 void conf_free(CONF_ROOT_T *conf);
 
+int conf_get_item_path(CONF_JSON_ITEM_T *json, char *buf, size_t size);
+bool conf_is_root_selected(const char *roots, const char *name);
+
 #endif
 
@@ -0,0 +1,1174 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "lcrest.h"
+#include "lcrest_conf.h"
+#include "lcrest_hal.h"
+#include "lcrest_decode.h"
+#include "lcrest_path.h"
+#include "lcrest_rt.h"
+
+// same limit as jansson
+#define DECODE_MAX_DEPTH 2048
+#define DECODE_NUMBER_BUFSIZE 64
+#define DECODE_MAX_COLUMN_DIMS 32
+
+// The request body is tokenized in a single pass. Keys are matched against
+// the config tree while reading and leaf values are stored in a write slot
+// per config item, so memory use only depends on the config. Nothing is
+// written to HAL before the whole body has been validated.
+typedef struct {
+  const char *pos;
+  const char *end;
+  int line;
+  int depth;
+  const char *error;
+  DECODE_WRITE_T *writes;
+} DECODE_PARSER_T;
+
+typedef struct {
+  DECODE_REQUEST_T *req;
+  HAL_VALUE_T val;
+  bool failed;
+} DECODE_EXPECT_CTX_T;
+
+static int fail(DECODE_PARSER_T *p, const char *error);
+static void skip_ws(DECODE_PARSER_T *p);
+static int expect_char(DECODE_PARSER_T *p, char c);
+static int parse_hex4(DECODE_PARSER_T *p, unsigned int *cp);
+static void put_char(char *out, size_t out_size, size_t *n, char c);
+static int parse_utf8(DECODE_PARSER_T *p, char *out, size_t out_size, size_t *n);
+static int parse_string(DECODE_PARSER_T *p, char *out, size_t out_size, bool *truncated);
+static int parse_number(DECODE_PARSER_T *p, HAL_VALUE_T *val);
+static int parse_literal(DECODE_PARSER_T *p, const char *lit);
+static int parse_value(DECODE_PARSER_T *p, CONF_JSON_ITEM_T *json);
+static int parse_object(DECODE_PARSER_T *p, CONF_JSON_ITEM_T *list);
+static int parse_array(DECODE_PARSER_T *p, CONF_JSON_ITEM_T *json);
+static int parse_column_values(DECODE_PARSER_T *p, CONF_JSON_ITEM_T **items, int n, const int *dims, int ndims);
+static int decode_base64_char(char c);
+static int parse_column_bits(DECODE_PARSER_T *p, CONF_JSON_ITEM_T **items, int n);
+static int parse_columns(DECODE_PARSER_T *p, CONF_JSON_ITEM_T **cur, int n, const int *dims, int ndims);
+static int parse_column_array(DECODE_PARSER_T *p, CONF_JSON_ITEM_T **cur, int n, const int *dims, int ndims);
+
+static CONF_JSON_ITEM_T *find_conf_item(const char *key, CONF_JSON_ITEM_T *list);
+static int get_subtree_end(CONF_JSON_ITEM_T *json);
+static void clear_writes(DECODE_PARSER_T *p, CONF_JSON_ITEM_T *json);
+
+static void add_expect(CONF_JSON_ITEM_T *json, void *data);
+static int parse_expect_value(const char *str, size_t len, HAL_VALUE_T *val);
+static bool check_expect(const DECODE_EXPECT_T *expect);
+
+// serializes precondition checks and writes of all requests
+static pthread_mutex_t apply_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int fail(DECODE_PARSER_T *p, const char *error) {
+  if (p->error == NULL) {
+    p->error = error;
+  }
+  return -1;
+}
+
+static void skip_ws(DECODE_PARSER_T *p) {
+  for (; p->pos < p->end; p->pos++) {
+    switch (*p->pos) {
+      case '\n':
+        p->line++;
+        break;
+      case ' ':
+      case '\t':
+      case '\r':
+        break;
+      default:
+        return;
+    }
+  }
+}
+
+static int expect_char(DECODE_PARSER_T *p, char c) {
+  skip_ws(p);
+  if (p->pos >= p->end) {
+    return fail(p, "premature end of input");
+  }
+  if (*p->pos != c) {
+    return fail(p, "unexpected token");
+  }
+  p->pos++;
+  return 0;
+}
+
+static int parse_hex4(DECODE_PARSER_T *p, unsigned int *cp) {
+  int i;
+  char c;
+
+  if (p->end - p->pos < 4) {
+    return fail(p, "premature end of input");
+  }
+
+  *cp = 0;
+  for (i = 0; i < 4; i++) {
+    c = *(p->pos++);
+    *cp <<= 4;
+    if (c >= '0' && c <= '9') {
+      *cp |= c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+      *cp |= c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+      *cp |= c - 'A' + 10;
+    } else {
+      return fail(p, "invalid escape");
+    }
+  }
+
+  return 0;
+}
+
+static void put_char(char *out, size_t out_size, size_t *n, char c) {
+  if (out != NULL && *n < out_size) {
+    out[*n] = c;
+  }
+  (*n)++;
+}
+
+static int parse_utf8(DECODE_PARSER_T *p, char *out, size_t out_size, size_t *n) {
+  const unsigned char *s = (const unsigned char *) p->pos;
+  unsigned int cp;
+  int len, i;
+
+  if (s[0] < 0xc2 || s[0] > 0xf4) {
+    return fail(p, "invalid UTF-8");
+  }
+  if (s[0] < 0xe0) {
+    len = 2;
+    cp = s[0] & 0x1f;
+  } else if (s[0] < 0xf0) {
+    len = 3;
+    cp = s[0] & 0x0f;
+  } else {
+    len = 4;
+    cp = s[0] & 0x07;
+  }
+
+  if (p->end - p->pos < len) {
+    return fail(p, "invalid UTF-8");
+  }
+  for (i = 1; i < len; i++) {
+    if ((s[i] & 0xc0) != 0x80) {
+      return fail(p, "invalid UTF-8");
+    }
+    cp = (cp << 6) | (s[i] & 0x3f);
+  }
+
+  // reject overlong encodings, surrogates and out of range code points
+  if ((len == 3 && cp < 0x800) || (len == 4 && cp < 0x10000) || cp > 0x10ffff || (cp >= 0xd800 && cp <= 0xdfff)) {
+    return fail(p, "invalid UTF-8");
+  }
+
+  for (i = 0; i < len; i++) {
+    put_char(out, out_size, n, p->pos[i]);
+  }
+  p->pos += len;
+
+  return 0;
+}
+
+static int parse_string(DECODE_PARSER_T *p, char *out, size_t out_size, bool *truncated) {
+  size_t n = 0;
+  unsigned int cp, cp2;
+  unsigned char c;
+
+  // skip leading quote
+  p->pos++;
+
+  while (1) {
+    if (p->pos >= p->end) {
+      return fail(p, "premature end of input");
+    }
+
+    c = *p->pos;
+    if (c == '"') {
+      p->pos++;
+      break;
+    }
+    if (c < 0x20) {
+      return fail(p, "control character in string");
+    }
+    if (c >= 0x80) {
+      if (parse_utf8(p, out, out_size, &n)) {
+        return -1;
+      }
+      continue;
+    }
+    p->pos++;
+    if (c != '\\') {
+      put_char(out, out_size, &n, c);
+      continue;
+    }
+
+    // escape sequences
+    if (p->pos >= p->end) {
+      return fail(p, "premature end of input");
+    }
+    c = *(p->pos++);
+    switch (c) {
+      case '"':
+      case '\\':
+      case '/':
+        break;
+      case 'b':
+        c = '\b';
+        break;
+      case 'f':
+        c = '\f';
+        break;
+      case 'n':
+        c = '\n';
+        break;
+      case 'r':
+        c = '\r';
+        break;
+      case 't':
+        c = '\t';
+        break;
+      case 'u':
+        if (parse_hex4(p, &cp)) {
+          return -1;
+        }
+        if (cp >= 0xdc00 && cp <= 0xdfff) {
+          return fail(p, "invalid Unicode escape");
+        }
+        if (cp >= 0xd800 && cp <= 0xdbff) {
+          // surrogate pair
+          if (p->end - p->pos < 2 || p->pos[0] != '\\' || p->pos[1] != 'u') {
+            return fail(p, "invalid Unicode escape");
+          }
+          p->pos += 2;
+          if (parse_hex4(p, &cp2)) {
+            return -1;
+          }
+          if (cp2 < 0xdc00 || cp2 > 0xdfff) {
+            return fail(p, "invalid Unicode escape");
+          }
+          cp = 0x10000 + ((cp - 0xd800) << 10) + (cp2 - 0xdc00);
+        }
+        if (cp == 0) {
+          return fail(p, "\\u0000 is not allowed");
+        }
+        if (cp < 0x80) {
+          put_char(out, out_size, &n, cp);
+        } else if (cp < 0x800) {
+          put_char(out, out_size, &n, 0xc0 | (cp >> 6));
+          put_char(out, out_size, &n, 0x80 | (cp & 0x3f));
+        } else if (cp < 0x10000) {
+          put_char(out, out_size, &n, 0xe0 | (cp >> 12));
+          put_char(out, out_size, &n, 0x80 | ((cp >> 6) & 0x3f));
+          put_char(out, out_size, &n, 0x80 | (cp & 0x3f));
+        } else {
+          put_char(out, out_size, &n, 0xf0 | (cp >> 18));
+          put_char(out, out_size, &n, 0x80 | ((cp >> 12) & 0x3f));
+          put_char(out, out_size, &n, 0x80 | ((cp >> 6) & 0x3f));
+          put_char(out, out_size, &n, 0x80 | (cp & 0x3f));
+        }
+        continue;
+      default:
+        return fail(p, "invalid escape");
+    }
+    put_char(out, out_size, &n, c);
+  }
+
+  if (out != NULL) {
+    *truncated = (n >= out_size);
+    out[*truncated ? out_size - 1 : n] = 0;
+  }
+
+  return 0;
+}
+
+static int parse_number(DECODE_PARSER_T *p, HAL_VALUE_T *val) {
+  const char *start = p->pos;
+  const char *s = p->pos;
+  bool is_real = false;
+  char sbuf[DECODE_NUMBER_BUFSIZE];
+  char *buf = sbuf;
+  size_t len;
+  int ret = 0;
+
+  // validate against JSON number grammar
+  if (s < p->end && *s == '-') {
+    s++;
+  }
+  if (s >= p->end) {
+    return fail(p, "premature end of input");
+  }
+  if (*s == '0') {
+    s++;
+  } else if (*s >= '1' && *s <= '9') {
+    for (; s < p->end && *s >= '0' && *s <= '9'; s++);
+  } else {
+    return fail(p, "invalid token");
+  }
+  if (s < p->end && *s == '.') {
+    is_real = true;
+    s++;
+    if (s >= p->end || *s < '0' || *s > '9') {
+      return fail(p, "invalid token");
+    }
+    for (; s < p->end && *s >= '0' && *s <= '9'; s++);
+  }
+  if (s < p->end && (*s == 'e' || *s == 'E')) {
+    is_real = true;
+    s++;
+    if (s < p->end && (*s == '+' || *s == '-')) {
+      s++;
+    }
+    if (s >= p->end || *s < '0' || *s > '9') {
+      return fail(p, "invalid token");
+    }
+    for (; s < p->end && *s >= '0' && *s <= '9'; s++);
+  }
+  p->pos = s;
+
+  // body is not terminated, so convert from a copy
+  len = s - start;
+  if (len >= DECODE_NUMBER_BUFSIZE) {
+    buf = malloc(len + 1);
+    if (buf == NULL) {
+      return fail(p, "out of memory");
+    }
+  }
+  memcpy(buf, start, len);
+  buf[len] = 0;
+
+  errno = 0;
+  if (is_real) {
+    val->type = halValueReal;
+    val->d = strtod(buf, NULL);
+    if (errno == ERANGE && isinf(val->d)) {
+      ret = fail(p, "real number overflow");
+    }
+  } else {
+    val->type = halValueInt;
+    val->i = strtoll(buf, NULL, 10);
+    if (errno == ERANGE) {
+      ret = fail(p, "too big integer");
+    }
+  }
+
+  if (buf != sbuf) {
+    free(buf);
+  }
+  return ret;
+}
+
+static int parse_literal(DECODE_PARSER_T *p, const char *lit) {
+  size_t len = strlen(lit);
+
+  if ((size_t) (p->end - p->pos) < len || memcmp(p->pos, lit, len) != 0) {
+    return fail(p, "invalid token");
+  }
+  p->pos += len;
+
+  return 0;
+}
+
+static int parse_value(DECODE_PARSER_T *p, CONF_JSON_ITEM_T *json) {
+  HAL_VALUE_T val;
+
+  skip_ws(p);
+  if (p->pos >= p->end) {
+    return fail(p, "premature end of input");
+  }
+
+  // a HAL value can only be written with a scalar
+  if (json != NULL && CONF_TYPE_IS_HAL(json->type) && (*p->pos == '{' || *p->pos == '[' || *p->pos == '"')) {
+    return fail(p, "data type mismatch");
+  }
+
+  val.type = halValueNone;
+  switch (*p->pos) {
+    case '{':
+      // arrays may also be sent in columnar layout
+      if (json != NULL && json->type == confTypeJsonArray) {
+        return parse_column_array(p, &json, 1, NULL, 0);
+      }
+      return parse_object(p, (json != NULL && json->type == confTypeJsonObject) ? json->childs : NULL);
+    case '[':
+      return parse_array(p, (json != NULL && json->type == confTypeJsonArray) ? json : NULL);
+    case '"':
+      return parse_string(p, NULL, 0, NULL);
+    case 't':
+      if (parse_literal(p, "true")) {
+        return -1;
+      }
+      val.type = halValueBool;
+      val.b = true;
+      break;
+    case 'f':
+      if (parse_literal(p, "false")) {
+        return -1;
+      }
+      val.type = halValueBool;
+      val.b = false;
+      break;
+    case 'n':
+      return parse_literal(p, "null");
+    default:
+      if (parse_number(p, &val)) {
+        return -1;
+      }
+      break;
+  }
+
+  // reject the whole request instead of skipping single values on write
+  if (json != NULL && CONF_TYPE_IS_HAL(json->type) && !hal_validate_json_type(json->hal.type, &val)) {
+    return fail(p, "data type mismatch");
+  }
+  // computed values are read only and ignored, so GET bodies can be posted back
+  if (json != NULL && CONF_TYPE_IS_HAL(json->type)) {
+    p->writes[json->item_index].json = json;
+    p->writes[json->item_index].val = val;
+  }
+
+  return 0;
+}
+
+static int parse_object(DECODE_PARSER_T *p, CONF_JSON_ITEM_T *list) {
+  char key[HAL_NAME_LEN + 1];
+  bool truncated;
+  CONF_JSON_ITEM_T *json;
+
+  if (++(p->depth) > DECODE_MAX_DEPTH) {
+    return fail(p, "maximum parsing depth reached");
+  }
+
+  // skip leading brace
+  p->pos++;
+
+  skip_ws(p);
+  if (p->pos < p->end && *p->pos == '}') {
+    p->pos++;
+    p->depth--;
+    return 0;
+  }
+
+  while (1) {
+    skip_ws(p);
+    if (p->pos >= p->end) {
+      return fail(p, "premature end of input");
+    }
+    if (*p->pos != '"') {
+      return fail(p, "string or '}' expected");
+    }
+    if (parse_string(p, key, sizeof(key), &truncated)) {
+      return -1;
+    }
+    if (expect_char(p, ':')) {
+      return -1;
+    }
+
+    // overlong keys can't match any config item
+    json = NULL;
+    if (list != NULL && !truncated) {
+      json = find_conf_item(key, list);
+    }
+
+    // a later duplicate key replaces the earlier value completely
+    if (json != NULL) {
+      clear_writes(p, json);
+    }
+
+    if (parse_value(p, json)) {
+      return -1;
+    }
+
+    skip_ws(p);
+    if (p->pos >= p->end) {
+      return fail(p, "premature end of input");
+    }
+    if (*p->pos == '}') {
+      p->pos++;
+      break;
+    }
+    if (*p->pos != ',') {
+      return fail(p, "',' or '}' expected");
+    }
+    p->pos++;
+  }
+
+  p->depth--;
+  return 0;
+}
+
+static int parse_array(DECODE_PARSER_T *p, CONF_JSON_ITEM_T *json) {
+  CONF_JSON_ITEM_T *cur = json;
+  int index;
+
+  if (++(p->depth) > DECODE_MAX_DEPTH) {
+    return fail(p, "maximum parsing depth reached");
+  }
+
+  // skip leading bracket
+  p->pos++;
+
+  skip_ws(p);
+  if (p->pos < p->end && *p->pos == ']') {
+    p->pos++;
+    p->depth--;
+    return 0;
+  }
+
+  for (index = 0; ; index++) {
+    skip_ws(p);
+    if (p->pos >= p->end) {
+      return fail(p, "premature end of input");
+    }
+
+    // elements must be objects in config order, anything else ends matching
+    if (cur != NULL && *p->pos == '{' && cur->array_index == index && strcasecmp(cur->name, json->name) == 0) {
+      if (parse_object(p, cur->childs)) {
+        return -1;
+      }
+      cur = cur->next;
+    } else {
+      cur = NULL;
+      if (parse_value(p, NULL)) {
+        return -1;
+      }
+    }
+
+    skip_ws(p);
+    if (p->pos >= p->end) {
+      return fail(p, "premature end of input");
+    }
+    if (*p->pos == ']') {
+      p->pos++;
+      break;
+    }
+    if (*p->pos != ',') {
+      return fail(p, "',' or ']' expected");
+    }
+    p->pos++;
+  }
+
+  p->depth--;
+  return 0;
+}
+
+// Columnar layout: each member of an array holds the values of all instances
+// as a JSON array, nested arrays add a dimension. The instances are walked in
+// parallel with one cursor each, since array copies share their structure.
+static int parse_column_values(DECODE_PARSER_T *p, CONF_JSON_ITEM_T **items, int n, const int *dims, int ndims) {
+  int sub = n / dims[0];
+  int index;
+  int ret;
+
+  skip_ws(p);
+  if (p->pos >= p->end) {
+    return fail(p, "premature end of input");
+  }
+
+  // computed columns are ignored like computed values
+  if (!CONF_TYPE_IS_HAL(items[0]->type)) {
+    return parse_value(p, NULL);
+  }
+
+  // bit columns may be sent packed
+  if (*p->pos == '"' && items[0]->hal.type == HAL_BIT) {
+    return parse_column_bits(p, items, n);
+  }
+
+  // same mistake as a non scalar value in rows layout
+  if (*p->pos != '[') {
+    return fail(p, "data type mismatch");
+  }
+
+  if (++(p->depth) > DECODE_MAX_DEPTH) {
+    return fail(p, "maximum parsing depth reached");
+  }
+
+  // skip leading bracket
+  p->pos++;
+
+  skip_ws(p);
+  if (p->pos < p->end && *p->pos == ']') {
+    p->pos++;
+    p->depth--;
+    return 0;
+  }
+
+  for (index = 0; ; index++) {
+    // values beyond the array size are ignored
+    if (index >= dims[0]) {
+      ret = parse_value(p, NULL);
+    } else if (ndims == 1) {
+      ret = parse_value(p, items[index]);
+    } else {
+      ret = parse_column_values(p, items + index * sub, sub, dims + 1, ndims - 1);
+    }
+    if (ret) {
+      return -1;
+    }
+
+    skip_ws(p);
+    if (p->pos >= p->end) {
+      return fail(p, "premature end of input");
+    }
+    if (*p->pos == ']') {
+      p->pos++;
+      break;
+    }
+    if (*p->pos != ',') {
+      return fail(p, "',' or ']' expected");
+    }
+    p->pos++;
+  }
+
+  p->depth--;
+  return 0;
+}
+
+static int decode_base64_char(char c) {
+  if (c >= 'A' && c <= 'Z') {
+    return c - 'A';
+  }
+  if (c >= 'a' && c <= 'z') {
+    return c - 'a' + 26;
+  }
+  if (c >= '0' && c <= '9') {
+    return c - '0' + 52;
+  }
+  if (c == '+') {
+    return 62;
+  }
+  if (c == '/') {
+    return 63;
+  }
+  return -1;
+}
+
+// Packed bits are a base64 string covering exactly all values of the
+// column in row major order, value i is bit (i % 8) of byte (i / 8).
+static int parse_column_bits(DECODE_PARSER_T *p, CONF_JSON_ITEM_T **items, int n) {
+  int nbytes = (n + 7) / 8;
+  size_t len = 4 * ((nbytes + 2) / 3);
+  bool truncated;
+  char *str;
+  CONF_JSON_ITEM_T *json;
+  uint8_t byte;
+  uint32_t acc;
+  int i, j, k, v, pad;
+  int ret = -1;
+
+  // one extra char to detect overlong input
+  str = malloc(len + 2);
+  if (str == NULL) {
+    return fail(p, "out of memory");
+  }
+  if (parse_string(p, str, len + 2, &truncated)) {
+    goto out;
+  }
+  if (truncated || strlen(str) != len) {
+    fail(p, "packed bits size mismatch");
+    goto out;
+  }
+
+  for (i = 0, k = 0; (size_t) i < len; i += 4) {
+    acc = 0;
+    pad = 0;
+    for (j = 0; j < 4; j++) {
+      // padding is only allowed at the end of the last quantum
+      if (str[i + j] == '=' && (size_t) (i + 4) == len && j >= 2) {
+        pad++;
+        v = 0;
+      } else {
+        v = decode_base64_char(str[i + j]);
+        if (v < 0 || pad > 0) {
+          fail(p, "invalid packed bits");
+          goto out;
+        }
+      }
+      acc = (acc << 6) | v;
+    }
+
+    for (j = 0; j < 3 - pad && k < nbytes; j++, k++) {
+      byte = acc >> (16 - 8 * j);
+      for (v = 0; v < 8 && k * 8 + v < n; v++) {
+        json = items[k * 8 + v];
+        p->writes[json->item_index].json = json;
+        p->writes[json->item_index].val.type = halValueBool;
+        p->writes[json->item_index].val.b = (byte >> v) & 1;
+      }
+    }
+  }
+
+  // padding must match the byte count
+  if (k != nbytes) {
+    fail(p, "packed bits size mismatch");
+    goto out;
+  }
+
+  ret = 0;
+
+out:
+  free(str);
+  return ret;
+}
+
+static int parse_columns(DECODE_PARSER_T *p, CONF_JSON_ITEM_T **cur, int n, const int *dims, int ndims) {
+  char key[HAL_NAME_LEN + 1];
+  bool truncated;
+  CONF_JSON_ITEM_T **col;
+  CONF_JSON_ITEM_T *tmpl;
+  CONF_JSON_ITEM_T *json;
+  int pos, i, j;
+  int ret = -1;
+
+  if (++(p->depth) > DECODE_MAX_DEPTH) {
+    return fail(p, "maximum parsing depth reached");
+  }
+
+  col = malloc(n * sizeof(CONF_JSON_ITEM_T *));
+  if (col == NULL) {
+    return fail(p, "out of memory");
+  }
+
+  // skip leading brace
+  p->pos++;
+
+  skip_ws(p);
+  if (p->pos < p->end && *p->pos == '}') {
+    p->pos++;
+    p->depth--;
+    ret = 0;
+    goto out;
+  }
+
+  while (1) {
+    skip_ws(p);
+    if (p->pos >= p->end) {
+      fail(p, "premature end of input");
+      goto out;
+    }
+    if (*p->pos != '"') {
+      fail(p, "string or '}' expected");
+      goto out;
+    }
+    if (parse_string(p, key, sizeof(key), &truncated)) {
+      goto out;
+    }
+    if (expect_char(p, ':')) {
+      goto out;
+    }
+    skip_ws(p);
+    if (p->pos >= p->end) {
+      fail(p, "premature end of input");
+      goto out;
+    }
+
+    // find member in first instance and the same position in all others
+    tmpl = truncated ? NULL : find_conf_item(key, cur[0]);
+    if (tmpl != NULL) {
+      for (pos = 0, json = cur[0]; json != tmpl; json = json->next, pos++);
+      for (i = 0; i < n; i++) {
+        for (j = 0, json = cur[i]; j < pos; j++, json = json->next);
+        col[i] = json;
+        clear_writes(p, json);
+      }
+    }
+
+    if (tmpl != NULL && CONF_TYPE_IS_LEAF(tmpl->type)) {
+      ret = parse_column_values(p, col, n, dims, ndims);
+    } else if (tmpl != NULL && tmpl->type == confTypeJsonObject && *p->pos == '{') {
+      for (i = 0; i < n; i++) {
+        col[i] = col[i]->childs;
+      }
+      ret = parse_columns(p, col, n, dims, ndims);
+    } else if (tmpl != NULL && tmpl->type == confTypeJsonArray && *p->pos == '{') {
+      ret = parse_column_array(p, col, n, dims, ndims);
+    } else {
+      ret = parse_value(p, NULL);
+    }
+    if (ret) {
+      goto out;
+    }
+    ret = -1;
+
+    skip_ws(p);
+    if (p->pos >= p->end) {
+      fail(p, "premature end of input");
+      goto out;
+    }
+    if (*p->pos == '}') {
+      p->pos++;
+      break;
+    }
+    if (*p->pos != ',') {
+      fail(p, "',' or '}' expected");
+      goto out;
+    }
+    p->pos++;
+  }
+
+  p->depth--;
+  ret = 0;
+
+out:
+  free(col);
+  return ret;
+}
+
+static int parse_column_array(DECODE_PARSER_T *p, CONF_JSON_ITEM_T **cur, int n, const int *dims, int ndims) {
+  CONF_JSON_ITEM_T *tmpl = cur[0];
+  CONF_JSON_ITEM_T *json;
+  CONF_JSON_ITEM_T **sub;
+  int sub_dims[DECODE_MAX_COLUMN_DIMS];
+  int count, i, m;
+  int ret;
+
+  if (ndims >= DECODE_MAX_COLUMN_DIMS) {
+    return fail(p, "maximum parsing depth reached");
+  }
+
+  // count instances
+  for (count = 1, json = tmpl; json->next != NULL && json->next->name == tmpl->name && json->next->array_index > json->array_index; json = json->next) {
+    count++;
+  }
+
+  sub = malloc(n * count * sizeof(CONF_JSON_ITEM_T *));
+  if (sub == NULL) {
+    return fail(p, "out of memory");
+  }
+
+  // row major: outer instances first
+  for (i = 0, m = 0; i < n; i++) {
+    for (json = cur[i]; m < (i + 1) * count; json = json->next) {
+      sub[m++] = json->childs;
+    }
+  }
+  if (ndims > 0) {
+    memcpy(sub_dims, dims, ndims * sizeof(int));
+  }
+  sub_dims[ndims] = count;
+
+  ret = parse_columns(p, sub, n * count, sub_dims, ndims + 1);
+  free(sub);
+  return ret;
+}
+
+static CONF_JSON_ITEM_T *find_conf_item(const char *key, CONF_JSON_ITEM_T *list) {
+  CONF_JSON_ITEM_T *json;
+
+  for (json = list; json != NULL; json = json->next) {
+    // skip array copies
+    if (json->array_index > 0) {
+      continue;
+    }
+
+    // skip unmatching names
+    if (strcasecmp(key, json->name) != 0) {
+      continue;
+    }
+
+    return json;
+  }
+
+  return NULL;
+}
+
+static int get_subtree_end(CONF_JSON_ITEM_T *json) {
+  CONF_JSON_ITEM_T *child;
+
+  // array values cover all instances
+  if (json->type == confTypeJsonArray) {
+    while (json->next != NULL && json->next->name == json->name && json->next->array_index > json->array_index) {
+      json = json->next;
+    }
+  }
+
+  // items are numbered in tree order, so the last descendant ends the range
+  while (json->childs != NULL) {
+    for (child = json->childs; child->next != NULL; child = child->next);
+    json = child;
+  }
+
+  return json->item_index + 1;
+}
+
+static void clear_writes(DECODE_PARSER_T *p, CONF_JSON_ITEM_T *json) {
+  int start = json->item_index;
+
+  memset(&p->writes[start], 0, (get_subtree_end(json) - start) * sizeof(DECODE_WRITE_T));
+}
+
+int decode_request(DECODE_REQUEST_T *req, CONF_JSON_ITEM_T *root, const char *buf, size_t len) {
+  DECODE_PARSER_T p;
+
+  memset(req, 0, sizeof(DECODE_REQUEST_T));
+  req->root = root;
+  req->line = 1;
+
+  req->writes = calloc(root->item_count + 1, sizeof(DECODE_WRITE_T));
+  if (req->writes == NULL) {
+    req->error = "out of memory";
+    return -1;
+  }
+
+  memset(&p, 0, sizeof(p));
+  p.pos = buf;
+  p.end = buf + len;
+  p.line = 1;
+  p.writes = req->writes;
+
+  // like jansson, only objects and arrays are accepted on top level
+  skip_ws(&p);
+  if (p.pos < p.end && *p.pos == '{') {
+    parse_object(&p, root->childs);
+  } else if (p.pos < p.end && *p.pos == '[') {
+    parse_array(&p, NULL);
+  } else {
+    fail(&p, "'[' or '{' expected");
+  }
+
+  if (p.error == NULL) {
+    skip_ws(&p);
+    if (p.pos < p.end) {
+      fail(&p, "end of file expected");
+    }
+  }
+
+  req->line = p.line;
+  req->error = p.error;
+  return (p.error != NULL) ? -1 : 0;
+}
+
+static void add_expect(CONF_JSON_ITEM_T *json, void *data) {
+  DECODE_EXPECT_CTX_T *ctx = (DECODE_EXPECT_CTX_T *) data;
+  DECODE_REQUEST_T *req = ctx->req;
+  DECODE_EXPECT_T *expects;
+
+  if (ctx->failed) {
+    return;
+  }
+
+  // only hal backed values can be compared
+  if (!CONF_TYPE_IS_HAL(json->type) || !hal_validate_json_type(json->hal.type, &ctx->val)) {
+    req->error = "expected value does not match item type";
+    ctx->failed = true;
+    return;
+  }
+
+  expects = realloc(req->expects, (req->expect_count + 1) * sizeof(DECODE_EXPECT_T));
+  if (expects == NULL) {
+    req->error = "out of memory";
+    ctx->failed = true;
+    return;
+  }
+  req->expects = expects;
+  expects[req->expect_count].json = json;
+  expects[req->expect_count].val = ctx->val;
+  req->expect_count++;
+}
+
+static int parse_expect_value(const char *str, size_t len, HAL_VALUE_T *val) {
+  DECODE_PARSER_T p;
+
+  memset(&p, 0, sizeof(p));
+  p.pos = str;
+  p.end = str + len;
+  p.line = 1;
+
+  // same literals as in the request body
+  if (len > 0 && *str == 't') {
+    val->type = halValueBool;
+    val->b = true;
+    parse_literal(&p, "true");
+  } else if (len > 0 && *str == 'f') {
+    val->type = halValueBool;
+    val->b = false;
+    parse_literal(&p, "false");
+  } else {
+    parse_number(&p, val);
+  }
+
+  return (p.error != NULL || p.pos != p.end) ? -1 : 0;
+}
+
+static bool check_expect(const DECODE_EXPECT_T *expect) {
+  CONF_JSON_ITEM_T *json = expect->json;
+  volatile void *ptr;
+  HAL_VALUE_T cur;
+  double want, scale;
+
+  ptr = hal_get_json_ptr(json);
+  if (ptr == NULL) {
+    return false;
+  }
+  hal_read_value(json->hal.type, ptr, &cur);
+
+  switch (cur.type) {
+    case halValueBool:
+      return cur.b == expect->val.b;
+    case halValueInt:
+      return cur.i == expect->val.i;
+    case halValueReal:
+      want = (expect->val.type == halValueInt) ? expect->val.i : expect->val.d;
+      if (json->precision < 0) {
+        return cur.d == want;
+      }
+      // compare as rendered, so values read with GET can be sent back
+      scale = pow(10.0, json->precision);
+      return round(cur.d * scale) == round(want * scale);
+    default:
+      return false;
+  }
+}
+
+int decode_expect(DECODE_REQUEST_T *req, const char *spec) {
+  DECODE_EXPECT_CTX_T ctx;
+  const char *pos, *end, *eq;
+  PATH_T *path;
+  int count;
+
+  ctx.req = req;
+  ctx.failed = false;
+
+  // comma separated list of path=value
+  for (pos = spec; *pos != 0; pos = (*end != 0) ? end + 1 : end) {
+    end = pos + strcspn(pos, ",");
+    eq = memchr(pos, '=', end - pos);
+    if (eq == NULL) {
+      req->error = "invalid expect";
+      return -1;
+    }
+    if (parse_expect_value(eq + 1, end - eq - 1, &ctx.val)) {
+      req->error = "invalid expected value";
+      return -1;
+    }
+
+    path = path_parse(pos, eq - pos);
+    if (path == NULL) {
+      req->error = "invalid expect path";
+      return -1;
+    }
+    count = path_resolve(path, req->root->childs, add_expect, &ctx);
+    path_free(path);
+
+    if (ctx.failed) {
+      return -1;
+    }
+    if (count == 0) {
+      req->error = "expect path matches nothing";
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+int decode_apply(DECODE_REQUEST_T *req, const struct sockaddr *client) {
+  RT_WRITES_T rt_writes;
+  int i, rt;
+
+  // with the RT helper all writes reach the RT logic in the same cycle.
+  // the ring is claimed before apply_lock, so the wait for the RT side
+  // never blocks the single writes of the main loop.
+  rt = rt_write_begin(req->root, client, &rt_writes);
+  if (rt < 0) {
+    req->error = "write not applied";
+    return DECODE_NOT_APPLIED;
+  }
+
+  pthread_mutex_lock(&apply_lock);
+
+  // preconditions are checked right before writing, other requests
+  // can't interleave. The RT side may still change values meanwhile.
+  if (req->match_generation && hal_get_json_generation(req->root) != req->generation) {
+    goto precondition;
+  }
+  for (i = 0; i < req->expect_count; i++) {
+    if (!check_expect(&req->expects[i])) {
+      goto precondition;
+    }
+  }
+
+  for (i = 0; i < req->root->item_count; i++) {
+    if (req->writes[i].json != NULL) {
+      if (rt == 1) {
+        hal_write_json_pin(req->writes[i].json, &req->writes[i].val, client);
+      } else if (rt_write_add(&rt_writes, req->writes[i].json, &req->writes[i].val)) {
+        goto failed;
+      }
+    }
+  }
+  if (rt == 0) {
+    rt_write_publish(&rt_writes);
+  }
+
+  pthread_mutex_unlock(&apply_lock);
+
+  if (rt == 0 && rt_write_finish(&rt_writes)) {
+    req->error = "write not applied";
+    return DECODE_NOT_APPLIED;
+  }
+  return 0;
+
+precondition:
+  pthread_mutex_unlock(&apply_lock);
+  if (rt == 0) {
+    rt_write_abort(&rt_writes);
+  }
+  req->error = "precondition failed";
+  return -1;
+
+failed:
+  // nothing of the command was published
+  pthread_mutex_unlock(&apply_lock);
+  rt_write_abort(&rt_writes);
+  req->error = "write not applied";
+  return DECODE_NOT_APPLIED;
+}
+
+int decode_write(CONF_JSON_ITEM_T *json, const HAL_VALUE_T *val, const struct sockaddr *client) {
+  CONF_JSON_ITEM_T *root;
+  RT_WRITES_T rt_writes;
+  int rt, ret;
+
+  // same path as a POST, a direct write could be overwritten by an older
+  // command that is still queued for the RT side
+  for (root = json; root->parent != NULL; root = root->parent);
+  rt = rt_write_begin(root, client, &rt_writes);
+  if (rt < 0) {
+    return -1;
+  }
+
+  // single writes from other sources must not slip between check and apply
+  pthread_mutex_lock(&apply_lock);
+  if (rt == 1) {
+    ret = hal_write_json_pin(json, val, client);
+    pthread_mutex_unlock(&apply_lock);
+    return ret;
+  }
+
+  // a skipped value fails like a rejected direct write
+  if (rt_write_add(&rt_writes, json, val) || rt_writes.count == 0) {
+    pthread_mutex_unlock(&apply_lock);
+    rt_write_abort(&rt_writes);
+    return -1;
+  }
+  rt_write_publish(&rt_writes);
+  pthread_mutex_unlock(&apply_lock);
+
+  return rt_write_finish(&rt_writes);
+}
+
+void decode_free(DECODE_REQUEST_T *req) {
+  free(req->writes);
+  free(req->expects);
+  req->writes = NULL;
+  req->expects = NULL;
+  req->expect_count = 0;
+}
@@ -0,0 +1,42 @@
+#ifndef LCREST_DECODE_H
+#define LCREST_DECODE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/socket.h>
+
+#include "lcrest.h"
+#include "lcrest_conf.h"
+#include "lcrest_hal.h"
+
+// decode_apply result if the RT helper did not take the writes
+#define DECODE_NOT_APPLIED -2
+
+typedef struct {
+  CONF_JSON_ITEM_T *json;
+  HAL_VALUE_T val;
+} DECODE_WRITE_T;
+
+typedef struct {
+  CONF_JSON_ITEM_T *json;
+  HAL_VALUE_T val;
+} DECODE_EXPECT_T;
+
+typedef struct {
+  CONF_JSON_ITEM_T *root;
+  DECODE_WRITE_T *writes;
+  DECODE_EXPECT_T *expects;
+  int expect_count;
+  bool match_generation;
+  uint64_t generation;
+  int line;
+  const char *error;
+} DECODE_REQUEST_T;
+
+int decode_request(DECODE_REQUEST_T *req, CONF_JSON_ITEM_T *root, const char *buf, size_t len);
+int decode_expect(DECODE_REQUEST_T *req, const char *spec);
+int decode_apply(DECODE_REQUEST_T *req, const struct sockaddr *client);
+int decode_write(CONF_JSON_ITEM_T *json, const HAL_VALUE_T *val, const struct sockaddr *client);
+void decode_free(DECODE_REQUEST_T *req);
+
+#endif
@@ -0,0 +1,390 @@
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "lcrest_dtoa.h"
+
+// Shortest round-trip formatting based on Florian Loitsch's Grisu2 as
+// implemented in RapidJSON (MIT license, Milo Yip).
+
+#define DP_SIGNIFICAND_SIZE 52
+#define DP_EXPONENT_BIAS (0x3ff + DP_SIGNIFICAND_SIZE)
+#define DP_MIN_EXPONENT (-DP_EXPONENT_BIAS)
+#define DP_EXPONENT_MASK 0x7ff0000000000000ULL
+#define DP_SIGNIFICAND_MASK 0x000fffffffffffffULL
+#define DP_HIDDEN_BIT 0x0010000000000000ULL
+
+// fixed formatting falls back to shortest beyond this
+#define DTOA_FIXED_LIMIT 9.0e18
+
+typedef struct {
+  uint64_t f;
+  int e;
+} DIYFP_T;
+
+static const uint64_t cached_powers_f[] = {
+  0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL, 0xcf42894a5dce35eaULL,
+  0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL, 0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL,
+  0xbe5691ef416bd60cULL, 0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+  0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL, 0xc21094364dfb5637ULL,
+  0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL, 0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL,
+  0xb23867fb2a35b28eULL, 0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+  0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL, 0xb5b5ada8aaff80b8ULL,
+  0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL, 0x964e858c91ba2655ULL, 0xdff9772470297ebdULL,
+  0xa6dfbd9fb8e5b88fULL, 0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+  0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL, 0xaa242499697392d3ULL,
+  0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL, 0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL,
+  0x9c40000000000000ULL, 0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+  0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL, 0x9f4f2726179a2245ULL,
+  0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL, 0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL,
+  0x924d692ca61be758ULL, 0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+  0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL, 0x952ab45cfa97a0b3ULL,
+  0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL, 0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL,
+  0x88fcf317f22241e2ULL, 0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+  0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL, 0x8bab8eefb6409c1aULL,
+  0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL, 0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL,
+  0x80444b5e7aa7cf85ULL, 0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+  0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL
+};
+
+static const int16_t cached_powers_e[] = {
+  -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980,
+  -954, -927, -901, -874, -847, -821, -794, -768, -741, -715,
+  -688, -661, -635, -608, -582, -555, -529, -502, -475, -449,
+  -422, -396, -369, -343, -316, -289, -263, -236, -210, -183,
+  -157, -130, -103, -77, -50, -24, 3, 30, 56, 83,
+  109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+  375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+  641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+  907, 933, 960, 986, 1013, 1039, 1066
+};
+
+static const uint64_t pow10_tab[] = {
+  1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL,
+  1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+  100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL,
+  1000000000000000000ULL, 10000000000000000000ULL
+};
+
+static DIYFP_T diyfp_from_double(double d);
+static DIYFP_T diyfp_sub(DIYFP_T a, DIYFP_T b);
+static DIYFP_T diyfp_mul(DIYFP_T a, DIYFP_T b);
+static DIYFP_T diyfp_normalize(DIYFP_T a);
+static void normalized_boundaries(DIYFP_T v, DIYFP_T *minus, DIYFP_T *plus);
+static DIYFP_T get_cached_power(int e, int *k);
+static int count_digits(uint32_t n);
+static void grisu_round(char *buf, int len, uint64_t delta, uint64_t rest, uint64_t ten_kappa, uint64_t wp_w);
+static void digit_gen(DIYFP_T w, DIYFP_T mp, uint64_t delta, char *buf, int *len, int *k);
+static int write_exponent(int k, char *buf);
+static int prettify(char *buf, int len, int k);
+static int write_uint(uint64_t v, char *buf);
+
+static DIYFP_T diyfp_from_double(double d) {
+  DIYFP_T ret;
+  uint64_t u;
+  int biased_e;
+
+  memcpy(&u, &d, sizeof(u));
+  biased_e = (u & DP_EXPONENT_MASK) >> DP_SIGNIFICAND_SIZE;
+  ret.f = u & DP_SIGNIFICAND_MASK;
+  if (biased_e != 0) {
+    ret.f += DP_HIDDEN_BIT;
+    ret.e = biased_e - DP_EXPONENT_BIAS;
+  } else {
+    ret.e = DP_MIN_EXPONENT + 1;
+  }
+
+  return ret;
+}
+
+static DIYFP_T diyfp_sub(DIYFP_T a, DIYFP_T b) {
+  DIYFP_T ret = { a.f - b.f, a.e };
+  return ret;
+}
+
+static DIYFP_T diyfp_mul(DIYFP_T a, DIYFP_T b) {
+  DIYFP_T ret;
+  unsigned __int128 p = (unsigned __int128) a.f * b.f;
+
+  // upper 64 bits, rounded
+  ret.f = (uint64_t) (p >> 64);
+  if ((uint64_t) p & (1ULL << 63)) {
+    ret.f++;
+  }
+  ret.e = a.e + b.e + 64;
+
+  return ret;
+}
+
+static DIYFP_T diyfp_normalize(DIYFP_T a) {
+  int s = __builtin_clzll(a.f);
+
+  a.f <<= s;
+  a.e -= s;
+  return a;
+}
+
+static void normalized_boundaries(DIYFP_T v, DIYFP_T *minus, DIYFP_T *plus) {
+  DIYFP_T pl = { (v.f << 1) + 1, v.e - 1 };
+  DIYFP_T mi;
+
+  pl = diyfp_normalize(pl);
+  if (v.f == DP_HIDDEN_BIT) {
+    mi.f = (v.f << 2) - 1;
+    mi.e = v.e - 2;
+  } else {
+    mi.f = (v.f << 1) - 1;
+    mi.e = v.e - 1;
+  }
+  mi.f <<= mi.e - pl.e;
+  mi.e = pl.e;
+
+  *plus = pl;
+  *minus = mi;
+}
+
+static DIYFP_T get_cached_power(int e, int *k) {
+  DIYFP_T ret;
+  double dk = (-61 - e) * 0.30102999566398114 + 347;
+  int ik = (int) dk;
+  unsigned int index;
+
+  if (dk - ik > 0.0) {
+    ik++;
+  }
+
+  index = (unsigned int) ((ik >> 3) + 1);
+  *k = -(-348 + (int) (index << 3));
+
+  ret.f = cached_powers_f[index];
+  ret.e = cached_powers_e[index];
+  return ret;
+}
+
+static int count_digits(uint32_t n) {
+  int i;
+
+  for (i = 1; i < 10; i++) {
+    if (n < pow10_tab[i]) {
+      return i;
+    }
+  }
+  return 10;
+}
+
+static void grisu_round(char *buf, int len, uint64_t delta, uint64_t rest, uint64_t ten_kappa, uint64_t wp_w) {
+  while (rest < wp_w && delta - rest >= ten_kappa &&
+         (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w)) {
+    buf[len - 1]--;
+    rest += ten_kappa;
+  }
+}
+
+static void digit_gen(DIYFP_T w, DIYFP_T mp, uint64_t delta, char *buf, int *len, int *k) {
+  DIYFP_T one = { 1ULL << -mp.e, mp.e };
+  DIYFP_T wp_w = diyfp_sub(mp, w);
+  uint32_t p1 = (uint32_t) (mp.f >> -one.e);
+  uint64_t p2 = mp.f & (one.f - 1);
+  int kappa = count_digits(p1);
+  uint64_t tmp;
+  uint32_t d;
+
+  *len = 0;
+
+  // integral part
+  while (kappa > 0) {
+    d = p1 / pow10_tab[kappa - 1];
+    p1 %= pow10_tab[kappa - 1];
+    if (d || *len) {
+      buf[(*len)++] = '0' + d;
+    }
+    kappa--;
+    tmp = ((uint64_t) p1 << -one.e) + p2;
+    if (tmp <= delta) {
+      *k += kappa;
+      grisu_round(buf, *len, delta, tmp, pow10_tab[kappa] << -one.e, wp_w.f);
+      return;
+    }
+  }
+
+  // fractional part
+  while (1) {
+    p2 *= 10;
+    delta *= 10;
+    d = (uint32_t) (p2 >> -one.e);
+    if (d || *len) {
+      buf[(*len)++] = '0' + d;
+    }
+    p2 &= one.f - 1;
+    kappa--;
+    if (p2 < delta) {
+      *k += kappa;
+      grisu_round(buf, *len, delta, p2, one.f, wp_w.f * (-kappa < 20 ? pow10_tab[-kappa] : 0));
+      return;
+    }
+  }
+}
+
+static int write_exponent(int k, char *buf) {
+  char *p = buf;
+
+  if (k < 0) {
+    *(p++) = '-';
+    k = -k;
+  }
+  if (k >= 100) {
+    *(p++) = '0' + k / 100;
+    k %= 100;
+    *(p++) = '0' + k / 10;
+  } else if (k >= 10) {
+    *(p++) = '0' + k / 10;
+  }
+  *(p++) = '0' + k % 10;
+
+  return p - buf;
+}
+
+static int prettify(char *buf, int len, int k) {
+  int kk = len + k;
+  int i, offset;
+
+  // 1234e7 -> 12340000000.0
+  if (k >= 0 && kk <= 21) {
+    for (i = len; i < kk; i++) {
+      buf[i] = '0';
+    }
+    buf[kk] = '.';
+    buf[kk + 1] = '0';
+    return kk + 2;
+  }
+
+  // 1234e-2 -> 12.34
+  if (kk > 0 && kk <= 21) {
+    memmove(&buf[kk + 1], &buf[kk], len - kk);
+    buf[kk] = '.';
+    return len + 1;
+  }
+
+  // 1234e-6 -> 0.001234
+  if (kk > -6 && kk <= 0) {
+    offset = 2 - kk;
+    memmove(&buf[offset], &buf[0], len);
+    buf[0] = '0';
+    buf[1] = '.';
+    for (i = 2; i < offset; i++) {
+      buf[i] = '0';
+    }
+    return len + offset;
+  }
+
+  // 1e30
+  if (len == 1) {
+    buf[1] = 'e';
+    return 2 + write_exponent(kk - 1, &buf[2]);
+  }
+
+  // 1234e30 -> 1.234e33
+  memmove(&buf[2], &buf[1], len - 1);
+  buf[1] = '.';
+  buf[len + 1] = 'e';
+  return len + 2 + write_exponent(kk - 1, &buf[len + 2]);
+}
+
+static int write_uint(uint64_t v, char *buf) {
+  char tmp[20];
+  int n = 0;
+  int i;
+
+  do {
+    tmp[n++] = '0' + v % 10;
+    v /= 10;
+  } while (v != 0);
+
+  for (i = 0; i < n; i++) {
+    buf[i] = tmp[n - 1 - i];
+  }
+
+  return n;
+}
+
+int dtoa_int(int64_t v, char *buf) {
+  if (v < 0) {
+    *buf = '-';
+    return 1 + write_uint(-(uint64_t) v, buf + 1);
+  }
+
+  return write_uint(v, buf);
+}
+
+int dtoa_shortest(double v, char *buf) {
+  DIYFP_T w, w_m, w_p, c_mk, wn, wp, wm;
+  char *p = buf;
+  int len, k;
+
+  if (v == 0.0) {
+    if (signbit(v)) {
+      *(p++) = '-';
+    }
+    memcpy(p, "0.0", 3);
+    return (p - buf) + 3;
+  }
+
+  if (v < 0) {
+    *(p++) = '-';
+    v = -v;
+  }
+
+  w = diyfp_from_double(v);
+  normalized_boundaries(w, &w_m, &w_p);
+  c_mk = get_cached_power(w_p.e, &k);
+  wn = diyfp_mul(diyfp_normalize(w), c_mk);
+  wp = diyfp_mul(w_p, c_mk);
+  wm = diyfp_mul(w_m, c_mk);
+  wm.f++;
+  wp.f--;
+  digit_gen(wn, wp, wp.f - wm.f, p, &len, &k);
+
+  return (p - buf) + prettify(p, len, k);
+}
+
+int dtoa_fixed(double v, int precision, char *buf) {
+  uint64_t scale, r, ip, fp;
+  char *p = buf;
+  double scaled;
+  int i, n;
+
+  if (precision < 0 || precision > DTOA_MAX_PRECISION) {
+    return dtoa_shortest(v, buf);
+  }
+
+  scale = pow10_tab[precision];
+  scaled = fabs(v) * scale;
+  if (!(scaled < DTOA_FIXED_LIMIT)) {
+    return dtoa_shortest(v, buf);
+  }
+
+  r = (uint64_t) (scaled + 0.5);
+  ip = r / scale;
+  fp = r % scale;
+
+  // no negative zero after rounding
+  if (v < 0 && r != 0) {
+    *(p++) = '-';
+  }
+  p += write_uint(ip, p);
+  *(p++) = '.';
+
+  // fractional digits with leading zeros
+  for (i = precision - 1; i >= 0; i--) {
+    p[i] = '0' + fp % 10;
+    fp /= 10;
+  }
+
+  // strip trailing zeros, but keep one digit so the value stays a real
+  for (n = precision; n > 0 && p[n - 1] == '0'; n--);
+  if (n == 0) {
+    p[n++] = '0';
+  }
+
+  return (p - buf) + n;
+}
@@ -0,0 +1,16 @@
+#ifndef LCREST_DTOA_H
+#define LCREST_DTOA_H
+
+#include <stdint.h>
+
+// big enough for any output of the functions below
+#define DTOA_BUFSIZE 32
+
+#define DTOA_MAX_PRECISION 15
+
+// values passed must be finite
+int dtoa_int(int64_t v, char *buf);
+int dtoa_shortest(double v, char *buf);
+int dtoa_fixed(double v, int precision, char *buf);
+
+#endif
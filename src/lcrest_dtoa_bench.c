@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <jansson.h>
+
+#include "lcrest_dtoa.h"
+
+// compares the float formatting of the json renderer with the former
+// jansson path (json_real dumped with %.17g) in bytes and ns per value
+//
+// usage: lcrest-dtoa-bench [count]
+
+#define BENCH_DEFAULT_COUNT 1000000
+#define BENCH_FIXED_PRECISION 3
+
+typedef int (*BENCH_FMT_T)(double v, char *buf);
+
+static uint64_t get_time(void);
+static int fmt_printf(double v, char *buf);
+static int fmt_jansson(double v, char *buf);
+static int fmt_shortest(double v, char *buf);
+static int fmt_fixed(double v, char *buf);
+static void run(const char *name, BENCH_FMT_T fmt, const double *values, int count);
+static int check_round_trip(const double *values, int count);
+
+static volatile size_t sink;
+
+static uint64_t get_time(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int fmt_printf(double v, char *buf) {
+  return snprintf(buf, DTOA_BUFSIZE, "%.17g", v);
+}
+
+static int fmt_jansson(double v, char *buf) {
+  json_t *json;
+  char *str;
+  int len;
+
+  // what a value cost when the response was built as a jansson tree
+  json = json_real(v);
+  str = json_dumps(json, JSON_ENCODE_ANY | JSON_REAL_PRECISION(17));
+  len = strlen(str);
+  memcpy(buf, str, len < DTOA_BUFSIZE ? len : DTOA_BUFSIZE);
+  free(str);
+  json_decref(json);
+
+  return len;
+}
+
+static int fmt_shortest(double v, char *buf) {
+  return dtoa_shortest(v, buf);
+}
+
+static int fmt_fixed(double v, char *buf) {
+  return dtoa_fixed(v, BENCH_FIXED_PRECISION, buf);
+}
+
+static void run(const char *name, BENCH_FMT_T fmt, const double *values, int count) {
+  char buf[DTOA_BUFSIZE];
+  uint64_t start, end;
+  size_t bytes = 0;
+  int i;
+
+  start = get_time();
+  for (i = 0; i < count; i++) {
+    bytes += fmt(values[i], buf);
+  }
+  end = get_time();
+  sink += bytes;
+
+  printf("  %-10s %7.1f ns %5.1f B\n", name, (double) (end - start) / count, (double) bytes / count);
+}
+
+static int check_round_trip(const double *values, int count) {
+  char buf[DTOA_BUFSIZE + 1];
+  int i, len;
+
+  for (i = 0; i < count; i++) {
+    len = dtoa_shortest(values[i], buf);
+    buf[len] = 0;
+    if (strtod(buf, NULL) != values[i]) {
+      fprintf(stderr, "round trip failed: %.17g -> %s\n", values[i], buf);
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  double *values;
+  uint64_t bits;
+  int count, i, ret = 1;
+
+  count = (argc > 1) ? atoi(argv[1]) : BENCH_DEFAULT_COUNT;
+  if (count <= 0) {
+    fprintf(stderr, "usage: %s [count]\n", argv[0]);
+    return 1;
+  }
+
+  values = malloc(count * sizeof(double));
+  if (values == NULL) {
+    fprintf(stderr, "unable to alloc memory for %d values\n", count);
+    return 1;
+  }
+  srand(1);
+
+  // typical machine values: positions and speeds with a few decimals
+  for (i = 0; i < count; i++) {
+    values[i] = (double) (rand() % 2000000 - 1000000) / 1000.0;
+  }
+  printf("values x/1000 (%d)\n", count);
+  run("%.17g", fmt_printf, values, count);
+  run("jansson", fmt_jansson, values, count);
+  run("shortest", fmt_shortest, values, count);
+  run("fixed(3)", fmt_fixed, values, count);
+  if (check_round_trip(values, count)) {
+    goto out;
+  }
+
+  // full precision values from scaled random bits
+  for (i = 0; i < count; i++) {
+    bits = ((uint64_t) rand() << 31) ^ rand();
+    values[i] = ((double) bits / (double) (1ULL << 62) - 0.5) * 2000.0;
+  }
+  printf("full precision (%d)\n", count);
+  run("%.17g", fmt_printf, values, count);
+  run("jansson", fmt_jansson, values, count);
+  run("shortest", fmt_shortest, values, count);
+  run("fixed(3)", fmt_fixed, values, count);
+  if (check_round_trip(values, count)) {
+    goto out;
+  }
+
+  ret = 0;
+
+out:
+  free(values);
+  return ret;
+}
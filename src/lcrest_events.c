@@ -0,0 +1,330 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "lcrest.h"
+#include "lcrest_conf.h"
+#include "lcrest_hal.h"
+#include "lcrest_json.h"
+#include "lcrest_expr.h"
+#include "lcrest_loop.h"
+#include "lcrest_events.h"
+
+#define EVENTS_PATH_MAX 1024
+
+typedef struct {
+  uint64_t time;
+  CONF_JSON_ITEM_T *item;
+  EXPR_VALUE_T old_val;
+  EXPR_VALUE_T new_val;
+} EVENT_T;
+
+static uint64_t get_time(void);
+static int count_items(CONF_JSON_ITEM_T *json, CONF_JSON_ITEM_T **items);
+static bool read_raw(CONF_JSON_ITEM_T *json, EXPR_VALUE_T *val);
+static void events_tick(void *data);
+static uint64_t clamp_cursor(uint64_t cursor);
+
+static const CONF_EVENTS_T *events_conf;
+static CONF_JSON_ITEM_T **items;
+static EXPR_VALUE_T *last;
+static int item_count;
+static bool primed;
+
+// the journal is protected by events_lock, event n lives in slot n % size
+static pthread_mutex_t events_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t events_cond;
+static EVENT_T *ring;
+static uint64_t head;
+static bool quit;
+
+static uint64_t get_time(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int count_items(CONF_JSON_ITEM_T *json, CONF_JSON_ITEM_T **items) {
+  int count = 0;
+
+  for (; json != NULL; json = json->next) {
+    if (json->event && (json->type == confTypeJsonPin || json->type == confTypeJsonParam)) {
+      if (items != NULL) {
+        items[count] = json;
+      }
+      count++;
+    }
+    count += count_items(json->childs, (items != NULL) ? items + count : NULL);
+  }
+
+  return count;
+}
+
+// raw copy, so float changes are detected bitwise and NaN doesn't flap
+static bool read_raw(CONF_JSON_ITEM_T *json, EXPR_VALUE_T *val) {
+  volatile void *ptr;
+
+  memset(val, 0, sizeof(EXPR_VALUE_T));
+  ptr = hal_get_json_ptr(json);
+  if (ptr == NULL) {
+    return false;
+  }
+
+  switch (json->hal.type) {
+    case HAL_BIT:
+      val->bit = *((hal_bit_t *) ptr);
+      break;
+    case HAL_U32:
+      val->u32 = *((hal_u32_t *) ptr);
+      break;
+    case HAL_S32:
+      val->s32 = *((hal_s32_t *) ptr);
+      break;
+    case HAL_FLOAT:
+      val->flt = *((hal_float_t *) ptr);
+      break;
+    default:
+      return false;
+  }
+
+  return true;
+}
+
+static void events_tick(void *data) {
+  EXPR_VALUE_T val;
+  EVENT_T *ev;
+  uint64_t time = 0;
+  bool locked = false;
+  int i;
+
+  for (i = 0; i < item_count; i++) {
+    if (!read_raw(items[i], &val)) {
+      continue;
+    }
+
+    // first sample is the baseline
+    if (!primed || memcmp(&val, &last[i], sizeof(val)) == 0) {
+      last[i] = val;
+      continue;
+    }
+
+    // changes of one tick share the timestamp and keep config order
+    if (!locked) {
+      time = get_time();
+      pthread_mutex_lock(&events_lock);
+      locked = true;
+    }
+    ev = &ring[head % events_conf->size];
+    ev->time = time;
+    ev->item = items[i];
+    ev->old_val = last[i];
+    ev->new_val = val;
+    head++;
+
+    last[i] = val;
+  }
+  primed = true;
+
+  if (locked) {
+    pthread_cond_broadcast(&events_cond);
+    pthread_mutex_unlock(&events_lock);
+  }
+}
+
+// a cursor ahead of the journal is from before a restart, start over then
+static uint64_t clamp_cursor(uint64_t cursor) {
+  return (cursor > head) ? 0 : cursor;
+}
+
+int events_start(CONF_ROOT_T *conf) {
+  pthread_condattr_t attr;
+
+  events_conf = &conf->events;
+  item_count = count_items(conf->json, NULL);
+  if (item_count == 0) {
+    return 0;
+  }
+
+  if (events_conf->rate <= 0) {
+    fprintf(stderr, "%s: ERROR: event pins require an events section\n", modname);
+    goto fail0;
+  }
+
+  // preallocate everything the detector touches
+  items = calloc(item_count, sizeof(CONF_JSON_ITEM_T *));
+  if (items == NULL) {
+    fprintf(stderr, "%s: ERROR: unable to alloc memory for event items\n", modname);
+    goto fail0;
+  }
+  count_items(conf->json, items);
+
+  last = calloc(item_count, sizeof(EXPR_VALUE_T));
+  if (last == NULL) {
+    fprintf(stderr, "%s: ERROR: unable to alloc memory for event values\n", modname);
+    goto fail1;
+  }
+
+  ring = calloc(events_conf->size, sizeof(EVENT_T));
+  if (ring == NULL) {
+    fprintf(stderr, "%s: ERROR: unable to alloc memory for event journal\n", modname);
+    goto fail2;
+  }
+
+  // long polls wait on the monotonic clock
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&events_cond, &attr);
+  pthread_condattr_destroy(&attr);
+
+  head = 0;
+  primed = false;
+  quit = false;
+  if (loop_add_timer(1000000000ULL / events_conf->rate, events_tick, NULL)) {
+    goto fail3;
+  }
+
+  return 0;
+
+fail3:
+  pthread_cond_destroy(&events_cond);
+  free(ring);
+  ring = NULL;
+fail2:
+  free(last);
+  last = NULL;
+fail1:
+  free(items);
+  items = NULL;
+fail0:
+  return -1;
+}
+
+void events_stop(void) {
+  if (ring == NULL) {
+    return;
+  }
+
+  pthread_cond_destroy(&events_cond);
+  free(ring);
+  free(last);
+  free(items);
+  ring = NULL;
+  last = NULL;
+  items = NULL;
+}
+
+void events_release(void) {
+  if (ring == NULL) {
+    return;
+  }
+
+  // wake pending long polls, further waits return at once
+  pthread_mutex_lock(&events_lock);
+  quit = true;
+  pthread_cond_broadcast(&events_cond);
+  pthread_mutex_unlock(&events_lock);
+}
+
+bool events_is_enabled(void) {
+  return ring != NULL;
+}
+
+int events_parse_cursor(const char *str, uint64_t *cursor) {
+  char *end;
+
+  // no cursor returns the whole journal
+  if (str == NULL || str[0] == 0) {
+    *cursor = 0;
+    return 0;
+  }
+
+  *cursor = strtoull(str, &end, 10);
+  return (*end == 0 && str[0] != '-') ? 0 : -1;
+}
+
+void events_wait(uint64_t cursor, int wait_ms) {
+  struct timespec ts;
+
+  if (wait_ms <= 0) {
+    return;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  ts.tv_sec += wait_ms / 1000;
+  ts.tv_nsec += (long) (wait_ms % 1000) * 1000000L;
+  if (ts.tv_nsec >= 1000000000L) {
+    ts.tv_sec++;
+    ts.tv_nsec -= 1000000000L;
+  }
+
+  pthread_mutex_lock(&events_lock);
+  while (!quit && clamp_cursor(cursor) == head) {
+    if (pthread_cond_timedwait(&events_cond, &events_lock, &ts) != 0) {
+      break;
+    }
+  }
+  pthread_mutex_unlock(&events_lock);
+}
+
+void events_put(BUF_T *buf, uint64_t cursor, int limit) {
+  char path[EVENTS_PATH_MAX];
+  char num[32];
+  EVENT_T *copy;
+  EVENT_T *ev;
+  uint64_t oldest, lost, start;
+  int count, i;
+
+  copy = malloc((size_t) limit * sizeof(EVENT_T));
+  if (copy == NULL) {
+    buf->error = true;
+    return;
+  }
+
+  // copy out, so the detector is blocked only briefly
+  pthread_mutex_lock(&events_lock);
+  cursor = clamp_cursor(cursor);
+  oldest = (head > (uint64_t) events_conf->size) ? head - events_conf->size : 0;
+  lost = (cursor < oldest) ? oldest - cursor : 0;
+  start = cursor + lost;
+  count = (head - start < (uint64_t) limit) ? (int) (head - start) : limit;
+  for (i = 0; i < count; i++) {
+    copy[i] = ring[(start + i) % events_conf->size];
+  }
+  pthread_mutex_unlock(&events_lock);
+
+  snprintf(num, sizeof(num), "%llu", (unsigned long long) (start + count));
+  buf_puts(buf, "{\"cursor\":");
+  buf_puts(buf, num);
+  snprintf(num, sizeof(num), "%llu", (unsigned long long) lost);
+  buf_puts(buf, ",\"lost\":");
+  buf_puts(buf, num);
+  buf_puts(buf, ",\"events\":[");
+  for (i = 0; i < count; i++) {
+    ev = &copy[i];
+    if (i > 0) {
+      buf_putc(buf, ',');
+    }
+    snprintf(num, sizeof(num), "%llu", (unsigned long long) (start + i));
+    buf_puts(buf, "{\"seq\":");
+    buf_puts(buf, num);
+    snprintf(num, sizeof(num), "%llu", (unsigned long long) ev->time);
+    buf_puts(buf, ",\"time\":");
+    buf_puts(buf, num);
+    if (conf_get_item_path(ev->item, path, sizeof(path)) < 0) {
+      snprintf(path, sizeof(path), "%s", ev->item->name);
+    }
+    buf_puts(buf, ",\"path\":");
+    json_put_string(buf, path);
+    buf_puts(buf, ",\"old\":");
+    json_put_value(buf, ev->item->hal.type, &ev->old_val, ev->item->precision);
+    buf_puts(buf, ",\"new\":");
+    json_put_value(buf, ev->item->hal.type, &ev->new_val, ev->item->precision);
+    buf_putc(buf, '}');
+  }
+  buf_puts(buf, "]}");
+
+  free(copy);
+}
@@ -0,0 +1,25 @@
+#ifndef LCREST_EVENTS_H
+#define LCREST_EVENTS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "lcrest.h"
+#include "lcrest_conf.h"
+#include "lcrest_buf.h"
+
+// long poll and response size limits of GET /hal/events
+#define EVENTS_WAIT_MAX     60000
+#define EVENTS_LIMIT_DEFAULT 1000
+#define EVENTS_LIMIT_MAX    10000
+
+int events_start(CONF_ROOT_T *conf);
+void events_stop(void);
+bool events_is_enabled(void);
+void events_release(void);
+
+int events_parse_cursor(const char *str, uint64_t *cursor);
+void events_wait(uint64_t cursor, int wait_ms);
+void events_put(BUF_T *buf, uint64_t cursor, int limit);
+
+#endif
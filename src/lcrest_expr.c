@@ -0,0 +1,634 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <math.h>
+
+#include "lcrest.h"
+#include "lcrest_conf.h"
+#include "lcrest_hal.h"
+#include "lcrest_path.h"
+#include "lcrest_expr.h"
+
+// expressions are evaluated on a fixed size stack, depth is checked at compile time
+#define EXPR_MAX_STACK 32
+
+typedef enum {
+  exprOpConst = 0,
+  exprOpLoad,
+  exprOpSum,
+  exprOpCount,
+  exprOpAny,
+  exprOpAll,
+  exprOpMin,
+  exprOpMax,
+  exprOpAvg,
+  exprOpNeg,
+  exprOpNot,
+  exprOpAdd,
+  exprOpSub,
+  exprOpMul,
+  exprOpDiv,
+  exprOpLt,
+  exprOpLe,
+  exprOpGt,
+  exprOpGe,
+  exprOpEq,
+  exprOpNe,
+  exprOpAnd,
+  exprOpOr
+} EXPR_OP_T;
+
+typedef struct {
+  EXPR_OP_T op;
+  int leaf;
+  int count;
+  double val;
+} EXPR_INSN_T;
+
+struct EXPR {
+  int code_len;
+  EXPR_INSN_T *code;
+  int leaf_count;
+  CONF_JSON_ITEM_T **leafs;
+};
+
+typedef struct {
+  const char *name;
+  EXPR_OP_T op;
+} EXPR_FUNC_T;
+
+typedef struct {
+  const char *src;
+  const char *pos;
+  CONF_JSON_ITEM_T *scope;
+  struct EXPR *expr;
+  int depth;
+  bool failed;
+  char *err;
+  size_t errlen;
+} EXPR_COMPILER_T;
+
+typedef struct {
+  EXPR_COMPILER_T *c;
+  int count;
+  CONF_JSON_ITEM_T *bad;
+} EXPR_MATCH_CTX_T;
+
+static const EXPR_FUNC_T funcs[] = {
+  { "sum", exprOpSum },
+  { "count", exprOpCount },
+  { "any", exprOpAny },
+  { "all", exprOpAll },
+  { "min", exprOpMin },
+  { "max", exprOpMax },
+  { "avg", exprOpAvg },
+  { NULL, 0 }
+};
+
+static void set_error(EXPR_COMPILER_T *c, const char *fmt, ...);
+static void skip_ws(EXPR_COMPILER_T *c);
+static bool accept_token(EXPR_COMPILER_T *c, const char *tok);
+static void emit(EXPR_COMPILER_T *c, EXPR_OP_T op, int leaf, int count, double val);
+static void match_leaf(CONF_JSON_ITEM_T *json, void *data);
+static int resolve_leafs(EXPR_COMPILER_T *c, const char *path_str, size_t len, int *first);
+static void compile_primary(EXPR_COMPILER_T *c);
+static void compile_unary(EXPR_COMPILER_T *c);
+static void compile_mul(EXPR_COMPILER_T *c);
+static void compile_add(EXPR_COMPILER_T *c);
+static void compile_cmp(EXPR_COMPILER_T *c);
+static void compile_and(EXPR_COMPILER_T *c);
+static void compile_or(EXPR_COMPILER_T *c);
+static double eval_aggregate(const struct EXPR *expr, const EXPR_INSN_T *insn);
+
+static void set_error(EXPR_COMPILER_T *c, const char *fmt, ...) {
+  va_list ap;
+  int len;
+
+  // keep first error only
+  if (c->failed) {
+    return;
+  }
+  c->failed = true;
+
+  len = snprintf(c->err, c->errlen, "at position %d: ", (int) (c->pos - c->src));
+  if (len < 0 || (size_t) len >= c->errlen) {
+    return;
+  }
+
+  va_start(ap, fmt);
+  vsnprintf(c->err + len, c->errlen - len, fmt, ap);
+  va_end(ap);
+}
+
+static void skip_ws(EXPR_COMPILER_T *c) {
+  while (isspace((unsigned char) *c->pos)) {
+    c->pos++;
+  }
+}
+
+static bool accept_token(EXPR_COMPILER_T *c, const char *tok) {
+  size_t len = strlen(tok);
+
+  skip_ws(c);
+  if (strncmp(c->pos, tok, len) != 0) {
+    return false;
+  }
+
+  // don't split two char operators
+  if (len == 1 && (*tok == '<' || *tok == '>' || *tok == '!') && c->pos[1] == '=') {
+    return false;
+  }
+
+  c->pos += len;
+  return true;
+}
+
+static void emit(EXPR_COMPILER_T *c, EXPR_OP_T op, int leaf, int count, double val) {
+  struct EXPR *expr = c->expr;
+  EXPR_INSN_T *code;
+
+  if (c->failed) {
+    return;
+  }
+
+  // track stack depth: loads push, unary ops keep, binary ops pop one
+  if (op <= exprOpAvg) {
+    c->depth++;
+  } else if (op >= exprOpAdd) {
+    c->depth--;
+  }
+  if (c->depth > EXPR_MAX_STACK) {
+    set_error(c, "expression nested too deep");
+    return;
+  }
+
+  code = realloc(expr->code, (expr->code_len + 1) * sizeof(EXPR_INSN_T));
+  if (code == NULL) {
+    set_error(c, "unable to alloc memory for bytecode");
+    return;
+  }
+  expr->code = code;
+
+  code[expr->code_len].op = op;
+  code[expr->code_len].leaf = leaf;
+  code[expr->code_len].count = count;
+  code[expr->code_len].val = val;
+  expr->code_len++;
+}
+
+static void match_leaf(CONF_JSON_ITEM_T *json, void *data) {
+  EXPR_MATCH_CTX_T *ctx = (EXPR_MATCH_CTX_T *) data;
+  struct EXPR *expr = ctx->c->expr;
+  CONF_JSON_ITEM_T **leafs;
+
+  // only hal backed values can be referenced (no containers, no other computed values)
+  if (!CONF_TYPE_IS_HAL(json->type)) {
+    if (ctx->bad == NULL) {
+      ctx->bad = json;
+    }
+    return;
+  }
+
+  leafs = realloc(expr->leafs, (expr->leaf_count + 1) * sizeof(CONF_JSON_ITEM_T *));
+  if (leafs == NULL) {
+    set_error(ctx->c, "unable to alloc memory for leaf table");
+    return;
+  }
+  expr->leafs = leafs;
+  leafs[expr->leaf_count++] = json;
+  ctx->count++;
+}
+
+static int resolve_leafs(EXPR_COMPILER_T *c, const char *path_str, size_t len, int *first) {
+  EXPR_MATCH_CTX_T ctx;
+  PATH_T *path;
+
+  path = path_parse(path_str, len);
+  if (path == NULL) {
+    set_error(c, "invalid path '%.*s'", (int) len, path_str);
+    return -1;
+  }
+
+  ctx.c = c;
+  ctx.count = 0;
+  ctx.bad = NULL;
+  *first = c->expr->leaf_count;
+  path_resolve(path, c->scope, match_leaf, &ctx);
+  path_free(path);
+
+  if (c->failed) {
+    return -1;
+  }
+  if (ctx.bad != NULL) {
+    set_error(c, "path '%.*s' matches '%s', which is not a pin, param or ref", (int) len, path_str, ctx.bad->name);
+    return -1;
+  }
+  if (ctx.count == 0) {
+    set_error(c, "path '%.*s' matches nothing", (int) len, path_str);
+    return -1;
+  }
+
+  return ctx.count;
+}
+
+static void compile_primary(EXPR_COMPILER_T *c) {
+  const EXPR_FUNC_T *func;
+  const char *start;
+  const char *end;
+  char *num_end;
+  size_t len;
+  double val;
+  int first;
+  int count;
+
+  if (c->failed) {
+    return;
+  }
+
+  // parenthesis
+  if (accept_token(c, "(")) {
+    compile_or(c);
+    if (!accept_token(c, ")")) {
+      set_error(c, "missing ')'");
+    }
+    return;
+  }
+
+  skip_ws(c);
+  start = c->pos;
+
+  // number
+  if (isdigit((unsigned char) *start) || *start == '.') {
+    val = strtod(start, &num_end);
+    if (num_end == start) {
+      set_error(c, "invalid number");
+      return;
+    }
+    c->pos = num_end;
+    emit(c, exprOpConst, 0, 0, val);
+    return;
+  }
+
+  // path or function name
+  for (end = start; *end != 0; end++) {
+    if (isalnum((unsigned char) *end) || *end == '_' || *end == '.') {
+      continue;
+    }
+    if (*end == '[') {
+      for (; *end != 0 && *end != ']'; end++);
+      if (*end == 0) {
+        break;
+      }
+      continue;
+    }
+    break;
+  }
+  len = end - start;
+  if (len == 0) {
+    if (*start == 0) {
+      set_error(c, "unexpected end of expression");
+    } else {
+      set_error(c, "unexpected '%c'", *start);
+    }
+    return;
+  }
+  c->pos = end;
+
+  // function call
+  if (accept_token(c, "(")) {
+    for (func = funcs; func->name != NULL; func++) {
+      if (strlen(func->name) == len && strncasecmp(func->name, start, len) == 0) {
+        break;
+      }
+    }
+    if (func->name == NULL) {
+      set_error(c, "unknown function '%.*s'", (int) len, start);
+      return;
+    }
+
+    skip_ws(c);
+    start = c->pos;
+    for (end = start; *end != 0 && *end != ')' && !isspace((unsigned char) *end); end++);
+    c->pos = end;
+    if (!accept_token(c, ")")) {
+      set_error(c, "function '%s' takes a single path argument", func->name);
+      return;
+    }
+
+    count = resolve_leafs(c, start, end - start, &first);
+    if (count < 0) {
+      return;
+    }
+    emit(c, func->op, first, count, 0.0);
+    return;
+  }
+
+  // plain value, must reference exactly one leaf
+  count = resolve_leafs(c, start, len, &first);
+  if (count < 0) {
+    return;
+  }
+  if (count != 1) {
+    set_error(c, "path '%.*s' matches %d values, use an aggregate function", (int) len, start, count);
+    return;
+  }
+  emit(c, exprOpLoad, first, 1, 0.0);
+}
+
+static void compile_unary(EXPR_COMPILER_T *c) {
+  if (accept_token(c, "-")) {
+    compile_unary(c);
+    emit(c, exprOpNeg, 0, 0, 0.0);
+    return;
+  }
+  if (accept_token(c, "!")) {
+    compile_unary(c);
+    emit(c, exprOpNot, 0, 0, 0.0);
+    return;
+  }
+
+  compile_primary(c);
+}
+
+static void compile_mul(EXPR_COMPILER_T *c) {
+  compile_unary(c);
+  while (!c->failed) {
+    if (accept_token(c, "*")) {
+      compile_unary(c);
+      emit(c, exprOpMul, 0, 0, 0.0);
+    } else if (accept_token(c, "/")) {
+      compile_unary(c);
+      emit(c, exprOpDiv, 0, 0, 0.0);
+    } else {
+      break;
+    }
+  }
+}
+
+static void compile_add(EXPR_COMPILER_T *c) {
+  compile_mul(c);
+  while (!c->failed) {
+    if (accept_token(c, "+")) {
+      compile_mul(c);
+      emit(c, exprOpAdd, 0, 0, 0.0);
+    } else if (accept_token(c, "-")) {
+      compile_mul(c);
+      emit(c, exprOpSub, 0, 0, 0.0);
+    } else {
+      break;
+    }
+  }
+}
+
+static void compile_cmp(EXPR_COMPILER_T *c) {
+  EXPR_OP_T op;
+
+  compile_add(c);
+  while (!c->failed) {
+    if (accept_token(c, "<=")) {
+      op = exprOpLe;
+    } else if (accept_token(c, ">=")) {
+      op = exprOpGe;
+    } else if (accept_token(c, "==")) {
+      op = exprOpEq;
+    } else if (accept_token(c, "!=")) {
+      op = exprOpNe;
+    } else if (accept_token(c, "<")) {
+      op = exprOpLt;
+    } else if (accept_token(c, ">")) {
+      op = exprOpGt;
+    } else {
+      break;
+    }
+    compile_add(c);
+    emit(c, op, 0, 0, 0.0);
+  }
+}
+
+static void compile_and(EXPR_COMPILER_T *c) {
+  compile_cmp(c);
+  while (!c->failed && accept_token(c, "&&")) {
+    compile_cmp(c);
+    emit(c, exprOpAnd, 0, 0, 0.0);
+  }
+}
+
+static void compile_or(EXPR_COMPILER_T *c) {
+  compile_and(c);
+  while (!c->failed && accept_token(c, "||")) {
+    compile_and(c);
+    emit(c, exprOpOr, 0, 0, 0.0);
+  }
+}
+
+struct EXPR *expr_compile(const char *src, CONF_JSON_ITEM_T *scope, char *err, size_t errlen) {
+  EXPR_COMPILER_T c;
+
+  memset(&c, 0, sizeof(c));
+  c.src = src;
+  c.pos = src;
+  c.scope = scope;
+  c.err = err;
+  c.errlen = errlen;
+
+  c.expr = calloc(1, sizeof(struct EXPR));
+  if (c.expr == NULL) {
+    snprintf(err, errlen, "unable to alloc memory for expression");
+    return NULL;
+  }
+
+  compile_or(&c);
+  skip_ws(&c);
+  if (!c.failed && *c.pos != 0) {
+    set_error(&c, "unexpected '%c'", *c.pos);
+  }
+  if (!c.failed && c.expr->code_len == 0) {
+    set_error(&c, "empty expression");
+  }
+
+  if (c.failed) {
+    expr_free(c.expr);
+    return NULL;
+  }
+
+  return c.expr;
+}
+
+void expr_free(struct EXPR *expr) {
+  if (expr == NULL) {
+    return;
+  }
+
+  free(expr->code);
+  free(expr->leafs);
+  free(expr);
+}
+
+static double eval_aggregate(const struct EXPR *expr, const EXPR_INSN_T *insn) {
+  CONF_JSON_ITEM_T **leaf = &expr->leafs[insn->leaf];
+  CONF_JSON_ITEM_T **end = leaf + insn->count;
+  double acc;
+  double val;
+  int nonzero = 0;
+
+  // leaf ranges are never empty, this is checked at compile time
+  acc = hal_get_json_double(*leaf);
+  if (acc != 0.0) {
+    nonzero++;
+  }
+
+  for (leaf++; leaf < end; leaf++) {
+    val = hal_get_json_double(*leaf);
+    if (val != 0.0) {
+      nonzero++;
+    }
+    switch (insn->op) {
+      case exprOpMin:
+        if (val < acc) {
+          acc = val;
+        }
+        break;
+      case exprOpMax:
+        if (val > acc) {
+          acc = val;
+        }
+        break;
+      default:
+        acc += val;
+        break;
+    }
+  }
+
+  switch (insn->op) {
+    case exprOpCount:
+      return nonzero;
+    case exprOpAny:
+      return nonzero > 0;
+    case exprOpAll:
+      return nonzero == insn->count;
+    case exprOpAvg:
+      return acc / insn->count;
+    default:
+      return acc;
+  }
+}
+
+double expr_eval(const struct EXPR *expr) {
+  double stack[EXPR_MAX_STACK];
+  const EXPR_INSN_T *insn;
+  const EXPR_INSN_T *end = expr->code + expr->code_len;
+  int sp = 0;
+  double a, b;
+
+  for (insn = expr->code; insn < end; insn++) {
+    switch (insn->op) {
+      case exprOpConst:
+        stack[sp++] = insn->val;
+        continue;
+      case exprOpLoad:
+        stack[sp++] = hal_get_json_double(expr->leafs[insn->leaf]);
+        continue;
+      case exprOpSum:
+      case exprOpCount:
+      case exprOpAny:
+      case exprOpAll:
+      case exprOpMin:
+      case exprOpMax:
+      case exprOpAvg:
+        stack[sp++] = eval_aggregate(expr, insn);
+        continue;
+      case exprOpNeg:
+        stack[sp - 1] = -stack[sp - 1];
+        continue;
+      case exprOpNot:
+        stack[sp - 1] = (stack[sp - 1] == 0.0);
+        continue;
+      default:
+        break;
+    }
+
+    // binary operators
+    b = stack[--sp];
+    a = stack[sp - 1];
+    switch (insn->op) {
+      case exprOpAdd:
+        a = a + b;
+        break;
+      case exprOpSub:
+        a = a - b;
+        break;
+      case exprOpMul:
+        a = a * b;
+        break;
+      case exprOpDiv:
+        a = a / b;
+        break;
+      case exprOpLt:
+        a = a < b;
+        break;
+      case exprOpLe:
+        a = a <= b;
+        break;
+      case exprOpGt:
+        a = a > b;
+        break;
+      case exprOpGe:
+        a = a >= b;
+        break;
+      case exprOpEq:
+        a = a == b;
+        break;
+      case exprOpNe:
+        a = a != b;
+        break;
+      case exprOpAnd:
+        a = (a != 0.0) && (b != 0.0);
+        break;
+      case exprOpOr:
+        a = (a != 0.0) || (b != 0.0);
+        break;
+      default:
+        break;
+    }
+    stack[sp - 1] = a;
+  }
+
+  return stack[0];
+}
+
+void expr_eval_hal(const struct EXPR *expr, hal_type_t type, EXPR_VALUE_T *val) {
+  double v = expr_eval(expr);
+
+  // integer results are rounded and saturated, NaN maps to zero
+  switch (type) {
+    case HAL_BIT:
+      val->bit = !isnan(v) && v != 0.0;
+      break;
+    case HAL_U32:
+      if (!(v > 0.0)) {
+        val->u32 = 0;
+      } else if (v >= 4294967295.0) {
+        val->u32 = UINT32_MAX;
+      } else {
+        val->u32 = (hal_u32_t) rint(v);
+      }
+      break;
+    case HAL_S32:
+      if (isnan(v)) {
+        val->s32 = 0;
+      } else if (v <= -2147483648.0) {
+        val->s32 = INT32_MIN;
+      } else if (v >= 2147483647.0) {
+        val->s32 = INT32_MAX;
+      } else {
+        val->s32 = (hal_s32_t) rint(v);
+      }
+      break;
+    default:
+      val->flt = v;
+      break;
+  }
+}
@@ -0,0 +1,22 @@
+#ifndef LCREST_EXPR_H
+#define LCREST_EXPR_H
+
+#include <stddef.h>
+
+#include "lcrest.h"
+#include "lcrest_conf.h"
+
+typedef union {
+  hal_bit_t bit;
+  hal_u32_t u32;
+  hal_s32_t s32;
+  hal_float_t flt;
+} EXPR_VALUE_T;
+
+struct EXPR *expr_compile(const char *src, CONF_JSON_ITEM_T *scope, char *err, size_t errlen);
+void expr_free(struct EXPR *expr);
+
+double expr_eval(const struct EXPR *expr);
+void expr_eval_hal(const struct EXPR *expr, hal_type_t type, EXPR_VALUE_T *val);
+
+#endif
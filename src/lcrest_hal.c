@@ -1,14 +1,24 @@
 #include <stdio.h>
+#include <string.h>
+
+#include "hal_priv.h"
 
 #include "lcrest.h"
 #include "lcrest_conf.h"
 #include "lcrest_hal.h"
+#include "lcrest_audit.h"
 
 static int export_json_pins(CONF_JSON_ITEM_T *json, const char *pfx, void **hal_data_ptr);
 static int export_json_pin(CONF_JSON_ITEM_T *json, const char *name, void **hal_data_ptr);
+static int resolve_json_refs(CONF_JSON_ITEM_T *json);
+static int resolve_json_ref(CONF_JSON_ITEM_T *json);
+static uint64_t hash_json_values(CONF_JSON_ITEM_T *json, uint64_t hash);
 
 int hal_comp_id;
 
+// snapshot of the current root (RT sampler), per request thread
+static __thread const char *json_view;
+
 static int export_json_pins(CONF_JSON_ITEM_T *json, const char *pfx, void **hal_data_ptr) {
   char name[HAL_NAME_LEN];
 
@@ -38,6 +48,13 @@ static int export_json_pins(CONF_JSON_ITEM_T *json, const char *pfx, void **hal_
         fprintf(stderr, "%s: ERROR: failed to export param/pin '%s'\n", modname, name);
         return -1;
       }
+
+      // the pin's data pointer is only valid here, the RT sampler needs the object
+      if (json->type == confTypeJsonPin) {
+        rtapi_mutex_get(&(hal_data->mutex));
+        json->hal.pin.obj = halpr_find_pin_by_name(name);
+        rtapi_mutex_give(&(hal_data->mutex));
+      }
     }
   }
 
@@ -127,112 +144,313 @@ int hal_export_json_pins(CONF_ROOT_T *conf) {
     fprintf(stderr, "%s: ERROR: unable to allocate HAL shared memory for json pins\n", modname);
     return -1;
   }
+  conf->json_hal_data = hal_data;
 
   // export pins
   return export_json_pins(conf->json, "json", &hal_data);
 }
 
-bool hal_validate_json_type(hal_type_t type, json_t *val) {
-    switch (type) {
-      case HAL_BIT:
-        return json_is_boolean(val);
-      case HAL_U32:
-        return json_is_integer(val);
-      case HAL_S32:
-        return json_is_integer(val);
-      case HAL_FLOAT:
-        return json_is_number(val);
-      default:
-        return false;
+static int resolve_json_refs(CONF_JSON_ITEM_T *json) {
+  for (; json != NULL; json = json->next) {
+    if (json->childs != NULL && resolve_json_refs(json->childs)) {
+      return -1;
+    }
+
+    if (json->type == confTypeJsonRef && resolve_json_ref(json)) {
+      return -1;
     }
+  }
+
+  return 0;
 }
 
-json_t *hal_read_json_pin(CONF_JSON_ITEM_T *json) {
-  if (json->type == confTypeJsonPin) {
-    switch (json->hal.type) {
-      case HAL_BIT:
-        return json_boolean(**(json->hal.pin.ptr.bit));
-      case HAL_U32:
-        return json_integer(**(json->hal.pin.ptr.u32));
-      case HAL_S32:
-        return json_integer(**(json->hal.pin.ptr.s32));
-      case HAL_FLOAT:
-        return json_real(**(json->hal.pin.ptr.flt));
-      default:
-        return NULL;
+static int resolve_json_ref(CONF_JSON_ITEM_T *json) {
+  const char *target = json->hal.ref.target;
+  hal_pin_t *pin;
+  hal_sig_t *sig;
+  hal_param_t *param;
+  hal_type_t type;
+
+  // pins are looked up through their signal on each access, so relinking is followed
+  if ((pin = halpr_find_pin_by_name(target)) != NULL) {
+    if (json->hal.ref.writable && pin->dir == HAL_OUT) {
+      fprintf(stderr, "%s: ERROR: halJsonRef target pin '%s' is an output and can't be written\n", modname, target);
+      return -1;
+    }
+    json->hal.ref.type = confRefPin;
+    json->hal.ref.obj = pin;
+    type = pin->type;
+  } else if ((sig = halpr_find_sig_by_name(target)) != NULL) {
+    json->hal.ref.type = confRefSignal;
+    json->hal.ref.obj = sig;
+    json->hal.ref.ptr.ptr = SHMPTR(sig->data_ptr);
+    type = sig->type;
+  } else if ((param = halpr_find_param_by_name(target)) != NULL) {
+    if (json->hal.ref.writable && param->dir == HAL_RO) {
+      fprintf(stderr, "%s: ERROR: halJsonRef target param '%s' is read only\n", modname, target);
+      return -1;
     }
+    json->hal.ref.type = confRefParam;
+    json->hal.ref.obj = param;
+    json->hal.ref.ptr.ptr = SHMPTR(param->data_ptr);
+    type = param->type;
+  } else {
+    fprintf(stderr, "%s: ERROR: halJsonRef target '%s' not found\n", modname, target);
+    return -1;
   }
 
-  if (json->type == confTypeJsonParam) {
-    switch (json->hal.type) {
+  // check for supported types
+  if (hal_get_param_size(type) == 0) {
+    fprintf(stderr, "%s: ERROR: halJsonRef target '%s' has unsupported type\n", modname, target);
+    return -1;
+  }
+
+  json->hal.type = type;
+  return 0;
+}
+
+int hal_resolve_json_refs(CONF_ROOT_T *conf) {
+  int ret;
+
+  rtapi_mutex_get(&(hal_data->mutex));
+  ret = resolve_json_refs(conf->json);
+  rtapi_mutex_give(&(hal_data->mutex));
+
+  return ret;
+}
+
+bool hal_validate_json_type(hal_type_t type, const HAL_VALUE_T *val) {
+    switch (type) {
       case HAL_BIT:
-        return json_boolean(*(json->hal.param.ptr.bit));
+        return val->type == halValueBool;
       case HAL_U32:
-        return json_integer(*(json->hal.param.ptr.u32));
+        return val->type == halValueInt;
       case HAL_S32:
-        return json_integer(*(json->hal.param.ptr.s32));
+        return val->type == halValueInt;
       case HAL_FLOAT:
-        return json_real(*(json->hal.param.ptr.flt));
+        return val->type == halValueInt || val->type == halValueReal;
       default:
-        return NULL;
+        return false;
     }
+}
+
+volatile void *hal_get_pin_value_ptr(void *pin_obj) {
+  hal_pin_t *pin = (hal_pin_t *) pin_obj;
+  hal_sig_t *sig;
+
+  // the pin's data pointer is only valid in the owner's address space
+  if (pin->signal != 0) {
+    sig = SHMPTR(pin->signal);
+    return SHMPTR(sig->data_ptr);
   }
 
-  return NULL;
+  return &(pin->dummysig);
 }
 
-int hal_write_json_pin(CONF_JSON_ITEM_T *json, json_t *val) {
-  if (!hal_validate_json_type(json->hal.type, val)) {
-    return -1;
+volatile void *hal_get_json_ptr(CONF_JSON_ITEM_T *json) {
+  // bound to local data (replay)
+  if (json->local_ptr != NULL) {
+    return json->local_ptr;
   }
 
-  if (json->type == confTypeJsonPin) {
-    if (json->hal.pin.dir != HAL_OUT && json->hal.pin.dir != HAL_IO) {
-      return -1;
-    }
+  // values of a sampled cycle
+  if (json_view != NULL && CONF_TYPE_IS_HAL(json->type)) {
+    return (volatile void *) (json_view + json->snap_offset);
+  }
 
-    switch (json->hal.type) {
-      case HAL_BIT:
-        **(json->hal.pin.ptr.bit) = json_is_true(val);
-        return 0;
-      case HAL_U32:
-        **(json->hal.pin.ptr.u32) = json_integer_value(val);
-        return 0;
-      case HAL_S32:
-        **(json->hal.pin.ptr.s32) = json_integer_value(val);
-        return 0;
-      case HAL_FLOAT:
-        **(json->hal.pin.ptr.flt) = json_number_value(val);
-        return 0;
-      default:
-        return -1;
-    }
+  switch (json->type) {
+    case confTypeJsonPin:
+      return *(json->hal.pin.ptr.bit);
+    case confTypeJsonParam:
+      return json->hal.param.ptr.ptr;
+    case confTypeJsonRef:
+      if (json->hal.ref.type == confRefPin) {
+        return hal_get_pin_value_ptr(json->hal.ref.obj);
+      }
+      return json->hal.ref.ptr.ptr;
+    default:
+      return NULL;
   }
+}
 
-  if (json->type == confTypeJsonParam) {
-    if (json->hal.param.dir != HAL_RW) {
+void hal_set_json_view(const char *data) {
+  json_view = data;
+}
+
+const char *hal_get_json_view(void) {
+  return json_view;
+}
+
+bool hal_is_json_writable(CONF_JSON_ITEM_T *json) {
+  // local data and sampled cycles are read only
+  if (json->local_ptr != NULL || json_view != NULL) {
+    return false;
+  }
+
+  switch (json->type) {
+    case confTypeJsonPin:
+      return json->hal.pin.dir == HAL_OUT || json->hal.pin.dir == HAL_IO;
+    case confTypeJsonParam:
+      return json->hal.param.dir == HAL_RW;
+    case confTypeJsonRef:
+      if (!json->hal.ref.writable) {
+        return false;
+      }
+      // only write where no one else drives the value
+      switch (json->hal.ref.type) {
+        case confRefPin:
+          return ((hal_pin_t *) json->hal.ref.obj)->signal == 0;
+        case confRefSignal:
+          return ((hal_sig_t *) json->hal.ref.obj)->writers == 0;
+        case confRefParam:
+          return ((hal_param_t *) json->hal.ref.obj)->dir != HAL_RO;
+        default:
+          return false;
+      }
+    default:
+      return false;
+  }
+}
+
+void hal_read_value(hal_type_t type, volatile void *ptr, HAL_VALUE_T *val) {
+  switch (type) {
+    case HAL_BIT:
+      val->type = halValueBool;
+      val->b = *((hal_bit_t *) ptr);
+      return;
+    case HAL_U32:
+      val->type = halValueInt;
+      val->i = *((hal_u32_t *) ptr);
+      return;
+    case HAL_S32:
+      val->type = halValueInt;
+      val->i = *((hal_s32_t *) ptr);
+      return;
+    case HAL_FLOAT:
+      val->type = halValueReal;
+      val->d = *((hal_float_t *) ptr);
+      return;
+    default:
+      val->type = halValueNone;
+      return;
+  }
+}
+
+int hal_store_value(hal_type_t type, volatile void *ptr, const HAL_VALUE_T *val) {
+  switch (type) {
+    case HAL_BIT:
+      *((hal_bit_t *) ptr) = val->b;
+      return 0;
+    case HAL_U32:
+      *((hal_u32_t *) ptr) = val->i;
+      return 0;
+    case HAL_S32:
+      *((hal_s32_t *) ptr) = val->i;
+      return 0;
+    case HAL_FLOAT:
+      *((hal_float_t *) ptr) = (val->type == halValueInt) ? val->i : val->d;
+      return 0;
+    default:
       return -1;
+  }
+}
+
+double hal_get_json_double(CONF_JSON_ITEM_T *json) {
+  volatile void *ptr = hal_get_json_ptr(json);
+
+  if (ptr == NULL) {
+    return 0.0;
+  }
+
+  switch (json->hal.type) {
+    case HAL_BIT:
+      return *((volatile hal_bit_t *) ptr) ? 1.0 : 0.0;
+    case HAL_U32:
+      return *((volatile hal_u32_t *) ptr);
+    case HAL_S32:
+      return *((volatile hal_s32_t *) ptr);
+    case HAL_FLOAT:
+      return *((volatile hal_float_t *) ptr);
+    default:
+      return 0.0;
+  }
+}
+
+static uint64_t hash_json_values(CONF_JSON_ITEM_T *json, uint64_t hash) {
+  volatile void *ptr;
+  size_t size;
+  uint8_t val[sizeof(hal_float_t)];
+  size_t i;
+
+  for (; json != NULL; json = json->next) {
+    hash = hash_json_values(json->childs, hash);
+
+    // computed values follow their inputs
+    if (!CONF_TYPE_IS_HAL(json->type)) {
+      continue;
     }
 
-    switch (json->hal.type) {
-      case HAL_BIT:
-        *(json->hal.param.ptr.bit) = json_is_true(val);
-        return 0;
-      case HAL_U32:
-        *(json->hal.param.ptr.u32) = json_integer_value(val);
-        return 0;
-      case HAL_S32:
-        *(json->hal.param.ptr.s32) = json_integer_value(val);
-        return 0;
-      case HAL_FLOAT:
-        *(json->hal.param.ptr.flt) = json_number_value(val);
-        return 0;
-      default:
-        return -1;
+    ptr = hal_get_json_ptr(json);
+    size = (json->hal.type == HAL_BIT) ? sizeof(hal_bit_t) : (json->hal.type == HAL_FLOAT) ? sizeof(hal_float_t) : sizeof(hal_u32_t);
+    if (ptr == NULL) {
+      memset(val, 0, size);
+    } else {
+      memcpy(val, (const void *) ptr, size);
+    }
+
+    // FNV-1a
+    for (i = 0; i < size; i++) {
+      hash = (hash ^ val[i]) * 0x100000001b3ULL;
     }
   }
 
-  return -1;
+  return hash;
+}
+
+uint64_t hal_get_json_generation(CONF_JSON_ITEM_T *root) {
+  return hash_json_values(root->childs, 0xcbf29ce484222325ULL);
+}
+
+int hal_write_json_pin(CONF_JSON_ITEM_T *json, const HAL_VALUE_T *val, const struct sockaddr *client) {
+  volatile void *ptr;
+  HAL_VALUE_T old_val, new_val;
+
+  ptr = hal_get_json_ptr(json);
+  if (ptr == NULL) {
+    return -1;
+  }
+
+  hal_read_value(json->hal.type, ptr, &old_val);
+
+  if (!hal_validate_json_type(json->hal.type, val) || !hal_is_json_writable(json)) {
+    audit_record(json, client, false, &old_val, val);
+    return -1;
+  }
+
+  if (hal_store_value(json->hal.type, ptr, val)) {
+    return -1;
+  }
+
+  // record the value as stored
+  hal_read_value(json->hal.type, ptr, &new_val);
+  audit_record(json, client, true, &old_val, &new_val);
+
+  return 0;
+}
+
+const char *hal_get_type_name(hal_type_t type) {
+  switch (type) {
+    case HAL_BIT:
+      return "bit";
+    case HAL_U32:
+      return "u32";
+    case HAL_S32:
+      return "s32";
+    case HAL_FLOAT:
+      return "float";
+    default:
+      return "unknown";
+  }
 }
 
 size_t hal_get_pin_size(hal_type_t type) {
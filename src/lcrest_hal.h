@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <sys/socket.h>
 
 #include <jansson.h>
 
@@ -11,14 +12,40 @@
 #include "lcrest.h"
 #include "lcrest_conf.h"
 
+typedef enum {
+  halValueNone = 0,
+  halValueBool,
+  halValueInt,
+  halValueReal
+} HAL_VALUE_TYPE_T;
+
+typedef struct {
+  HAL_VALUE_TYPE_T type;
+  union {
+    bool b;
+    json_int_t i;
+    double d;
+  };
+} HAL_VALUE_T;
+
 extern int hal_comp_id;
 
 int hal_export_json_pins(CONF_ROOT_T *conf);
-
-bool hal_validate_json_type(hal_type_t type, json_t *val);
-json_t *hal_read_json_pin(CONF_JSON_ITEM_T *json);
-int hal_write_json_pin(CONF_JSON_ITEM_T *json, json_t *val);
-
+int hal_resolve_json_refs(CONF_ROOT_T *conf);
+
+bool hal_validate_json_type(hal_type_t type, const HAL_VALUE_T *val);
+volatile void *hal_get_pin_value_ptr(void *pin_obj);
+volatile void *hal_get_json_ptr(CONF_JSON_ITEM_T *json);
+void hal_set_json_view(const char *data);
+const char *hal_get_json_view(void);
+bool hal_is_json_writable(CONF_JSON_ITEM_T *json);
+void hal_read_value(hal_type_t type, volatile void *ptr, HAL_VALUE_T *val);
+int hal_store_value(hal_type_t type, volatile void *ptr, const HAL_VALUE_T *val);
+double hal_get_json_double(CONF_JSON_ITEM_T *json);
+uint64_t hal_get_json_generation(CONF_JSON_ITEM_T *root);
+int hal_write_json_pin(CONF_JSON_ITEM_T *json, const HAL_VALUE_T *val, const struct sockaddr *client);
+
+const char *hal_get_type_name(hal_type_t type);
 size_t hal_get_pin_size(hal_type_t type);
 size_t hal_get_param_size(hal_type_t type);
 
@@ -1,150 +1,869 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-#include <jansson.h>
-#include <string.h>
+#include <math.h>
+#include <pthread.h>
 
 #include "lcrest.h"
 #include "lcrest_conf.h"
 #include "lcrest_json.h"
 #include "lcrest_hal.h"
+#include "lcrest_path.h"
+#include "lcrest_dtoa.h"
+#include "lcrest_expr.h"
+#include "lcrest_sys.h"
+
+// compiled fields specs, the least recently used one is evicted when full
+#define JSON_FIELDS_CACHE_SIZE 64
+
+// nested arrays add one dimension each, bounded by the config nesting depth
+#define JSON_COLUMN_MAX_DIMS 32
+
+// roots with fewer items are always rendered by the calling thread
+#define JSON_RENDER_THRESHOLD 8192
+
+// separator state of a member list, carried across chunk boundaries
+typedef struct {
+  bool first;
+  CONF_JSON_ITEM_T *arr_last;
+} RENDER_STATE_T;
+
+typedef struct {
+  CONF_JSON_ITEM_T *start;
+  CONF_JSON_ITEM_T *end;
+  RENDER_STATE_T state;
+  BUF_T buf;
+} RENDER_CHUNK_T;
+
+typedef struct RENDER_BATCH {
+  struct RENDER_BATCH *next;
+  const JSON_FIELDS_T *fields;
+  JSON_LAYOUT_T layout;
+  const char *view;
+  RENDER_CHUNK_T *chunks;
+  int count;
+  int taken;
+  int done;
+} RENDER_BATCH_T;
+
+static JSON_FIELDS_T *fields_compile(CONF_JSON_ITEM_T *root, const char *spec);
+static void fields_free(JSON_FIELDS_T *fields);
+static void fields_select(CONF_JSON_ITEM_T *json, void *data);
+static void fields_select_childs(JSON_FIELDS_T *fields, CONF_JSON_ITEM_T *json);
 
+static void render_leaf(BUF_T *buf, CONF_JSON_ITEM_T *json);
+static void render_object(BUF_T *buf, CONF_JSON_ITEM_T *json, const JSON_FIELDS_T *fields, JSON_LAYOUT_T layout);
+static void render_members(BUF_T *buf, CONF_JSON_ITEM_T *json, const JSON_FIELDS_T *fields, JSON_LAYOUT_T layout);
+static void render_member_range(BUF_T *buf, CONF_JSON_ITEM_T *json, CONF_JSON_ITEM_T *end, const JSON_FIELDS_T *fields, JSON_LAYOUT_T layout, RENDER_STATE_T *st);
+static void render_column_values(BUF_T *buf, CONF_JSON_ITEM_T **items, int n, const int *dims, int ndims);
+static bool read_bit(CONF_JSON_ITEM_T *json);
+static void render_column_bits(BUF_T *buf, CONF_JSON_ITEM_T **items, int n);
+static void render_columns(BUF_T *buf, CONF_JSON_ITEM_T **cur, int n, const int *dims, int ndims, const JSON_FIELDS_T *fields, JSON_LAYOUT_T layout);
+static void render_column_array(BUF_T *buf, CONF_JSON_ITEM_T **cur, int n, const int *dims, int ndims, const JSON_FIELDS_T *fields, JSON_LAYOUT_T layout, bool *first);
 
-static void parse_array(const char *key, json_t *inp, CONF_JSON_ITEM_T *json);
-static void parse_value(const char *key, json_t *inp, CONF_JSON_ITEM_T *json);
+static void advance_state(RENDER_STATE_T *st, CONF_JSON_ITEM_T *json, const JSON_FIELDS_T *fields);
+static int split_chunks(CONF_JSON_ITEM_T *root, const JSON_FIELDS_T *fields, RENDER_CHUNK_T *chunks, int max);
+static int take_chunk(RENDER_BATCH_T *batch);
+static void finish_chunk(RENDER_BATCH_T *batch, int index);
+static void *render_worker(void *data);
+static int render_parallel(BUF_T *buf, CONF_JSON_ITEM_T *root, const JSON_FIELDS_T *fields, JSON_LAYOUT_T layout);
 
-static CONF_JSON_ITEM_T *find_conf_item(const char *key, CONF_JSON_ITEM_T *json);
+static pthread_mutex_t fields_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static JSON_FIELDS_T *fields_cache = NULL;
+static int fields_cache_count = 0;
 
-void json_build_response(json_t *ret, CONF_JSON_ITEM_T *json) {
-  json_t *obj, *arr = NULL;
+static pthread_mutex_t render_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t render_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t render_done = PTHREAD_COND_INITIALIZER;
+static RENDER_BATCH_T *render_queue = NULL;
+static pthread_t *render_threads = NULL;
+static int render_thread_count = 0;
+static int render_threshold = JSON_RENDER_THRESHOLD;
+static bool render_quit = false;
 
+static void fields_select_childs(JSON_FIELDS_T *fields, CONF_JSON_ITEM_T *json) {
   for (; json != NULL; json = json->next) {
-    switch (json->type) {
-      case confTypeJsonPin:
-      case confTypeJsonParam:
-        json_object_set_new(ret, json->name, hal_read_json_pin(json));
-        break;
+    JSON_FIELDS_SET(fields, json->item_index);
+    fields_select_childs(fields, json->childs);
+  }
+}
 
-      case confTypeJsonObject:
-        obj = json_object();
-        json_build_response(obj, json->childs);
-        json_object_set_new(ret, json->name, obj);
-        break;
+static void fields_select(CONF_JSON_ITEM_T *json, void *data) {
+  JSON_FIELDS_T *fields = (JSON_FIELDS_T *) data;
+  CONF_JSON_ITEM_T *parent;
 
-      case confTypeJsonArray:
-        if (json->array_index == 0 || arr == NULL) {
-          arr = json_array();
-          json_object_set_new(ret, json->name, arr);
-        }
-        obj = json_object();
-        json_build_response(obj, json->childs);
-        json_array_append_new(arr, obj);
-        break;
+  // select item with whole subtree
+  JSON_FIELDS_SET(fields, json->item_index);
+  fields_select_childs(fields, json->childs);
+
+  // containers on the way up must be rendered too
+  for (parent = json->parent; parent != NULL && parent->type != confTypeJsonRoot; parent = parent->parent) {
+    JSON_FIELDS_SET(fields, parent->item_index);
+  }
+}
+
+static JSON_FIELDS_T *fields_compile(CONF_JSON_ITEM_T *root, const char *spec) {
+  JSON_FIELDS_T *fields;
+  const char *pos, *end;
+  PATH_T *path;
+  int count;
+
+  fields = json_fields_alloc(root);
+  if (fields == NULL) {
+    return NULL;
+  }
+
+  fields->spec = strdup(spec);
+  if (fields->spec == NULL) {
+    fprintf(stderr, "%s: ERROR: unable to alloc memory for fields\n", modname);
+    goto fail;
+  }
+
+  for (pos = spec; *pos != 0; pos = (*end != 0) ? end + 1 : end) {
+    end = pos + strcspn(pos, ",");
+
+    path = path_parse(pos, end - pos);
+    if (path == NULL) {
+      goto fail;
+    }
+    count = path_resolve(path, root->childs, fields_select, fields);
+    path_free(path);
+
+    // reject typos instead of silently rendering nothing
+    if (count == 0) {
+      goto fail;
+    }
+  }
+
+  return fields;
+
+fail:
+  fields_free(fields);
+  return NULL;
+}
+
+static void fields_free(JSON_FIELDS_T *fields) {
+  free(fields->mask);
+  free(fields->spec);
+  free(fields);
+}
+
+JSON_FIELDS_T *json_fields_alloc(CONF_JSON_ITEM_T *root) {
+  JSON_FIELDS_T *fields;
+
+  fields = calloc(1, sizeof(JSON_FIELDS_T));
+  if (fields == NULL) {
+    fprintf(stderr, "%s: ERROR: unable to alloc memory for fields\n", modname);
+    return NULL;
+  }
+
+  fields->root = root;
+  fields->refs = 1;
+  fields->mask = calloc((root->item_count + 7) / 8 + 1, 1);
+  if (fields->mask == NULL) {
+    fprintf(stderr, "%s: ERROR: unable to alloc memory for fields\n", modname);
+    free(fields);
+    return NULL;
+  }
+
+  return fields;
+}
+
+void json_fields_add(JSON_FIELDS_T *fields, CONF_JSON_ITEM_T *json) {
+  fields_select(json, fields);
+}
+
+JSON_FIELDS_T *json_fields_get(CONF_JSON_ITEM_T *root, const char *spec) {
+  JSON_FIELDS_T *fields, *cur, **prev;
+
+  // most recently used first, hits move to the front
+  pthread_mutex_lock(&fields_cache_lock);
+  for (prev = &fields_cache; (cur = *prev) != NULL; prev = &cur->next) {
+    if (cur->root == root && strcmp(cur->spec, spec) == 0) {
+      *prev = cur->next;
+      cur->next = fields_cache;
+      fields_cache = cur;
+      cur->refs++;
+      pthread_mutex_unlock(&fields_cache_lock);
+      return cur;
+    }
+  }
+  pthread_mutex_unlock(&fields_cache_lock);
 
+  fields = fields_compile(root, spec);
+  if (fields == NULL) {
+    return NULL;
+  }
+
+  pthread_mutex_lock(&fields_cache_lock);
+
+  // another request may have compiled the same spec meanwhile
+  for (cur = fields_cache; cur != NULL; cur = cur->next) {
+    if (cur->root == root && strcmp(cur->spec, spec) == 0) {
+      cur->refs++;
+      pthread_mutex_unlock(&fields_cache_lock);
+      fields_free(fields);
+      return cur;
+    }
+  }
+
+  // evict the least recently used entry, it is freed by its last user
+  if (fields_cache_count >= JSON_FIELDS_CACHE_SIZE) {
+    for (prev = &fields_cache; (*prev)->next != NULL; prev = &(*prev)->next);
+    cur = *prev;
+    *prev = NULL;
+    fields_cache_count--;
+    cur->cached = false;
+    if (cur->refs == 0) {
+      fields_free(cur);
+    }
+  }
+
+  // one reference is held by the caller, none by the cache itself
+  fields->cached = true;
+  fields->next = fields_cache;
+  fields_cache = fields;
+  fields_cache_count++;
+
+  pthread_mutex_unlock(&fields_cache_lock);
+
+  return fields;
+}
+
+void json_fields_release(JSON_FIELDS_T *fields) {
+  bool unused;
+
+  if (fields == NULL) {
+    return;
+  }
+
+  pthread_mutex_lock(&fields_cache_lock);
+  unused = (--fields->refs == 0 && !fields->cached);
+  pthread_mutex_unlock(&fields_cache_lock);
+
+  if (unused) {
+    fields_free(fields);
+  }
+}
+
+void json_fields_cleanup(void) {
+  JSON_FIELDS_T *fields;
+
+  pthread_mutex_lock(&fields_cache_lock);
+  while (fields_cache != NULL) {
+    fields = fields_cache;
+    fields_cache = fields->next;
+    fields_free(fields);
+  }
+  fields_cache_count = 0;
+  pthread_mutex_unlock(&fields_cache_lock);
+}
+
+void json_put_string(BUF_T *buf, const char *str) {
+  static const char hex[] = "0123456789abcdef";
+  const char *start;
+  unsigned char c;
+
+  buf_putc(buf, '"');
+  for (start = str; (c = *str) != 0; str++) {
+    if (c >= 0x20 && c != '"' && c != '\\') {
+      continue;
+    }
+
+    // flush plain run
+    buf_put(buf, start, str - start);
+    start = str + 1;
+
+    buf_putc(buf, '\\');
+    switch (c) {
+      case '"':
+      case '\\':
+        buf_putc(buf, c);
+        break;
+      case '\b':
+        buf_putc(buf, 'b');
+        break;
+      case '\f':
+        buf_putc(buf, 'f');
+        break;
+      case '\n':
+        buf_putc(buf, 'n');
+        break;
+      case '\r':
+        buf_putc(buf, 'r');
+        break;
+      case '\t':
+        buf_putc(buf, 't');
+        break;
       default:
+        buf_puts(buf, "u00");
+        buf_putc(buf, hex[c >> 4]);
+        buf_putc(buf, hex[c & 15]);
         break;
     }
   }
+  buf_put(buf, start, str - start);
+  buf_putc(buf, '"');
 }
 
-void json_parse_request(json_t *inp, CONF_JSON_ITEM_T *json) {
-  const char *key;
-  json_t *value;
+void json_put_value(BUF_T *buf, hal_type_t type, volatile void *ptr, int precision) {
+  char *p;
+  double d;
 
-  if (!json_is_object(inp)) {
+  p = buf_reserve(buf, DTOA_BUFSIZE);
+  if (p == NULL) {
     return;
   }
 
-  json_object_foreach(inp, key, value) {
-    parse_value(key, value, json);
+  switch (type) {
+    case HAL_BIT:
+      if (*((hal_bit_t *) ptr)) {
+        memcpy(p, "true", 4);
+        buf->len += 4;
+      } else {
+        memcpy(p, "false", 5);
+        buf->len += 5;
+      }
+      return;
+    case HAL_U32:
+      buf->len += dtoa_int(*((hal_u32_t *) ptr), p);
+      return;
+    case HAL_S32:
+      buf->len += dtoa_int(*((hal_s32_t *) ptr), p);
+      return;
+    case HAL_FLOAT:
+      d = *((hal_float_t *) ptr);
+      if (!isfinite(d)) {
+        break;
+      }
+      if (precision >= 0) {
+        buf->len += dtoa_fixed(d, precision, p);
+      } else {
+        buf->len += dtoa_shortest(d, p);
+      }
+      return;
+    default:
+      break;
   }
+
+  memcpy(p, "null", 4);
+  buf->len += 4;
 }
 
-static void parse_array(const char *key, json_t *inp, CONF_JSON_ITEM_T *json) {
-  int index;
-  json_t *value;
+static void render_leaf(BUF_T *buf, CONF_JSON_ITEM_T *json) {
+  volatile void *ptr;
+  EXPR_VALUE_T computed;
 
-  if (!json_is_array(inp)) {
+  // computed fields are evaluated on each render
+  if (json->type == confTypeJsonComputed) {
+    expr_eval_hal(json->hal.computed.code, json->hal.type, &computed);
+    json_put_value(buf, json->hal.type, &computed, json->precision);
     return;
   }
 
-  json_array_foreach(inp, index, value) {
-    // array must contain objects
-    if (!json_is_object(value)) {
-      return;
+  ptr = hal_get_json_ptr(json);
+  if (ptr == NULL) {
+    buf_puts(buf, "null");
+    return;
+  }
+
+  json_put_value(buf, json->hal.type, ptr, json->precision);
+}
+
+static void render_object(BUF_T *buf, CONF_JSON_ITEM_T *json, const JSON_FIELDS_T *fields, JSON_LAYOUT_T layout) {
+  buf_putc(buf, '{');
+  render_members(buf, json, fields, layout);
+  buf_putc(buf, '}');
+}
+
+static void render_members(BUF_T *buf, CONF_JSON_ITEM_T *json, const JSON_FIELDS_T *fields, JSON_LAYOUT_T layout) {
+  RENDER_STATE_T st = { true, NULL };
+
+  render_member_range(buf, json, NULL, fields, layout, &st);
+
+  if (st.arr_last != NULL) {
+    buf_putc(buf, ']');
+  }
+}
+
+static void render_member_range(BUF_T *buf, CONF_JSON_ITEM_T *json, CONF_JSON_ITEM_T *end, const JSON_FIELDS_T *fields, JSON_LAYOUT_T layout, RENDER_STATE_T *st) {
+  for (; json != end; json = json->next) {
+    // skip items not selected by projection
+    if (fields != NULL && !JSON_FIELDS_ISSET(fields, json->item_index)) {
+      continue;
     }
 
-    // check for corresponding index
-    if (json->array_index != index) {
-      return;
+    // columnar arrays are rendered as a whole, json is moved to the last instance
+    if (json->type == confTypeJsonArray && layout != jsonLayoutRows) {
+      if (st->arr_last != NULL) {
+        buf_putc(buf, ']');
+        st->arr_last = NULL;
+      }
+      render_column_array(buf, &json, 1, NULL, 0, fields, layout, &st->first);
+      continue;
     }
 
-    // check name for safety
-    if (strcasecmp(key, json->name) != 0) {
-      return;
+    // array instances are consecutive items, leading ones may be skipped
+    if (json->type == confTypeJsonArray) {
+      if (st->arr_last != NULL && st->arr_last->name == json->name && st->arr_last->array_index < json->array_index) {
+        buf_putc(buf, ',');
+      } else {
+        if (st->arr_last != NULL) {
+          buf_putc(buf, ']');
+        }
+        if (!st->first) {
+          buf_putc(buf, ',');
+        }
+        st->first = false;
+        json_put_string(buf, json->name);
+        buf_puts(buf, ":[");
+      }
+      st->arr_last = json;
+      render_object(buf, json->childs, fields, layout);
+      continue;
     }
 
-    // process object
-    json_parse_request(value, json->childs);
+    // close pending array
+    if (st->arr_last != NULL) {
+      buf_putc(buf, ']');
+      st->arr_last = NULL;
+    }
 
-    // go to next config item
-    json = json->next;
-    if (json == NULL) {
-      return;
+    if (!CONF_TYPE_IS_LEAF(json->type) && json->type != confTypeJsonObject) {
+      continue;
+    }
+
+    if (!st->first) {
+      buf_putc(buf, ',');
+    }
+    st->first = false;
+    json_put_string(buf, json->name);
+    buf_putc(buf, ':');
+
+    if (json->type == confTypeJsonObject) {
+      render_object(buf, json->childs, fields, layout);
+    } else {
+      render_leaf(buf, json);
     }
   }
 }
 
-static void parse_value(const char *key, json_t *inp, CONF_JSON_ITEM_T *list) {
-  CONF_JSON_ITEM_T *json;
+// Columnar layout transposes arrays: each member becomes one JSON array
+// holding the values of all instances, nested arrays add a dimension.
+// Parallel instances are walked with one cursor each, since array copies
+// share the structure of the first instance.
+static void render_column_values(BUF_T *buf, CONF_JSON_ITEM_T **items, int n, const int *dims, int ndims) {
+  int sub = n / dims[0];
+  int i;
+
+  buf_putc(buf, '[');
+  if (ndims == 1) {
+    for (i = 0; i < n; i++) {
+      if (i > 0) {
+        buf_putc(buf, ',');
+      }
+      render_leaf(buf, items[i]);
+    }
+  } else {
+    for (i = 0; i < dims[0]; i++) {
+      if (i > 0) {
+        buf_putc(buf, ',');
+      }
+      render_column_values(buf, items + i * sub, sub, dims + 1, ndims - 1);
+    }
+  }
+  buf_putc(buf, ']');
+}
 
-  json = find_conf_item(key, list);
-  if (json == NULL) {
+static bool read_bit(CONF_JSON_ITEM_T *json) {
+  volatile void *ptr;
+  EXPR_VALUE_T computed;
+
+  if (json->type == confTypeJsonComputed) {
+    expr_eval_hal(json->hal.computed.code, HAL_BIT, &computed);
+    return computed.bit;
+  }
+
+  ptr = hal_get_json_ptr(json);
+  return ptr != NULL && *((volatile hal_bit_t *) ptr);
+}
+
+// Packed bit columns are a base64 string of all values in row major order,
+// value i is bit (i % 8) of byte (i / 8).
+static void render_column_bits(BUF_T *buf, CONF_JSON_ITEM_T **items, int n) {
+  static const char b64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  uint8_t bytes[3];
+  char out[4];
+  int i, j, len;
+
+  buf_putc(buf, '"');
+  for (i = 0; i < n; i += 24) {
+    // pack up to 24 values into one base64 quantum
+    memset(bytes, 0, sizeof(bytes));
+    for (j = 0; j < 24 && i + j < n; j++) {
+      if (read_bit(items[i + j])) {
+        bytes[j >> 3] |= 1 << (j & 7);
+      }
+    }
+    len = (j + 7) / 8;
+
+    out[0] = b64[bytes[0] >> 2];
+    out[1] = b64[((bytes[0] & 0x03) << 4) | (bytes[1] >> 4)];
+    out[2] = (len > 1) ? b64[((bytes[1] & 0x0f) << 2) | (bytes[2] >> 6)] : '=';
+    out[3] = (len > 2) ? b64[bytes[2] & 0x3f] : '=';
+    buf_put(buf, out, 4);
+  }
+  buf_putc(buf, '"');
+}
+
+static void render_columns(BUF_T *buf, CONF_JSON_ITEM_T **cur, int n, const int *dims, int ndims, const JSON_FIELDS_T *fields, JSON_LAYOUT_T layout) {
+  CONF_JSON_ITEM_T **it;
+  CONF_JSON_ITEM_T **sub;
+  CONF_JSON_ITEM_T *tmpl;
+  bool first = true;
+  int i;
+
+  it = malloc(2 * n * sizeof(CONF_JSON_ITEM_T *));
+  if (it == NULL) {
+    buf->error = true;
     return;
   }
+  sub = it + n;
+  memcpy(it, cur, n * sizeof(CONF_JSON_ITEM_T *));
 
-  switch (json->type) {
-    case confTypeJsonPin:
-    case confTypeJsonParam:
-      // TODO: handle data type missmatch
-      if (json_is_number(inp) || json_is_boolean(inp)) {
-        hal_write_json_pin(json, inp);
+  buf_putc(buf, '{');
+  while ((tmpl = it[0]) != NULL) {
+    // arrays select their instances on their own
+    if (tmpl->type == confTypeJsonArray) {
+      render_column_array(buf, it, n, dims, ndims, fields, layout, &first);
+    } else if ((fields == NULL || JSON_FIELDS_ISSET(fields, tmpl->item_index)) &&
+        (CONF_TYPE_IS_LEAF(tmpl->type) || tmpl->type == confTypeJsonObject)) {
+      if (!first) {
+        buf_putc(buf, ',');
       }
-      return;
+      first = false;
+      json_put_string(buf, tmpl->name);
+      buf_putc(buf, ':');
 
-    case confTypeJsonObject:
-      if (json_is_object(inp) && json->childs != NULL) {
-        json_parse_request(inp, json->childs);
+      if (tmpl->type == confTypeJsonObject) {
+        for (i = 0; i < n; i++) {
+          sub[i] = it[i]->childs;
+        }
+        render_columns(buf, sub, n, dims, ndims, fields, layout);
+      } else if (layout == jsonLayoutPacked && tmpl->hal.type == HAL_BIT) {
+        render_column_bits(buf, it, n);
+      } else {
+        render_column_values(buf, it, n, dims, ndims);
       }
-      return;
+    }
+
+    for (i = 0; i < n; i++) {
+      it[i] = it[i]->next;
+    }
+  }
+  buf_putc(buf, '}');
+
+  free(it);
+}
+
+static void render_column_array(BUF_T *buf, CONF_JSON_ITEM_T **cur, int n, const int *dims, int ndims, const JSON_FIELDS_T *fields, JSON_LAYOUT_T layout, bool *first) {
+  CONF_JSON_ITEM_T *tmpl = cur[0];
+  CONF_JSON_ITEM_T *t, *x;
+  CONF_JSON_ITEM_T **sub;
+  int sub_dims[JSON_COLUMN_MAX_DIMS];
+  int count, sel, i, j, m;
 
-    case confTypeJsonArray:
-      if (json_is_array(inp)) {
-        parse_array(key, inp, json);
+  // count instances and selected ones (selection of the first parallel instance applies to all)
+  for (count = 1, sel = 0, t = tmpl; ; count++, t = t->next) {
+    if (fields == NULL || JSON_FIELDS_ISSET(fields, t->item_index)) {
+      sel++;
+    }
+    if (t->next == NULL || t->next->name != tmpl->name || t->next->array_index <= t->array_index) {
+      break;
+    }
+  }
+
+  if (sel > 0 && ndims < JSON_COLUMN_MAX_DIMS) {
+    sub = malloc(n * sel * sizeof(CONF_JSON_ITEM_T *));
+    if (sub == NULL) {
+      buf->error = true;
+    } else {
+      // row major: outer instances first
+      for (i = 0, m = 0; i < n; i++) {
+        for (j = 0, t = tmpl, x = cur[i]; j < count; j++, t = t->next, x = x->next) {
+          if (fields == NULL || JSON_FIELDS_ISSET(fields, t->item_index)) {
+            sub[m++] = x->childs;
+          }
+        }
       }
-      return;
+      if (ndims > 0) {
+        memcpy(sub_dims, dims, ndims * sizeof(int));
+      }
+      sub_dims[ndims] = sel;
 
-    default:
-      return;
+      if (!*first) {
+        buf_putc(buf, ',');
+      }
+      *first = false;
+      json_put_string(buf, tmpl->name);
+      buf_putc(buf, ':');
+      render_columns(buf, sub, n * sel, sub_dims, ndims + 1, fields, layout);
+      free(sub);
+    }
+  }
+
+  // move cursors to last instance
+  for (i = 0; i < n; i++) {
+    for (j = 1; j < count; j++) {
+      cur[i] = cur[i]->next;
+    }
+  }
+}
+
+// Same state changes as render_member_range() in rows layout, without output.
+static void advance_state(RENDER_STATE_T *st, CONF_JSON_ITEM_T *json, const JSON_FIELDS_T *fields) {
+  if (fields != NULL && !JSON_FIELDS_ISSET(fields, json->item_index)) {
+    return;
+  }
+
+  if (json->type == confTypeJsonArray) {
+    st->first = false;
+    st->arr_last = json;
+    return;
+  }
+
+  st->arr_last = NULL;
+  if (CONF_TYPE_IS_LEAF(json->type) || json->type == confTypeJsonObject) {
+    st->first = false;
   }
 }
 
-static CONF_JSON_ITEM_T *find_conf_item(const char *key, CONF_JSON_ITEM_T *list) {
+// Top level members (array instances count as members) are split into
+// chunks of about the same item count. Each chunk starts with the separator
+// state the serial renderer would have at that point, so the chunks
+// concatenate to the serial output.
+static int split_chunks(CONF_JSON_ITEM_T *root, const JSON_FIELDS_T *fields, RENDER_CHUNK_T *chunks, int max) {
+  RENDER_STATE_T st = { true, NULL };
   CONF_JSON_ITEM_T *json;
+  int target = root->item_count / max;
+  int count = 0;
+  int acc = 0;
 
-  for (json = list; json != NULL; json = json->next) {
-    // skip array copies
-    if (json->array_index > 0) {
-      continue;
+  chunks[0].start = root->childs;
+  chunks[0].state = st;
+  for (json = root->childs; json != NULL; json = json->next) {
+    if (count + 1 < max && acc >= (count + 1) * target) {
+      chunks[count++].end = json;
+      chunks[count].start = json;
+      chunks[count].state = st;
+    }
+
+    // items are numbered in tree order, the next sibling ends the subtree
+    acc += ((json->next != NULL) ? json->next->item_index : root->item_count) - json->item_index;
+    advance_state(&st, json, fields);
+  }
+  chunks[count].end = NULL;
+
+  return count + 1;
+}
+
+// called with render_lock held, a claimed chunk keeps the batch alive
+// until it is finished
+static int take_chunk(RENDER_BATCH_T *batch) {
+  RENDER_BATCH_T **p;
+  int index = -1;
+
+  if (batch->taken < batch->count) {
+    index = batch->taken++;
+
+    // fully taken batches leave the queue
+    if (batch->taken == batch->count) {
+      for (p = &render_queue; *p != NULL; p = &(*p)->next) {
+        if (*p == batch) {
+          *p = batch->next;
+          break;
+        }
+      }
     }
+  }
+
+  return index;
+}
+
+static void finish_chunk(RENDER_BATCH_T *batch, int index) {
+  RENDER_CHUNK_T *chunk = &batch->chunks[index];
 
-    // skip unmatching names
-    if (strcasecmp(key, json->name) != 0) {
+  render_member_range(&chunk->buf, chunk->start, chunk->end, batch->fields, batch->layout, &chunk->state);
+
+  pthread_mutex_lock(&render_lock);
+  if (++batch->done == batch->count) {
+    pthread_cond_broadcast(&render_done);
+  }
+  pthread_mutex_unlock(&render_lock);
+}
+
+static void *render_worker(void *data) {
+  RENDER_BATCH_T *batch;
+  int index;
+
+  pthread_mutex_lock(&render_lock);
+  while (!render_quit) {
+    batch = render_queue;
+    if (batch == NULL) {
+      pthread_cond_wait(&render_work, &render_lock);
       continue;
     }
 
-    return json;
+    // claim before unlocking, the caller may return once nothing is left
+    index = take_chunk(batch);
+    pthread_mutex_unlock(&render_lock);
+
+    // render from the same sampled cycle as the caller
+    if (index >= 0) {
+      hal_set_json_view(batch->view);
+      finish_chunk(batch, index);
+      hal_set_json_view(NULL);
+    }
+
+    pthread_mutex_lock(&render_lock);
   }
+  pthread_mutex_unlock(&render_lock);
 
   return NULL;
 }
 
+static int render_parallel(BUF_T *buf, CONF_JSON_ITEM_T *root, const JSON_FIELDS_T *fields, JSON_LAYOUT_T layout) {
+  RENDER_CHUNK_T *chunks;
+  RENDER_BATCH_T batch;
+  int count, i;
+  int index;
+
+  chunks = malloc((render_thread_count + 1) * sizeof(RENDER_CHUNK_T));
+  if (chunks == NULL) {
+    return -1;
+  }
+
+  count = split_chunks(root, fields, chunks, render_thread_count + 1);
+  if (count < 2) {
+    free(chunks);
+    return -1;
+  }
+
+  // the first chunk goes directly to the response buffer
+  chunks[0].buf = *buf;
+  for (i = 1; i < count; i++) {
+    buf_init(&chunks[i].buf);
+  }
+
+  memset(&batch, 0, sizeof(batch));
+  batch.fields = fields;
+  batch.layout = layout;
+  batch.view = hal_get_json_view();
+  batch.chunks = chunks;
+  batch.count = count;
+
+  // the first chunk is rendered by the caller before it starts waiting
+  batch.taken = 1;
+  batch.done = 1;
+
+  buf_putc(&chunks[0].buf, '{');
+
+  pthread_mutex_lock(&render_lock);
+  batch.next = render_queue;
+  render_queue = &batch;
+  pthread_cond_broadcast(&render_work);
+  pthread_mutex_unlock(&render_lock);
+
+  // help with the own batch instead of only waiting
+  render_member_range(&chunks[0].buf, chunks[0].start, chunks[0].end, fields, layout, &chunks[0].state);
+  for (;;) {
+    pthread_mutex_lock(&render_lock);
+    index = take_chunk(&batch);
+    pthread_mutex_unlock(&render_lock);
+    if (index < 0) {
+      break;
+    }
+    finish_chunk(&batch, index);
+  }
+
+  pthread_mutex_lock(&render_lock);
+  while (batch.done < count) {
+    pthread_cond_wait(&render_done, &render_lock);
+  }
+  pthread_mutex_unlock(&render_lock);
+
+  // stitch in order
+  *buf = chunks[0].buf;
+  for (i = 1; i < count; i++) {
+    if (chunks[i].buf.len > 0) {
+      buf_put(buf, chunks[i].buf.data, chunks[i].buf.len);
+    }
+    if (chunks[i].buf.error) {
+      buf->error = true;
+    }
+    buf_free(&chunks[i].buf);
+  }
+  if (chunks[count - 1].state.arr_last != NULL) {
+    buf_putc(buf, ']');
+  }
+  buf_putc(buf, '}');
+
+  free(chunks);
+  return 0;
+}
+
+int json_render_start(const CONF_SERVER_T *server) {
+  int i;
+
+  if (server->render_threshold > 0) {
+    render_threshold = server->render_threshold;
+  }
+  if (server->render_threads == 0) {
+    return 0;
+  }
+
+  render_threads = calloc(server->render_threads, sizeof(pthread_t));
+  if (render_threads == NULL) {
+    fprintf(stderr, "%s: ERROR: unable to alloc memory for render threads\n", modname);
+    return -1;
+  }
+
+  render_quit = false;
+  for (i = 0; i < (int) server->render_threads; i++) {
+    if (sys_thread_create(&render_threads[i], render_worker, NULL) != 0) {
+      fprintf(stderr, "%s: ERROR: unable to create render thread\n", modname);
+      json_render_stop();
+      return -1;
+    }
+    render_thread_count++;
+  }
+
+  return 0;
+}
+
+void json_render_stop(void) {
+  int i;
+
+  pthread_mutex_lock(&render_lock);
+  render_quit = true;
+  pthread_cond_broadcast(&render_work);
+  pthread_mutex_unlock(&render_lock);
+
+  for (i = 0; i < render_thread_count; i++) {
+    pthread_join(render_threads[i], NULL);
+  }
+
+  free(render_threads);
+  render_threads = NULL;
+  render_thread_count = 0;
+}
+
+int json_build_response(BUF_T *buf, CONF_JSON_ITEM_T *root, const JSON_FIELDS_T *fields, JSON_LAYOUT_T layout) {
+  // only rows layout is split, columnar arrays are rendered as a whole
+  if (render_thread_count == 0 || layout != jsonLayoutRows || root->item_count < render_threshold ||
+      render_parallel(buf, root, fields, layout)) {
+    render_object(buf, root->childs, fields, layout);
+  }
+
+  return buf->error ? -1 : 0;
+}
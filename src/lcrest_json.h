@@ -4,13 +4,41 @@
 #include <stdint.h>
 #include <stdbool.h>
 
-#include <jansson.h>
-
 #include "lcrest.h"
 #include "lcrest_conf.h"
+#include "lcrest_buf.h"
+
+#define JSON_FIELDS_ISSET(f, i) ((f)->mask[(i) >> 3] & (1 << ((i) & 7)))
+#define JSON_FIELDS_SET(f, i) ((f)->mask[(i) >> 3] |= (1 << ((i) & 7)))
+
+typedef enum {
+  jsonLayoutRows = 0,
+  jsonLayoutColumnar,
+  jsonLayoutPacked
+} JSON_LAYOUT_T;
+
+typedef struct JSON_FIELDS {
+  struct JSON_FIELDS *next;
+  CONF_JSON_ITEM_T *root;
+  char *spec;
+  bool cached;
+  int refs;
+  uint8_t *mask;
+} JSON_FIELDS_T;
+
+JSON_FIELDS_T *json_fields_alloc(CONF_JSON_ITEM_T *root);
+void json_fields_add(JSON_FIELDS_T *fields, CONF_JSON_ITEM_T *json);
+JSON_FIELDS_T *json_fields_get(CONF_JSON_ITEM_T *root, const char *spec);
+void json_fields_release(JSON_FIELDS_T *fields);
+void json_fields_cleanup(void);
+
+void json_put_string(BUF_T *buf, const char *str);
+void json_put_value(BUF_T *buf, hal_type_t type, volatile void *ptr, int precision);
+
+int json_render_start(const CONF_SERVER_T *server);
+void json_render_stop(void);
 
-void json_build_response(json_t *ret, CONF_JSON_ITEM_T *json);
-void json_parse_request(json_t *inp, CONF_JSON_ITEM_T *json);
+int json_build_response(BUF_T *buf, CONF_JSON_ITEM_T *root, const JSON_FIELDS_T *fields, JSON_LAYOUT_T layout);
 
 #endif
 
@@ -0,0 +1,150 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+#include "lcrest.h"
+#include "lcrest_loop.h"
+
+#define LOOP_MAX_EVENTS 16
+
+typedef struct LOOP_SOURCE {
+  struct LOOP_SOURCE *next;
+  int fd;
+  bool timer;
+  LOOP_CB_T cb;
+  void *data;
+} LOOP_SOURCE_T;
+
+static LOOP_SOURCE_T *add_source(int fd, bool timer, LOOP_CB_T cb, void *data);
+
+static int epoll_fd = -1;
+static LOOP_SOURCE_T *sources;
+static bool quit;
+
+static LOOP_SOURCE_T *add_source(int fd, bool timer, LOOP_CB_T cb, void *data) {
+  LOOP_SOURCE_T *src;
+  struct epoll_event ev;
+
+  src = calloc(1, sizeof(LOOP_SOURCE_T));
+  if (src == NULL) {
+    fprintf(stderr, "%s: ERROR: unable to alloc memory for loop source\n", modname);
+    return NULL;
+  }
+  src->fd = fd;
+  src->timer = timer;
+  src->cb = cb;
+  src->data = data;
+
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.ptr = src;
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+    fprintf(stderr, "%s: ERROR: unable to add loop source: %s\n", modname, strerror(errno));
+    free(src);
+    return NULL;
+  }
+
+  src->next = sources;
+  sources = src;
+  return src;
+}
+
+int loop_init(void) {
+  epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd < 0) {
+    fprintf(stderr, "%s: ERROR: unable to create epoll instance: %s\n", modname, strerror(errno));
+    return -1;
+  }
+
+  sources = NULL;
+  quit = false;
+  return 0;
+}
+
+void loop_cleanup(void) {
+  LOOP_SOURCE_T *src;
+
+  while (sources != NULL) {
+    src = sources;
+    sources = src->next;
+    // timers are owned by the loop
+    if (src->timer) {
+      close(src->fd);
+    }
+    free(src);
+  }
+
+  if (epoll_fd >= 0) {
+    close(epoll_fd);
+    epoll_fd = -1;
+  }
+}
+
+int loop_add_fd(int fd, LOOP_CB_T cb, void *data) {
+  return (add_source(fd, false, cb, data) != NULL) ? 0 : -1;
+}
+
+int loop_add_timer(uint64_t period_ns, LOOP_CB_T cb, void *data) {
+  struct itimerspec its;
+  int fd;
+
+  fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (fd < 0) {
+    fprintf(stderr, "%s: ERROR: unable to create timer: %s\n", modname, strerror(errno));
+    return -1;
+  }
+
+  its.it_interval.tv_sec = period_ns / 1000000000ULL;
+  its.it_interval.tv_nsec = period_ns % 1000000000ULL;
+  its.it_value = its.it_interval;
+  if (timerfd_settime(fd, 0, &its, NULL) < 0) {
+    fprintf(stderr, "%s: ERROR: unable to start timer: %s\n", modname, strerror(errno));
+    close(fd);
+    return -1;
+  }
+
+  if (add_source(fd, true, cb, data) == NULL) {
+    close(fd);
+    return -1;
+  }
+
+  return 0;
+}
+
+int loop_run(void) {
+  struct epoll_event events[LOOP_MAX_EVENTS];
+  LOOP_SOURCE_T *src;
+  uint64_t expirations;
+  int i, n;
+
+  while (!quit) {
+    n = epoll_wait(epoll_fd, events, LOOP_MAX_EVENTS, -1);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      fprintf(stderr, "%s: ERROR: epoll_wait failed: %s\n", modname, strerror(errno));
+      return -1;
+    }
+
+    for (i = 0; i < n && !quit; i++) {
+      src = (LOOP_SOURCE_T *) events[i].data.ptr;
+      // overruns are not replayed, the callback runs once per wakeup
+      if (src->timer && read(src->fd, &expirations, sizeof(expirations)) < 0) {
+        continue;
+      }
+      src->cb(src->data);
+    }
+  }
+
+  return 0;
+}
+
+void loop_quit(void) {
+  quit = true;
+}
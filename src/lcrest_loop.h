@@ -0,0 +1,19 @@
+#ifndef LCREST_LOOP_H
+#define LCREST_LOOP_H
+
+#include <stdint.h>
+
+#include "lcrest.h"
+
+typedef void (*LOOP_CB_T)(void *data);
+
+int loop_init(void);
+void loop_cleanup(void);
+
+int loop_add_fd(int fd, LOOP_CB_T cb, void *data);
+int loop_add_timer(uint64_t period_ns, LOOP_CB_T cb, void *data);
+
+int loop_run(void);
+void loop_quit(void);
+
+#endif
@@ -9,11 +9,31 @@
 #include "lcrest_conf.h"
 #include "lcrest_hal.h"
 #include "lcrest_rest.h"
+#include "lcrest_sys.h"
+#include "lcrest_audit.h"
+#include "lcrest_snap.h"
+#include "lcrest_loop.h"
+#include "lcrest_rec.h"
+#include "lcrest_shmpub.h"
+#include "lcrest_udppub.h"
+#include "lcrest_capture.h"
+#include "lcrest_seq.h"
+#include "lcrest_events.h"
+#include "lcrest_rt.h"
 
 const char *modname = "lcrest";
 
 static int exit_event;
 
+static void exitEvent(void *data) {
+  uint64_t u;
+
+  if (read(exit_event, &u, sizeof(uint64_t)) < 0) {
+    fprintf(stderr, "%s: ERROR: error reading exit event\n", modname);
+  }
+  loop_quit();
+}
+
 static void exitHandler(int sig) {
   uint64_t u = 1;
   if (write(exit_event, &u, sizeof(uint64_t)) < 0) {
@@ -25,7 +45,6 @@ int main(int argc, char **argv) {
   int ret = 1;
   char *filename;
   CONF_ROOT_T *conf;
-  uint64_t u;
 
   // get config file name
   if (argc != 2) {
@@ -40,53 +59,137 @@ int main(int argc, char **argv) {
     goto fail0;
   }
 
-  // initialize component
-  hal_comp_id = hal_init(modname);
-  if (hal_comp_id < 1) {
-    fprintf(stderr, "%s: ERROR: hal_init failed\n", modname);
+  // setup cpu affinity, scheduling and memory locking
+  if (sys_setup(&conf->server)) {
+    goto fail1;
+  }
+
+  // initialize main loop
+  if (loop_init()) {
     goto fail1;
   }
 
-  // export json pins
-  if (hal_export_json_pins(conf)) {
-    goto fail2;
+  if (conf->replay.file != NULL) {
+    // serve recorded data instead of live hal, lays out the snapshots
+    if (rec_replay_start(conf)) {
+      goto fail2;
+    }
+  } else {
+    // initialize component
+    hal_comp_id = hal_init(modname);
+    if (hal_comp_id < 1) {
+      fprintf(stderr, "%s: ERROR: hal_init failed\n", modname);
+      goto fail2;
+    }
+
+    // export json pins
+    if (hal_export_json_pins(conf)) {
+      goto fail3;
+    }
+
+    // resolve references to existing hal objects
+    if (hal_resolve_json_refs(conf)) {
+      goto fail3;
+    }
+
+    // layout fixed width snapshots of all roots, ref types are known now
+    snap_layout(conf);
+
+    // start recorder
+    if (rec_record_start(conf)) {
+      goto fail3;
+    }
+  }
+
+  // start shared memory publisher
+  if (shmpub_start(conf)) {
+    goto fail4;
+  }
+
+  // start udp multicast publisher
+  if (udppub_start(conf)) {
+    goto fail5;
+  }
+
+  // start write audit log
+  if (audit_start(conf)) {
+    goto fail6;
+  }
+
+  // attach servo-synchronous sampler
+  if (rt_start(conf)) {
+    goto fail7;
+  }
+
+  // start triggered capture sampler
+  if (capture_start(conf)) {
+    goto fail8;
+  }
+
+  // start write sequencer
+  if (seq_start(conf)) {
+    goto fail9;
+  }
+
+  // start event journal
+  if (events_start(conf)) {
+    goto fail10;
   }
 
   // start rest server
   if (rest_start(conf) != U_OK) {
-    goto fail2;
+    goto fail11;
   }
 
   // initialize signal handling
   exit_event = eventfd(0, 0);
   if (exit_event == -1) {
     fprintf(stderr, "%s: ERROR: unable to create exit event\n", modname);
-    goto fail3;
+    goto fail12;
+  }
+  if (loop_add_fd(exit_event, exitEvent, NULL)) {
+    goto fail13;
   }
   signal(SIGINT, exitHandler);
   signal(SIGTERM, exitHandler);
 
-
-
-
-
-
-
-
   // everything is fine
   ret = 0;
-  hal_ready(hal_comp_id);
+  if (hal_comp_id > 0) {
+    hal_ready(hal_comp_id);
+  }
 
-  // wait for SIGTERM
-  if (read(exit_event, &u, sizeof(uint64_t)) < 0) {
-    fprintf(stderr, "%s: ERROR: error reading exit event\n", modname);
+  // run until SIGTERM
+  if (loop_run()) {
+    ret = 1;
   }
 
+fail13:
   close(exit_event);
-fail3:
+fail12:
   rest_stop();
+fail11:
+  events_stop();
+fail10:
+  seq_stop();
+fail9:
+  capture_stop();
+fail8:
+  rt_stop();
+fail7:
+  audit_stop();
+fail6:
+  udppub_stop();
+fail5:
+  shmpub_stop();
+fail4:
+  rec_stop();
+fail3:
+  if (hal_comp_id > 0) {
+    hal_exit(hal_comp_id);
+  }
 fail2:
-  hal_exit(hal_comp_id);
+  loop_cleanup();
 fail1:
   conf_free(conf);
 fail0:
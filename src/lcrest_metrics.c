@@ -0,0 +1,297 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "lcrest.h"
+#include "lcrest_conf.h"
+#include "lcrest_hal.h"
+#include "lcrest_dtoa.h"
+#include "lcrest_metrics.h"
+
+// sample as collected from the config tree
+typedef struct {
+  char *name;
+  char *labels;
+  int order;
+  CONF_JSON_ITEM_T *item;
+} METRIC_DEF_T;
+
+// sample of the template, text at off is everything up to the value
+typedef struct {
+  size_t off;
+  size_t len;
+  CONF_JSON_ITEM_T *item;
+} METRIC_T;
+
+typedef struct {
+  METRIC_DEF_T *defs;
+  int count;
+  int max;
+} METRIC_CTX_T;
+
+static void put_name(BUF_T *buf, const char *name);
+static int add_def(METRIC_CTX_T *ctx, BUF_T *name, BUF_T *labels, CONF_JSON_ITEM_T *json);
+static int collect(METRIC_CTX_T *ctx, CONF_JSON_ITEM_T *json, BUF_T *name, BUF_T *labels);
+static int compare_defs(const void *a, const void *b);
+static void put_value(BUF_T *buf, CONF_JSON_ITEM_T *json);
+
+static char *tmpl;
+static size_t tmpl_len;
+static size_t tail_off;
+static METRIC_T *metrics;
+static int metric_count;
+
+// metric and label names only allow [a-zA-Z0-9_]
+static void put_name(BUF_T *buf, const char *name) {
+  for (; *name != 0; name++) {
+    if ((*name >= 'a' && *name <= 'z') || (*name >= 'A' && *name <= 'Z') || (*name >= '0' && *name <= '9')) {
+      buf_putc(buf, *name);
+    } else {
+      buf_putc(buf, '_');
+    }
+  }
+}
+
+static int add_def(METRIC_CTX_T *ctx, BUF_T *name, BUF_T *labels, CONF_JSON_ITEM_T *json) {
+  METRIC_DEF_T *def;
+  METRIC_DEF_T *tmp;
+  int max;
+
+  if (ctx->count == ctx->max) {
+    max = (ctx->max > 0) ? ctx->max * 2 : 256;
+    tmp = realloc(ctx->defs, max * sizeof(METRIC_DEF_T));
+    if (tmp == NULL) {
+      return -1;
+    }
+    ctx->defs = tmp;
+    ctx->max = max;
+  }
+
+  def = &ctx->defs[ctx->count];
+  def->name = strndup(name->data, name->len);
+  def->labels = (labels->len > 0) ? malloc(labels->len + 3) : strdup("");
+  if (def->name == NULL || def->labels == NULL) {
+    free(def->name);
+    free(def->labels);
+    return -1;
+  }
+  if (labels->len > 0) {
+    def->labels[0] = '{';
+    memcpy(def->labels + 1, labels->data, labels->len);
+    memcpy(def->labels + 1 + labels->len, "}", 2);
+  }
+  def->order = ctx->count;
+  def->item = json;
+
+  ctx->count++;
+  return 0;
+}
+
+// path components form the name, array indices become labels
+static int collect(METRIC_CTX_T *ctx, CONF_JSON_ITEM_T *json, BUF_T *name, BUF_T *labels) {
+  size_t name_len, labels_len;
+  char num[DTOA_BUFSIZE];
+
+  for (; json != NULL; json = json->next) {
+    name_len = name->len;
+    labels_len = labels->len;
+
+    buf_putc(name, '_');
+    put_name(name, json->name);
+    if (json->type == confTypeJsonArray) {
+      if (labels->len > 0) {
+        buf_putc(labels, ',');
+      }
+      put_name(labels, json->name);
+      snprintf(num, sizeof(num), "=\"%d\"", json->array_index);
+      buf_puts(labels, num);
+    }
+    if (name->error || labels->error) {
+      return -1;
+    }
+
+    if (json->type == confTypeJsonObject || json->type == confTypeJsonArray) {
+      if (collect(ctx, json->childs, name, labels)) {
+        return -1;
+      }
+    } else if (json->type == confTypeJsonPin || json->type == confTypeJsonParam) {
+      if (add_def(ctx, name, labels, json)) {
+        return -1;
+      }
+    }
+
+    name->len = name_len;
+    labels->len = labels_len;
+  }
+
+  return 0;
+}
+
+static int compare_defs(const void *a, const void *b) {
+  const METRIC_DEF_T *da = (const METRIC_DEF_T *) a;
+  const METRIC_DEF_T *db = (const METRIC_DEF_T *) b;
+  int ret;
+
+  // samples of a family must be contiguous, keep config order within
+  ret = strcmp(da->name, db->name);
+  if (ret != 0) {
+    return ret;
+  }
+  return da->order - db->order;
+}
+
+static void put_value(BUF_T *buf, CONF_JSON_ITEM_T *json) {
+  volatile void *ptr;
+  char *p;
+  double d;
+
+  p = buf_reserve(buf, DTOA_BUFSIZE);
+  if (p == NULL) {
+    return;
+  }
+
+  ptr = hal_get_json_ptr(json);
+  if (ptr == NULL) {
+    memcpy(p, "NaN", 3);
+    buf->len += 3;
+    return;
+  }
+
+  switch (json->hal.type) {
+    case HAL_BIT:
+      *p = *((hal_bit_t *) ptr) ? '1' : '0';
+      buf->len++;
+      return;
+    case HAL_U32:
+      buf->len += dtoa_int(*((hal_u32_t *) ptr), p);
+      return;
+    case HAL_S32:
+      buf->len += dtoa_int(*((hal_s32_t *) ptr), p);
+      return;
+    case HAL_FLOAT:
+      d = *((hal_float_t *) ptr);
+      if (isnan(d)) {
+        break;
+      }
+      if (isinf(d)) {
+        memcpy(p, (d > 0) ? "+Inf" : "-Inf", 4);
+        buf->len += 4;
+        return;
+      }
+      buf->len += dtoa_shortest(d, p);
+      return;
+    default:
+      break;
+  }
+
+  memcpy(p, "NaN", 3);
+  buf->len += 3;
+}
+
+int metrics_start(CONF_ROOT_T *conf) {
+  const CONF_METRICS_T *metrics_conf = &conf->metrics;
+  CONF_JSON_ITEM_T *root;
+  METRIC_CTX_T ctx;
+  BUF_T name, labels, text;
+  int i, ret = -1;
+
+  if (metrics_conf->prefix == NULL) {
+    return 0;
+  }
+
+  memset(&ctx, 0, sizeof(ctx));
+  buf_init(&name);
+  buf_init(&labels);
+  buf_init(&text);
+
+  for (root = conf->json; root != NULL; root = root->next) {
+    if (!conf_is_root_selected(metrics_conf->roots, root->name)) {
+      continue;
+    }
+    name.len = 0;
+    labels.len = 0;
+    buf_puts(&name, metrics_conf->prefix);
+    buf_putc(&name, '_');
+    put_name(&name, root->name);
+    if (collect(&ctx, root->childs, &name, &labels)) {
+      fprintf(stderr, "%s: ERROR: unable to alloc memory for metrics\n", modname);
+      goto out;
+    }
+  }
+  qsort(ctx.defs, ctx.count, sizeof(METRIC_DEF_T), compare_defs);
+
+  metrics = calloc((ctx.count > 0) ? ctx.count : 1, sizeof(METRIC_T));
+  if (metrics == NULL) {
+    fprintf(stderr, "%s: ERROR: unable to alloc memory for metrics\n", modname);
+    goto out;
+  }
+
+  // preformat everything but the values
+  for (i = 0; i < ctx.count; i++) {
+    metrics[i].off = text.len;
+    if (i == 0 || strcmp(ctx.defs[i].name, ctx.defs[i - 1].name) != 0) {
+      buf_puts(&text, "# TYPE ");
+      buf_puts(&text, ctx.defs[i].name);
+      buf_puts(&text, " gauge\n");
+    }
+    buf_puts(&text, ctx.defs[i].name);
+    buf_puts(&text, ctx.defs[i].labels);
+    buf_putc(&text, ' ');
+    metrics[i].len = text.len - metrics[i].off;
+    metrics[i].item = ctx.defs[i].item;
+  }
+  tail_off = text.len;
+  buf_puts(&text, "# EOF\n");
+  if (text.error) {
+    fprintf(stderr, "%s: ERROR: unable to alloc memory for metrics\n", modname);
+    free(metrics);
+    metrics = NULL;
+    goto out;
+  }
+
+  tmpl = text.data;
+  tmpl_len = text.len;
+  metric_count = ctx.count;
+  text.data = NULL;
+  ret = 0;
+
+out:
+  for (i = 0; i < ctx.count; i++) {
+    free(ctx.defs[i].name);
+    free(ctx.defs[i].labels);
+  }
+  free(ctx.defs);
+  buf_free(&text);
+  buf_free(&labels);
+  buf_free(&name);
+  return ret;
+}
+
+void metrics_stop(void) {
+  free(metrics);
+  free(tmpl);
+  metrics = NULL;
+  tmpl = NULL;
+  metric_count = 0;
+}
+
+bool metrics_is_enabled(void) {
+  return metrics != NULL;
+}
+
+void metrics_put(BUF_T *buf) {
+  int i;
+
+  // one allocation for the whole exposition
+  if (buf_reserve(buf, tmpl_len + (size_t) metric_count * (DTOA_BUFSIZE + 1)) == NULL) {
+    return;
+  }
+
+  for (i = 0; i < metric_count; i++) {
+    buf_put(buf, tmpl + metrics[i].off, metrics[i].len);
+    put_value(buf, metrics[i].item);
+    buf_putc(buf, '\n');
+  }
+  buf_put(buf, tmpl + tail_off, tmpl_len - tail_off);
+}
@@ -0,0 +1,18 @@
+#ifndef LCREST_METRICS_H
+#define LCREST_METRICS_H
+
+#include <stdbool.h>
+
+#include "lcrest.h"
+#include "lcrest_conf.h"
+#include "lcrest_buf.h"
+
+#define METRICS_CONTENT_TYPE "application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+int metrics_start(CONF_ROOT_T *conf);
+void metrics_stop(void);
+bool metrics_is_enabled(void);
+
+void metrics_put(BUF_T *buf);
+
+#endif
@@ -0,0 +1,178 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+#include "lcrest.h"
+#include "lcrest_conf.h"
+#include "lcrest_path.h"
+
+static int parse_index(const char **pos, const char *end, int *val);
+static int parse_segment(PATH_SEGMENT_T *seg, const char **pos, const char *end);
+static int resolve_segment(const PATH_T *path, int level, CONF_JSON_ITEM_T *list, PATH_MATCH_CB_T cb, void *data);
+
+static int parse_index(const char **pos, const char *end, int *val) {
+  const char *p = *pos;
+  long v = 0;
+
+  if (p >= end || !isdigit((unsigned char) *p)) {
+    return -1;
+  }
+
+  for (; p < end && isdigit((unsigned char) *p); p++) {
+    v = v * 10 + (*p - '0');
+    if (v > INT32_MAX) {
+      return -1;
+    }
+  }
+
+  *val = v;
+  *pos = p;
+  return 0;
+}
+
+static int parse_segment(PATH_SEGMENT_T *seg, const char **pos, const char *end) {
+  const char *p = *pos;
+  const char *name = p;
+  size_t len;
+
+  // name
+  for (; p < end && *p != '.' && *p != '['; p++);
+  len = p - name;
+  if (len == 0) {
+    return -1;
+  }
+  seg->name = strndup(name, len);
+  if (seg->name == NULL) {
+    fprintf(stderr, "%s: ERROR: unable to alloc memory for path segment\n", modname);
+    return -1;
+  }
+
+  // optional index, wildcard or slice
+  seg->start = PATH_INDEX_ALL;
+  seg->end = PATH_INDEX_ALL;
+  if (p < end && *p == '[') {
+    p++;
+    if (p < end && *p == '*') {
+      p++;
+    } else {
+      // slice start defaults to 0, end to array size
+      seg->start = 0;
+      if (p < end && *p != ':' && parse_index(&p, end, &seg->start)) {
+        return -1;
+      }
+      if (p < end && *p == ':') {
+        p++;
+        if (p < end && *p != ']' && parse_index(&p, end, &seg->end)) {
+          return -1;
+        }
+      } else {
+        seg->end = seg->start + 1;
+      }
+      if (seg->end != PATH_INDEX_ALL && seg->end <= seg->start) {
+        return -1;
+      }
+    }
+    if (p >= end || *p != ']') {
+      return -1;
+    }
+    p++;
+  }
+
+  *pos = p;
+  return 0;
+}
+
+PATH_T *path_parse(const char *str, size_t len) {
+  PATH_T *path;
+  PATH_SEGMENT_T *segs;
+  const char *pos = str;
+  const char *end = str + len;
+
+  path = calloc(1, sizeof(PATH_T));
+  if (path == NULL) {
+    fprintf(stderr, "%s: ERROR: unable to alloc memory for path\n", modname);
+    return NULL;
+  }
+
+  while (1) {
+    segs = realloc(path->segs, (path->count + 1) * sizeof(PATH_SEGMENT_T));
+    if (segs == NULL) {
+      fprintf(stderr, "%s: ERROR: unable to alloc memory for path segment\n", modname);
+      goto fail;
+    }
+    path->segs = segs;
+    memset(&segs[path->count], 0, sizeof(PATH_SEGMENT_T));
+    if (parse_segment(&segs[(path->count)++], &pos, end)) {
+      goto fail;
+    }
+
+    if (pos >= end) {
+      break;
+    }
+    if (*pos != '.') {
+      goto fail;
+    }
+    pos++;
+  }
+
+  return path;
+
+fail:
+  path_free(path);
+  return NULL;
+}
+
+void path_free(PATH_T *path) {
+  int i;
+
+  if (path == NULL) {
+    return;
+  }
+
+  for (i = 0; i < path->count; i++) {
+    free(path->segs[i].name);
+  }
+  free(path->segs);
+  free(path);
+}
+
+static int resolve_segment(const PATH_T *path, int level, CONF_JSON_ITEM_T *list, PATH_MATCH_CB_T cb, void *data) {
+  const PATH_SEGMENT_T *seg = &path->segs[level];
+  CONF_JSON_ITEM_T *json;
+  int count = 0;
+
+  for (json = list; json != NULL; json = json->next) {
+    // skip unmatching names
+    if (strcasecmp(seg->name, json->name) != 0) {
+      continue;
+    }
+
+    // indexes are only valid on arrays
+    if (seg->start != PATH_INDEX_ALL) {
+      if (json->type != confTypeJsonArray) {
+        continue;
+      }
+      if (json->array_index < seg->start) {
+        continue;
+      }
+      if (seg->end != PATH_INDEX_ALL && json->array_index >= seg->end) {
+        continue;
+      }
+    }
+
+    if (level + 1 == path->count) {
+      cb(json, data);
+      count++;
+    } else {
+      count += resolve_segment(path, level + 1, json->childs, cb, data);
+    }
+  }
+
+  return count;
+}
+
+int path_resolve(const PATH_T *path, CONF_JSON_ITEM_T *list, PATH_MATCH_CB_T cb, void *data) {
+  return resolve_segment(path, 0, list, cb, data);
+}
@@ -0,0 +1,29 @@
+#ifndef LCREST_PATH_H
+#define LCREST_PATH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "lcrest.h"
+#include "lcrest_conf.h"
+
+#define PATH_INDEX_ALL -1
+
+typedef struct {
+  char *name;
+  int start;
+  int end;
+} PATH_SEGMENT_T;
+
+typedef struct {
+  int count;
+  PATH_SEGMENT_T *segs;
+} PATH_T;
+
+typedef void (*PATH_MATCH_CB_T)(CONF_JSON_ITEM_T *json, void *data);
+
+PATH_T *path_parse(const char *str, size_t len);
+void path_free(PATH_T *path);
+int path_resolve(const PATH_T *path, CONF_JSON_ITEM_T *list, PATH_MATCH_CB_T cb, void *data);
+
+#endif
@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <dlfcn.h>
+
+#include "lcrest.h"
+#include "lcrest_conf.h"
+#include "lcrest_expr.h"
+#include "lcrest_plugin.h"
+#include "lcrest_plugin_api.h"
+
+typedef struct PLUGIN {
+  struct PLUGIN *next;
+  const CONF_PLUGIN_T *conf;
+  void *handle;
+  LCREST_PLUGIN_EXIT_T exit;
+  void *priv;
+} PLUGIN_T;
+
+static double plugin_get_double(CONF_JSON_ITEM_T *json);
+static int plugin_load(const CONF_PLUGIN_T *conf);
+
+static LCREST_PLUGIN_API_T api;
+static PLUGIN_T *plugins = NULL;
+
+static double plugin_get_double(CONF_JSON_ITEM_T *json) {
+  if (json->type == confTypeJsonComputed) {
+    return expr_eval(json->hal.computed.code);
+  }
+
+  return hal_get_json_double(json);
+}
+
+static int plugin_load(const CONF_PLUGIN_T *conf) {
+  PLUGIN_T *plugin;
+  LCREST_PLUGIN_INIT_T init;
+
+  plugin = calloc(1, sizeof(PLUGIN_T));
+  if (plugin == NULL) {
+    fprintf(stderr, "%s: ERROR: unable to alloc memory for plugin %s\n", modname, conf->file);
+    goto fail0;
+  }
+  plugin->conf = conf;
+
+  // plugin symbols are private, so plugins can't clash with each other
+  plugin->handle = dlopen(conf->file, RTLD_NOW | RTLD_LOCAL);
+  if (plugin->handle == NULL) {
+    fprintf(stderr, "%s: ERROR: unable to load plugin %s: %s\n", modname, conf->file, dlerror());
+    goto fail1;
+  }
+
+  init = (LCREST_PLUGIN_INIT_T) dlsym(plugin->handle, LCREST_PLUGIN_INIT_SYM);
+  if (init == NULL) {
+    fprintf(stderr, "%s: ERROR: plugin %s has no %s\n", modname, conf->file, LCREST_PLUGIN_INIT_SYM);
+    goto fail2;
+  }
+  plugin->exit = (LCREST_PLUGIN_EXIT_T) dlsym(plugin->handle, LCREST_PLUGIN_EXIT_SYM);
+
+  if (init(&api, conf->arg, &plugin->priv)) {
+    fprintf(stderr, "%s: ERROR: plugin %s failed to initialize\n", modname, conf->file);
+    goto fail2;
+  }
+
+  plugin->next = plugins;
+  plugins = plugin;
+  return 0;
+
+fail2:
+  dlclose(plugin->handle);
+fail1:
+  free(plugin);
+fail0:
+  return -1;
+}
+
+int plugin_start(CONF_ROOT_T *conf, struct _u_instance *instance) {
+  const CONF_PLUGIN_T *plugin;
+
+  api.version = LCREST_PLUGIN_API_VERSION;
+  api.conf = conf;
+  api.instance = instance;
+  api.hal_data = conf->json_hal_data;
+  api.hal_data_size = (conf->json_hal_data != NULL) ? conf->json_hal_size : 0;
+  api.admit_enter = admit_enter;
+  api.admit_leave = admit_leave;
+  api.get_ptr = hal_get_json_ptr;
+  api.read_value = hal_read_value;
+  api.get_double = plugin_get_double;
+  api.get_generation = hal_get_json_generation;
+  api.get_item_path = conf_get_item_path;
+  api.path_parse = path_parse;
+  api.path_free = path_free;
+  api.path_resolve = path_resolve;
+  api.buf_init = buf_init;
+  api.buf_free = buf_free;
+  api.buf_put = buf_put;
+  api.buf_puts = buf_puts;
+  api.json_put_string = json_put_string;
+  api.json_put_value = json_put_value;
+  api.json_fields_get = json_fields_get;
+  api.json_fields_release = json_fields_release;
+  api.json_build_response = json_build_response;
+
+  for (plugin = conf->plugins; plugin != NULL; plugin = plugin->next) {
+    if (plugin_load(plugin)) {
+      plugin_stop();
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+void plugin_stop(void) {
+  PLUGIN_T *plugin;
+
+  // unload in reverse order of loading
+  while (plugins != NULL) {
+    plugin = plugins;
+    plugins = plugin->next;
+    if (plugin->exit != NULL) {
+      plugin->exit(plugin->priv);
+    }
+    dlclose(plugin->handle);
+    free(plugin);
+  }
+}
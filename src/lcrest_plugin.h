@@ -0,0 +1,12 @@
+#ifndef LCREST_PLUGIN_H
+#define LCREST_PLUGIN_H
+
+#include <ulfius.h>
+
+#include "lcrest.h"
+#include "lcrest_conf.h"
+
+int plugin_start(CONF_ROOT_T *conf, struct _u_instance *instance);
+void plugin_stop(void);
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef LCREST_PLUGIN_API_H
+#define LCREST_PLUGIN_API_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <ulfius.h>
+
+#include "lcrest.h"
+#include "lcrest_conf.h"
+#include "lcrest_buf.h"
+#include "lcrest_hal.h"
+#include "lcrest_path.h"
+#include "lcrest_json.h"
+#include "lcrest_admit.h"
+
+// interface for endpoint plugins loaded with <plugin file="..." arg="..."/>
+//
+// a plugin exports LCREST_PLUGIN_INIT_SYM, which is called once before the
+// server starts. it may register ulfius endpoints on api->instance and keep
+// api for later use, the table stays valid until LCREST_PLUGIN_EXIT_SYM
+// (optional) was called. the config tree is shared and must not be modified.
+//
+// the table only holds function pointers, so plugins don't depend on
+// symbols exported by the lcrest executable. callbacks run on the http
+// worker threads and should use admit_enter()/admit_leave() like the
+// built-in endpoints.
+
+#define LCREST_PLUGIN_API_VERSION 1
+
+#define LCREST_PLUGIN_INIT_SYM "lcrest_plugin_init"
+#define LCREST_PLUGIN_EXIT_SYM "lcrest_plugin_exit"
+
+typedef struct {
+  int version;
+
+  // parsed config and server instance
+  const CONF_ROOT_T *conf;
+  struct _u_instance *instance;
+
+  // hal memory of the exported json pins and params (NULL in replay mode)
+  void *hal_data;
+  size_t hal_data_size;
+
+  // admission control
+  int (*admit_enter)(const struct _u_request *request, struct _u_response *response, ADMIT_CLASS_T cls);
+  void (*admit_leave)(void);
+
+  // value access, get_double also evaluates computed values
+  volatile void *(*get_ptr)(CONF_JSON_ITEM_T *json);
+  void (*read_value)(hal_type_t type, volatile void *ptr, HAL_VALUE_T *val);
+  double (*get_double)(CONF_JSON_ITEM_T *json);
+  uint64_t (*get_generation)(CONF_JSON_ITEM_T *root);
+  int (*get_item_path)(CONF_JSON_ITEM_T *json, char *buf, size_t size);
+
+  // path lookup
+  PATH_T *(*path_parse)(const char *str, size_t len);
+  void (*path_free)(PATH_T *path);
+  int (*path_resolve)(const PATH_T *path, CONF_JSON_ITEM_T *list, PATH_MATCH_CB_T cb, void *data);
+
+  // response buffers and rendering
+  void (*buf_init)(BUF_T *buf);
+  void (*buf_free)(BUF_T *buf);
+  void (*buf_put)(BUF_T *buf, const char *data, size_t len);
+  void (*buf_puts)(BUF_T *buf, const char *str);
+  void (*json_put_string)(BUF_T *buf, const char *str);
+  void (*json_put_value)(BUF_T *buf, hal_type_t type, volatile void *ptr, int precision);
+  JSON_FIELDS_T *(*json_fields_get)(CONF_JSON_ITEM_T *root, const char *spec);
+  void (*json_fields_release)(JSON_FIELDS_T *fields);
+  int (*json_build_response)(BUF_T *buf, CONF_JSON_ITEM_T *root, const JSON_FIELDS_T *fields, JSON_LAYOUT_T layout);
+} LCREST_PLUGIN_API_T;
+
+typedef int (*LCREST_PLUGIN_INIT_T)(const LCREST_PLUGIN_API_T *api, const char *arg, void **priv);
+typedef void (*LCREST_PLUGIN_EXIT_T)(void *priv);
+
+#endif
@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fnmatch.h>
+
+#include "hal_priv.h"
+
+#include "lcrest.h"
+#include "lcrest_hal.h"
+#include "lcrest_json.h"
+#include "lcrest_dtoa.h"
+#include "lcrest_query.h"
+
+// HAL keeps its object lists sorted by name, so a query walks the list
+// under the HAL mutex and stops behind the literal pattern prefix. No copy
+// of the list is kept, it could go stale when components are (re)loaded.
+
+static const char *get_name(QUERY_TYPE_T type, int off);
+static void put_pin(BUF_T *buf, hal_pin_t *pin);
+static void put_signal(BUF_T *buf, hal_sig_t *sig);
+static void put_param(BUF_T *buf, hal_param_t *param);
+static const char *get_owner_name(int owner_ptr);
+
+static const char *get_name(QUERY_TYPE_T type, int off) {
+  switch (type) {
+    case queryTypePins:
+      return ((hal_pin_t *) SHMPTR(off))->name;
+    case queryTypeSignals:
+      return ((hal_sig_t *) SHMPTR(off))->name;
+    case queryTypeParams:
+      return ((hal_param_t *) SHMPTR(off))->name;
+    default:
+      return "";
+  }
+}
+
+static const char *get_owner_name(int owner_ptr) {
+  if (owner_ptr == 0) {
+    return "";
+  }
+  return ((hal_comp_t *) SHMPTR(owner_ptr))->name;
+}
+
+static void put_pin(BUF_T *buf, hal_pin_t *pin) {
+  buf_puts(buf, "{\"type\":");
+  json_put_string(buf, hal_get_type_name(pin->type));
+  buf_puts(buf, ",\"dir\":");
+  json_put_string(buf, pin->dir == HAL_IN ? "in" : (pin->dir == HAL_OUT ? "out" : "io"));
+  buf_puts(buf, ",\"owner\":");
+  json_put_string(buf, get_owner_name(pin->owner_ptr));
+  buf_puts(buf, ",\"value\":");
+  json_put_value(buf, pin->type, hal_get_pin_value_ptr(pin), -1);
+  if (pin->signal != 0) {
+    buf_puts(buf, ",\"signal\":");
+    json_put_string(buf, ((hal_sig_t *) SHMPTR(pin->signal))->name);
+  }
+  buf_putc(buf, '}');
+}
+
+static void put_signal(BUF_T *buf, hal_sig_t *sig) {
+  char num[DTOA_BUFSIZE];
+
+  buf_puts(buf, "{\"type\":");
+  json_put_string(buf, hal_get_type_name(sig->type));
+  buf_puts(buf, ",\"value\":");
+  json_put_value(buf, sig->type, SHMPTR(sig->data_ptr), -1);
+  buf_puts(buf, ",\"readers\":");
+  buf_put(buf, num, dtoa_int(sig->readers, num));
+  buf_puts(buf, ",\"writers\":");
+  buf_put(buf, num, dtoa_int(sig->writers, num));
+  buf_puts(buf, ",\"bidirs\":");
+  buf_put(buf, num, dtoa_int(sig->bidirs, num));
+  buf_putc(buf, '}');
+}
+
+static void put_param(BUF_T *buf, hal_param_t *param) {
+  buf_puts(buf, "{\"type\":");
+  json_put_string(buf, hal_get_type_name(param->type));
+  buf_puts(buf, ",\"dir\":");
+  json_put_string(buf, param->dir == HAL_RO ? "ro" : "rw");
+  buf_puts(buf, ",\"owner\":");
+  json_put_string(buf, get_owner_name(param->owner_ptr));
+  buf_puts(buf, ",\"value\":");
+  json_put_value(buf, param->type, SHMPTR(param->data_ptr), -1);
+  buf_putc(buf, '}');
+}
+
+int query_build_response(BUF_T *buf, QUERY_TYPE_T type, const char *match) {
+  int off, cmp;
+  size_t len;
+  const char *name;
+  bool first = true;
+
+  // no pattern matches all
+  if (match == NULL || match[0] == 0) {
+    match = "*";
+  }
+
+  // literal prefix of the pattern limits the search range
+  len = strcspn(match, "*?[\\");
+
+  rtapi_mutex_get(&(hal_data->mutex));
+
+  switch (type) {
+    case queryTypePins:
+      off = hal_data->pin_list_ptr;
+      break;
+    case queryTypeSignals:
+      off = hal_data->sig_list_ptr;
+      break;
+    case queryTypeParams:
+      off = hal_data->param_list_ptr;
+      break;
+    default:
+      goto fail;
+  }
+
+  buf_putc(buf, '{');
+  // next_ptr is the first member of pins, signals and params
+  for (; off != 0; off = *((int *) SHMPTR(off))) {
+    name = get_name(type, off);
+
+    // skip up to the prefix range, stop at its end
+    cmp = strncmp(name, match, len);
+    if (cmp < 0) {
+      continue;
+    }
+    if (cmp > 0) {
+      break;
+    }
+
+    if (fnmatch(match, name, 0) != 0) {
+      continue;
+    }
+
+    if (!first) {
+      buf_putc(buf, ',');
+    }
+    first = false;
+    json_put_string(buf, name);
+    buf_putc(buf, ':');
+
+    switch (type) {
+      case queryTypePins:
+        put_pin(buf, SHMPTR(off));
+        break;
+      case queryTypeSignals:
+        put_signal(buf, SHMPTR(off));
+        break;
+      default:
+        put_param(buf, SHMPTR(off));
+        break;
+    }
+  }
+  buf_putc(buf, '}');
+
+  rtapi_mutex_give(&(hal_data->mutex));
+  return buf->error ? -1 : 0;
+
+fail:
+  rtapi_mutex_give(&(hal_data->mutex));
+  return -1;
+}
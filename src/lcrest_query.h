@@ -0,0 +1,19 @@
+#ifndef LCREST_QUERY_H
+#define LCREST_QUERY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "lcrest.h"
+#include "lcrest_buf.h"
+
+typedef enum {
+  queryTypePins = 0,
+  queryTypeSignals,
+  queryTypeParams,
+  queryTypeCount
+} QUERY_TYPE_T;
+
+int query_build_response(BUF_T *buf, QUERY_TYPE_T type, const char *match);
+
+#endif
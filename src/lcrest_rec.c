@@ -0,0 +1,482 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "lcrest.h"
+#include "lcrest_conf.h"
+#include "lcrest_hal.h"
+#include "lcrest_buf.h"
+#include "lcrest_snap.h"
+#include "lcrest_loop.h"
+#include "lcrest_rec.h"
+#include "lcrest_rec_file.h"
+
+#define REC_PAGE_SIZE 4096
+#define REC_PATH_MAX  1024
+
+#define REC_ALIGN(x, a) (((x) + (a) - 1) & ~((size_t) (a) - 1))
+
+typedef struct {
+  CONF_JSON_ITEM_T *root;
+  size_t offset;
+} REC_ROOT_T;
+
+typedef struct {
+  char *path;
+  char *type;
+  size_t offset;
+} REC_SCHEMA_LEAF_T;
+
+typedef struct {
+  size_t src;
+  volatile void *dst;
+  size_t size;
+} REC_COPY_T;
+
+typedef struct {
+  REC_SCHEMA_LEAF_T *leafs;
+  int leaf_count;
+  REC_COPY_T *copies;
+  int copy_count;
+  int copy_size;
+  int missing;
+  bool failed;
+} REC_MATCH_CTX_T;
+
+static void record_tick(void *data);
+static int compare_leafs(const void *a, const void *b);
+static int parse_schema(char *schema, REC_SCHEMA_LEAF_T **leafs);
+static void type_ref(CONF_JSON_ITEM_T *json, void *data);
+static void match_leaf(CONF_JSON_ITEM_T *json, void *data);
+static void replay_tick(void *data);
+
+static int fd = -1;
+static char *map;
+static size_t map_size;
+static REC_FILE_HEADER_T *hdr;
+
+static REC_ROOT_T *roots;
+static int root_count;
+
+static char **replay_data;
+static REC_COPY_T *copies;
+static int copy_count;
+static uint64_t replay_first;
+static uint64_t replay_last;
+static uint64_t replay_pos;
+static bool replay_loop;
+
+static void record_tick(void *data) {
+  REC_RECORD_HEADER_T *rec;
+  struct timespec ts;
+  uint64_t index;
+  char *ptr;
+  int i;
+
+  index = hdr->write_index;
+  ptr = map + hdr->header_size + (index % hdr->capacity) * hdr->record_size;
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+  rec = (REC_RECORD_HEADER_T *) ptr;
+  rec->time = (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+  rec->index = index;
+
+  for (i = 0; i < root_count; i++) {
+    snap_take(roots[i].root, ptr + roots[i].offset);
+  }
+
+  // publish record for readers of the live file
+  __atomic_store_n(&hdr->write_index, index + 1, __ATOMIC_RELEASE);
+}
+
+int rec_record_start(CONF_ROOT_T *conf) {
+  const CONF_RECORDER_T *recorder = &conf->recorder;
+  CONF_JSON_ITEM_T *root;
+  BUF_T schema;
+  size_t record_size, header_size;
+  uint64_t capacity;
+  int i;
+
+  if (recorder->file == NULL) {
+    return 0;
+  }
+
+  // select roots
+  for (root_count = 0, root = conf->json; root != NULL; root = root->next, root_count++);
+  roots = calloc(root_count, sizeof(REC_ROOT_T));
+  if (roots == NULL) {
+    fprintf(stderr, "%s: ERROR: unable to alloc memory for recorder\n", modname);
+    goto fail0;
+  }
+  record_size = sizeof(REC_RECORD_HEADER_T);
+  for (i = 0, root = conf->json; root != NULL; root = root->next) {
+    if (conf_is_root_selected(recorder->roots, root->name)) {
+      roots[i].root = root;
+      roots[i].offset = record_size;
+      record_size += root->snap_size;
+      i++;
+    }
+  }
+  root_count = i;
+  if (root_count == 0) {
+    fprintf(stderr, "%s: ERROR: recorder has no roots to record\n", modname);
+    goto fail1;
+  }
+
+  // build schema
+  buf_init(&schema);
+  for (i = 0; i < root_count; i++) {
+    snap_put_schema(&schema, roots[i].root, roots[i].offset);
+  }
+  if (schema.error) {
+    fprintf(stderr, "%s: ERROR: unable to build recorder schema\n", modname);
+    goto fail2;
+  }
+
+  // preallocate ring file
+  capacity = (uint64_t) recorder->rate * recorder->duration;
+  header_size = REC_ALIGN(sizeof(REC_FILE_HEADER_T) + schema.len, REC_PAGE_SIZE);
+  map_size = header_size + capacity * record_size;
+
+  fd = open(recorder->file, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    fprintf(stderr, "%s: ERROR: unable to open recording %s: %s\n", modname, recorder->file, strerror(errno));
+    goto fail2;
+  }
+  if ((errno = posix_fallocate(fd, 0, map_size)) != 0) {
+    fprintf(stderr, "%s: ERROR: unable to allocate recording %s: %s\n", modname, recorder->file, strerror(errno));
+    goto fail3;
+  }
+
+  map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "%s: ERROR: unable to map recording %s: %s\n", modname, recorder->file, strerror(errno));
+    goto fail3;
+  }
+
+  // write header
+  hdr = (REC_FILE_HEADER_T *) map;
+  memcpy(hdr->magic, REC_FILE_MAGIC, sizeof(hdr->magic));
+  hdr->version = REC_FILE_VERSION;
+  hdr->header_size = header_size;
+  hdr->period_ns = 1000000000ULL / recorder->rate;
+  hdr->record_size = record_size;
+  hdr->capacity = capacity;
+  hdr->schema_size = schema.len;
+  hdr->root_count = root_count;
+  hdr->write_index = 0;
+  memcpy(map + sizeof(REC_FILE_HEADER_T), schema.data, schema.len);
+
+  if (loop_add_timer(hdr->period_ns, record_tick, NULL)) {
+    goto fail4;
+  }
+
+  buf_free(&schema);
+  return 0;
+
+fail4:
+  munmap(map, map_size);
+  map = NULL;
+fail3:
+  close(fd);
+  fd = -1;
+fail2:
+  buf_free(&schema);
+fail1:
+  free(roots);
+  roots = NULL;
+fail0:
+  return -1;
+}
+
+static int compare_leafs(const void *a, const void *b) {
+  return strcmp(((const REC_SCHEMA_LEAF_T *) a)->path, ((const REC_SCHEMA_LEAF_T *) b)->path);
+}
+
+static int parse_schema(char *schema, REC_SCHEMA_LEAF_T **leafs) {
+  REC_SCHEMA_LEAF_T *list = NULL, *p;
+  int count = 0, size = 0;
+  char *line, *next, *fields[4];
+  int i;
+
+  for (line = schema; *line != 0; line = next) {
+    next = line + strcspn(line, "\n");
+    if (*next != 0) {
+      *(next++) = 0;
+    }
+
+    // split fields
+    fields[0] = line;
+    for (i = 1; i < 4 && fields[i - 1] != NULL; i++) {
+      fields[i] = strchr(fields[i - 1], '\t');
+      if (fields[i] != NULL) {
+        *(fields[i]++) = 0;
+      }
+    }
+    if (fields[3] == NULL || strcmp(fields[0], "leaf") != 0) {
+      continue;
+    }
+
+    if (count >= size) {
+      size = (size > 0) ? size * 2 : 64;
+      p = realloc(list, size * sizeof(REC_SCHEMA_LEAF_T));
+      if (p == NULL) {
+        free(list);
+        return -1;
+      }
+      list = p;
+    }
+    list[count].path = fields[1];
+    list[count].type = fields[2];
+    list[count].offset = strtoul(fields[3], NULL, 10);
+    count++;
+  }
+
+  qsort(list, count, sizeof(REC_SCHEMA_LEAF_T), compare_leafs);
+  *leafs = list;
+  return count;
+}
+
+// refs have no HAL to resolve against, they take the recorded type
+static void type_ref(CONF_JSON_ITEM_T *json, void *data) {
+  static const hal_type_t types[] = { HAL_BIT, HAL_U32, HAL_S32, HAL_FLOAT };
+  REC_MATCH_CTX_T *ctx = (REC_MATCH_CTX_T *) data;
+  REC_SCHEMA_LEAF_T key, *leaf;
+  char path[REC_PATH_MAX];
+  size_t i;
+
+  if (json->type != confTypeJsonRef || conf_get_item_path(json, path, sizeof(path)) < 0) {
+    return;
+  }
+
+  key.path = path;
+  leaf = bsearch(&key, ctx->leafs, ctx->leaf_count, sizeof(REC_SCHEMA_LEAF_T), compare_leafs);
+  if (leaf == NULL) {
+    return;
+  }
+  for (i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+    if (strcmp(leaf->type, hal_get_type_name(types[i])) == 0) {
+      json->hal.type = types[i];
+      return;
+    }
+  }
+}
+
+static void match_leaf(CONF_JSON_ITEM_T *json, void *data) {
+  REC_MATCH_CTX_T *ctx = (REC_MATCH_CTX_T *) data;
+  REC_SCHEMA_LEAF_T key, *leaf;
+  REC_COPY_T *p;
+  char path[REC_PATH_MAX];
+  int size;
+
+  if (conf_get_item_path(json, path, sizeof(path)) < 0) {
+    ctx->missing++;
+    return;
+  }
+
+  key.path = path;
+  leaf = bsearch(&key, ctx->leafs, ctx->leaf_count, sizeof(REC_SCHEMA_LEAF_T), compare_leafs);
+  if (leaf == NULL || strcmp(leaf->type, hal_get_type_name(json->hal.type)) != 0 ||
+      leaf->offset + snap_get_size(json->hal.type) > hdr->record_size) {
+    ctx->missing++;
+    return;
+  }
+
+  if (ctx->failed) {
+    return;
+  }
+
+  if (ctx->copy_count >= ctx->copy_size) {
+    size = (ctx->copy_size > 0) ? ctx->copy_size * 2 : 64;
+    p = realloc(ctx->copies, size * sizeof(REC_COPY_T));
+    if (p == NULL) {
+      ctx->failed = true;
+      return;
+    }
+    ctx->copies = p;
+    ctx->copy_size = size;
+  }
+  ctx->copies[ctx->copy_count].src = leaf->offset;
+  ctx->copies[ctx->copy_count].dst = json->local_ptr;
+  ctx->copies[ctx->copy_count].size = snap_get_size(json->hal.type);
+  ctx->copy_count++;
+}
+
+static void replay_tick(void *data) {
+  const char *rec;
+  int i;
+
+  rec = map + hdr->header_size + (replay_pos % hdr->capacity) * hdr->record_size;
+  for (i = 0; i < copy_count; i++) {
+    memcpy((void *) copies[i].dst, rec + copies[i].src, copies[i].size);
+  }
+
+  // advance, hold the last record at the end unless looping
+  if (replay_pos + 1 < replay_last) {
+    replay_pos++;
+  } else if (replay_loop) {
+    replay_pos = replay_first;
+  }
+}
+
+int rec_replay_start(CONF_ROOT_T *conf) {
+  const CONF_REPLAY_T *replay = &conf->replay;
+  CONF_JSON_ITEM_T *root;
+  REC_MATCH_CTX_T ctx;
+  struct stat st;
+  char *schema;
+  int i;
+
+  if (replay->file == NULL) {
+    return 0;
+  }
+
+  fd = open(replay->file, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    fprintf(stderr, "%s: ERROR: unable to open recording %s: %s\n", modname, replay->file, strerror(errno));
+    goto fail0;
+  }
+  if (fstat(fd, &st) < 0 || (size_t) st.st_size < sizeof(REC_FILE_HEADER_T)) {
+    fprintf(stderr, "%s: ERROR: invalid recording %s\n", modname, replay->file);
+    goto fail1;
+  }
+
+  map_size = st.st_size;
+  map = mmap(NULL, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "%s: ERROR: unable to map recording %s: %s\n", modname, replay->file, strerror(errno));
+    goto fail1;
+  }
+
+  // validate header
+  hdr = (REC_FILE_HEADER_T *) map;
+  if (memcmp(hdr->magic, REC_FILE_MAGIC, sizeof(hdr->magic)) != 0 || hdr->version != REC_FILE_VERSION ||
+      hdr->period_ns == 0 || hdr->capacity == 0 || hdr->record_size < sizeof(REC_RECORD_HEADER_T) ||
+      sizeof(REC_FILE_HEADER_T) + hdr->schema_size > hdr->header_size ||
+      hdr->header_size + (uint64_t) hdr->capacity * hdr->record_size > map_size) {
+    fprintf(stderr, "%s: ERROR: invalid recording %s\n", modname, replay->file);
+    goto fail2;
+  }
+  if (hdr->write_index == 0) {
+    fprintf(stderr, "%s: ERROR: recording %s is empty\n", modname, replay->file);
+    goto fail2;
+  }
+
+  // parse schema
+  schema = malloc(hdr->schema_size + 1);
+  if (schema == NULL) {
+    fprintf(stderr, "%s: ERROR: unable to alloc memory for replay\n", modname);
+    goto fail2;
+  }
+  memcpy(schema, map + sizeof(REC_FILE_HEADER_T), hdr->schema_size);
+  schema[hdr->schema_size] = 0;
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.leaf_count = parse_schema(schema, &ctx.leafs);
+  if (ctx.leaf_count < 0) {
+    fprintf(stderr, "%s: ERROR: unable to alloc memory for replay\n", modname);
+    goto fail3;
+  }
+
+  // layout needs the types of all leaves
+  for (root = conf->json; root != NULL; root = root->next) {
+    snap_walk(root, type_ref, &ctx);
+  }
+  snap_layout(conf);
+
+  // bind all leaves to local data and match them against the recording
+  for (root_count = 0, root = conf->json; root != NULL; root = root->next, root_count++);
+  replay_data = calloc(root_count, sizeof(char *));
+  if (replay_data == NULL) {
+    fprintf(stderr, "%s: ERROR: unable to alloc memory for replay\n", modname);
+    goto fail4;
+  }
+  for (i = 0, root = conf->json; root != NULL; root = root->next, i++) {
+    replay_data[i] = calloc(1, root->snap_size + 1);
+    if (replay_data[i] == NULL) {
+      fprintf(stderr, "%s: ERROR: unable to alloc memory for replay\n", modname);
+      goto fail5;
+    }
+    snap_bind(root, replay_data[i]);
+    snap_walk(root, match_leaf, &ctx);
+  }
+  if (ctx.failed) {
+    fprintf(stderr, "%s: ERROR: unable to alloc memory for replay\n", modname);
+    goto fail5;
+  }
+  copies = ctx.copies;
+  copy_count = ctx.copy_count;
+  if (ctx.missing > 0) {
+    fprintf(stderr, "%s: WARNING: %d leaves not found in recording %s\n", modname, ctx.missing, replay->file);
+  }
+
+  // replay the oldest record still in the ring first
+  replay_last = hdr->write_index;
+  replay_first = (replay_last > hdr->capacity) ? replay_last - hdr->capacity : 0;
+  replay_pos = replay_first;
+  replay_loop = replay->loop;
+  replay_tick(NULL);
+
+  if (loop_add_timer(hdr->period_ns, replay_tick, NULL)) {
+    goto fail5;
+  }
+
+  free(ctx.leafs);
+  free(schema);
+  return 0;
+
+fail5:
+  for (i = 0; i < root_count; i++) {
+    free(replay_data[i]);
+  }
+  free(replay_data);
+  replay_data = NULL;
+  free(ctx.copies);
+  copies = NULL;
+fail4:
+  free(ctx.leafs);
+fail3:
+  free(schema);
+fail2:
+  munmap(map, map_size);
+  map = NULL;
+fail1:
+  close(fd);
+  fd = -1;
+fail0:
+  return -1;
+}
+
+void rec_stop(void) {
+  int i;
+
+  if (map != NULL) {
+    if (roots != NULL) {
+      msync(map, map_size, MS_ASYNC);
+    }
+    munmap(map, map_size);
+    map = NULL;
+  }
+  if (fd >= 0) {
+    close(fd);
+    fd = -1;
+  }
+
+  free(roots);
+  roots = NULL;
+
+  if (replay_data != NULL) {
+    for (i = 0; i < root_count; i++) {
+      free(replay_data[i]);
+    }
+    free(replay_data);
+    replay_data = NULL;
+  }
+  free(copies);
+  copies = NULL;
+}
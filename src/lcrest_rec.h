@@ -0,0 +1,11 @@
+#ifndef LCREST_REC_H
+#define LCREST_REC_H
+
+#include "lcrest.h"
+#include "lcrest_conf.h"
+
+int rec_record_start(CONF_ROOT_T *conf);
+int rec_replay_start(CONF_ROOT_T *conf);
+void rec_stop(void);
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef LCREST_REC_FILE_H
+#define LCREST_REC_FILE_H
+
+#include <stdint.h>
+
+// recording file layout, all values in host byte order
+//
+// the header is followed by schema_size bytes of schema text, records
+// start at header_size. records form a ring of capacity slots, record n
+// is stored in slot n % capacity. each record starts with
+// REC_RECORD_HEADER_T followed by the snapshots of the recorded roots.
+//
+// schema lines are tab separated:
+//   root <name> <offset> <size>
+//   leaf <path> <type> <offset>
+// offsets are relative to the start of a record.
+
+#define REC_FILE_MAGIC    "LCRRECRD"
+#define REC_FILE_VERSION  1
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t header_size;
+  uint64_t period_ns;
+  uint32_t record_size;
+  uint32_t capacity;
+  uint32_t schema_size;
+  uint32_t root_count;
+  uint64_t write_index;
+} REC_FILE_HEADER_T;
+
+typedef struct {
+  uint64_t time;
+  uint64_t index;
+} REC_RECORD_HEADER_T;
+
+#endif
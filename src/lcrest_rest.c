@@ -1,57 +1,620 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <ulfius.h>
 #include <jansson.h>
 #include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 
 #include "lcrest.h"
 #include "lcrest_conf.h"
 #include "lcrest_rest.h"
 #include "lcrest_json.h"
+#include "lcrest_query.h"
+#include "lcrest_decode.h"
+#include "lcrest_admit.h"
+#include "lcrest_sys.h"
+#include "lcrest_capture.h"
+#include "lcrest_events.h"
+#include "lcrest_static.h"
+#include "lcrest_metrics.h"
+#include "lcrest_hal.h"
+#include "lcrest_plugin.h"
+#include "lcrest_seq.h"
+#include "lcrest_rt.h"
 
 #define PORT 8080
 
+static void set_buf_response(struct _u_response * response, unsigned int status, const char *content_type, BUF_T *buf);
+static void set_etag(struct _u_response * response, CONF_JSON_ITEM_T *root);
+static int parse_etag(const char *str, uint64_t *generation);
+static int create_listen_socket(const struct sockaddr_in *addr, const CONF_SERVER_T *server);
+
 static int callback_json_get(const struct _u_request * request, struct _u_response * response, void * user_data);
 static int callback_json_post(const struct _u_request * request, struct _u_response * response, void * user_data);
+static int callback_query_get(const struct _u_request * request, struct _u_response * response, void * user_data);
+static int callback_capture_arm(const struct _u_request * request, struct _u_response * response, void * user_data);
+static int callback_capture_disarm(const struct _u_request * request, struct _u_response * response, void * user_data);
+static int callback_capture_status(const struct _u_request * request, struct _u_response * response, void * user_data);
+static int callback_capture_data(const struct _u_request * request, struct _u_response * response, void * user_data);
+static int callback_events_get(const struct _u_request * request, struct _u_response * response, void * user_data);
+static int callback_static_get(const struct _u_request * request, struct _u_response * response, void * user_data);
+static int callback_metrics_get(const struct _u_request * request, struct _u_response * response, void * user_data);
+static int get_seq_id(const struct _u_request * request);
+static int callback_seq_post(const struct _u_request * request, struct _u_response * response, void * user_data);
+static int callback_seq_get(const struct _u_request * request, struct _u_response * response, void * user_data);
+static int callback_seq_delete(const struct _u_request * request, struct _u_response * response, void * user_data);
 
 static struct _u_instance instance;
 
+static void set_buf_response(struct _u_response * response, unsigned int status, const char *content_type, BUF_T *buf) {
+  ulfius_set_binary_body_response(response, status, buf->data, buf->len);
+  u_map_put(response->map_header, "Content-Type", content_type);
+}
+
+// the root generation is a digest of all its HAL values, used as ETag
+static void set_etag(struct _u_response * response, CONF_JSON_ITEM_T *root) {
+  char etag[24];
+
+  snprintf(etag, sizeof(etag), "\"%016llx\"", (unsigned long long) hal_get_json_generation(root));
+  u_map_put(response->map_header, "ETag", etag);
+}
+
+static int parse_etag(const char *str, uint64_t *generation) {
+  char *end;
+
+  if (str[0] != '"' || strlen(str) != 18 || str[17] != '"') {
+    return -1;
+  }
+  *generation = strtoull(str + 1, &end, 16);
+  return (end == str + 17) ? 0 : -1;
+}
+
 static int callback_json_get(const struct _u_request * request, struct _u_response * response, void * user_data) {
-  CONF_JSON_ITEM_T *json = (CONF_JSON_ITEM_T *) user_data;
-  json_t *ret;
+  CONF_JSON_ITEM_T *root = (CONF_JSON_ITEM_T *) user_data;
+  JSON_FIELDS_T *fields = NULL;
+  JSON_LAYOUT_T layout = jsonLayoutRows;
+  const char *spec;
+  RT_VIEW_T view;
+  char cycle[24];
+  BUF_T buf;
 
-  ret = json_object();
-  json_build_response(ret, json);
-  ulfius_set_json_body_response(response, 200, ret);
-  json_decref(ret);
+  if (admit_enter(request, response, admitGet)) {
+    return U_CALLBACK_CONTINUE;
+  }
+
+  // optional array layout
+  spec = u_map_get(request->map_url, "layout");
+  if (spec != NULL && spec[0] != 0) {
+    if (strcmp(spec, "columnar") == 0) {
+      layout = jsonLayoutColumnar;
+    } else if (strcmp(spec, "rows") != 0) {
+      ulfius_set_string_body_response(response, 400, "Invalid layout.");
+      admit_leave();
+      return U_CALLBACK_CONTINUE;
+    }
+  }
 
+  // optional bit packing, only possible for columns
+  spec = u_map_get(request->map_url, "bits");
+  if (spec != NULL && spec[0] != 0) {
+    if (strcmp(spec, "packed") == 0) {
+      layout = jsonLayoutPacked;
+    } else if (strcmp(spec, "json") != 0) {
+      ulfius_set_string_body_response(response, 400, "Invalid bits.");
+      admit_leave();
+      return U_CALLBACK_CONTINUE;
+    }
+  }
+
+  // optional projection
+  spec = u_map_get(request->map_url, "fields");
+  if (spec != NULL && spec[0] != 0) {
+    fields = json_fields_get(root, spec);
+    if (fields == NULL) {
+      ulfius_set_string_body_response(response, 400, "Invalid fields.");
+      admit_leave();
+      return U_CALLBACK_CONTINUE;
+    }
+  }
+
+  // serve all values from the latest RT cycle if sampled, live values otherwise
+  if (rt_view_enter(root, &view) == 0) {
+    snprintf(cycle, sizeof(cycle), "%llu", (unsigned long long) view.cycle);
+    u_map_put(response->map_header, "X-Cycle", cycle);
+    snprintf(cycle, sizeof(cycle), "%lld", (long long) view.time);
+    u_map_put(response->map_header, "X-Cycle-Time", cycle);
+  }
+
+  // generation before values, so a concurrent change fails a later If-Match
+  buf_init(&buf);
+  set_etag(response, root);
+  if (json_build_response(&buf, root, fields, layout)) {
+    ulfius_set_string_body_response(response, 500, "Out of memory.");
+  } else {
+    set_buf_response(response, 200, "application/json", &buf);
+  }
+  buf_free(&buf);
+  rt_view_leave(&view);
+  json_fields_release(fields);
+
+  admit_leave();
   return U_CALLBACK_CONTINUE;
 }
 
 static int callback_json_post(const struct _u_request * request, struct _u_response * response, void * user_data) {
-  CONF_JSON_ITEM_T *json = (CONF_JSON_ITEM_T *) user_data;
-  json_t *root;
-  json_error_t error;
+  CONF_JSON_ITEM_T *root = (CONF_JSON_ITEM_T *) user_data;
+  DECODE_REQUEST_T req;
+  JSON_FIELDS_T *fields;
+  const char *spec;
+  BUF_T buf;
+  int i, ret;
+
+  if (admit_enter(request, response, admitPost)) {
+    return U_CALLBACK_CONTINUE;
+  }
 
-  root = json_loadb(request->binary_body, request->binary_body_length, 0, &error);
-  if (!root) {
-    fprintf(stderr, "json error on line %d: %s\n", error.line, error.text);
+  if (decode_request(&req, root, request->binary_body, request->binary_body_length)) {
+    fprintf(stderr, "json error on line %d: %s\n", req.line, req.error);
     ulfius_set_string_body_response(response, 400, "JSON parsing error.");
+    decode_free(&req);
+    admit_leave();
     return U_CALLBACK_ERROR;
   }
 
-  json_parse_request(root, json);
-  json_decref(root);
+  // optional preconditions
+  spec = u_map_get_case(request->map_header, "If-Match");
+  if (spec != NULL && strcmp(spec, "*") != 0) {
+    if (parse_etag(spec, &req.generation)) {
+      ulfius_set_string_body_response(response, 400, "Invalid If-Match.");
+      goto out;
+    }
+    req.match_generation = true;
+  }
+  spec = u_map_get(request->map_url, "expect");
+  if (spec != NULL && spec[0] != 0 && decode_expect(&req, spec)) {
+    ulfius_set_string_body_response(response, 400, req.error);
+    goto out;
+  }
 
+  ret = decode_apply(&req, request->client_address);
+  if (ret == DECODE_NOT_APPLIED) {
+    ulfius_set_string_body_response(response, 503, "Write not applied in time.");
+    goto out;
+  }
+  if (ret) {
+    set_etag(response, root);
+    ulfius_set_string_body_response(response, 412, "Precondition failed.");
+    goto out;
+  }
+
+  // optional read back of the written values
+  spec = u_map_get(request->map_url, "echo");
+  if (spec != NULL && strcmp(spec, "1") == 0) {
+    fields = json_fields_alloc(root);
+    if (fields == NULL) {
+      ulfius_set_string_body_response(response, 500, "Out of memory.");
+      goto out;
+    }
+    for (i = 0; i < root->item_count; i++) {
+      if (req.writes[i].json != NULL) {
+        json_fields_add(fields, req.writes[i].json);
+      }
+    }
+
+    buf_init(&buf);
+    set_etag(response, root);
+    if (json_build_response(&buf, root, fields, jsonLayoutRows)) {
+      ulfius_set_string_body_response(response, 500, "Out of memory.");
+    } else {
+      set_buf_response(response, 200, "application/json", &buf);
+    }
+    buf_free(&buf);
+    json_fields_release(fields);
+    goto out;
+  }
+
+  set_etag(response, root);
   ulfius_set_string_body_response(response, 200, "OK");
+
+out:
+  decode_free(&req);
+  admit_leave();
+  return U_CALLBACK_CONTINUE;
+}
+
+static int callback_query_get(const struct _u_request * request, struct _u_response * response, void * user_data) {
+  QUERY_TYPE_T type = (QUERY_TYPE_T) (intptr_t) user_data;
+  BUF_T buf;
+
+  if (admit_enter(request, response, admitGet)) {
+    return U_CALLBACK_CONTINUE;
+  }
+
+  buf_init(&buf);
+  if (query_build_response(&buf, type, u_map_get(request->map_url, "match"))) {
+    ulfius_set_string_body_response(response, 500, "HAL query failed.");
+  } else {
+    set_buf_response(response, 200, "application/json", &buf);
+  }
+  buf_free(&buf);
+
+  admit_leave();
+  return U_CALLBACK_CONTINUE;
+}
+
+static int callback_capture_arm(const struct _u_request * request, struct _u_response * response, void * user_data) {
+  CAPTURE_REQUEST_T req;
+  const char *error;
+
+  if (admit_enter(request, response, admitPost)) {
+    return U_CALLBACK_CONTINUE;
+  }
+
+  req.root = u_map_get(request->map_url, "root");
+  req.trigger = u_map_get(request->map_url, "trigger");
+  req.mode = u_map_get(request->map_url, "mode");
+  req.level = u_map_get(request->map_url, "level");
+  req.channels = u_map_get(request->map_url, "channels");
+  req.pre = u_map_get(request->map_url, "pre");
+  req.post = u_map_get(request->map_url, "post");
+
+  if (capture_arm(&req, &error)) {
+    ulfius_set_string_body_response(response, 400, error);
+  } else {
+    ulfius_set_string_body_response(response, 200, "OK");
+  }
+
+  admit_leave();
+  return U_CALLBACK_CONTINUE;
+}
+
+static int callback_capture_disarm(const struct _u_request * request, struct _u_response * response, void * user_data) {
+  if (admit_enter(request, response, admitPost)) {
+    return U_CALLBACK_CONTINUE;
+  }
+
+  capture_disarm();
+  ulfius_set_string_body_response(response, 200, "OK");
+
+  admit_leave();
+  return U_CALLBACK_CONTINUE;
+}
+
+static int callback_capture_status(const struct _u_request * request, struct _u_response * response, void * user_data) {
+  BUF_T buf;
+
+  if (admit_enter(request, response, admitGet)) {
+    return U_CALLBACK_CONTINUE;
+  }
+
+  buf_init(&buf);
+  if (capture_put_status(&buf)) {
+    ulfius_set_string_body_response(response, 500, "Out of memory.");
+  } else {
+    set_buf_response(response, 200, "application/json", &buf);
+  }
+  buf_free(&buf);
+
+  admit_leave();
+  return U_CALLBACK_CONTINUE;
+}
+
+static int callback_capture_data(const struct _u_request * request, struct _u_response * response, void * user_data) {
+  const char *format;
+  bool binary = false;
+  BUF_T buf;
+
+  if (admit_enter(request, response, admitGet)) {
+    return U_CALLBACK_CONTINUE;
+  }
+
+  format = u_map_get(request->map_url, "format");
+  if (format != NULL && format[0] != 0) {
+    if (strcmp(format, "binary") == 0) {
+      binary = true;
+    } else if (strcmp(format, "json") != 0) {
+      ulfius_set_string_body_response(response, 400, "Invalid format.");
+      admit_leave();
+      return U_CALLBACK_CONTINUE;
+    }
+  }
+
+  buf_init(&buf);
+  if (capture_put_data(&buf, binary)) {
+    ulfius_set_string_body_response(response, 404, "No finished capture.");
+  } else if (buf.error) {
+    ulfius_set_string_body_response(response, 500, "Out of memory.");
+  } else {
+    set_buf_response(response, 200, binary ? "application/octet-stream" : "application/json", &buf);
+  }
+  buf_free(&buf);
+
+  admit_leave();
+  return U_CALLBACK_CONTINUE;
+}
+
+static int callback_events_get(const struct _u_request * request, struct _u_response * response, void * user_data) {
+  const char *str;
+  uint64_t cursor;
+  long wait = 0;
+  long limit = EVENTS_LIMIT_DEFAULT;
+  char *end;
+  BUF_T buf;
+
+  if (admit_enter(request, response, admitGet)) {
+    return U_CALLBACK_CONTINUE;
+  }
+
+  if (events_parse_cursor(u_map_get(request->map_url, "cursor"), &cursor)) {
+    ulfius_set_string_body_response(response, 400, "Invalid cursor.");
+    admit_leave();
+    return U_CALLBACK_CONTINUE;
+  }
+
+  str = u_map_get(request->map_url, "wait");
+  if (str != NULL && str[0] != 0) {
+    wait = strtol(str, &end, 10);
+    if (*end != 0 || wait < 0 || wait > EVENTS_WAIT_MAX) {
+      ulfius_set_string_body_response(response, 400, "Invalid wait.");
+      admit_leave();
+      return U_CALLBACK_CONTINUE;
+    }
+  }
+
+  str = u_map_get(request->map_url, "limit");
+  if (str != NULL && str[0] != 0) {
+    limit = strtol(str, &end, 10);
+    if (*end != 0 || limit < 1 || limit > EVENTS_LIMIT_MAX) {
+      ulfius_set_string_body_response(response, 400, "Invalid limit.");
+      admit_leave();
+      return U_CALLBACK_CONTINUE;
+    }
+  }
+
+  // long polls don't hold an admission slot while waiting, but in epoll
+  // mode they occupy a pool worker, so size threads for the expected pollers
+  admit_leave();
+  events_wait(cursor, wait);
+
+  buf_init(&buf);
+  events_put(&buf, cursor, limit);
+  if (buf.error) {
+    ulfius_set_string_body_response(response, 500, "Out of memory.");
+  } else {
+    set_buf_response(response, 200, "application/json", &buf);
+  }
+  buf_free(&buf);
+
+  return U_CALLBACK_CONTINUE;
+}
+
+static int callback_static_get(const struct _u_request * request, struct _u_response * response, void * user_data) {
+  const CONF_STATIC_T *conf = (const CONF_STATIC_T *) user_data;
+  const STATIC_FILE_T *file;
+  const STATIC_BODY_T *body;
+  const char *match;
+  char cache[64];
+  STATIC_ENC_T enc;
+
+  if (admit_enter(request, response, admitGet)) {
+    return U_CALLBACK_CONTINUE;
+  }
+
+  file = static_lookup(request->url_path + strlen(conf->url));
+  if (file == NULL) {
+    ulfius_set_string_body_response(response, 404, "Not found.");
+    admit_leave();
+    return U_CALLBACK_CONTINUE;
+  }
+
+  enc = static_select(file, u_map_get_case(request->map_header, "Accept-Encoding"));
+  body = &file->body[enc];
+
+  // index documents are revalidated, so a new bundle is picked up at once
+  if (file->index) {
+    snprintf(cache, sizeof(cache), "no-cache");
+  } else {
+    snprintf(cache, sizeof(cache), "public, max-age=%d", conf->max_age);
+  }
+  u_map_put(response->map_header, "Cache-Control", cache);
+  u_map_put(response->map_header, "ETag", body->etag);
+  if (file->body[staticEncGzip].data != NULL || file->body[staticEncBr].data != NULL) {
+    u_map_put(response->map_header, "Vary", "Accept-Encoding");
+  }
+
+  match = u_map_get_case(request->map_header, "If-None-Match");
+  if (match != NULL && (strcmp(match, "*") == 0 || strstr(match, body->etag) != NULL)) {
+    ulfius_set_empty_body_response(response, 304);
+    admit_leave();
+    return U_CALLBACK_CONTINUE;
+  }
+
+  // streamed from the mapping, the body is not copied into the response
+  u_map_put(response->map_header, "Content-Type", file->type);
+  if (enc != staticEncIdentity) {
+    u_map_put(response->map_header, "Content-Encoding", static_enc_names[enc]);
+  }
+  ulfius_set_stream_response(response, 200, static_stream, NULL, body->size, STATIC_BLOCK_SIZE, (void *) body);
+
+  admit_leave();
   return U_CALLBACK_CONTINUE;
 }
 
+static int callback_metrics_get(const struct _u_request * request, struct _u_response * response, void * user_data) {
+  BUF_T buf;
+
+  if (admit_enter(request, response, admitGet)) {
+    return U_CALLBACK_CONTINUE;
+  }
+
+  buf_init(&buf);
+  metrics_put(&buf);
+  if (buf.error) {
+    ulfius_set_string_body_response(response, 500, "Out of memory.");
+  } else {
+    set_buf_response(response, 200, METRICS_CONTENT_TYPE, &buf);
+  }
+  buf_free(&buf);
+
+  admit_leave();
+  return U_CALLBACK_CONTINUE;
+}
+
+static int get_seq_id(const struct _u_request * request) {
+  const char *str = u_map_get(request->map_url, "id");
+  char *end;
+  long id;
+
+  if (str == NULL || str[0] == 0) {
+    return -1;
+  }
+  id = strtol(str, &end, 10);
+  if (*end != 0 || id < 1 || id > INT32_MAX) {
+    return 0;
+  }
+
+  return id;
+}
+
+static int callback_seq_post(const struct _u_request * request, struct _u_response * response, void * user_data) {
+  CONF_JSON_ITEM_T *root = (CONF_JSON_ITEM_T *) user_data;
+  const char *error;
+  char body[32];
+  int id;
+  int ret;
+
+  if (admit_enter(request, response, admitPost)) {
+    return U_CALLBACK_CONTINUE;
+  }
+
+  ret = seq_submit(root, request->binary_body, request->binary_body_length, request->client_address, &id, &error);
+  if (ret == SEQ_SUBMIT_BUSY) {
+    ulfius_set_string_body_response(response, 503, error);
+  } else if (ret) {
+    ulfius_set_string_body_response(response, 400, error);
+  } else {
+    snprintf(body, sizeof(body), "{\"id\":%d}", id);
+    ulfius_set_string_body_response(response, 200, body);
+    u_map_put(response->map_header, "Content-Type", "application/json");
+  }
+
+  admit_leave();
+  return U_CALLBACK_CONTINUE;
+}
+
+static int callback_seq_get(const struct _u_request * request, struct _u_response * response, void * user_data) {
+  BUF_T buf;
+  int id;
+
+  if (admit_enter(request, response, admitGet)) {
+    return U_CALLBACK_CONTINUE;
+  }
+
+  // single job by id, or all jobs
+  id = get_seq_id(request);
+  buf_init(&buf);
+  if (id == 0 || seq_put_status(&buf, id)) {
+    ulfius_set_string_body_response(response, 404, "Unknown sequence.");
+  } else if (buf.error) {
+    ulfius_set_string_body_response(response, 500, "Out of memory.");
+  } else {
+    set_buf_response(response, 200, "application/json", &buf);
+  }
+  buf_free(&buf);
+
+  admit_leave();
+  return U_CALLBACK_CONTINUE;
+}
+
+static int callback_seq_delete(const struct _u_request * request, struct _u_response * response, void * user_data) {
+  int id;
+
+  if (admit_enter(request, response, admitPost)) {
+    return U_CALLBACK_CONTINUE;
+  }
+
+  id = get_seq_id(request);
+  if (id <= 0 || seq_cancel(id)) {
+    ulfius_set_string_body_response(response, 404, "Unknown sequence.");
+  } else {
+    ulfius_set_string_body_response(response, 200, "OK");
+  }
+
+  admit_leave();
+  return U_CALLBACK_CONTINUE;
+}
+
+static int create_listen_socket(const struct sockaddr_in *addr, const CONF_SERVER_T *server) {
+  int fd;
+  int on = 1;
+  int val;
+
+  fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    fprintf(stderr, "%s: ERROR: unable to create listen socket: %s\n", modname, strerror(errno));
+    goto fail0;
+  }
+
+  if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0) {
+    goto fail_opt;
+  }
+
+  // accepted connections inherit these options from the listen socket
+  if (server->nodelay && setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)) < 0) {
+    goto fail_opt;
+  }
+  if (server->keepalive > 0) {
+    if (setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on)) < 0) {
+      goto fail_opt;
+    }
+    val = server->keepalive;
+    if (setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &val, sizeof(val)) < 0) {
+      goto fail_opt;
+    }
+    val = (server->keepalive >= 3) ? server->keepalive / 3 : 1;
+    if (setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &val, sizeof(val)) < 0) {
+      goto fail_opt;
+    }
+    val = 3;
+    if (setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &val, sizeof(val)) < 0) {
+      goto fail_opt;
+    }
+  }
+
+  if (bind(fd, (const struct sockaddr *) addr, sizeof(*addr)) < 0) {
+    fprintf(stderr, "%s: ERROR: unable to bind listen socket: %s\n", modname, strerror(errno));
+    goto fail1;
+  }
+
+  if (listen(fd, (server->backlog > 0) ? (int) server->backlog : SOMAXCONN) < 0) {
+    fprintf(stderr, "%s: ERROR: unable to listen: %s\n", modname, strerror(errno));
+    goto fail1;
+  }
+
+  return fd;
+
+fail_opt:
+  fprintf(stderr, "%s: ERROR: unable to set listen socket options: %s\n", modname, strerror(errno));
+fail1:
+  close(fd);
+fail0:
+  return -1;
+}
+
 int rest_start(CONF_ROOT_T *conf) {
+  const CONF_SERVER_T *server = &conf->server;
   int err;
   struct sockaddr_in lsnr;
   CONF_JSON_ITEM_T *json;
+  struct MHD_OptionItem mhd_ops[10];
+  int ops = 0;
+  unsigned int flags;
+  int fd;
 
   // build listener address
   memset(&lsnr, 0, sizeof(lsnr));
@@ -67,18 +630,122 @@ int rest_start(CONF_ROOT_T *conf) {
 
   // setup json endpoints
   for (json = conf->json; json != NULL; json = json->next) {
-    ulfius_add_endpoint_by_val(&instance, "GET", "/hal/json", json->name, 0, &callback_json_get, json->childs);
-    ulfius_add_endpoint_by_val(&instance, "POST", "/hal/json", json->name, 0, &callback_json_post, json->childs);
+    ulfius_add_endpoint_by_val(&instance, "GET", "/hal/json", json->name, 0, &callback_json_get, json);
+    ulfius_add_endpoint_by_val(&instance, "POST", "/hal/json", json->name, 0, &callback_json_post, json);
+  }
+
+  // setup generic hal query endpoints (there is no hal in replay mode)
+  if (conf->replay.file == NULL) {
+    ulfius_add_endpoint_by_val(&instance, "GET", "/hal", "pins", 0, &callback_query_get, (void *) (intptr_t) queryTypePins);
+    ulfius_add_endpoint_by_val(&instance, "GET", "/hal", "signals", 0, &callback_query_get, (void *) (intptr_t) queryTypeSignals);
+    ulfius_add_endpoint_by_val(&instance, "GET", "/hal", "params", 0, &callback_query_get, (void *) (intptr_t) queryTypeParams);
+  }
+
+  // setup triggered capture endpoints
+  if (capture_is_enabled()) {
+    ulfius_add_endpoint_by_val(&instance, "POST", "/hal", "capture", 0, &callback_capture_arm, NULL);
+    ulfius_add_endpoint_by_val(&instance, "DELETE", "/hal", "capture", 0, &callback_capture_disarm, NULL);
+    ulfius_add_endpoint_by_val(&instance, "GET", "/hal", "capture", 0, &callback_capture_status, NULL);
+    ulfius_add_endpoint_by_val(&instance, "GET", "/hal", "capture/data", 0, &callback_capture_data, NULL);
+  }
+
+  // setup sequencer endpoints
+  if (seq_is_enabled()) {
+    for (json = conf->json; json != NULL; json = json->next) {
+      ulfius_add_endpoint_by_val(&instance, "POST", "/hal/seq", json->name, 0, &callback_seq_post, json);
+    }
+    ulfius_add_endpoint_by_val(&instance, "GET", "/hal", "seq", 0, &callback_seq_get, NULL);
+    ulfius_add_endpoint_by_val(&instance, "GET", "/hal", "seq/:id", 0, &callback_seq_get, NULL);
+    ulfius_add_endpoint_by_val(&instance, "DELETE", "/hal", "seq/:id", 0, &callback_seq_delete, NULL);
+  }
+
+  // setup event journal endpoint
+  if (events_is_enabled()) {
+    ulfius_add_endpoint_by_val(&instance, "GET", "/hal", "events", 0, &callback_events_get, NULL);
+  }
+
+  // setup static file endpoints
+  if (static_start(&conf->stat)) {
+    err = U_ERROR;
+    goto fail1;
+  }
+  if (static_is_enabled()) {
+    ulfius_add_endpoint_by_val(&instance, "GET", conf->stat.url, NULL, 0, &callback_static_get, &conf->stat);
+    ulfius_add_endpoint_by_val(&instance, "GET", conf->stat.url, "*", 0, &callback_static_get, &conf->stat);
+  }
+
+  // setup metrics endpoint
+  if (metrics_start(conf)) {
+    err = U_ERROR;
+    goto fail2;
+  }
+  if (metrics_is_enabled()) {
+    ulfius_add_endpoint_by_val(&instance, "GET", "/hal", "metrics", 0, &callback_metrics_get, NULL);
+  }
+
+  // setup admission control
+  admit_init(&conf->server);
+
+  // worker pool for rendering large roots
+  if (json_render_start(&conf->server)) {
+    err = U_ERROR;
+    goto fail3;
+  }
+
+  // load plugins, they may add their own endpoints
+  if (plugin_start(conf, &instance)) {
+    err = U_ERROR;
+    goto fail4;
+  }
+
+  // own listen socket, so TCP options can be applied (MHD closes it on stop)
+  fd = create_listen_socket(&lsnr, server);
+  if (fd < 0) {
+    err = U_ERROR;
+    goto fail5;
+  }
+
+  // build daemon options, the first ones are the ones ulfius itself needs
+  mhd_ops[ops++] = (struct MHD_OptionItem) { MHD_OPTION_NOTIFY_COMPLETED, (intptr_t) mhd_request_completed, NULL };
+  mhd_ops[ops++] = (struct MHD_OptionItem) { MHD_OPTION_URI_LOG_CALLBACK, (intptr_t) ulfius_uri_logger, NULL };
+  mhd_ops[ops++] = (struct MHD_OptionItem) { MHD_OPTION_LISTEN_SOCKET, fd, NULL };
+  mhd_ops[ops++] = (struct MHD_OptionItem) { MHD_OPTION_CONNECTION_TIMEOUT, (server->timeout > 0) ? server->timeout : instance.timeout, NULL };
+  if (server->max_connections > 0) {
+    mhd_ops[ops++] = (struct MHD_OptionItem) { MHD_OPTION_CONNECTION_LIMIT, server->max_connections, NULL };
+  }
+  if (server->conn_memory > 0) {
+    mhd_ops[ops++] = (struct MHD_OptionItem) { MHD_OPTION_CONNECTION_MEMORY_LIMIT, server->conn_memory, NULL };
   }
+  if (sys_get_thread_stack() > 0) {
+    mhd_ops[ops++] = (struct MHD_OptionItem) { MHD_OPTION_THREAD_STACK_SIZE, sys_get_thread_stack(), NULL };
+  }
+
+  // thread per connection, or a fixed pool of epoll workers sharing all connections
+  if (server->mode == confHttpEpoll) {
+    flags = MHD_USE_EPOLL_INTERNAL_THREAD | MHD_USE_ERROR_LOG;
+    mhd_ops[ops++] = (struct MHD_OptionItem) { MHD_OPTION_THREAD_POOL_SIZE, (server->threads > 0) ? server->threads : (unsigned int) sys_get_cpu_count(), NULL };
+  } else {
+    flags = MHD_USE_THREAD_PER_CONNECTION | MHD_USE_INTERNAL_POLLING_THREAD | MHD_USE_ERROR_LOG;
+  }
+  mhd_ops[ops++] = (struct MHD_OptionItem) { MHD_OPTION_END, 0, NULL };
 
   // Start the framework
-  if ((err = ulfius_start_framework(&instance)) != U_OK) {
+  if ((err = ulfius_start_framework_with_mhd_options(&instance, flags, mhd_ops)) != U_OK) {
     fprintf(stderr, "%s: ERROR: unable to start ulfius instance\n", modname);
-    goto fail1;
+    close(fd);
+    goto fail5;
   }
 
   return U_OK;
 
+fail5:
+  plugin_stop();
+fail4:
+  json_render_stop();
+fail3:
+  metrics_stop();
+fail2:
+  static_stop();
 fail1:
   ulfius_clean_instance(&instance);
 fail0:
@@ -86,6 +753,17 @@ fail0:
 }
 
 int rest_stop(void) {
-  return ulfius_stop_framework(&instance);
+  int ret;
+
+  // pending long polls would delay the framework stop
+  events_release();
+  ret = ulfius_stop_framework(&instance);
+  plugin_stop();
+  json_render_stop();
+  metrics_stop();
+  static_stop();
+  json_fields_cleanup();
+
+  return ret;
 }
 
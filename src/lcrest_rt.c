@@ -0,0 +1,463 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "hal_priv.h"
+
+#include "lcrest.h"
+#include "lcrest_conf.h"
+#include "lcrest_hal.h"
+#include "lcrest_snap.h"
+#include "lcrest_loop.h"
+#include "lcrest_audit.h"
+#include "lcrest_rt.h"
+#include "lcrest_rt_layout.h"
+
+#define RT_ALIGN(x) (((x) + LCREST_RT_ALIGN - 1) & ~((size_t) LCREST_RT_ALIGN - 1))
+
+// poll interval and limit while waiting for the RT function to let go
+#define RT_STOP_POLL_US 1000
+#define RT_STOP_POLLS   100
+
+// poll interval while waiting for a write command to be applied
+#define RT_WRITE_POLL_US 100
+
+typedef struct {
+  LCREST_RT_COPY_T *table;
+  uint32_t count;
+  size_t offset;
+} RT_TABLE_CTX_T;
+
+static uint64_t get_time_ms(void);
+static void rt_tick(void *data);
+static void get_source(CONF_JSON_ITEM_T *json, uint32_t *kind, uint32_t *offset);
+static void count_leaf(CONF_JSON_ITEM_T *json, void *data);
+static void add_leaf(CONF_JSON_ITEM_T *json, void *data);
+static hal_pin_t *find_area_pin(const char *comp);
+static int retract_write(RT_WRITES_T *writes);
+static void release_writes(RT_WRITES_T *writes, bool ok);
+
+static const CONF_RT_T *rt_conf;
+static LCREST_RT_HEADER_T *hdr;
+static hal_pin_t *area_pin;
+
+// record offset of each root, -1 if not sampled
+static long *root_offsets;
+
+// last observed progress of the RT function, updated by rt_tick
+static uint32_t seen_head;
+static uint64_t seen_time;
+
+// one command in the ring at a time, held from rt_write_begin until the
+// command is applied or taken back. never held together with a lock the
+// main loop takes while waiting.
+static pthread_mutex_t write_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t get_time_ms(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+static void rt_tick(void *data) {
+  uint32_t head = __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE);
+
+  if (head != seen_head) {
+    seen_head = head;
+    __atomic_store_n(&seen_time, get_time_ms(), __ATOMIC_RELAXED);
+  }
+}
+
+static void count_leaf(CONF_JSON_ITEM_T *json, void *data) {
+  ((RT_TABLE_CTX_T *) data)->count++;
+}
+
+static void get_source(CONF_JSON_ITEM_T *json, uint32_t *kind, uint32_t *offset) {
+  // pins are followed through their signal, everything else is plain data
+  switch (json->type) {
+    case confTypeJsonPin:
+      *kind = LCREST_RT_COPY_PIN;
+      *offset = SHMOFF(json->hal.pin.obj);
+      return;
+    case confTypeJsonParam:
+      *kind = LCREST_RT_COPY_DATA;
+      *offset = SHMOFF(json->hal.param.ptr.ptr);
+      return;
+    default:
+      if (json->hal.ref.type == confRefPin) {
+        *kind = LCREST_RT_COPY_PIN;
+        *offset = SHMOFF(json->hal.ref.obj);
+      } else {
+        *kind = LCREST_RT_COPY_DATA;
+        *offset = SHMOFF(json->hal.ref.ptr.ptr);
+      }
+      return;
+  }
+}
+
+static void add_leaf(CONF_JSON_ITEM_T *json, void *data) {
+  RT_TABLE_CTX_T *ctx = (RT_TABLE_CTX_T *) data;
+  LCREST_RT_COPY_T *copy = &ctx->table[ctx->count++];
+
+  get_source(json, &copy->kind, &copy->src);
+  copy->dst = ctx->offset + json->snap_offset;
+  copy->size = snap_get_size(json->hal.type);
+}
+
+static hal_pin_t *find_area_pin(const char *comp) {
+  char name[HAL_NAME_LEN];
+  hal_pin_t *pin;
+
+  if (snprintf(name, HAL_NAME_LEN, "%s.area", comp) >= HAL_NAME_LEN) {
+    fprintf(stderr, "%s: ERROR: rtSampler comp name %s too long\n", modname, comp);
+    return NULL;
+  }
+
+  rtapi_mutex_get(&(hal_data->mutex));
+  pin = halpr_find_pin_by_name(name);
+  rtapi_mutex_give(&(hal_data->mutex));
+
+  if (pin == NULL) {
+    fprintf(stderr, "%s: ERROR: pin %s not found, is lcrest_rt loaded?\n", modname, name);
+    return NULL;
+  }
+  if (pin->type != HAL_U32 || pin->dir != HAL_IN || pin->signal != 0) {
+    fprintf(stderr, "%s: ERROR: pin %s must be an unlinked u32 input\n", modname, name);
+    return NULL;
+  }
+
+  return pin;
+}
+
+int rt_start(CONF_ROOT_T *conf) {
+  CONF_JSON_ITEM_T *root;
+  RT_TABLE_CTX_T ctx, leaves;
+  size_t record_size, slot_size, table_offset, write_offset, ring_offset, area_size;
+  uint32_t write_count;
+  int root_count;
+  char *area;
+
+  rt_conf = &conf->rt;
+  if (rt_conf->comp == NULL) {
+    return 0;
+  }
+
+  // recorded data has no RT thread behind it
+  if (hal_comp_id <= 0) {
+    fprintf(stderr, "%s: WARNING: rtSampler ignored in replay mode\n", modname);
+    return 0;
+  }
+
+  area_pin = find_area_pin(rt_conf->comp);
+  if (area_pin == NULL) {
+    goto fail0;
+  }
+
+  // place the selected roots in one record
+  for (root_count = 0, root = conf->json; root != NULL; root = root->next, root_count++);
+  root_offsets = malloc(root_count * sizeof(long));
+  if (root_offsets == NULL) {
+    fprintf(stderr, "%s: ERROR: unable to alloc memory for rt sampler\n", modname);
+    goto fail0;
+  }
+  memset(&ctx, 0, sizeof(ctx));
+  record_size = 0;
+  for (root = conf->json; root != NULL; root = root->next) {
+    root_offsets[root->root_index] = -1;
+    if (conf_is_root_selected(rt_conf->roots, root->name)) {
+      root_offsets[root->root_index] = record_size;
+      record_size += RT_ALIGN(root->snap_size);
+      snap_walk(root, count_leaf, &ctx);
+    }
+  }
+  if (ctx.count == 0) {
+    fprintf(stderr, "%s: ERROR: rt sampler has no values to sample\n", modname);
+    goto fail1;
+  }
+
+  // only one write command is in flight, it holds at most all values of a root
+  write_count = 0;
+  if (rt_conf->writes) {
+    for (root = conf->json; root != NULL; root = root->next) {
+      leaves.count = 0;
+      snap_walk(root, count_leaf, &leaves);
+      while (write_count < leaves.count) {
+        write_count = (write_count > 0) ? write_count << 1 : 1;
+      }
+    }
+  }
+
+  // header, copy table, write ring and sample ring share one block of HAL memory
+  slot_size = RT_ALIGN(sizeof(LCREST_RT_SLOT_T) + record_size);
+  table_offset = RT_ALIGN(sizeof(LCREST_RT_HEADER_T));
+  write_offset = RT_ALIGN(table_offset + ctx.count * sizeof(LCREST_RT_COPY_T));
+  ring_offset = RT_ALIGN(write_offset + write_count * sizeof(LCREST_RT_WRITE_T));
+  area_size = ring_offset + slot_size * rt_conf->slots;
+  area = hal_malloc(area_size);
+  if (area == NULL) {
+    fprintf(stderr, "%s: ERROR: unable to allocate %zu bytes of HAL shared memory for rt sampler, reduce slots or roots\n", modname, area_size);
+    goto fail1;
+  }
+  memset(area, 0, area_size);
+
+  // build the copy table
+  ctx.table = (LCREST_RT_COPY_T *) (area + table_offset);
+  ctx.count = 0;
+  for (root = conf->json; root != NULL; root = root->next) {
+    if (root_offsets[root->root_index] >= 0) {
+      ctx.offset = root_offsets[root->root_index];
+      snap_walk(root, add_leaf, &ctx);
+    }
+  }
+
+  hdr = (LCREST_RT_HEADER_T *) area;
+  hdr->magic = LCREST_RT_MAGIC;
+  hdr->version = LCREST_RT_VERSION;
+  hdr->copy_count = ctx.count;
+  hdr->record_size = record_size;
+  hdr->slot_count = rt_conf->slots;
+  hdr->slot_size = slot_size;
+  hdr->table_offset = table_offset;
+  hdr->ring_offset = ring_offset;
+  hdr->write_count = write_count;
+  hdr->write_offset = write_offset;
+
+  // attach, the RT function picks the area up with its next period
+  __atomic_store_n(&hdr->ready, 1, __ATOMIC_SEQ_CST);
+  *((volatile hal_u32_t *) hal_get_pin_value_ptr(area_pin)) = SHMOFF(area);
+
+  if (loop_add_timer(RT_CHECK_MS * 1000000ULL, rt_tick, NULL)) {
+    goto fail2;
+  }
+
+  return 0;
+
+fail2:
+  __atomic_store_n(&hdr->ready, 0, __ATOMIC_SEQ_CST);
+  *((volatile hal_u32_t *) hal_get_pin_value_ptr(area_pin)) = 0;
+  hdr = NULL;
+fail1:
+  free(root_offsets);
+  root_offsets = NULL;
+fail0:
+  return -1;
+}
+
+void rt_stop(void) {
+  int i;
+
+  if (hdr == NULL) {
+    return;
+  }
+
+  // the pins in the copy table go away with the component
+  __atomic_store_n(&hdr->ready, 0, __ATOMIC_SEQ_CST);
+  for (i = 0; (__atomic_load_n(&hdr->busy, __ATOMIC_SEQ_CST) || __atomic_load_n(&hdr->write_busy, __ATOMIC_SEQ_CST)) && i < RT_STOP_POLLS; i++) {
+    usleep(RT_STOP_POLL_US);
+  }
+  if (hdr->busy || hdr->write_busy) {
+    fprintf(stderr, "%s: WARNING: rt sampler did not detach\n", modname);
+  }
+  *((volatile hal_u32_t *) hal_get_pin_value_ptr(area_pin)) = 0;
+
+  // HAL memory can't be freed, the area stays until HAL is unloaded
+  hdr = NULL;
+  free(root_offsets);
+  root_offsets = NULL;
+}
+
+bool rt_is_enabled(void) {
+  return hdr != NULL;
+}
+
+int rt_view_enter(CONF_JSON_ITEM_T *root, RT_VIEW_T *view) {
+  LCREST_RT_SLOT_T *slot;
+  uint32_t head, index, seq;
+  long offset;
+  int i;
+
+  view->data = NULL;
+  if (hdr == NULL || (offset = root_offsets[root->root_index]) < 0) {
+    return -1;
+  }
+
+  // nothing sampled yet, or the thread is stopped
+  head = __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE);
+  if (head == 0 || get_time_ms() - __atomic_load_n(&seen_time, __ATOMIC_RELAXED) > RT_STALE_MS) {
+    return -1;
+  }
+
+  view->data = malloc(root->snap_size + 1);
+  if (view->data == NULL) {
+    return -1;
+  }
+
+  // slot seqlock, retry with the then latest slot if it was overwritten
+  for (i = 0; i < RT_READ_TRIES; i++) {
+    index = head - 1;
+    slot = (LCREST_RT_SLOT_T *) ((char *) hdr + hdr->ring_offset + (index & (hdr->slot_count - 1)) * hdr->slot_size);
+    seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    if (seq == 2 * index + 2) {
+      memcpy(view->data, (char *) (slot + 1) + offset, root->snap_size);
+      view->cycle = slot->cycle;
+      view->time = slot->time;
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == seq) {
+        hal_set_json_view(view->data);
+        return 0;
+      }
+    }
+    head = __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE);
+  }
+
+  free(view->data);
+  view->data = NULL;
+  return -1;
+}
+
+void rt_view_leave(RT_VIEW_T *view) {
+  if (view->data == NULL) {
+    return;
+  }
+
+  hal_set_json_view(NULL);
+  free(view->data);
+  view->data = NULL;
+}
+
+static int retract_write(RT_WRITES_T *writes) {
+  uint32_t end = writes->head + writes->count;
+  int i;
+
+  // take the command back. an apply that already read the old write_head
+  // is still busy, once write_busy dropped write_tail tells the outcome.
+  __atomic_store_n(&hdr->write_head, writes->head, __ATOMIC_SEQ_CST);
+  for (i = 0; __atomic_load_n(&hdr->write_busy, __ATOMIC_SEQ_CST) && i < RT_STOP_POLLS; i++) {
+    usleep(RT_STOP_POLL_US);
+  }
+  if (hdr->write_busy) {
+    fprintf(stderr, "%s: WARNING: %s.apply did not return, rt writes are blocked\n", modname, rt_conf->comp);
+  }
+
+  // applied late, but before it could be taken back
+  if (__atomic_load_n(&hdr->write_tail, __ATOMIC_ACQUIRE) == end) {
+    __atomic_store_n(&hdr->write_head, end, __ATOMIC_RELEASE);
+    return 0;
+  }
+
+  return -1;
+}
+
+static void release_writes(RT_WRITES_T *writes, bool ok) {
+  RT_WRITE_ITEM_T *item;
+  HAL_VALUE_T new_val;
+  int i;
+
+  // record the values as stored, or the requested ones if nothing was written
+  for (i = 0; i < writes->count; i++) {
+    item = &writes->items[i];
+    if (ok) {
+      hal_read_value(item->json->hal.type, hal_get_json_ptr(item->json), &new_val);
+      audit_record(item->json, writes->client, true, &item->old_val, &new_val);
+    } else {
+      audit_record(item->json, writes->client, false, &item->old_val, &item->val);
+    }
+  }
+
+  free(writes->items);
+  writes->items = NULL;
+  pthread_mutex_unlock(&write_lock);
+}
+
+int rt_write_begin(CONF_JSON_ITEM_T *root, const struct sockaddr *client, RT_WRITES_T *writes) {
+  // without a running RT thread, writes go directly to HAL
+  if (hdr == NULL || hdr->write_count == 0 || get_time_ms() - __atomic_load_n(&seen_time, __ATOMIC_RELAXED) > RT_STALE_MS) {
+    return 1;
+  }
+
+  pthread_mutex_lock(&write_lock);
+
+  // only left behind if the apply function hung during a retraction
+  writes->head = hdr->write_head;
+  if (__atomic_load_n(&hdr->write_tail, __ATOMIC_ACQUIRE) != writes->head) {
+    fprintf(stderr, "%s: ERROR: previous rt write command still pending\n", modname);
+    pthread_mutex_unlock(&write_lock);
+    return -1;
+  }
+
+  writes->items = malloc(root->item_count * sizeof(RT_WRITE_ITEM_T));
+  if (writes->items == NULL) {
+    pthread_mutex_unlock(&write_lock);
+    return -1;
+  }
+  writes->client = client;
+  writes->count = 0;
+
+  return 0;
+}
+
+int rt_write_add(RT_WRITES_T *writes, CONF_JSON_ITEM_T *json, const HAL_VALUE_T *val) {
+  RT_WRITE_ITEM_T *item = &writes->items[writes->count];
+  LCREST_RT_WRITE_T *cmd;
+  HAL_VALUE_T old_val;
+  volatile void *ptr;
+
+  ptr = hal_get_json_ptr(json);
+  if (ptr == NULL || (uint32_t) writes->count == hdr->write_count) {
+    return -1;
+  }
+
+  hal_read_value(json->hal.type, ptr, &old_val);
+
+  // skipped like a direct write, the other values still go out
+  if (!hal_validate_json_type(json->hal.type, val) || !hal_is_json_writable(json)) {
+    audit_record(json, writes->client, false, &old_val, val);
+    return 0;
+  }
+
+  // entries behind write_head are not visible to the RT side yet
+  cmd = (LCREST_RT_WRITE_T *) ((char *) hdr + hdr->write_offset) + ((writes->head + writes->count) & (hdr->write_count - 1));
+  get_source(json, &cmd->kind, &cmd->dst);
+  cmd->size = snap_get_size(json->hal.type);
+  cmd->value = 0;
+  hal_store_value(json->hal.type, &cmd->value, val);
+
+  item->json = json;
+  item->old_val = old_val;
+  item->val = *val;
+  writes->count++;
+  return 0;
+}
+
+void rt_write_publish(RT_WRITES_T *writes) {
+  // the whole command becomes visible at once
+  __atomic_store_n(&hdr->write_head, writes->head + writes->count, __ATOMIC_RELEASE);
+}
+
+int rt_write_finish(RT_WRITES_T *writes) {
+  uint32_t end = writes->head + writes->count;
+  int i;
+
+  for (i = 0; __atomic_load_n(&hdr->write_tail, __ATOMIC_ACQUIRE) != end; i++) {
+    if (i >= RT_WRITE_TIMEOUT_MS * 1000 / RT_WRITE_POLL_US) {
+      if (retract_write(writes) == 0) {
+        break;
+      }
+      fprintf(stderr, "%s: ERROR: rt write command not applied, is %s.apply running?\n", modname, rt_conf->comp);
+      release_writes(writes, false);
+      return -1;
+    }
+    usleep(RT_WRITE_POLL_US);
+  }
+
+  release_writes(writes, true);
+  return 0;
+}
+
+void rt_write_abort(RT_WRITES_T *writes) {
+  release_writes(writes, false);
+}
@@ -0,0 +1,54 @@
+#ifndef LCREST_RT_H
+#define LCREST_RT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/socket.h>
+
+#include "lcrest.h"
+#include "lcrest_conf.h"
+#include "lcrest_hal.h"
+
+// progress check interval, the latest cycle is ignored if the RT thread
+// made no progress for RT_STALE_MS
+#define RT_CHECK_MS   100
+#define RT_STALE_MS   1000
+#define RT_READ_TRIES 16
+
+// time a queued write command may take to reach the RT side, after that
+// it is taken back and the request fails
+#define RT_WRITE_TIMEOUT_MS 100
+
+typedef struct {
+  char *data;
+  uint64_t cycle;
+  int64_t time;
+} RT_VIEW_T;
+
+typedef struct {
+  CONF_JSON_ITEM_T *json;
+  HAL_VALUE_T old_val;
+  HAL_VALUE_T val;
+} RT_WRITE_ITEM_T;
+
+typedef struct {
+  const struct sockaddr *client;
+  uint32_t head;
+  int count;
+  RT_WRITE_ITEM_T *items;
+} RT_WRITES_T;
+
+int rt_start(CONF_ROOT_T *conf);
+void rt_stop(void);
+bool rt_is_enabled(void);
+
+int rt_view_enter(CONF_JSON_ITEM_T *root, RT_VIEW_T *view);
+void rt_view_leave(RT_VIEW_T *view);
+
+int rt_write_begin(CONF_JSON_ITEM_T *root, const struct sockaddr *client, RT_WRITES_T *writes);
+int rt_write_add(RT_WRITES_T *writes, CONF_JSON_ITEM_T *json, const HAL_VALUE_T *val);
+void rt_write_publish(RT_WRITES_T *writes);
+int rt_write_finish(RT_WRITES_T *writes);
+void rt_write_abort(RT_WRITES_T *writes);
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef LCREST_RT_LAYOUT_H
+#define LCREST_RT_LAYOUT_H
+
+#ifdef RTAPI
+#include "rtapi_stdint.h"
+#else
+#include <stdint.h>
+#endif
+
+// sample area in HAL shared memory, shared by lcrest and the lcrest_rt component
+//
+// lcrest allocates the area with hal_malloc, fills the copy table and
+// writes the area offset to the lcrest-rt.area pin. each period the RT
+// function copies all table entries into the next ring slot, tagged with
+// its cycle counter. every slot has its own seqlock: seq is 2 * index + 1
+// while slot index is written and 2 * index + 2 when it is complete.
+//
+// all offsets in the copy table are HAL shared memory offsets. pins are
+// referenced by their hal_pin_t, so the RT side follows relinking through
+// the signal (or dummysig). ready and busy form the stop handshake: the RT
+// function sets busy before it checks ready, lcrest clears ready and waits
+// for busy to drop before it releases the area.
+//
+// writes go the other way through a command ring: lcrest fills the entries
+// behind write_head and then advances write_head past the whole command.
+// the apply function writes everything up to write_head at once and
+// advances write_tail. it has its own write_busy flag, as it may run in a
+// different thread than the sampler. if a command is not applied in time,
+// lcrest moves write_head back and waits for write_busy to drop: either
+// write_tail then reached the old write_head (applied) or the command is gone.
+
+#define LCREST_RT_MAGIC   0x54524c4cU
+#define LCREST_RT_VERSION 2
+#define LCREST_RT_ALIGN   8
+
+#define LCREST_RT_COPY_PIN  0
+#define LCREST_RT_COPY_DATA 1
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  volatile uint32_t ready;
+  volatile uint32_t busy;
+  uint32_t copy_count;
+  uint32_t record_size;
+  uint32_t slot_count;
+  uint32_t slot_size;
+  uint32_t table_offset;
+  uint32_t ring_offset;
+  volatile uint32_t head;
+  volatile uint32_t write_busy;
+  uint32_t write_count;
+  uint32_t write_offset;
+  volatile uint32_t write_head;
+  volatile uint32_t write_tail;
+} LCREST_RT_HEADER_T;
+
+typedef struct {
+  uint32_t kind;
+  uint32_t src;
+  uint32_t dst;
+  uint32_t size;
+} LCREST_RT_COPY_T;
+
+typedef struct {
+  uint32_t kind;
+  uint32_t dst;
+  uint32_t size;
+  uint32_t reserved;
+  uint64_t value;
+} LCREST_RT_WRITE_T;
+
+typedef struct {
+  volatile uint32_t seq;
+  uint32_t reserved;
+  uint64_t cycle;
+  int64_t time;
+} LCREST_RT_SLOT_T;
+
+#endif
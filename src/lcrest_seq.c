@@ -0,0 +1,537 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <jansson.h>
+
+#include "lcrest.h"
+#include "lcrest_conf.h"
+#include "lcrest_hal.h"
+#include "lcrest_json.h"
+#include "lcrest_path.h"
+#include "lcrest_expr.h"
+#include "lcrest_loop.h"
+#include "lcrest_decode.h"
+#include "lcrest_seq.h"
+
+typedef enum {
+  seqStepSet = 0,
+  seqStepRamp,
+  seqStepWait
+} SEQ_STEP_TYPE_T;
+
+typedef struct {
+  SEQ_STEP_TYPE_T type;
+  CONF_JSON_ITEM_T *json;
+  HAL_VALUE_T val;
+  double tolerance;
+  // set: delay before writing, ramp: duration, wait: timeout (0 = none)
+  uint64_t time;
+} SEQ_STEP_T;
+
+typedef enum {
+  seqJobFree = 0,
+  seqJobRunning,
+  seqJobDone,
+  seqJobTimeout,
+  seqJobFailed,
+  seqJobCancelled
+} SEQ_JOB_STATE_T;
+
+typedef struct {
+  int id;
+  SEQ_JOB_STATE_T state;
+  CONF_JSON_ITEM_T *root;
+  struct sockaddr_storage client;
+  SEQ_STEP_T *steps;
+  int step_count;
+  int current;
+  bool step_started;
+  uint64_t step_start;
+  double ramp_from;
+  uint64_t finished;
+} SEQ_JOB_T;
+
+typedef struct {
+  CONF_JSON_ITEM_T *json;
+  int count;
+} SEQ_MATCH_CTX_T;
+
+static const char *state_names[] = { "free", "running", "done", "timeout", "failed", "cancelled" };
+
+static uint64_t get_time(void);
+static double read_value(CONF_JSON_ITEM_T *json);
+static bool write_value(SEQ_JOB_T *job, CONF_JSON_ITEM_T *json, const HAL_VALUE_T *val);
+static bool write_ramp(SEQ_JOB_T *job, const SEQ_STEP_T *step, double frac);
+static void run_job(SEQ_JOB_T *job, uint64_t now);
+static void seq_tick(void *data);
+static void match_item(CONF_JSON_ITEM_T *json, void *data);
+static CONF_JSON_ITEM_T *find_item(CONF_JSON_ITEM_T *root, const char *str);
+static int get_value(json_t *obj, HAL_VALUE_T *val);
+static int get_ms(json_t *obj, const char *key, uint64_t *ns);
+static int parse_step(CONF_JSON_ITEM_T *root, json_t *obj, SEQ_STEP_T *step, const char **error);
+static void put_job(BUF_T *buf, const SEQ_JOB_T *job);
+
+static const CONF_SEQ_T *seq_conf;
+static pthread_mutex_t seq_lock = PTHREAD_MUTEX_INITIALIZER;
+static SEQ_JOB_T *jobs;
+static SEQ_STEP_T *step_pool;
+static int next_id;
+
+static uint64_t get_time(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static double read_value(CONF_JSON_ITEM_T *json) {
+  if (json->type == confTypeJsonComputed) {
+    return expr_eval(json->hal.computed.code);
+  }
+
+  return hal_get_json_double(json);
+}
+
+static bool write_value(SEQ_JOB_T *job, CONF_JSON_ITEM_T *json, const HAL_VALUE_T *val) {
+  if (decode_write(json, val, (const struct sockaddr *) &job->client)) {
+    job->state = seqJobFailed;
+    return false;
+  }
+
+  return true;
+}
+
+static bool write_ramp(SEQ_JOB_T *job, const SEQ_STEP_T *step, double frac) {
+  HAL_VALUE_T val;
+  double to = (step->val.type == halValueInt) ? step->val.i : step->val.d;
+  double cur = job->ramp_from + (to - job->ramp_from) * frac;
+
+  if (step->json->hal.type == HAL_FLOAT) {
+    val.type = halValueReal;
+    val.d = cur;
+  } else {
+    val.type = halValueInt;
+    val.i = llround(cur);
+  }
+
+  return write_value(job, step->json, &val);
+}
+
+static void run_job(SEQ_JOB_T *job, uint64_t now) {
+  SEQ_STEP_T *step;
+  uint64_t elapsed;
+  double cur;
+
+  // steps that complete immediately are chained within one tick
+  while (job->state == seqJobRunning) {
+    if (job->current >= job->step_count) {
+      job->state = seqJobDone;
+      break;
+    }
+
+    step = &job->steps[job->current];
+    if (!job->step_started) {
+      job->step_started = true;
+      job->step_start = now;
+      if (step->type == seqStepRamp) {
+        job->ramp_from = read_value(step->json);
+      }
+    }
+    elapsed = now - job->step_start;
+
+    switch (step->type) {
+      case seqStepSet:
+        if (elapsed < step->time) {
+          return;
+        }
+        if (!write_value(job, step->json, &step->val)) {
+          return;
+        }
+        break;
+
+      case seqStepRamp:
+        if (elapsed < step->time) {
+          write_ramp(job, step, (double) elapsed / step->time);
+          return;
+        }
+        // end exactly on target
+        if (!write_value(job, step->json, &step->val)) {
+          return;
+        }
+        break;
+
+      case seqStepWait:
+        cur = read_value(step->json);
+        if (step->val.type == halValueBool) {
+          if ((cur != 0.0) != step->val.b) {
+            goto waiting;
+          }
+        } else if (fabs(cur - ((step->val.type == halValueInt) ? step->val.i : step->val.d)) > step->tolerance) {
+          goto waiting;
+        }
+        break;
+waiting:
+        if (step->time > 0 && elapsed >= step->time) {
+          job->state = seqJobTimeout;
+        }
+        return;
+    }
+
+    job->current++;
+    job->step_started = false;
+  }
+}
+
+static void seq_tick(void *data) {
+  uint64_t now = get_time();
+  int i;
+
+  pthread_mutex_lock(&seq_lock);
+  for (i = 0; i < seq_conf->jobs; i++) {
+    if (jobs[i].state == seqJobRunning) {
+      run_job(&jobs[i], now);
+      if (jobs[i].state != seqJobRunning) {
+        jobs[i].finished = now;
+      }
+    }
+  }
+  pthread_mutex_unlock(&seq_lock);
+}
+
+static void match_item(CONF_JSON_ITEM_T *json, void *data) {
+  SEQ_MATCH_CTX_T *ctx = (SEQ_MATCH_CTX_T *) data;
+
+  ctx->json = json;
+  ctx->count++;
+}
+
+static CONF_JSON_ITEM_T *find_item(CONF_JSON_ITEM_T *root, const char *str) {
+  SEQ_MATCH_CTX_T ctx;
+  PATH_T *path;
+
+  path = path_parse(str, strlen(str));
+  if (path == NULL) {
+    return NULL;
+  }
+
+  ctx.json = NULL;
+  ctx.count = 0;
+  path_resolve(path, root->childs, match_item, &ctx);
+  path_free(path);
+
+  // steps address exactly one value
+  if (ctx.count != 1 || !CONF_TYPE_IS_LEAF(ctx.json->type)) {
+    return NULL;
+  }
+
+  return ctx.json;
+}
+
+static int get_value(json_t *obj, HAL_VALUE_T *val) {
+  json_t *v = json_object_get(obj, "value");
+
+  if (json_is_boolean(v)) {
+    val->type = halValueBool;
+    val->b = json_is_true(v);
+    return 0;
+  }
+  if (json_is_integer(v)) {
+    val->type = halValueInt;
+    val->i = json_integer_value(v);
+    return 0;
+  }
+  if (json_is_real(v)) {
+    val->type = halValueReal;
+    val->d = json_real_value(v);
+    return 0;
+  }
+
+  return -1;
+}
+
+static int get_ms(json_t *obj, const char *key, uint64_t *ns) {
+  json_t *v = json_object_get(obj, key);
+
+  if (v == NULL) {
+    *ns = 0;
+    return 0;
+  }
+  if (!json_is_integer(v) || json_integer_value(v) < 0 || json_integer_value(v) > 86400000) {
+    return -1;
+  }
+
+  *ns = (uint64_t) json_integer_value(v) * 1000000ULL;
+  return 0;
+}
+
+static int parse_step(CONF_JSON_ITEM_T *root, json_t *obj, SEQ_STEP_T *step, const char **error) {
+  json_t *v;
+
+  memset(step, 0, sizeof(SEQ_STEP_T));
+  if (!json_is_object(obj)) {
+    *error = "step must be an object";
+    return -1;
+  }
+
+  // {"set": path, "value": v, "delay": ms}
+  if ((v = json_object_get(obj, "set")) != NULL) {
+    step->type = seqStepSet;
+    if (!json_is_string(v) || (step->json = find_item(root, json_string_value(v))) == NULL || !CONF_TYPE_IS_HAL(step->json->type)) {
+      *error = "set must name a single pin, param or ref";
+      return -1;
+    }
+    if (get_value(obj, &step->val) || !hal_validate_json_type(step->json->hal.type, &step->val)) {
+      *error = "invalid set value";
+      return -1;
+    }
+    if (get_ms(obj, "delay", &step->time)) {
+      *error = "invalid delay";
+      return -1;
+    }
+    return 0;
+  }
+
+  // {"ramp": path, "value": v, "time": ms}
+  if ((v = json_object_get(obj, "ramp")) != NULL) {
+    step->type = seqStepRamp;
+    if (!json_is_string(v) || (step->json = find_item(root, json_string_value(v))) == NULL || !CONF_TYPE_IS_HAL(step->json->type) || step->json->hal.type == HAL_BIT) {
+      *error = "ramp must name a single numeric pin, param or ref";
+      return -1;
+    }
+    if (get_value(obj, &step->val) || step->val.type == halValueBool || !hal_validate_json_type(step->json->hal.type, &step->val)) {
+      *error = "invalid ramp value";
+      return -1;
+    }
+    if (get_ms(obj, "time", &step->time)) {
+      *error = "invalid ramp time";
+      return -1;
+    }
+    return 0;
+  }
+
+  // {"wait": path, "value": v, "tolerance": t, "timeout": ms}
+  if ((v = json_object_get(obj, "wait")) != NULL) {
+    step->type = seqStepWait;
+    if (!json_is_string(v) || (step->json = find_item(root, json_string_value(v))) == NULL) {
+      *error = "wait must name a single value";
+      return -1;
+    }
+    if (get_value(obj, &step->val) || (step->val.type == halValueBool) != (step->json->hal.type == HAL_BIT)) {
+      *error = "invalid wait value";
+      return -1;
+    }
+    v = json_object_get(obj, "tolerance");
+    if (v != NULL) {
+      if (!json_is_number(v) || json_number_value(v) < 0.0) {
+        *error = "invalid wait tolerance";
+        return -1;
+      }
+      step->tolerance = json_number_value(v);
+    }
+    if (get_ms(obj, "timeout", &step->time)) {
+      *error = "invalid wait timeout";
+      return -1;
+    }
+    return 0;
+  }
+
+  *error = "unknown step type";
+  return -1;
+}
+
+int seq_start(CONF_ROOT_T *conf) {
+  int i;
+
+  seq_conf = &conf->seq;
+  if (seq_conf->rate <= 0) {
+    return 0;
+  }
+
+  jobs = calloc(seq_conf->jobs, sizeof(SEQ_JOB_T));
+  if (jobs == NULL) {
+    fprintf(stderr, "%s: ERROR: unable to alloc memory for sequencer jobs\n", modname);
+    goto fail0;
+  }
+
+  step_pool = calloc((size_t) seq_conf->jobs * seq_conf->steps, sizeof(SEQ_STEP_T));
+  if (step_pool == NULL) {
+    fprintf(stderr, "%s: ERROR: unable to alloc memory for sequencer steps\n", modname);
+    goto fail1;
+  }
+  for (i = 0; i < seq_conf->jobs; i++) {
+    jobs[i].steps = step_pool + (size_t) i * seq_conf->steps;
+  }
+  next_id = 1;
+
+  if (loop_add_timer(1000000000ULL / seq_conf->rate, seq_tick, NULL)) {
+    goto fail2;
+  }
+
+  return 0;
+
+fail2:
+  free(step_pool);
+  step_pool = NULL;
+fail1:
+  free(jobs);
+  jobs = NULL;
+fail0:
+  return -1;
+}
+
+void seq_stop(void) {
+  free(step_pool);
+  free(jobs);
+  step_pool = NULL;
+  jobs = NULL;
+}
+
+bool seq_is_enabled(void) {
+  return jobs != NULL;
+}
+
+int seq_submit(CONF_JSON_ITEM_T *root, const char *body, size_t len, const struct sockaddr *client, int *id, const char **error) {
+  json_t *doc;
+  json_t *list;
+  SEQ_STEP_T *steps;
+  SEQ_JOB_T *job;
+  size_t count, i;
+  int ret = SEQ_SUBMIT_INVALID;
+
+  doc = json_loadb(body, len, 0, NULL);
+  if (doc == NULL) {
+    *error = "JSON parsing error";
+    goto fail0;
+  }
+
+  list = json_object_get(doc, "steps");
+  count = json_array_size(list);
+  if (!json_is_array(list) || count == 0) {
+    *error = "steps must be a non empty array";
+    goto fail1;
+  }
+  if (count > (size_t) seq_conf->steps) {
+    *error = "too many steps";
+    goto fail1;
+  }
+
+  // validate everything before taking a slot
+  steps = malloc(count * sizeof(SEQ_STEP_T));
+  if (steps == NULL) {
+    *error = "out of memory";
+    goto fail1;
+  }
+  for (i = 0; i < count; i++) {
+    if (parse_step(root, json_array_get(list, i), &steps[i], error)) {
+      goto fail2;
+    }
+  }
+
+  // use a free slot, or the one finished longest ago
+  pthread_mutex_lock(&seq_lock);
+  job = NULL;
+  for (i = 0; i < (size_t) seq_conf->jobs; i++) {
+    if (jobs[i].state == seqJobFree) {
+      job = &jobs[i];
+      break;
+    }
+    if (jobs[i].state != seqJobRunning && (job == NULL || jobs[i].finished < job->finished)) {
+      job = &jobs[i];
+    }
+  }
+  if (job == NULL) {
+    pthread_mutex_unlock(&seq_lock);
+    *error = "too many running sequences";
+    ret = SEQ_SUBMIT_BUSY;
+    goto fail2;
+  }
+
+  job->id = next_id++;
+  job->root = root;
+  memset(&job->client, 0, sizeof(job->client));
+  if (client != NULL) {
+    memcpy(&job->client, client, (client->sa_family == AF_INET6) ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in));
+  }
+  memcpy(job->steps, steps, count * sizeof(SEQ_STEP_T));
+  job->step_count = count;
+  job->current = 0;
+  job->step_started = false;
+  job->finished = 0;
+  job->state = seqJobRunning;
+  *id = job->id;
+  pthread_mutex_unlock(&seq_lock);
+
+  ret = 0;
+
+fail2:
+  free(steps);
+fail1:
+  json_decref(doc);
+fail0:
+  return ret;
+}
+
+int seq_cancel(int id) {
+  int i;
+  int ret = -1;
+
+  pthread_mutex_lock(&seq_lock);
+  for (i = 0; i < seq_conf->jobs; i++) {
+    if (jobs[i].state != seqJobFree && jobs[i].id == id) {
+      // values stay where the sequence left them
+      if (jobs[i].state == seqJobRunning) {
+        jobs[i].state = seqJobCancelled;
+        jobs[i].finished = get_time();
+      }
+      ret = 0;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&seq_lock);
+
+  return ret;
+}
+
+static void put_job(BUF_T *buf, const SEQ_JOB_T *job) {
+  char num[64];
+
+  snprintf(num, sizeof(num), "{\"id\":%d,\"root\":", job->id);
+  buf_puts(buf, num);
+  json_put_string(buf, job->root->name);
+  buf_puts(buf, ",\"state\":");
+  json_put_string(buf, state_names[job->state]);
+  snprintf(num, sizeof(num), ",\"step\":%d,\"steps\":%d}", job->current, job->step_count);
+  buf_puts(buf, num);
+}
+
+int seq_put_status(BUF_T *buf, int id) {
+  bool first = true;
+  int i;
+  int ret = (id < 0) ? 0 : -1;
+
+  pthread_mutex_lock(&seq_lock);
+  if (id < 0) {
+    buf_putc(buf, '[');
+  }
+  for (i = 0; i < seq_conf->jobs; i++) {
+    if (jobs[i].state == seqJobFree || (id >= 0 && jobs[i].id != id)) {
+      continue;
+    }
+    if (!first) {
+      buf_putc(buf, ',');
+    }
+    first = false;
+    put_job(buf, &jobs[i]);
+    ret = 0;
+  }
+  if (id < 0) {
+    buf_putc(buf, ']');
+  }
+  pthread_mutex_unlock(&seq_lock);
+
+  return ret;
+}
@@ -0,0 +1,23 @@
+#ifndef LCREST_SEQ_H
+#define LCREST_SEQ_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/socket.h>
+
+#include "lcrest.h"
+#include "lcrest_conf.h"
+#include "lcrest_buf.h"
+
+#define SEQ_SUBMIT_INVALID -1
+#define SEQ_SUBMIT_BUSY    -2
+
+int seq_start(CONF_ROOT_T *conf);
+void seq_stop(void);
+bool seq_is_enabled(void);
+
+int seq_submit(CONF_JSON_ITEM_T *root, const char *body, size_t len, const struct sockaddr *client, int *id, const char **error);
+int seq_cancel(int id);
+int seq_put_status(BUF_T *buf, int id);
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef LCREST_SHM_LAYOUT_H
+#define LCREST_SHM_LAYOUT_H
+
+#include <stdint.h>
+
+// shared memory segment layout, shared by lcrest and the client library
+//
+// LCREST_SHM_HEADER_T is followed by root_count LCREST_SHM_ROOT_T and
+// schema_size bytes of schema text (same format as the recorder schema,
+// offsets relative to the root data). each root has its own seqlock:
+// seq is odd while the root data is updated.
+//
+// generation is set to a new value whenever lcrest creates the segment
+// and cleared on shutdown, clients have to reopen if it changes.
+
+#define LCREST_SHM_MAGIC      "LCRSHM01"
+#define LCREST_SHM_VERSION    1
+#define LCREST_SHM_ALIGN      64
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t root_count;
+  uint64_t generation;
+  uint64_t size;
+  uint32_t schema_offset;
+  uint32_t schema_size;
+} LCREST_SHM_HEADER_T;
+
+typedef struct {
+  uint32_t seq;
+  uint32_t size;
+  uint64_t offset;
+  uint64_t time;
+  uint8_t reserved[LCREST_SHM_ALIGN - 24];
+} LCREST_SHM_ROOT_T;
+
+#endif
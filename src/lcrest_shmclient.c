@@ -0,0 +1,231 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "lcrest_shmclient.h"
+
+// an odd seq that outlasts this is left behind by a crashed lcrest
+#define SHM_READ_SPINS      1024
+#define SHM_READ_TIMEOUT_NS 100000000ULL
+
+static const char *find_line(const LCREST_SHM_T *shm, const char *kind, const char *name, int *index);
+static bool check_range(const LCREST_SHM_T *shm, uint64_t offset, uint64_t size);
+static uint64_t get_time(void);
+
+static const char *find_line(const LCREST_SHM_T *shm, const char *kind, const char *name, int *index) {
+  size_t kind_len = strlen(kind);
+  size_t name_len = strlen(name);
+  const char *line;
+
+  *index = -1;
+  for (line = shm->schema; *line != 0; line += strcspn(line, "\n") + (line[strcspn(line, "\n")] != 0)) {
+    if (strncmp(line, "root\t", 5) == 0) {
+      (*index)++;
+    }
+    if (strncmp(line, kind, kind_len) == 0 && line[kind_len] == '\t' &&
+        strncmp(line + kind_len + 1, name, name_len) == 0 && line[kind_len + 1 + name_len] == '\t') {
+      return line + kind_len + 1 + name_len + 1;
+    }
+  }
+
+  return NULL;
+}
+
+static uint64_t get_time(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static bool check_range(const LCREST_SHM_T *shm, uint64_t offset, uint64_t size) {
+  return offset <= shm->size && size <= shm->size - offset;
+}
+
+LCREST_SHM_T *lcrest_shm_open(const char *name) {
+  LCREST_SHM_T *shm;
+  struct stat st;
+  uint32_t i;
+  int fd;
+
+  shm = calloc(1, sizeof(LCREST_SHM_T));
+  if (shm == NULL) {
+    goto fail0;
+  }
+  shm->name = strdup(name);
+  if (shm->name == NULL) {
+    goto fail1;
+  }
+
+  fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+  if (fd < 0) {
+    goto fail1;
+  }
+  if (fstat(fd, &st) < 0 || (size_t) st.st_size < sizeof(LCREST_SHM_HEADER_T)) {
+    close(fd);
+    goto fail1;
+  }
+  shm->size = st.st_size;
+  shm->dev = st.st_dev;
+  shm->ino = st.st_ino;
+  shm->map = mmap(NULL, shm->size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (shm->map == MAP_FAILED) {
+    goto fail1;
+  }
+
+  // segment is valid once the generation is set
+  shm->hdr = (const LCREST_SHM_HEADER_T *) shm->map;
+  shm->generation = __atomic_load_n(&shm->hdr->generation, __ATOMIC_ACQUIRE);
+  if (shm->generation == 0 || memcmp(shm->hdr->magic, LCREST_SHM_MAGIC, sizeof(shm->hdr->magic)) != 0 ||
+      shm->hdr->version != LCREST_SHM_VERSION || shm->hdr->size > shm->size ||
+      !check_range(shm, shm->hdr->schema_offset, shm->hdr->schema_size) ||
+      !check_range(shm, sizeof(LCREST_SHM_HEADER_T), (uint64_t) shm->hdr->root_count * sizeof(LCREST_SHM_ROOT_T))) {
+    goto fail2;
+  }
+  shm->roots = (const LCREST_SHM_ROOT_T *) (shm->map + sizeof(LCREST_SHM_HEADER_T));
+  for (i = 0; i < shm->hdr->root_count; i++) {
+    if (!check_range(shm, shm->roots[i].offset, shm->roots[i].size)) {
+      goto fail2;
+    }
+  }
+
+  // private copy of the schema, terminated
+  shm->schema = malloc(shm->hdr->schema_size + 1);
+  if (shm->schema == NULL) {
+    goto fail2;
+  }
+  memcpy(shm->schema, shm->map + shm->hdr->schema_offset, shm->hdr->schema_size);
+  shm->schema[shm->hdr->schema_size] = 0;
+
+  return shm;
+
+fail2:
+  munmap(shm->map, shm->size);
+fail1:
+  free(shm->name);
+  free(shm);
+fail0:
+  return NULL;
+}
+
+void lcrest_shm_close(LCREST_SHM_T *shm) {
+  if (shm == NULL) {
+    return;
+  }
+
+  munmap(shm->map, shm->size);
+  free(shm->schema);
+  free(shm->name);
+  free(shm);
+}
+
+bool lcrest_shm_is_stale(const LCREST_SHM_T *shm) {
+  return __atomic_load_n(&shm->hdr->generation, __ATOMIC_ACQUIRE) != shm->generation;
+}
+
+bool lcrest_shm_is_replaced(const LCREST_SHM_T *shm) {
+  struct stat st;
+  int fd;
+
+  // lcrest always creates a new segment, a crashed one is never reused
+  fd = shm_open(shm->name, O_RDONLY | O_CLOEXEC, 0);
+  if (fd < 0) {
+    return true;
+  }
+  if (fstat(fd, &st) < 0) {
+    close(fd);
+    return true;
+  }
+  close(fd);
+
+  return st.st_dev != shm->dev || st.st_ino != shm->ino;
+}
+
+int lcrest_shm_find_root(const LCREST_SHM_T *shm, const char *name) {
+  int index;
+
+  if (find_line(shm, "root", name, &index) == NULL) {
+    return -1;
+  }
+
+  return index;
+}
+
+size_t lcrest_shm_get_root_size(const LCREST_SHM_T *shm, int root) {
+  if (root < 0 || (uint32_t) root >= shm->hdr->root_count) {
+    return 0;
+  }
+
+  return shm->roots[root].size;
+}
+
+int lcrest_shm_find_leaf(const LCREST_SHM_T *shm, const char *path, LCREST_SHM_LEAF_T *leaf) {
+  const char *pos;
+  size_t len;
+
+  pos = find_line(shm, "leaf", path, &leaf->root);
+  if (pos == NULL || leaf->root < 0) {
+    return -1;
+  }
+
+  len = strcspn(pos, "\t");
+  if (len >= sizeof(leaf->type) || pos[len] != '\t') {
+    return -1;
+  }
+  memcpy(leaf->type, pos, len);
+  leaf->type[len] = 0;
+  leaf->offset = strtoul(pos + len + 1, NULL, 10);
+
+  return 0;
+}
+
+uint32_t lcrest_shm_read(const LCREST_SHM_T *shm, int root, void *dst, uint64_t *time) {
+  const LCREST_SHM_ROOT_T *r;
+  uint32_t seq0, seq1;
+  uint64_t offset, start = 0;
+  uint32_t size;
+  int spins;
+
+  if (root < 0 || (uint32_t) root >= shm->hdr->root_count) {
+    return LCREST_SHM_READ_ERROR;
+  }
+  r = &shm->roots[root];
+
+  // retry until no update overlapped the copy
+  do {
+    for (spins = 0; (seq0 = __atomic_load_n(&r->seq, __ATOMIC_ACQUIRE)) & 1; spins++) {
+      if (spins < SHM_READ_SPINS) {
+        continue;
+      }
+      spins = 0;
+      if (start == 0) {
+        start = get_time();
+      } else if (lcrest_shm_is_stale(shm) || get_time() - start > SHM_READ_TIMEOUT_NS) {
+        return LCREST_SHM_READ_ERROR;
+      }
+    }
+
+    // rechecked on every read, a copy must never leave the mapping
+    offset = r->offset;
+    size = r->size;
+    if (!check_range(shm, offset, size)) {
+      return LCREST_SHM_READ_ERROR;
+    }
+    memcpy(dst, shm->map + offset, size);
+    if (time != NULL) {
+      *time = r->time;
+    }
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    seq1 = __atomic_load_n(&r->seq, __ATOMIC_RELAXED);
+  } while (seq0 != seq1);
+
+  // number of updates, lets callers skip unchanged snapshots
+  return seq0 >> 1;
+}
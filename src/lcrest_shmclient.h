@@ -0,0 +1,56 @@
+#ifndef LCREST_SHMCLIENT_H
+#define LCREST_SHMCLIENT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "lcrest_shm_layout.h"
+
+// read only client for the lcrest shared memory publisher
+//
+// lcrest_shm_read() does not enter the kernel, it copies a consistent
+// snapshot of one root using the per root seqlock. values are located in
+// the snapshot by lcrest_shm_find_leaf().
+//
+// lcrest_shm_is_stale() is true once lcrest shut down orderly. a crashed
+// lcrest can't clear the generation, the mapping then just stops changing.
+// on restart lcrest always creates a new segment under the same name, which
+// lcrest_shm_is_replaced() detects (one shm_open, not meant for every read).
+// in both cases close and reopen.
+
+// lcrest_shm_read() result for an invalid root, a corrupt root entry or an
+// update that never completes (lcrest died while writing the root)
+#define LCREST_SHM_READ_ERROR UINT32_MAX
+
+typedef struct {
+  char *name;
+  dev_t dev;
+  ino_t ino;
+  char *map;
+  size_t size;
+  uint64_t generation;
+  const LCREST_SHM_HEADER_T *hdr;
+  const LCREST_SHM_ROOT_T *roots;
+  char *schema;
+} LCREST_SHM_T;
+
+typedef struct {
+  int root;
+  size_t offset;
+  char type[8];
+} LCREST_SHM_LEAF_T;
+
+LCREST_SHM_T *lcrest_shm_open(const char *name);
+void lcrest_shm_close(LCREST_SHM_T *shm);
+bool lcrest_shm_is_stale(const LCREST_SHM_T *shm);
+bool lcrest_shm_is_replaced(const LCREST_SHM_T *shm);
+
+int lcrest_shm_find_root(const LCREST_SHM_T *shm, const char *name);
+size_t lcrest_shm_get_root_size(const LCREST_SHM_T *shm, int root);
+int lcrest_shm_find_leaf(const LCREST_SHM_T *shm, const char *path, LCREST_SHM_LEAF_T *leaf);
+
+uint32_t lcrest_shm_read(const LCREST_SHM_T *shm, int root, void *dst, uint64_t *time);
+
+#endif
@@ -0,0 +1,209 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "lcrest.h"
+#include "lcrest_conf.h"
+#include "lcrest_buf.h"
+#include "lcrest_snap.h"
+#include "lcrest_loop.h"
+#include "lcrest_shmpub.h"
+#include "lcrest_shm_layout.h"
+
+#define SHMPUB_ALIGN(x) (((x) + LCREST_SHM_ALIGN - 1) & ~((size_t) LCREST_SHM_ALIGN - 1))
+
+typedef struct {
+  CONF_JSON_ITEM_T *root;
+  LCREST_SHM_ROOT_T *shm;
+  char *data;
+  char *stage;
+} SHMPUB_ROOT_T;
+
+static uint64_t get_time(void);
+static void publish_tick(void *data);
+
+static const CONF_SHMPUB_T *shmpub_conf;
+static LCREST_SHM_HEADER_T *hdr;
+static size_t map_size;
+
+static SHMPUB_ROOT_T *roots;
+static int root_count;
+
+static uint64_t get_time(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void publish_tick(void *data) {
+  SHMPUB_ROOT_T *pub;
+  uint32_t seq;
+  int i;
+
+  for (i = 0; i < root_count; i++) {
+    pub = &roots[i];
+
+    // sample outside of the critical section, skip unchanged roots
+    snap_take(pub->root, pub->stage);
+    if (memcmp(pub->stage, pub->data, pub->root->snap_size) == 0) {
+      continue;
+    }
+
+    seq = pub->shm->seq;
+    __atomic_store_n(&pub->shm->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(pub->data, pub->stage, pub->root->snap_size);
+    pub->shm->time = get_time();
+    __atomic_store_n(&pub->shm->seq, seq + 2, __ATOMIC_RELEASE);
+  }
+}
+
+int shmpub_start(CONF_ROOT_T *conf) {
+  CONF_JSON_ITEM_T *root;
+  BUF_T schema;
+  size_t schema_offset, data_offset;
+  char *map;
+  int fd, i;
+
+  shmpub_conf = &conf->shmpub;
+  if (shmpub_conf->name == NULL) {
+    return 0;
+  }
+
+  // select roots
+  for (root_count = 0, root = conf->json; root != NULL; root = root->next, root_count++);
+  roots = calloc(root_count, sizeof(SHMPUB_ROOT_T));
+  if (roots == NULL) {
+    fprintf(stderr, "%s: ERROR: unable to alloc memory for shm publisher\n", modname);
+    goto fail0;
+  }
+  for (i = 0, root = conf->json; root != NULL; root = root->next) {
+    if (conf_is_root_selected(shmpub_conf->roots, root->name)) {
+      roots[i++].root = root;
+    }
+  }
+  root_count = i;
+  if (root_count == 0) {
+    fprintf(stderr, "%s: ERROR: shm publisher has no roots to publish\n", modname);
+    goto fail1;
+  }
+
+  // alloc staging buffers
+  for (i = 0; i < root_count; i++) {
+    roots[i].stage = malloc(roots[i].root->snap_size + 1);
+    if (roots[i].stage == NULL) {
+      fprintf(stderr, "%s: ERROR: unable to alloc memory for shm publisher\n", modname);
+      goto fail2;
+    }
+  }
+
+  // build schema, data blocks are aligned to cache lines
+  buf_init(&schema);
+  schema_offset = sizeof(LCREST_SHM_HEADER_T) + root_count * sizeof(LCREST_SHM_ROOT_T);
+  for (i = 0; i < root_count; i++) {
+    snap_put_schema(&schema, roots[i].root, 0);
+  }
+  if (schema.error) {
+    fprintf(stderr, "%s: ERROR: unable to build shm schema\n", modname);
+    goto fail3;
+  }
+  data_offset = SHMPUB_ALIGN(schema_offset + schema.len);
+  map_size = data_offset;
+  for (i = 0; i < root_count; i++) {
+    map_size += SHMPUB_ALIGN(roots[i].root->snap_size);
+  }
+
+  // recreate segment, even after a crash. old clients keep their stale
+  // mapping and see the new one with lcrest_shm_is_replaced()
+  shm_unlink(shmpub_conf->name);
+  fd = shm_open(shmpub_conf->name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    fprintf(stderr, "%s: ERROR: unable to create shm segment %s: %s\n", modname, shmpub_conf->name, strerror(errno));
+    goto fail3;
+  }
+  if (ftruncate(fd, map_size) < 0) {
+    fprintf(stderr, "%s: ERROR: unable to size shm segment %s: %s\n", modname, shmpub_conf->name, strerror(errno));
+    close(fd);
+    goto fail4;
+  }
+  map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "%s: ERROR: unable to map shm segment %s: %s\n", modname, shmpub_conf->name, strerror(errno));
+    goto fail4;
+  }
+
+  // setup roots
+  hdr = (LCREST_SHM_HEADER_T *) map;
+  for (i = 0; i < root_count; i++) {
+    roots[i].shm = &((LCREST_SHM_ROOT_T *) (map + sizeof(LCREST_SHM_HEADER_T)))[i];
+    roots[i].shm->size = roots[i].root->snap_size;
+    roots[i].shm->offset = data_offset;
+    roots[i].data = map + data_offset;
+    data_offset += SHMPUB_ALIGN(roots[i].root->snap_size);
+  }
+  memcpy(map + schema_offset, schema.data, schema.len);
+
+  // initial snapshot, then make the segment valid
+  for (i = 0; i < root_count; i++) {
+    snap_take(roots[i].root, roots[i].data);
+    roots[i].shm->time = get_time();
+  }
+  memcpy(hdr->magic, LCREST_SHM_MAGIC, sizeof(hdr->magic));
+  hdr->version = LCREST_SHM_VERSION;
+  hdr->root_count = root_count;
+  hdr->size = map_size;
+  hdr->schema_offset = schema_offset;
+  hdr->schema_size = schema.len;
+  __atomic_store_n(&hdr->generation, get_time(), __ATOMIC_RELEASE);
+
+  if (loop_add_timer(1000000000ULL / shmpub_conf->rate, publish_tick, NULL)) {
+    goto fail5;
+  }
+
+  buf_free(&schema);
+  return 0;
+
+fail5:
+  munmap(map, map_size);
+  hdr = NULL;
+fail4:
+  shm_unlink(shmpub_conf->name);
+fail3:
+  buf_free(&schema);
+fail2:
+  for (i = 0; i < root_count; i++) {
+    free(roots[i].stage);
+  }
+fail1:
+  free(roots);
+  roots = NULL;
+fail0:
+  return -1;
+}
+
+void shmpub_stop(void) {
+  int i;
+
+  if (hdr == NULL) {
+    return;
+  }
+
+  // tell clients this segment is gone
+  __atomic_store_n(&hdr->generation, 0, __ATOMIC_RELEASE);
+  shm_unlink(shmpub_conf->name);
+  munmap(hdr, map_size);
+  hdr = NULL;
+
+  for (i = 0; i < root_count; i++) {
+    free(roots[i].stage);
+  }
+  free(roots);
+  roots = NULL;
+}
@@ -0,0 +1,10 @@
+#ifndef LCREST_SHMPUB_H
+#define LCREST_SHMPUB_H
+
+#include "lcrest.h"
+#include "lcrest_conf.h"
+
+int shmpub_start(CONF_ROOT_T *conf);
+void shmpub_stop(void);
+
+#endif
@@ -0,0 +1,139 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "lcrest.h"
+#include "lcrest_conf.h"
+#include "lcrest_hal.h"
+#include "lcrest_snap.h"
+
+// leaves are placed by descending size, so no padding is needed in between
+#define SNAP_MAX_ALIGN 8
+#define SNAP_PATH_MAX  1024
+
+typedef struct {
+  BUF_T *buf;
+  size_t offset;
+} SNAP_SCHEMA_CTX_T;
+
+static size_t layout_leaves(CONF_JSON_ITEM_T *json, size_t size, size_t offset);
+static void walk_leaves(CONF_JSON_ITEM_T *json, SNAP_LEAF_CB_T cb, void *data);
+static void take_leaf(CONF_JSON_ITEM_T *json, void *data);
+static void bind_leaf(CONF_JSON_ITEM_T *json, void *data);
+static void put_schema_leaf(CONF_JSON_ITEM_T *json, void *data);
+
+static size_t layout_leaves(CONF_JSON_ITEM_T *json, size_t size, size_t offset) {
+  for (; json != NULL; json = json->next) {
+    if (CONF_TYPE_IS_HAL(json->type) && snap_get_size(json->hal.type) == size) {
+      json->snap_offset = offset;
+      offset += size;
+    }
+    offset = layout_leaves(json->childs, size, offset);
+  }
+
+  return offset;
+}
+
+static void walk_leaves(CONF_JSON_ITEM_T *json, SNAP_LEAF_CB_T cb, void *data) {
+  for (; json != NULL; json = json->next) {
+    if (CONF_TYPE_IS_HAL(json->type)) {
+      cb(json, data);
+    }
+    walk_leaves(json->childs, cb, data);
+  }
+}
+
+static void take_leaf(CONF_JSON_ITEM_T *json, void *data) {
+  char *dst = (char *) data + json->snap_offset;
+  volatile void *ptr = hal_get_json_ptr(json);
+
+  if (ptr == NULL) {
+    return;
+  }
+
+  switch (json->hal.type) {
+    case HAL_BIT:
+      *((hal_bit_t *) dst) = *((hal_bit_t *) ptr);
+      break;
+    case HAL_U32:
+      *((hal_u32_t *) dst) = *((hal_u32_t *) ptr);
+      break;
+    case HAL_S32:
+      *((hal_s32_t *) dst) = *((hal_s32_t *) ptr);
+      break;
+    case HAL_FLOAT:
+      *((hal_float_t *) dst) = *((hal_float_t *) ptr);
+      break;
+    default:
+      break;
+  }
+}
+
+static void bind_leaf(CONF_JSON_ITEM_T *json, void *data) {
+  json->local_ptr = (char *) data + json->snap_offset;
+}
+
+static void put_schema_leaf(CONF_JSON_ITEM_T *json, void *data) {
+  SNAP_SCHEMA_CTX_T *ctx = (SNAP_SCHEMA_CTX_T *) data;
+  char path[SNAP_PATH_MAX];
+  char line[SNAP_PATH_MAX + 64];
+
+  if (conf_get_item_path(json, path, sizeof(path)) < 0) {
+    ctx->buf->error = true;
+    return;
+  }
+
+  snprintf(line, sizeof(line), "leaf\t%s\t%s\t%zu\n", path, hal_get_type_name(json->hal.type), ctx->offset + json->snap_offset);
+  buf_puts(ctx->buf, line);
+}
+
+void snap_layout(CONF_ROOT_T *conf) {
+  CONF_JSON_ITEM_T *root;
+  size_t size, offset;
+
+  for (root = conf->json; root != NULL; root = root->next) {
+    offset = 0;
+    for (size = SNAP_MAX_ALIGN; size > 0; size >>= 1) {
+      offset = layout_leaves(root->childs, size, offset);
+    }
+    root->snap_size = (offset + SNAP_MAX_ALIGN - 1) & ~(SNAP_MAX_ALIGN - 1);
+  }
+}
+
+size_t snap_get_size(hal_type_t type) {
+  switch (type) {
+    case HAL_BIT:
+      return sizeof(hal_bit_t);
+    case HAL_U32:
+      return sizeof(hal_u32_t);
+    case HAL_S32:
+      return sizeof(hal_s32_t);
+    case HAL_FLOAT:
+      return sizeof(hal_float_t);
+    default:
+      return 0;
+  }
+}
+
+void snap_walk(CONF_JSON_ITEM_T *root, SNAP_LEAF_CB_T cb, void *data) {
+  walk_leaves(root->childs, cb, data);
+}
+
+void snap_take(CONF_JSON_ITEM_T *root, char *dst) {
+  walk_leaves(root->childs, take_leaf, dst);
+}
+
+void snap_bind(CONF_JSON_ITEM_T *root, char *data) {
+  walk_leaves(root->childs, bind_leaf, data);
+}
+
+void snap_put_schema(BUF_T *buf, CONF_JSON_ITEM_T *root, size_t offset) {
+  SNAP_SCHEMA_CTX_T ctx;
+  char line[SNAP_PATH_MAX + 64];
+
+  snprintf(line, sizeof(line), "root\t%s\t%zu\t%zu\n", root->name, offset, root->snap_size);
+  buf_puts(buf, line);
+
+  ctx.buf = buf;
+  ctx.offset = offset;
+  walk_leaves(root->childs, put_schema_leaf, &ctx);
+}
@@ -0,0 +1,21 @@
+#ifndef LCREST_SNAP_H
+#define LCREST_SNAP_H
+
+#include <stddef.h>
+
+#include "lcrest.h"
+#include "lcrest_conf.h"
+#include "lcrest_buf.h"
+
+typedef void (*SNAP_LEAF_CB_T)(CONF_JSON_ITEM_T *json, void *data);
+
+void snap_layout(CONF_ROOT_T *conf);
+size_t snap_get_size(hal_type_t type);
+
+void snap_walk(CONF_JSON_ITEM_T *root, SNAP_LEAF_CB_T cb, void *data);
+void snap_take(CONF_JSON_ITEM_T *root, char *dst);
+void snap_bind(CONF_JSON_ITEM_T *root, char *data);
+
+void snap_put_schema(BUF_T *buf, CONF_JSON_ITEM_T *root, size_t offset);
+
+#endif
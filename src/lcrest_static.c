@@ -0,0 +1,354 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <ulfius.h>
+
+#include "lcrest.h"
+#include "lcrest_conf.h"
+#include "lcrest_static.h"
+
+#define STATIC_PATH_MAX  4096
+#define STATIC_DEPTH_MAX 16
+
+typedef struct {
+  const char *ext;
+  const char *type;
+} STATIC_TYPE_T;
+
+static int compare_files(const void *a, const void *b);
+static const char *get_type(const char *path);
+static void set_etag(STATIC_BODY_T *body);
+static int map_file(const char *full, size_t size, STATIC_BODY_T *body);
+static int add_file(const char *rel, const char *full, size_t size);
+static int scan_dir(const char *base, const char *rel, int depth);
+static STATIC_FILE_T *find_file(const char *path);
+static bool accepts(const char *accept, const char *coding);
+
+static const STATIC_TYPE_T types[] = {
+  { "html", "text/html; charset=utf-8" },
+  { "htm", "text/html; charset=utf-8" },
+  { "js", "text/javascript; charset=utf-8" },
+  { "mjs", "text/javascript; charset=utf-8" },
+  { "css", "text/css; charset=utf-8" },
+  { "json", "application/json" },
+  { "map", "application/json" },
+  { "txt", "text/plain; charset=utf-8" },
+  { "svg", "image/svg+xml" },
+  { "png", "image/png" },
+  { "jpg", "image/jpeg" },
+  { "jpeg", "image/jpeg" },
+  { "gif", "image/gif" },
+  { "webp", "image/webp" },
+  { "ico", "image/x-icon" },
+  { "woff", "font/woff" },
+  { "woff2", "font/woff2" },
+  { "ttf", "font/ttf" },
+  { "wasm", "application/wasm" },
+  { "gz", "application/gzip" },
+  { NULL, NULL }
+};
+
+const char *static_enc_names[] = { NULL, "gzip", "br" };
+static const char *enc_exts[] = { NULL, ".gz", ".br" };
+
+static const CONF_STATIC_T *static_conf;
+static STATIC_FILE_T *files;
+static int file_count;
+static int file_max;
+
+static int compare_files(const void *a, const void *b) {
+  return strcmp(((const STATIC_FILE_T *) a)->path, ((const STATIC_FILE_T *) b)->path);
+}
+
+static const char *get_type(const char *path) {
+  const STATIC_TYPE_T *type;
+  const char *ext;
+
+  ext = strrchr(path, '.');
+  if (ext != NULL && strchr(ext, '/') == NULL) {
+    for (type = types; type->ext != NULL; type++) {
+      if (strcasecmp(type->ext, ext + 1) == 0) {
+        return type->type;
+      }
+    }
+  }
+
+  return "application/octet-stream";
+}
+
+// strong validator, a digest of the bytes actually sent
+static void set_etag(STATIC_BODY_T *body) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  size_t i;
+
+  for (i = 0; i < body->size; i++) {
+    hash ^= (unsigned char) body->data[i];
+    hash *= 0x100000001b3ULL;
+  }
+
+  snprintf(body->etag, sizeof(body->etag), "\"%016llx\"", (unsigned long long) hash);
+}
+
+static int map_file(const char *full, size_t size, STATIC_BODY_T *body) {
+  void *data;
+  int fd;
+
+  // empty files can't be mapped
+  if (size == 0) {
+    body->data = "";
+    body->size = 0;
+    set_etag(body);
+    return 0;
+  }
+
+  fd = open(full, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "%s: ERROR: unable to open static file %s\n", modname, full);
+    return -1;
+  }
+  data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    fprintf(stderr, "%s: ERROR: unable to map static file %s\n", modname, full);
+    return -1;
+  }
+
+  body->data = data;
+  body->size = size;
+  set_etag(body);
+  return 0;
+}
+
+static int add_file(const char *rel, const char *full, size_t size) {
+  STATIC_FILE_T *file;
+  STATIC_FILE_T *tmp;
+  int max;
+
+  if (file_count == file_max) {
+    max = (file_max > 0) ? file_max * 2 : 64;
+    tmp = realloc(files, max * sizeof(STATIC_FILE_T));
+    if (tmp == NULL) {
+      fprintf(stderr, "%s: ERROR: unable to alloc memory for static files\n", modname);
+      return -1;
+    }
+    files = tmp;
+    file_max = max;
+  }
+
+  file = &files[file_count];
+  memset(file, 0, sizeof(STATIC_FILE_T));
+  file->path = strdup(rel);
+  if (file->path == NULL) {
+    fprintf(stderr, "%s: ERROR: unable to alloc memory for static files\n", modname);
+    return -1;
+  }
+  if (map_file(full, size, &file->body[staticEncIdentity])) {
+    free(file->path);
+    return -1;
+  }
+
+  file->type = get_type(rel);
+  file_count++;
+  return 0;
+}
+
+static int scan_dir(const char *base, const char *rel, int depth) {
+  char full[STATIC_PATH_MAX];
+  char sub[STATIC_PATH_MAX];
+  struct dirent *ent;
+  struct stat st;
+  DIR *dir;
+  int ret = 0;
+
+  snprintf(full, sizeof(full), "%s/%s", base, rel);
+  dir = opendir(full);
+  if (dir == NULL) {
+    fprintf(stderr, "%s: ERROR: unable to open static dir %s\n", modname, full);
+    return -1;
+  }
+
+  while (ret == 0 && (ent = readdir(dir)) != NULL) {
+    // hidden files are never served
+    if (ent->d_name[0] == '.') {
+      continue;
+    }
+
+    snprintf(sub, sizeof(sub), "%s%s%s", rel, (rel[0] != 0) ? "/" : "", ent->d_name);
+    snprintf(full, sizeof(full), "%s/%s", base, sub);
+    if (stat(full, &st)) {
+      continue;
+    }
+
+    if (S_ISDIR(st.st_mode)) {
+      if (depth < STATIC_DEPTH_MAX) {
+        ret = scan_dir(base, sub, depth + 1);
+      }
+    } else if (S_ISREG(st.st_mode)) {
+      ret = add_file(sub, full, st.st_size);
+    }
+  }
+
+  closedir(dir);
+  return ret;
+}
+
+static STATIC_FILE_T *find_file(const char *path) {
+  STATIC_FILE_T key;
+
+  if (file_count == 0) {
+    return NULL;
+  }
+
+  key.path = (char *) path;
+  return bsearch(&key, files, file_count, sizeof(STATIC_FILE_T), compare_files);
+}
+
+// coding listed in Accept-Encoding and not refused with q=0
+static bool accepts(const char *accept, const char *coding) {
+  size_t len = strlen(coding);
+  const char *p;
+  const char *end;
+  const char *param;
+
+  for (p = accept; *p != 0; p = (*end != 0) ? end + 1 : end) {
+    end = strchr(p, ',');
+    if (end == NULL) {
+      end = p + strlen(p);
+    }
+
+    while (p < end && *p == ' ') {
+      p++;
+    }
+    if ((size_t) (end - p) < len || strncasecmp(p, coding, len) != 0 ||
+        (p + len < end && p[len] != ';' && p[len] != ' ')) {
+      continue;
+    }
+
+    param = memchr(p, ';', end - p);
+    if (param == NULL) {
+      return true;
+    }
+    for (param++; param < end && *param == ' '; param++);
+    if (param + 2 <= end && (param[0] == 'q' || param[0] == 'Q') && param[1] == '=') {
+      return strtod(param + 2, NULL) > 0.0;
+    }
+    return true;
+  }
+
+  return false;
+}
+
+int static_start(const CONF_STATIC_T *conf) {
+  STATIC_FILE_T *file;
+  STATIC_FILE_T *variant;
+  const char *name;
+  char path[STATIC_PATH_MAX];
+  int i, enc;
+
+  static_conf = conf;
+  if (conf->dir == NULL) {
+    return 0;
+  }
+
+  // file contents and metadata are loaded once, changes need a restart
+  if (scan_dir(conf->dir, "", 0)) {
+    static_stop();
+    return -1;
+  }
+  qsort(files, file_count, sizeof(STATIC_FILE_T), compare_files);
+
+  // precompressed siblings become variants of their base file
+  for (i = 0; i < file_count; i++) {
+    file = &files[i];
+    for (enc = staticEncIdentity + 1; enc < staticEncCount; enc++) {
+      snprintf(path, sizeof(path), "%s%s", file->path, enc_exts[enc]);
+      variant = find_file(path);
+      if (variant != NULL) {
+        file->body[enc] = variant->body[staticEncIdentity];
+      }
+    }
+
+    name = strrchr(file->path, '/');
+    name = (name != NULL) ? name + 1 : file->path;
+    file->index = (strcmp(name, conf->index) == 0);
+  }
+
+  return 0;
+}
+
+void static_stop(void) {
+  int i;
+
+  // variants share the mapping of their own entry
+  for (i = 0; i < file_count; i++) {
+    if (files[i].body[staticEncIdentity].size > 0) {
+      munmap((void *) files[i].body[staticEncIdentity].data, files[i].body[staticEncIdentity].size);
+    }
+    free(files[i].path);
+  }
+
+  free(files);
+  files = NULL;
+  file_count = 0;
+  file_max = 0;
+}
+
+bool static_is_enabled(void) {
+  return files != NULL;
+}
+
+const STATIC_FILE_T *static_lookup(const char *path) {
+  char buf[STATIC_PATH_MAX];
+  size_t len;
+
+  while (*path == '/') {
+    path++;
+  }
+
+  // directories map to their index file
+  len = strlen(path);
+  if (len == 0 || path[len - 1] == '/') {
+    snprintf(buf, sizeof(buf), "%s%s", path, static_conf->index);
+    path = buf;
+  }
+
+  return find_file(path);
+}
+
+STATIC_ENC_T static_select(const STATIC_FILE_T *file, const char *accept) {
+  if (accept == NULL) {
+    return staticEncIdentity;
+  }
+
+  if (file->body[staticEncBr].data != NULL && accepts(accept, "br")) {
+    return staticEncBr;
+  }
+  if (file->body[staticEncGzip].data != NULL && accepts(accept, "gzip")) {
+    return staticEncGzip;
+  }
+
+  return staticEncIdentity;
+}
+
+ssize_t static_stream(void *data, uint64_t offset, char *out, size_t max) {
+  const STATIC_BODY_T *body = (const STATIC_BODY_T *) data;
+  size_t len;
+
+  if (offset >= body->size) {
+    return U_STREAM_END;
+  }
+
+  len = body->size - offset;
+  if (len > max) {
+    len = max;
+  }
+  memcpy(out, body->data + offset, len);
+  return len;
+}
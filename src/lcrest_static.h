@@ -0,0 +1,44 @@
+#ifndef LCREST_STATIC_H
+#define LCREST_STATIC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "lcrest.h"
+#include "lcrest_conf.h"
+
+#define STATIC_BLOCK_SIZE 65536
+
+typedef enum {
+  staticEncIdentity = 0,
+  staticEncGzip,
+  staticEncBr,
+  staticEncCount
+} STATIC_ENC_T;
+
+typedef struct {
+  const char *data;
+  size_t size;
+  char etag[24];
+} STATIC_BODY_T;
+
+typedef struct {
+  char *path;
+  const char *type;
+  bool index;
+  STATIC_BODY_T body[staticEncCount];
+} STATIC_FILE_T;
+
+extern const char *static_enc_names[];
+
+int static_start(const CONF_STATIC_T *conf);
+void static_stop(void);
+bool static_is_enabled(void);
+
+const STATIC_FILE_T *static_lookup(const char *path);
+STATIC_ENC_T static_select(const STATIC_FILE_T *file, const char *accept);
+ssize_t static_stream(void *data, uint64_t offset, char *out, size_t max);
+
+#endif
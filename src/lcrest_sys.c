@@ -0,0 +1,176 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <malloc.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#include "lcrest.h"
+#include "lcrest_conf.h"
+#include "lcrest_sys.h"
+
+#define SYS_PREFAULT_STACK (256 * 1024)
+
+static int setup_affinity(const CONF_SERVER_T *server);
+static int setup_sched(const CONF_SERVER_T *server);
+static int setup_memory(const CONF_SERVER_T *server);
+static void prefault_stack(void);
+
+// 0 keeps the default stack size
+static size_t thread_stack;
+
+static int setup_affinity(const CONF_SERVER_T *server) {
+  cpu_set_t set;
+  int cpu;
+
+  if (!server->cpus_set) {
+    return 0;
+  }
+
+  CPU_ZERO(&set);
+  for (cpu = 0; cpu < CONF_SERVER_MAX_CPUS && cpu < CPU_SETSIZE; cpu++) {
+    if (server->cpus[cpu / 64] & (1ULL << (cpu % 64))) {
+      CPU_SET(cpu, &set);
+    }
+  }
+
+  if (sched_setaffinity(0, sizeof(set), &set) < 0) {
+    fprintf(stderr, "%s: ERROR: unable to set cpu affinity: %s\n", modname, strerror(errno));
+    return -1;
+  }
+
+  return 0;
+}
+
+static int setup_sched(const CONF_SERVER_T *server) {
+  struct sched_param param;
+  int policy;
+
+  switch (server->sched) {
+    case confSchedBatch:
+      policy = SCHED_BATCH;
+      break;
+    case confSchedIdle:
+      policy = SCHED_IDLE;
+      break;
+    default:
+      policy = SCHED_OTHER;
+      break;
+  }
+
+  memset(&param, 0, sizeof(param));
+  if (sched_setscheduler(0, policy, &param) < 0) {
+    fprintf(stderr, "%s: ERROR: unable to set scheduling policy: %s\n", modname, strerror(errno));
+    return -1;
+  }
+
+  // on linux this only affects the calling thread, new threads inherit it
+  if (server->nice != 0 && setpriority(PRIO_PROCESS, 0, server->nice) < 0) {
+    fprintf(stderr, "%s: ERROR: unable to set nice level: %s\n", modname, strerror(errno));
+    return -1;
+  }
+
+  return 0;
+}
+
+static void prefault_stack(void) {
+  volatile char stack[SYS_PREFAULT_STACK];
+
+  memset((char *) stack, 0, SYS_PREFAULT_STACK);
+}
+
+static int setup_memory(const CONF_SERVER_T *server) {
+  char *heap;
+
+  if (!server->mlock) {
+    return 0;
+  }
+
+  // keep freed heap memory mapped instead of returning it to the kernel
+  mallopt(M_TRIM_THRESHOLD, -1);
+  mallopt(M_MMAP_MAX, 0);
+
+  // lock all current and future mappings (including thread stacks)
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+    fprintf(stderr, "%s: ERROR: unable to lock memory: %s\n", modname, strerror(errno));
+    return -1;
+  }
+
+  prefault_stack();
+  thread_stack = SYS_THREAD_STACK;
+
+  if (server->prefault > 0) {
+    heap = malloc(server->prefault);
+    if (heap == NULL) {
+      fprintf(stderr, "%s: ERROR: unable to prefault heap memory\n", modname);
+      return -1;
+    }
+    memset(heap, 0, server->prefault);
+    free(heap);
+  }
+
+  return 0;
+}
+
+int sys_setup(const CONF_SERVER_T *server) {
+  // called before any thread is started, so all threads inherit the settings
+  if (setup_affinity(server)) {
+    return -1;
+  }
+
+  if (setup_sched(server)) {
+    return -1;
+  }
+
+  if (setup_memory(server)) {
+    return -1;
+  }
+
+  return 0;
+}
+
+int sys_get_cpu_count(void) {
+  cpu_set_t set;
+  int count;
+
+  // cpus usable by this process (after affinity setup)
+  if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+    count = CPU_COUNT(&set);
+    if (count > 0) {
+      return count;
+    }
+  }
+
+  count = sysconf(_SC_NPROCESSORS_ONLN);
+  return (count > 0) ? count : 1;
+}
+
+size_t sys_get_thread_stack(void) {
+  return thread_stack;
+}
+
+int sys_thread_create(pthread_t *thread, void *(*fn)(void *), void *arg) {
+  pthread_attr_t attr;
+  int ret;
+
+  if (thread_stack == 0) {
+    return pthread_create(thread, NULL, fn, arg);
+  }
+
+  if (pthread_attr_init(&attr) != 0) {
+    return -1;
+  }
+  ret = pthread_attr_setstacksize(&attr, thread_stack);
+  if (ret == 0) {
+    ret = pthread_create(thread, &attr, fn, arg);
+  }
+  pthread_attr_destroy(&attr);
+
+  return ret;
+}
@@ -0,0 +1,19 @@
+#ifndef LCREST_SYS_H
+#define LCREST_SYS_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+#include "lcrest.h"
+#include "lcrest_conf.h"
+
+// stack size of all threads lcrest starts while memory is locked, the
+// default of 8 MiB would be locked in full for every connection thread
+#define SYS_THREAD_STACK (256 * 1024)
+
+int sys_setup(const CONF_SERVER_T *server);
+int sys_get_cpu_count(void);
+size_t sys_get_thread_stack(void);
+int sys_thread_create(pthread_t *thread, void *(*fn)(void *), void *arg);
+
+#endif
@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lcrest.h"
+#include "lcrest_conf.h"
+#include "lcrest_buf.h"
+#include "lcrest_snap.h"
+#include "lcrest_json.h"
+
+// checks that the parallel renderer is byte identical to the serial one
+//
+// all leaves are bound to local data (like replay), so no HAL is needed.
+// every root is rendered in all layouts, in full and with a projection of
+// every other leaf, serially and with several worker counts.
+
+#define TEST_ROUNDS 200
+
+static const int thread_counts[] = { 1, 2, 3, 4, 7 };
+
+const char *modname = "lcrest-test-render";
+
+static void fill_leaf(CONF_JSON_ITEM_T *json, void *data);
+static void select_leaf(CONF_JSON_ITEM_T *json, void *data);
+static int render_all(CONF_ROOT_T *conf, JSON_FIELDS_T **projections, BUF_T *out);
+
+static void fill_leaf(CONF_JSON_ITEM_T *json, void *data) {
+  int *n = (int *) data;
+
+  (*n)++;
+  switch (json->hal.type) {
+    case HAL_BIT:
+      *((volatile hal_bit_t *) json->local_ptr) = (*n % 3) == 0;
+      break;
+    case HAL_U32:
+      *((volatile hal_u32_t *) json->local_ptr) = *n * 7919;
+      break;
+    case HAL_S32:
+      *((volatile hal_s32_t *) json->local_ptr) = -*n * 31;
+      break;
+    case HAL_FLOAT:
+      *((volatile hal_float_t *) json->local_ptr) = *n * 0.1 - 3.0;
+      break;
+    default:
+      break;
+  }
+}
+
+static void select_leaf(CONF_JSON_ITEM_T *json, void *data) {
+  JSON_FIELDS_T *fields = (JSON_FIELDS_T *) data;
+
+  if ((json->item_index & 1) == 0) {
+    json_fields_add(fields, json);
+  }
+}
+
+static int render_all(CONF_ROOT_T *conf, JSON_FIELDS_T **projections, BUF_T *out) {
+  CONF_JSON_ITEM_T *root;
+  JSON_LAYOUT_T layout;
+  int i;
+
+  out->len = 0;
+  for (i = 0, root = conf->json; root != NULL; root = root->next, i++) {
+    for (layout = jsonLayoutRows; layout <= jsonLayoutPacked; layout++) {
+      if (json_build_response(out, root, NULL, layout) ||
+          json_build_response(out, root, projections[i], layout)) {
+        return -1;
+      }
+      buf_putc(out, '\n');
+    }
+  }
+
+  return out->error ? -1 : 0;
+}
+
+int main(int argc, char **argv) {
+  CONF_ROOT_T *conf;
+  CONF_JSON_ITEM_T *root;
+  JSON_FIELDS_T **projections;
+  char **data;
+  BUF_T serial, parallel;
+  size_t t;
+  int root_count, i, n = 0, round, ret = 1;
+
+  if (argc != 2) {
+    fprintf(stderr, "usage: %s <config>\n", argv[0]);
+    return 1;
+  }
+
+  conf = conf_parse(argv[1]);
+  if (conf == NULL) {
+    return 1;
+  }
+  snap_layout(conf);
+
+  for (root_count = 0, root = conf->json; root != NULL; root = root->next, root_count++);
+  data = calloc(root_count, sizeof(char *));
+  projections = calloc(root_count, sizeof(JSON_FIELDS_T *));
+  if (data == NULL || projections == NULL) {
+    goto out;
+  }
+  for (i = 0, root = conf->json; root != NULL; root = root->next, i++) {
+    data[i] = calloc(1, root->snap_size + 1);
+    projections[i] = json_fields_alloc(root);
+    if (data[i] == NULL || projections[i] == NULL) {
+      goto out;
+    }
+    snap_bind(root, data[i]);
+    snap_walk(root, fill_leaf, &n);
+    snap_walk(root, select_leaf, projections[i]);
+  }
+
+  buf_init(&serial);
+  buf_init(&parallel);
+  if (render_all(conf, projections, &serial)) {
+    fprintf(stderr, "%s: ERROR: serial render failed\n", modname);
+    goto out_buf;
+  }
+
+  // a tiny threshold splits every root that has more than one member
+  for (t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++) {
+    conf->server.render_threads = thread_counts[t];
+    conf->server.render_threshold = 1;
+    if (json_render_start(&conf->server)) {
+      goto out_buf;
+    }
+    for (round = 0; round < TEST_ROUNDS; round++) {
+      if (render_all(conf, projections, &parallel) || parallel.len != serial.len ||
+          memcmp(parallel.data, serial.data, serial.len) != 0) {
+        fprintf(stderr, "%s: ERROR: output differs with %d threads in round %d\n", modname, thread_counts[t], round);
+        json_render_stop();
+        goto out_buf;
+      }
+    }
+    json_render_stop();
+  }
+
+  printf("%s: %zu bytes identical with up to %d threads\n", modname, serial.len, thread_counts[t - 1]);
+  ret = 0;
+
+out_buf:
+  buf_free(&serial);
+  buf_free(&parallel);
+out:
+  for (i = 0; i < root_count; i++) {
+    if (projections != NULL) {
+      json_fields_release(projections[i]);
+    }
+    if (data != NULL) {
+      free(data[i]);
+    }
+  }
+  free(projections);
+  free(data);
+  json_fields_cleanup();
+  conf_free(conf);
+  return ret;
+}
@@ -0,0 +1,37 @@
+#ifndef LCREST_UDP_LAYOUT_H
+#define LCREST_UDP_LAYOUT_H
+
+#include <stdint.h>
+
+// binary datagram layout of the udp publisher, host byte order of the
+// publisher. every datagram starts with LCREST_UDP_HEADER_T followed by
+// size bytes of payload:
+//   schema: schema text (same format as the recorder, offsets relative
+//           to the root data), root is LCREST_UDP_ROOT_NONE
+//   data:   fixed width snapshot of root number root in schema order
+// seq counts datagrams per root (and per schema), gaps mean loss. the
+// generation changes whenever lcrest restarts.
+
+#define LCREST_UDP_MAGIC   0x5544524c
+#define LCREST_UDP_VERSION 1
+
+#define LCREST_UDP_TYPE_SCHEMA 1
+#define LCREST_UDP_TYPE_DATA   2
+
+#define LCREST_UDP_ROOT_NONE   0xffff
+
+#define LCREST_UDP_MAX_PAYLOAD 65000
+
+typedef struct {
+  uint32_t magic;
+  uint8_t version;
+  uint8_t type;
+  uint16_t root;
+  uint64_t generation;
+  uint64_t seq;
+  uint64_t time;
+  uint32_t size;
+  uint32_t reserved;
+} LCREST_UDP_HEADER_T;
+
+#endif
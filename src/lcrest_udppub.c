@@ -0,0 +1,293 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "lcrest.h"
+#include "lcrest_conf.h"
+#include "lcrest_buf.h"
+#include "lcrest_snap.h"
+#include "lcrest_json.h"
+#include "lcrest_loop.h"
+#include "lcrest_udppub.h"
+#include "lcrest_udp_layout.h"
+
+#define UDPPUB_SCHEMA_INTERVAL_NS 1000000000ULL
+
+typedef struct {
+  CONF_JSON_ITEM_T *root;
+  uint64_t seq;
+  bool valid;
+  bool oversize;
+  char *last;
+  char *stage;
+} UDPPUB_ROOT_T;
+
+static uint64_t get_time(void);
+static void send_datagram(uint8_t type, uint16_t root, uint64_t seq, const char *payload, size_t size);
+static int render_json(UDPPUB_ROOT_T *pub, uint64_t time);
+static int send_json(UDPPUB_ROOT_T *pub, uint64_t time);
+static void publish_tick(void *data);
+
+static const CONF_UDPPUB_T *udppub_conf;
+static int sock = -1;
+static struct sockaddr_in dest;
+static uint64_t generation;
+
+static UDPPUB_ROOT_T *roots;
+static int root_count;
+
+static BUF_T schema;
+static uint64_t schema_seq;
+static uint64_t schema_time;
+
+static BUF_T out;
+
+static uint64_t get_time(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void send_datagram(uint8_t type, uint16_t root, uint64_t seq, const char *payload, size_t size) {
+  LCREST_UDP_HEADER_T hdr;
+  struct iovec iov[2];
+  struct msghdr msg;
+
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.magic = LCREST_UDP_MAGIC;
+  hdr.version = LCREST_UDP_VERSION;
+  hdr.type = type;
+  hdr.root = root;
+  hdr.generation = generation;
+  hdr.seq = seq;
+  hdr.time = get_time();
+  hdr.size = size;
+
+  iov[0].iov_base = &hdr;
+  iov[0].iov_len = sizeof(hdr);
+  iov[1].iov_base = (void *) payload;
+  iov[1].iov_len = size;
+
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_name = &dest;
+  msg.msg_namelen = sizeof(dest);
+  msg.msg_iov = iov;
+  msg.msg_iovlen = 2;
+
+  // never block the main loop, a full socket buffer is just loss
+  sendmsg(sock, &msg, MSG_DONTWAIT);
+}
+
+static int render_json(UDPPUB_ROOT_T *pub, uint64_t time) {
+  char head[256];
+
+  out.len = 0;
+  out.error = false;
+  snprintf(head, sizeof(head), "{\"root\":");
+  buf_puts(&out, head);
+  json_put_string(&out, pub->root->name);
+  snprintf(head, sizeof(head), ",\"generation\":%llu,\"seq\":%llu,\"time\":%llu,\"data\":",
+    (unsigned long long) generation, (unsigned long long) pub->seq, (unsigned long long) time);
+  buf_puts(&out, head);
+  if (json_build_response(&out, pub->root, NULL, jsonLayoutRows)) {
+    return -1;
+  }
+  buf_putc(&out, '}');
+
+  return (out.error || out.len > LCREST_UDP_MAX_PAYLOAD) ? -1 : 0;
+}
+
+static int send_json(UDPPUB_ROOT_T *pub, uint64_t time) {
+  // rendered from the live values right after a change was detected
+  if (render_json(pub, time)) {
+    if (!pub->oversize) {
+      fprintf(stderr, "%s: WARNING: root %s no longer fits into a udp datagram, changes are not sent\n", modname, pub->root->name);
+      pub->oversize = true;
+    }
+    return -1;
+  }
+  pub->oversize = false;
+
+  sendto(sock, out.data, out.len, MSG_DONTWAIT, (struct sockaddr *) &dest, sizeof(dest));
+  return 0;
+}
+
+static void publish_tick(void *data) {
+  UDPPUB_ROOT_T *pub;
+  uint64_t now;
+  char *tmp;
+  int i;
+
+  now = get_time();
+
+  // binary receivers need the schema, it also serves as heartbeat
+  if (!udppub_conf->json && now - schema_time >= UDPPUB_SCHEMA_INTERVAL_NS) {
+    send_datagram(LCREST_UDP_TYPE_SCHEMA, LCREST_UDP_ROOT_NONE, schema_seq++, schema.data, schema.len);
+    schema_time = now;
+  }
+
+  for (i = 0; i < root_count; i++) {
+    pub = &roots[i];
+
+    // only changed snapshots are sent
+    snap_take(pub->root, pub->stage);
+    if (pub->valid && memcmp(pub->stage, pub->last, pub->root->snap_size) == 0) {
+      continue;
+    }
+    tmp = pub->last;
+    pub->last = pub->stage;
+    pub->stage = tmp;
+    pub->valid = true;
+
+    // receivers detect loss by gaps, so only sent datagrams take a seq
+    if (udppub_conf->json) {
+      if (send_json(pub, now)) {
+        continue;
+      }
+    } else {
+      send_datagram(LCREST_UDP_TYPE_DATA, i, pub->seq, pub->last, pub->root->snap_size);
+    }
+    pub->seq++;
+  }
+}
+
+int udppub_start(CONF_ROOT_T *conf) {
+  CONF_JSON_ITEM_T *root;
+  struct in_addr iface;
+  unsigned char ttl;
+  int i;
+
+  udppub_conf = &conf->udppub;
+  if (udppub_conf->group == NULL) {
+    return 0;
+  }
+
+  // select roots
+  for (root_count = 0, root = conf->json; root != NULL; root = root->next, root_count++);
+  roots = calloc(root_count, sizeof(UDPPUB_ROOT_T));
+  if (roots == NULL) {
+    fprintf(stderr, "%s: ERROR: unable to alloc memory for udp publisher\n", modname);
+    goto fail0;
+  }
+  for (i = 0, root = conf->json; root != NULL; root = root->next) {
+    if (conf_is_root_selected(udppub_conf->roots, root->name)) {
+      roots[i++].root = root;
+    }
+  }
+  root_count = i;
+  if (root_count == 0) {
+    fprintf(stderr, "%s: ERROR: udp publisher has no roots to publish\n", modname);
+    goto fail1;
+  }
+
+  // alloc snapshot buffers
+  for (i = 0; i < root_count; i++) {
+    if (!udppub_conf->json && roots[i].root->snap_size > LCREST_UDP_MAX_PAYLOAD) {
+      fprintf(stderr, "%s: ERROR: root %s is too large for udp publisher\n", modname, roots[i].root->name);
+      goto fail2;
+    }
+    roots[i].last = malloc(roots[i].root->snap_size + 1);
+    roots[i].stage = malloc(roots[i].root->snap_size + 1);
+    if (roots[i].last == NULL || roots[i].stage == NULL) {
+      fprintf(stderr, "%s: ERROR: unable to alloc memory for udp publisher\n", modname);
+      goto fail2;
+    }
+  }
+
+  // build schema
+  buf_init(&schema);
+  buf_init(&out);
+  for (i = 0; i < root_count; i++) {
+    snap_put_schema(&schema, roots[i].root, 0);
+  }
+  if (schema.error || schema.len > LCREST_UDP_MAX_PAYLOAD) {
+    fprintf(stderr, "%s: ERROR: unable to build udp publisher schema\n", modname);
+    goto fail3;
+  }
+
+  // setup socket
+  memset(&dest, 0, sizeof(dest));
+  dest.sin_family = AF_INET;
+  dest.sin_port = htons(udppub_conf->port);
+  inet_pton(AF_INET, udppub_conf->group, &dest.sin_addr);
+
+  sock = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  if (sock < 0) {
+    fprintf(stderr, "%s: ERROR: unable to create udp socket: %s\n", modname, strerror(errno));
+    goto fail3;
+  }
+  ttl = udppub_conf->ttl;
+  if (setsockopt(sock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) < 0) {
+    fprintf(stderr, "%s: ERROR: unable to set multicast ttl: %s\n", modname, strerror(errno));
+    goto fail4;
+  }
+  if (udppub_conf->interface != NULL) {
+    inet_pton(AF_INET, udppub_conf->interface, &iface);
+    if (setsockopt(sock, IPPROTO_IP, IP_MULTICAST_IF, &iface, sizeof(iface)) < 0) {
+      fprintf(stderr, "%s: ERROR: unable to set multicast interface %s: %s\n", modname, udppub_conf->interface, strerror(errno));
+      goto fail4;
+    }
+  }
+
+  generation = get_time();
+  schema_seq = 0;
+  schema_time = 0;
+
+  // json size depends on the values, check with the current ones
+  for (i = 0; udppub_conf->json && i < root_count; i++) {
+    if (render_json(&roots[i], get_time())) {
+      fprintf(stderr, "%s: ERROR: root %s is too large for udp publisher\n", modname, roots[i].root->name);
+      goto fail4;
+    }
+  }
+
+  if (loop_add_timer(1000000000ULL / udppub_conf->rate, publish_tick, NULL)) {
+    goto fail4;
+  }
+
+  return 0;
+
+fail4:
+  close(sock);
+  sock = -1;
+fail3:
+  buf_free(&out);
+  buf_free(&schema);
+fail2:
+  for (i = 0; i < root_count; i++) {
+    free(roots[i].last);
+    free(roots[i].stage);
+  }
+fail1:
+  free(roots);
+  roots = NULL;
+fail0:
+  return -1;
+}
+
+void udppub_stop(void) {
+  int i;
+
+  if (sock < 0) {
+    return;
+  }
+
+  close(sock);
+  sock = -1;
+  buf_free(&out);
+  buf_free(&schema);
+
+  for (i = 0; i < root_count; i++) {
+    free(roots[i].last);
+    free(roots[i].stage);
+  }
+  free(roots);
+  roots = NULL;
+}
@@ -0,0 +1,10 @@
+#ifndef LCREST_UDPPUB_H
+#define LCREST_UDPPUB_H
+
+#include "lcrest.h"
+#include "lcrest_conf.h"
+
+int udppub_start(CONF_ROOT_T *conf);
+void udppub_stop(void);
+
+#endif
@@ -0,0 +1,13 @@
+include ../config.mk
+
+.PHONY: all clean install
+
+all: lcrest_rt.so
+
+install: lcrest_rt.so
+	mkdir -p $(DESTDIR)$(RTLIBDIR)
+	cp lcrest_rt.so $(DESTDIR)$(RTLIBDIR)/
+
+# halcompile builds in a temp dir, but adds the source dir to the include path
+lcrest_rt.so: lcrest_rt.comp lcrest_rt_layout.h
+	$(COMP) --compile lcrest_rt.comp
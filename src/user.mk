@@ -8,17 +8,76 @@ LCEC_CONF_OBJS = \
 	lcrest_hal.o \
 	lcrest_rest.o \
 	lcrest_json.o \
+	lcrest_query.o \
+	lcrest_path.o \
+	lcrest_decode.o \
+	lcrest_buf.o \
+	lcrest_dtoa.o \
+	lcrest_sys.o \
+	lcrest_admit.o \
+	lcrest_audit.o \
+	lcrest_snap.o \
+	lcrest_loop.o \
+	lcrest_rec.o \
+	lcrest_shmpub.o \
+	lcrest_udppub.o \
+	lcrest_expr.o \
+	lcrest_capture.o \
+	lcrest_plugin.o \
+	lcrest_seq.o \
+	lcrest_events.o \
+	lcrest_static.o \
+	lcrest_metrics.o \
+	lcrest_rt.o \
 
-.PHONY: all clean install
+LCEC_AUDITDUMP_OBJS = \
+	lcrest_auditdump.o \
 
-all: lcrest
+LCEC_SHMCLIENT_OBJS = \
+	lcrest_shmclient.o \
 
-install: lcrest
+LCEC_DTOA_BENCH_OBJS = \
+	lcrest_dtoa.o \
+	lcrest_dtoa_bench.o \
+
+LCEC_TEST_RENDER_OBJS = \
+	$(filter-out lcrest_main.o,$(LCEC_CONF_OBJS)) \
+	lcrest_test_render.o \
+
+.PHONY: all clean install check bench
+
+all: lcrest lcrest-auditdump liblcrest-shm.a
+
+install: lcrest lcrest-auditdump liblcrest-shm.a
 	mkdir -p $(DESTDIR)$(EMC2_HOME)/bin
 	cp lcrest $(DESTDIR)$(EMC2_HOME)/bin/
+	cp lcrest-auditdump $(DESTDIR)$(EMC2_HOME)/bin/
+	mkdir -p $(DESTDIR)$(EMC2_HOME)/lib
+	cp liblcrest-shm.a $(DESTDIR)$(EMC2_HOME)/lib/
+	mkdir -p $(DESTDIR)$(EMC2_HOME)/include
+	cp lcrest_shmclient.h lcrest_shm_layout.h lcrest_rt_layout.h $(DESTDIR)$(EMC2_HOME)/include/
+	cp lcrest_plugin_api.h lcrest.h lcrest_conf.h lcrest_buf.h lcrest_hal.h lcrest_path.h lcrest_json.h lcrest_admit.h $(DESTDIR)$(EMC2_HOME)/include/
 
 lcrest: $(LCEC_CONF_OBJS)
-	$(CC) -o $@ $(LCEC_CONF_OBJS) -Wl,-rpath,$(LIBDIR) -L$(LIBDIR) -llinuxcnchal -lexpat -lulfius -ljansson
+	$(CC) -o $@ $(LCEC_CONF_OBJS) -Wl,-rpath,$(LIBDIR) -L$(LIBDIR) -llinuxcnchal -lexpat -lulfius -ljansson -lpthread -lrt -lm -ldl
+
+lcrest-auditdump: $(LCEC_AUDITDUMP_OBJS)
+	$(CC) -o $@ $(LCEC_AUDITDUMP_OBJS)
+
+liblcrest-shm.a: $(LCEC_SHMCLIENT_OBJS)
+	$(AR) rcs $@ $(LCEC_SHMCLIENT_OBJS)
+
+check: lcrest-test-render
+	./lcrest-test-render ../examples/json/rest-config.xml
+
+bench: lcrest-dtoa-bench
+	./lcrest-dtoa-bench
+
+lcrest-dtoa-bench: $(LCEC_DTOA_BENCH_OBJS)
+	$(CC) -o $@ $(LCEC_DTOA_BENCH_OBJS) -Wl,-rpath,$(LIBDIR) -L$(LIBDIR) -ljansson
+
+lcrest-test-render: $(LCEC_TEST_RENDER_OBJS)
+	$(CC) -o $@ $(LCEC_TEST_RENDER_OBJS) -Wl,-rpath,$(LIBDIR) -L$(LIBDIR) -llinuxcnchal -lexpat -lulfius -ljansson -lpthread -lrt -lm -ldl
 
 %.o: %.c
 	$(CC) -o $@ $(EXTRA_CFLAGS) -URTAPI -U__MODULE__ -DULAPI -Os -c $<